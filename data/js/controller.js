@@ -16,8 +16,7 @@
 
     let config = {};
     try {
-        let settings_response = await fetch("/settings");
-        config = await settings_response.json();
+        config = (await load_state())["settings"];
     } catch (e) {
         console.error(e);
         return
@@ -33,8 +32,68 @@
     led_brightness.min = LED_MIN;
     led_brightness.max = LED_MAX;
 
+    // Live duty control channel, the duty is applied on the fly and saved
+    // by the controller after the sliders are idle.
+    const PWM_FAN = 0;
+    const PWM_MOS = 1;
+    let ws = new WebSocket("ws://" + window.location.host + "/ws");
+    ws.binaryType = "arraybuffer";
+    ws.onerror = (e) => console.error("websocket:", e);
+
+    // The slider input events are coalesced to one update per animation
+    // frame, only the newest duty of each PWM output is sent.
+    let pending_duty = new Map();
+    let frame_requested = false;
+    function send_duty(pwm, duty) {
+        pending_duty.set(pwm, parseInt(duty) || 0);
+        if (!frame_requested) {
+            frame_requested = true;
+            requestAnimationFrame(flush_duty);
+        }
+    }
+    function flush_duty() {
+        frame_requested = false;
+        let duties = pending_duty;
+        pending_duty = new Map();
+        if (ws.readyState === WebSocket.OPEN) {
+            for (let [pwm, duty] of duties) {
+                ws.send(new Uint8Array([pwm, duty & 0xff, (duty >> 8) & 0xff]));
+            }
+            return;
+        }
+        // No live channel, patch the settings instead.
+        let settings = {};
+        for (let [pwm, duty] of duties) {
+            settings[pwm === PWM_FAN ? "pwm_fan_duty" : "pwm_mos_duty"] = duty;
+        }
+        update_settings(settings).catch((e) => {
+            if (e.name !== "AbortError") {
+                console.error(e);
+            }
+        });
+    }
+
+    // A newer update supersedes the one in flight, which is cancelled.
+    let update_controller = null;
+    async function update_settings(settings) {
+        if (update_controller) {
+            update_controller.abort();
+        }
+        let controller = new AbortController();
+        update_controller = controller;
+        try {
+            let state = await patch_settings(settings, controller.signal);
+            show_settings(state["settings"]);
+        } finally {
+            if (update_controller === controller) {
+                update_controller = null;
+            }
+        }
+    }
+
     fan_speed.addEventListener("input", () => {
         fan_speed_percentage.textContent = get_percentage(FAN_MIN, FAN_MAX, fan_speed.value);
+        send_duty(PWM_FAN, fan_speed.value);
     });
     fan_enable.addEventListener("input", () => {
         if (fan_enable.checked) {
@@ -46,10 +105,12 @@
             fan_speed.type = "hidden";
             fan_speed_percentage.textContent = `N/A`;
         }
+        send_duty(PWM_FAN, fan_speed.value);
     });
 
     led_brightness.addEventListener("input", () => {
         led_percentage.textContent = get_percentage(LED_MIN, LED_MAX, led_brightness.value);
+        send_duty(PWM_MOS, led_brightness.value);
     });
     led_enable.addEventListener("input", () => {
         if (led_enable.checked) {
@@ -61,55 +122,91 @@
             led_brightness.type = "hidden";
             led_percentage.textContent = `N/A`;
         }
+        send_duty(PWM_MOS, led_brightness.value);
     });
 
-    let fan_duty = parseInt(config["pwm_fan_duty"]);
-    let led_duty = parseInt(config["pwm_mos_duty"]);
-    if (isNaN(fan_duty) || fan_duty <= 1) {
-        fan_enable.checked = false;
-        fan_speed.type = "hidden";
-        fan_speed.value = 0;
-    } else {
-        fan_enable.checked = true;
-        fan_speed.value = fan_duty;
-        fan_speed_percentage.textContent = get_percentage(FAN_MIN, FAN_MAX, fan_duty);
+    function show_fan_duty(fan_duty) {
+        fan_duty = parseInt(fan_duty);
+        if (isNaN(fan_duty) || fan_duty <= 1) {
+            fan_enable.checked = false;
+            fan_speed.type = "hidden";
+            fan_speed.value = 0;
+            fan_speed_percentage.textContent = `N/A`;
+        } else {
+            fan_enable.checked = true;
+            fan_speed.type = "range";
+            fan_speed.value = fan_duty;
+            fan_speed_percentage.textContent = get_percentage(FAN_MIN, FAN_MAX, fan_duty);
+        }
+    }
+    function show_led_duty(led_duty) {
+        led_duty = parseInt(led_duty);
+        if (isNaN(led_duty) || led_duty <= 1) {
+            led_enable.checked = false;
+            led_brightness.type = "hidden";
+            led_brightness.value = 0;
+            led_percentage.textContent = `N/A`;
+        } else {
+            led_enable.checked = true;
+            led_brightness.type = "range";
+            led_brightness.value = led_duty;
+            led_percentage.textContent = get_percentage(LED_MIN, LED_MAX, led_duty);
+        }
     }
-    if (isNaN(led_duty) || led_duty <= 1) {
-        led_enable.checked = false;
-        led_brightness.type = "hidden";
-        led_brightness.value = 0;
-    } else {
-        led_enable.checked = true;
-        led_brightness.value = led_duty;
-        led_percentage.textContent = get_percentage(LED_MIN, LED_MAX, led_duty);
+    // The slider being dragged is not updated.
+    function show_settings(settings) {
+        if (document.activeElement !== fan_speed) {
+            show_fan_duty(settings["pwm_fan_duty"]);
+        }
+        if (document.activeElement !== led_brightness) {
+            show_led_duty(settings["pwm_mos_duty"]);
+        }
     }
+    show_fan_duty(config["pwm_fan_duty"]);
+    show_led_duty(config["pwm_mos_duty"]);
+
+    // Keep in sync with the duty changed by other clients.
+    let events = new EventSource("/events");
+    events.addEventListener("duty", (e) => {
+        show_settings(JSON.parse(e.data));
+    });
 
+    // The page is updated from the response, not reloaded.
+    let button_text = button_save.textContent;
     button_save.addEventListener("click", async () => {
         button_save.textContent = "Saving...";
-        let query = "?";
-        if (!fan_enable.checked) {
-            query += "pwm_fan_duty=0&";
-        } else {
-            query += "pwm_fan_duty=" + fan_speed.value + "&";
-        }
-        if (!led_enable.checked) {
-            query += "pwm_mos_duty=0";
-        } else {
-            query += "pwm_mos_duty=" + led_brightness.value + "&";
-        }
+        button_save.disabled = true;
+        let settings = {
+            "pwm_fan_duty": fan_enable.checked ? fan_speed.value : "0",
+            "pwm_mos_duty": led_enable.checked ? led_brightness.value : "0",
+        };
         try {
-            let query_url = "http://" + window.location.host + "/settings" + query;
-            console.log("query: ", query);
-            await fetch(query_url);
+            console.log("settings: ", settings);
+            await update_settings(settings);
         } catch(e) {
-            console.error(e);
-            alert("FAILED: " + e);
+            if (e.name !== "AbortError") {
+                console.error(e);
+                alert("FAILED: " + e);
+            }
         }
-
-        location.reload();
+        button_save.textContent = button_text;
+        button_save.disabled = false;
     });
 })();
 
+async function patch_settings(settings, signal) {
+    let response = await fetch("/api/settings", {
+        method: "PATCH",
+        headers: { "Content-Type": "application/json" },
+        body: JSON.stringify(settings),
+        signal: signal,
+    });
+    if (!response.ok) {
+        throw (await response.json())["error"];
+    }
+    return await response.json();
+}
+
 function get_percentage(min, max, value) {
     min = parseInt(min);
     max = parseInt(max);
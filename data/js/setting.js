@@ -35,8 +35,7 @@
 
     let settings = {};
     try {
-        let settings_response = await fetch("/settings");
-        settings = await settings_response.json()
+        settings = (await load_state())["settings"];
     } catch(e) {
         console.error(e)
     }
@@ -60,16 +59,23 @@
             return;
         }
         button_save.textContent = "Saving...";
-        let query = "?"
+        let settings = {};
         for (let key in inputs) {
-            if (!inputs.hasOwnProperty(key)) {
+            // disabled inputs are read-only settings.
+            if (!inputs.hasOwnProperty(key) || inputs[key].disabled) {
                 continue;
             }
-            query += key + "=" + inputs[key].value + "&";
+            settings[key] = inputs[key].value;
         }
-        let query_url = "http://" + window.location.host + "/settings" + query;
         try {
-            await fetch(query_url);
+            let response = await fetch("/api/settings", {
+                method: "PATCH",
+                headers: { "Content-Type": "application/json" },
+                body: JSON.stringify(settings),
+            });
+            if (!response.ok) {
+                throw (await response.json())["error"];
+            }
         } catch(e) {
             console.error(e);
             alert("FAILED to apply settings: " + e);
@@ -261,7 +267,7 @@ async function restart() {
         button_restart.textContent = "Restarting..."
     }
     try {
-        await fetch("/restart");
+        await fetch("/api/restart", { method: "POST" });
     } catch(e) {
         console.error(e)
         return
@@ -273,7 +279,7 @@ async function restart() {
 
 async function reset_to_default() {
     try {
-        await fetch("/reset_settings");
+        await fetch("/api/reset", { method: "POST" });
     } catch(e) {
         console.error(e)
         alert("Failed: " + e);
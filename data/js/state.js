@@ -0,0 +1,25 @@
+"use strict";
+
+// load_state gets the state of the first view. The settings are read from
+// the state slot filled by the server when the page has one, otherwise the
+// state is requested from the API.
+async function load_state() {
+    if (document.readyState === "loading") {
+        // The slot is at the end of the page.
+        await new Promise((resolve) => {
+            document.addEventListener("DOMContentLoaded", resolve, { once: true });
+        });
+    }
+    let slot = document.getElementById("state");
+    let text = slot ? slot.textContent.trim() : "";
+    // The slot is kept as is if the server did not fill it.
+    if (text !== "" && !text.startsWith("<!--")) {
+        try {
+            return { "settings": JSON.parse(text) };
+        } catch (e) {
+            console.error("failed to parse the state slot:", e);
+        }
+    }
+    let response = await fetch("/api/state");
+    return await response.json();
+}
@@ -0,0 +1,64 @@
+#ifndef API_H
+#define API_H
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/**
+ * @brief API_MAX_URI_HANDLERS is the number of URI handlers registered by
+ * register_api_handlers.
+ */
+#define API_MAX_URI_HANDLERS 4
+
+/**
+ * @brief API_SETTINGS_JSON_SIZE is the size of the rendered settings JSON
+ * cache, larger JSON is rendered on every request.
+ */
+#define API_SETTINGS_JSON_SIZE 1024
+
+/**
+ * @brief API_BODY_MAX_SIZE is the max size of the request body, larger
+ * bodies are answered with 413.
+ */
+#define API_BODY_MAX_SIZE 2048
+
+/**
+ * @brief register_api_handlers registers the REST API handlers:
+ *
+ * GET   /api/state     read the controller state & settings
+ * PATCH /api/settings  update settings by a JSON object of key values
+ * POST  /api/restart   restart the controller
+ * POST  /api/reset     reset settings to default
+ *
+ * They must be registered before the wildcard static file handler.
+ *
+ * @param server
+ * @return esp_err_t
+ */
+esp_err_t register_api_handlers(httpd_handle_t server);
+
+/**
+ * @brief api_send_settings_json sends the settings JSON, the rendered JSON
+ * is cached until the config changes.
+ *
+ * @param req
+ * @return esp_err_t
+ */
+esp_err_t api_send_settings_json(httpd_req_t *req);
+
+/**
+ * @brief api_copy_settings_json copies the cached settings JSON into the
+ * buffer, so it can be embedded into other responses. The JSON contains
+ * no '<' character, the config strings are validated by the schema.
+ *
+ * @param buffer
+ * @param size buffer size
+ * @param length [out] JSON length
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_NO_MEM if the JSON does not fit into the cache or the
+ * buffer.
+ * @return ESP_FAIL if failed to render the JSON.
+ */
+esp_err_t api_copy_settings_json(char *buffer, size_t size, size_t *length);
+
+#endif // API_H
@@ -0,0 +1,79 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+/**
+ * @brief ARENA_ALIGN is the alignment of the arena allocations.
+ */
+#define ARENA_ALIGN 4
+
+/**
+ * @brief arena is a bump allocator on a preallocated buffer, the memory is
+ * released all at once by rewinding or resetting the arena.
+ */
+struct arena {
+	uint8_t *base;
+	size_t size;       // hard size budget
+	size_t used;
+	size_t high_water; // max used size since init
+	uint32_t failures; // allocations rejected for exceeding the budget
+};
+
+/**
+ * @brief arena_stats is the usage of one or more arenas.
+ */
+struct arena_stats {
+	size_t size;
+	size_t used;
+	size_t high_water;
+	uint32_t failures;
+};
+
+/**
+ * @brief arena_init allocates the buffer of the arena.
+ *
+ * @param arena
+ * @param size size budget in bytes
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_NO_MEM if failed to allocate the buffer.
+ */
+esp_err_t arena_init(struct arena *arena, size_t size);
+
+/**
+ * @brief arena_alloc allocates memory from the arena, the memory is not
+ * initialized and must not be freed.
+ *
+ * @param arena
+ * @param size
+ * @return pointer to the memory, NULL if the size budget is exceeded.
+ */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/**
+ * @brief arena_mark gets the current position of the arena, it can be
+ * passed to arena_rewind to release the memory allocated after it.
+ *
+ * @param arena
+ * @return size_t
+ */
+size_t arena_mark(const struct arena *arena);
+
+/**
+ * @brief arena_rewind releases the memory allocated after the mark.
+ *
+ * @param arena
+ * @param mark
+ */
+void arena_rewind(struct arena *arena, size_t mark);
+
+/**
+ * @brief arena_reset releases all the memory of the arena.
+ *
+ * @param arena
+ */
+void arena_reset(struct arena *arena);
+
+#endif // ARENA_H
@@ -0,0 +1,158 @@
+#ifndef ASSET_H
+#define ASSET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+/**
+ * @brief ASSET_CACHE_MAX_ENTRIES is the max number of cached assets.
+ */
+#define ASSET_CACHE_MAX_ENTRIES 32
+
+/**
+ * @brief ASSET_CACHE_MAX_SIZE is the max total size of the cached asset
+ * contents in bytes, assets loaded after reaching the size are not cached.
+ */
+#define ASSET_CACHE_MAX_SIZE (64 * 1024)
+
+/**
+ * @brief ASSET_CACHE_MAX_FILE_SIZE is the max size of a file to be read into
+ * memory, larger files are streamed from the file system in chunks.
+ */
+#define ASSET_CACHE_MAX_FILE_SIZE (24 * 1024)
+
+/**
+ * @brief ASSET_PATH_MAX_LEN is the max length of the asset file path.
+ */
+#define ASSET_PATH_MAX_LEN 64
+
+/**
+ * @brief ASSET_MANIFEST_FILE is the ETag manifest generated by
+ * tools/build_assets.py under the base path.
+ */
+#define ASSET_MANIFEST_FILE "assets.manifest"
+
+/**
+ * @brief ASSET_MANIFEST_MAX_ENTRIES is the max number of files in the
+ * manifest.
+ */
+#define ASSET_MANIFEST_MAX_ENTRIES 64
+
+/**
+ * @brief static asset content.
+ */
+struct asset {
+	const char *data;  // file content, NULL if the file is streamed
+	size_t length;     // content length
+	const char *mime;  // MIME type by the file extension
+	bool gzip;         // data is the gzip compressed '.gz' variant
+	uint32_t etag;     // content hash from the manifest, 0 if unknown
+	char file[ASSET_PATH_MAX_LEN]; // file path of the asset
+	bool cached;       // data is owned by the cache, otherwise by the asset
+};
+
+/**
+ * @brief asset cache statistics.
+ */
+struct asset_stats {
+	uint32_t hits;       // requests served from the cache
+	uint32_t misses;     // requests loaded from the file system
+	uint32_t streams;    // requests of large files streamed in chunks
+	uint32_t entries;    // cached assets
+	size_t size;         // cached content size
+	int64_t hit_us;      // total lookup latency of the hits
+	int64_t miss_us;     // total load latency of the misses
+};
+
+/**
+ * @brief init_asset_cache initializes the asset cache of the files under
+ * the base path. Assets are loaded lazily on the first request.
+ *
+ * @param base_path
+ * @return esp_err_t
+ */
+esp_err_t init_asset_cache(const char *base_path);
+
+/**
+ * @brief ASSET_GZIP_SUFFIX is the suffix of the gzip compressed asset files
+ * generated by tools/build_assets.py.
+ */
+#define ASSET_GZIP_SUFFIX ".gz"
+
+/**
+ * @brief asset_cache_get gets the asset by the URI path, directory paths
+ * are resolved to the index.html under the directory.
+ * If gzip is accepted, the '.gz' variant of the file is preferred.
+ * The asset is loaded from the file system and cached on the first request,
+ * the content of the cached asset is never freed, it can be sent directly.
+ * Files larger than ASSET_CACHE_MAX_FILE_SIZE are not read into memory,
+ * the data is NULL and the file should be streamed from asset->file.
+ *
+ * @param path URI path without query, such as '/css/styles.css'
+ * @param gzip the client accepts gzip content encoding
+ * @param asset [out] asset, must be released by asset_release
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_NOT_FOUND if the file does not exist.
+ * @return ESP_FAIL if failed.
+ */
+esp_err_t asset_cache_get(const char *path, bool gzip, struct asset *asset);
+
+/**
+ * @brief asset_cache_lookup gets the asset only if it is cached, it never
+ * reads the file system, so it can be used to tell the requests which can
+ * be served from memory.
+ *
+ * @param path URI path without query
+ * @param gzip the client accepts gzip content encoding
+ * @param asset [out] cached asset
+ * @return ESP_OK if the asset is cached.
+ * @return ESP_ERR_NOT_FOUND if the asset is not cached.
+ */
+esp_err_t asset_cache_lookup(const char *path, bool gzip, struct asset *asset);
+
+/**
+ * @brief asset_etag gets the ETag of the asset by the URI path from the
+ * manifest without opening the file, the path is resolved in the same way
+ * as asset_cache_get.
+ *
+ * @param path URI path without query
+ * @param gzip the client accepts gzip content encoding
+ * @param etag [out] content hash
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_NOT_FOUND if the asset is not in the manifest.
+ */
+esp_err_t asset_etag(const char *path, bool gzip, uint32_t *etag);
+
+/**
+ * @brief asset_exists detects whether the asset of the URI path exists,
+ * the path is resolved in the same way as asset_cache_get.
+ *
+ * @param path URI path without query
+ * @return bool
+ */
+bool asset_exists(const char *path);
+
+/**
+ * @brief asset_release releases the asset content if it is not cached.
+ *
+ * @param asset
+ */
+void asset_release(struct asset *asset);
+
+/**
+ * @brief asset_mime_type gets the MIME type by the file extension.
+ *
+ * @param filename
+ * @return MIME type, "text/plain" if unknown.
+ */
+const char *asset_mime_type(const char *filename);
+
+/**
+ * @brief asset_cache_get_stats gets the asset cache statistics.
+ *
+ * @param stats
+ */
+void asset_cache_get_stats(struct asset_stats *stats);
+
+#endif // ASSET_H
@@ -26,6 +26,77 @@
 #define CONFIG_KEY_DHCPS_NETMASK 	"dhcps_netmask"
 #define CONFIG_KEY_DHCPS_AS_ROUTER 	"dhcps_as_router"
 
+/**
+ * @brief config_key_id indexes the CONFIG_KEY_* keys, in the same order as
+ * they are written into the config file.
+ */
+enum config_key_id {
+	CONFIG_ID_PWM_FAN_CHANNEL = 0,
+	CONFIG_ID_PWM_FAN_FREQUENCY,
+	CONFIG_ID_PWM_FAN_GPIO,
+	CONFIG_ID_PWM_FAN_DUTY,
+	CONFIG_ID_PWM_FAN_DUTY_MIN,
+	CONFIG_ID_PWM_FAN_DUTY_MAX,
+	CONFIG_ID_PWM_MOS_CHANNEL,
+	CONFIG_ID_PWM_MOS_FREQUENCY,
+	CONFIG_ID_PWM_MOS_GPIO,
+	CONFIG_ID_PWM_MOS_DUTY,
+	CONFIG_ID_PWM_MOS_DUTY_MIN,
+	CONFIG_ID_PWM_MOS_DUTY_MAX,
+	CONFIG_ID_WIFI_SSID,
+	CONFIG_ID_WIFI_PASSWORD,
+	CONFIG_ID_WIFI_CHANNEL,
+	CONFIG_ID_DHCPS_IP,
+	CONFIG_ID_DHCPS_NETMASK,
+	CONFIG_ID_DHCPS_AS_ROUTER,
+	CONFIG_ID_MAX,
+};
+
+/**
+ * @brief config_type is the storage type of a config value.
+ */
+enum config_type {
+	CONFIG_TYPE_U8,      // uint8_t, range checked by min/max
+	CONFIG_TYPE_U32,     // uint32_t, range checked by min/max
+	CONFIG_TYPE_STR,     // char[max + 1], length checked by min/max
+	CONFIG_TYPE_IPV4,    // esp_ip4_addr_t interface address
+	CONFIG_TYPE_NETMASK, // esp_ip4_addr_t netmask
+};
+
+/**
+ * @brief CONFIG_FLAG_QUERY marks the keys which can be updated by the
+ * '/settings' http query and the '/api/settings' JSON request.
+ */
+#define CONFIG_FLAG_QUERY (1 << 0)
+
+/**
+ * @brief CONFIG_FLAG_JOURNAL marks the frequently updated keys which are
+ * saved by appending to the config journal instead of rewriting the
+ * whole config.
+ */
+#define CONFIG_FLAG_JOURNAL (1 << 1)
+
+/**
+ * @brief CONFIG_ID_BIT converts the CONFIG_ID_* index to the bit of the
+ * config key mask.
+ */
+#define CONFIG_ID_BIT(id) (1UL << (id))
+
+/**
+ * @brief config_schema describes how a config key is stored and validated.
+ */
+struct config_schema {
+	const char *key;         // CONFIG_KEY_* key
+	enum config_key_id id;   // CONFIG_ID_* index
+	enum config_type type;   // value type
+	uint16_t offset;         // value offset in the struct config
+	uint16_t flags;          // CONFIG_FLAG_* flags
+	uint32_t min;            // min value (or min string length)
+	uint32_t max;            // max value (or max string length)
+	uint32_t def;            // default value
+	const char *def_str;     // default value of CONFIG_TYPE_STR
+};
+
 /**
  * @brief PWM configuration.
  */
@@ -38,12 +109,24 @@ struct pwm_config {
 	uint8_t duty_max;   // PWM duty max (0-255)
 };
 
+/**
+ * @brief max length of the WIFI SSID & password defined by 802.11.
+ */
+#define CONFIG_WIFI_SSID_MAX_LEN 32
+#define CONFIG_WIFI_PASSWORD_MAX_LEN 63
+
+/**
+ * @brief min length of a WPA2 passphrase, an empty password starts an open
+ * AP instead.
+ */
+#define CONFIG_WIFI_PASSWORD_MIN_LEN 8
+
 /**
  * @brief WIFI configuration
  */
 struct wifi_config {
-	char* ssid;      // Wifi SSID
-	char* password;  // Wifi password
+	char ssid[CONFIG_WIFI_SSID_MAX_LEN + 1];         // Wifi SSID
+	char password[CONFIG_WIFI_PASSWORD_MAX_LEN + 1]; // Wifi password
 	uint8_t channel; // Wifi channel (1-11)
 };
 
@@ -71,12 +154,15 @@ struct dhcps_config {
  * Use `config_get_value` to get value by key.
  * Use `save_config_file` to save the config obj to config file.
  * Use `release_config` to release the config obj.
+ *
+ * The config is a single fixed size block without pointers, it can be
+ * copied by `config_copy` and compared by `config_equal` directly.
  */
 struct config {
-	struct pwm_config *pwm_fan; // Fan speed configuration
-	struct pwm_config *pwm_mos; // Fan power switch (or LED) configuration
-	struct wifi_config *wifi;   // WIFI configuration
-	struct dhcps_config *dhcps; // DHCP server configuration
+	struct pwm_config pwm_fan; // Fan speed configuration
+	struct pwm_config pwm_mos; // Fan power switch (or LED) configuration
+	struct wifi_config wifi;   // WIFI configuration
+	struct dhcps_config dhcps; // DHCP server configuration
 };
 
 /**
@@ -89,10 +175,27 @@ struct config {
 #define CONFIG_FILE_DEFAULT "/spiffs/config/config.cfg.default"
 
 /**
- * @brief CONFIG_JSON_TEMPLATE_FILE defines the default config json
- * marshal template
+ * @brief CONFIG_NVS_NAMESPACE and CONFIG_NVS_KEY define where the binary
+ * config snapshot is stored in NVS.
  */
-#define CONFIG_JSON_TEMPLATE_FILE "/spiffs/config/config_template.json"
+#define CONFIG_NVS_NAMESPACE "controller"
+#define CONFIG_NVS_KEY "config"
+
+/**
+ * @brief config_schema_lookup finds the schema of the config key.
+ *
+ * @param key CONFIG_KEY_* key
+ * @return schema of the key, NULL if the key is unrecognized.
+ */
+const struct config_schema *config_schema_lookup(const char *key);
+
+/**
+ * @brief config_schema_get gets the schema by CONFIG_ID_* index.
+ *
+ * @param id CONFIG_ID_* index
+ * @return schema of the key, NULL if the id is out of range.
+ */
+const struct config_schema *config_schema_get(enum config_key_id id);
 
 /**
  * @brief new_config_by_load_file builds config struct object from the
@@ -110,6 +213,29 @@ struct config* new_config_by_load_file();
  */
 struct config* new_config_by_load_default_file();
 
+/**
+ * @brief new_config_by_load_nvs builds config struct object from the binary
+ * config snapshot stored in NVS, need to release by `release_config`
+ * manually.
+ *
+ * @param journal_epoch [out] epoch of the config journal based on the
+ * snapshot, can be NULL.
+ * @return struct config*, NULL if the snapshot is missing, corrupted or
+ * in a different version.
+ */
+struct config* new_config_by_load_nvs(uint32_t *journal_epoch);
+
+/**
+ * @brief save_config_nvs saves config into the binary config snapshot
+ * in NVS.
+ *
+ * @param config
+ * @param journal_epoch epoch of the config journal based on the snapshot.
+ * @return ESP_OK if succeed.
+ * @return ESP_FAIL if failed.
+ */
+esp_err_t save_config_nvs(struct config *config, uint32_t journal_epoch);
+
 /**
  * @brief save_config_file saves config into the default config file.
  *
@@ -143,6 +269,25 @@ esp_err_t config_set_value(
 	const char *value
 );
 
+/**
+ * @brief config_parse_value updates the config by key & value strictly.
+ * Unlike `config_set_value`, which loads the config file leniently, the
+ * number must be a plain decimal, the address must be a dotted decimal,
+ * the password must be empty or a WPA2 passphrase, and the invalid value is rejected instead of being reset to the default
+ * value. Use it for the values from the clients.
+ *
+ * @param config pointer points to the struct config obj.
+ * @param key CONFIG_KEY_* key
+ * @param value value string
+ * @return ESP_OK if succeed.
+ * @return ESP_FAIL if the key is unrecognized or the value is invalid.
+ */
+esp_err_t config_parse_value(
+	struct config *config,
+	const char *key,
+	const char *value
+);
+
 /**
  * @brief config_get_value gets the config by key.
  *
@@ -162,13 +307,104 @@ esp_err_t config_get_value(
 );
 
 /**
- * @brief
+ * @brief config_writer_t receives the marshaled data piece by piece.
  *
- * @param config
+ * @param ctx user context passed to the marshal function
  * @param data
- * @return esp_err_t
+ * @param length
+ * @return ESP_OK to continue, other values abort the marshal.
+ */
+typedef esp_err_t (*config_writer_t)(
+	void *ctx, const char *data, size_t length);
+
+/**
+ * @brief config_marshal_json marshals the config into JSON string and
+ * streams it to the writer, all values are encoded as JSON strings.
+ *
+ * @param config
+ * @param writer
+ * @param ctx user context passed to the writer
+ * @return ESP_OK if succeed.
+ * @return ESP_FAIL if the config is invalid, or the error of the writer.
  */
-esp_err_t config_marshal_json(struct config *config, char* data);
+esp_err_t config_marshal_json(
+	struct config *config,
+	config_writer_t writer,
+	void *ctx
+);
+
+/**
+ * @brief new_config_default_value builds config struct object with the
+ * default values, need to release by `release_config` manually.
+ *
+ * @return struct config*
+ */
+struct config* new_config_default_value();
+
+/**
+ * @brief config_reset_default resets all values of the config to default.
+ *
+ * @param config
+ */
+void config_reset_default(struct config *config);
+
+/**
+ * @brief config_copy copies the config from src to dst.
+ *
+ * @param dst
+ * @param src
+ */
+void config_copy(struct config *dst, const struct config *src);
+
+/**
+ * @brief config_equal compares two config objs.
+ *
+ * @param a
+ * @param b
+ * @return true if the content of the configs are the same.
+ */
+bool config_equal(const struct config *a, const struct config *b);
+
+/**
+ * @brief config_diff compares two config objs key by key.
+ *
+ * @param a
+ * @param b
+ * @return mask of CONFIG_ID_BIT of the keys which have different values.
+ */
+uint32_t config_diff(const struct config *a, const struct config *b);
+
+/**
+ * @brief config_get_uint gets the numeric value by CONFIG_ID_* index.
+ *
+ * @param config
+ * @param id CONFIG_ID_* index of a non-string key
+ * @param value [out]
+ * @return ESP_OK if succeed.
+ * @return ESP_FAIL if the key is a string key.
+ */
+esp_err_t config_get_uint(
+	const struct config *config,
+	enum config_key_id id,
+	uint32_t *value
+);
+
+/**
+ * @brief config_set_uint sets the numeric value by CONFIG_ID_* index.
+ * Unlike `config_set_value`, the invalid value is rejected instead of being
+ * reset to the default value.
+ *
+ * @param config
+ * @param id CONFIG_ID_* index of a non-string key
+ * @param value
+ * @return ESP_OK if succeed.
+ * @return ESP_FAIL if the key is a string key or the value is invalid.
+ */
+esp_err_t config_set_uint(
+	struct config *config,
+	enum config_key_id id,
+	uint32_t value
+);
 
 /**
  * @brief release_config release config allocated memory.
@@ -3,6 +3,8 @@
 
 #include <esp_err.h>
 
+#include "config.h"
+
 /**
  * @brief private controller struct object.
  */
@@ -45,22 +47,132 @@ esp_err_t global_controller_start();
 bool is_global_controller_running();
 
 /**
- * @brief global_controller_main_loop is the main loop function.
+ * @brief CONTROLLER_TICK_RATE_HZ is the rate of the controller tick which
+ * applies the PWM duty, it can be overridden by the build flags.
+ * The tick period is rounded to the FreeRTOS tick.
+ */
+#ifndef CONTROLLER_TICK_RATE_HZ
+#define CONTROLLER_TICK_RATE_HZ 100
+#endif
+
+/**
+ * @brief controller_tick_stats is the statistics of the controller tick.
+ */
+struct controller_tick_stats {
+	uint32_t ticks;         // ticks run
+	uint32_t applied;       // duties written to the PWM outputs
+	uint32_t coalesced;     // duties replaced before being applied
+	uint32_t jitter_us;     // deviation of the last tick interval
+	uint32_t jitter_max_us; // max deviation of the tick interval
+};
+
+/**
+ * @brief global_controller_main_loop is the main loop function, it runs
+ * one controller tick at CONTROLLER_TICK_RATE_HZ.
+ *
+ * The duty updates are posted to a single slot mailbox per PWM output,
+ * the tick only applies the newest duty of each output, so a burst of
+ * updates writes the PWM output once per tick.
  *
  * @return true if the controller server is running
  * @return false if the controller server is stopped
  */
 bool global_controller_main_loop();
 
+/**
+ * @brief global_controller_get_tick_stats copies the statistics of the
+ * controller tick.
+ *
+ * @param stats [out]
+ */
+void global_controller_get_tick_stats(struct controller_tick_stats *stats);
+
 esp_err_t global_controller_apply_pwm_duty();
 
+/**
+ * @brief controller PWM outputs.
+ */
+enum controller_pwm {
+	CONTROLLER_PWM_FAN = 0,
+	CONTROLLER_PWM_MOS,
+	CONTROLLER_PWM_MAX,
+};
+
+/**
+ * @brief controller_pwm_duty_id gets the duty key of the PWM output.
+ *
+ * @param pwm
+ * @return CONFIG_ID_* index of the duty key, CONFIG_ID_MAX if the PWM
+ * output is invalid.
+ */
+enum config_key_id controller_pwm_duty_id(enum controller_pwm pwm);
+
+/**
+ * @brief global_controller_set_duty updates the PWM duty, the duty is
+ * applied by the next controller tick.
+ * The config is updated but not saved, call global_controller_save_config
+ * to save it.
+ *
+ * @param pwm
+ * @param duty
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_INVALID_ARG if the duty is out of range.
+ * @return ESP_FAIL if failed.
+ */
+esp_err_t global_controller_set_duty(enum controller_pwm pwm, uint32_t duty);
+
+/**
+ * @brief global_controller_get_duty gets the current PWM duty.
+ *
+ * @param pwm
+ * @return duty
+ */
+uint32_t global_controller_get_duty(enum controller_pwm pwm);
+
 esp_err_t global_controller_update_config(const char* k, const char* v);
 
 esp_err_t global_controller_save_config();
 
+/**
+ * @brief config_batch_fn stages config changes on the staged config copy.
+ *
+ * @param staged copy of the controller config to modify
+ * @param ctx
+ * @return ESP_OK to commit the staged config, the batch is discarded
+ * otherwise.
+ */
+typedef esp_err_t (*config_batch_fn)(struct config *staged, void *ctx);
+
+/**
+ * @brief global_controller_update_config_batch updates the config by a
+ * batch of changes atomically.
+ * The changes are staged on a copy of the config and validated together,
+ * either all of them or none of them are applied.
+ * Only the PWM channels affected by the changed keys are updated, and the
+ * config is saved once if anything changed.
+ *
+ * @param stage function to stage the changes
+ * @param ctx context passed to the stage function
+ * @return ESP_OK if succeed.
+ * @return error returned by the stage function or ESP_FAIL if failed,
+ * the config is not changed.
+ */
+esp_err_t global_controller_update_config_batch(
+	config_batch_fn stage, void *ctx);
+
 esp_err_t global_controller_reset_default();
 
-esp_err_t global_controller_config_marshal_json(char *data);
+/**
+ * @brief global_controller_config_generation gets the generation of the
+ * controller config, the generation changes every time the config is
+ * updated or reset.
+ *
+ * @return uint32_t
+ */
+uint32_t global_controller_config_generation();
+
+esp_err_t global_controller_config_marshal_json(
+	config_writer_t writer, void *ctx);
 
 /**
  * @brief stop the global controller.
@@ -0,0 +1,95 @@
+#ifndef I18N_H
+#define I18N_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/**
+ * @brief I18N_FILE is the string tables of the locales generated by
+ * tools/build_assets.py under the base path.
+ *
+ * Header: 'I18N', u8 locale count, u8 reserved, u16 string count.
+ * The locale codes, I18N_CODE_MAX_LEN bytes each, the first is the default.
+ * The index of each locale, u16 offset & u16 length of each string.
+ * The blob of the strings, each is preceded by a deflate stored block
+ * header. The integers are little endian.
+ */
+#define I18N_FILE "i18n.bin"
+
+/**
+ * @brief I18N_CODE_MAX_LEN is the size of a locale code in I18N_FILE.
+ */
+#define I18N_CODE_MAX_LEN 8
+
+/**
+ * @brief I18N_STRING_HEADER_SIZE is the size of the deflate stored block
+ * header before each string, so the string can be sent into a gzip stream
+ * without copying.
+ */
+#define I18N_STRING_HEADER_SIZE 5
+
+/**
+ * @brief I18N_COOKIE is the cookie of the locale chosen by the client.
+ */
+#define I18N_COOKIE "lang"
+
+/**
+ * @brief init_i18n loads the string tables under the base path.
+ *
+ * @param base_path
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_NOT_FOUND if the string tables do not exist.
+ * @return ESP_FAIL if failed.
+ */
+esp_err_t init_i18n(const char *base_path);
+
+/**
+ * @brief i18n_locale_count gets the number of the locales.
+ *
+ * @return int, 0 if the string tables are not loaded.
+ */
+int i18n_locale_count();
+
+/**
+ * @brief i18n_locale_code gets the code of the locale, such as 'en'.
+ *
+ * @param locale
+ * @return const char*, NULL if the locale does not exist.
+ */
+const char *i18n_locale_code(int locale);
+
+/**
+ * @brief i18n_find_locale finds the locale by its code.
+ *
+ * @param code not NUL terminated
+ * @param length code length
+ * @return the locale, -1 if not found.
+ */
+int i18n_find_locale(const char *code, size_t length);
+
+/**
+ * @brief i18n_negotiate gets the locale of the request by the I18N_COOKIE
+ * cookie, or the primary language subtags of the Accept-Language header.
+ *
+ * @param req
+ * @return the locale, the default locale 0 if none matches.
+ */
+int i18n_negotiate(httpd_req_t *req);
+
+/**
+ * @brief i18n_get_string gets the string of the locale, the string is
+ * preceded by I18N_STRING_HEADER_SIZE bytes of its stored block header.
+ *
+ * @param locale
+ * @param id
+ * @param string [out] not NUL terminated
+ * @param length [out]
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_NOT_FOUND if the locale or the string does not exist.
+ */
+esp_err_t i18n_get_string(
+	int locale, uint16_t id, const char **string, size_t *length);
+
+#endif // I18N_H
@@ -0,0 +1,63 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <esp_err.h>
+
+#include "config.h"
+
+/**
+ * @brief CONFIG_JOURNAL_FILE defines the config journal file path.
+ */
+#define CONFIG_JOURNAL_FILE "/spiffs/config/config.journal"
+
+/**
+ * @brief CONFIG_JOURNAL_MAX_SIZE is the size threshold of the journal file,
+ * the journal will be compacted into the config snapshot after passing it.
+ */
+#define CONFIG_JOURNAL_MAX_SIZE 4096
+
+/**
+ * @brief config_journal_replay applies the journal records on top of the
+ * config loaded from the config snapshot.
+ * The journal is ignored if it is missing or not based on the snapshot
+ * (different epoch), and replay stops at the first incomplete or corrupted
+ * record.
+ *
+ * @param config config loaded from the snapshot
+ * @param epoch journal epoch of the snapshot
+ * @return ESP_OK if the whole journal is applied.
+ * @return ESP_ERR_NOT_FOUND if the journal is missing or ignored.
+ * @return ESP_ERR_INVALID_SIZE if the journal has incomplete or corrupted
+ * records, it needs to be compacted.
+ */
+esp_err_t config_journal_replay(struct config *config, uint32_t epoch);
+
+/**
+ * @brief config_journal_append appends the values of the keys to the
+ * journal, only non-string keys can be appended.
+ *
+ * @param config
+ * @param keys mask of CONFIG_ID_BIT of the keys to append
+ * @return ESP_OK if succeed.
+ * @return ESP_FAIL if failed.
+ */
+esp_err_t config_journal_append(const struct config *config, uint32_t keys);
+
+/**
+ * @brief config_journal_reset clears the journal and starts a new epoch.
+ * The config snapshot with the same epoch should be saved before reset.
+ *
+ * @param epoch
+ * @return ESP_OK if succeed.
+ * @return ESP_FAIL if failed.
+ */
+esp_err_t config_journal_reset(uint32_t epoch);
+
+/**
+ * @brief config_journal_size gets the size of the journal file in bytes.
+ *
+ * @return size, 0 if the journal does not exist.
+ */
+size_t config_journal_size();
+
+#endif // JOURNAL_H
@@ -0,0 +1,38 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+#include <esp_err.h>
+
+/**
+ * @brief json_member_fn is called for each member of the parsed object.
+ * The key & value point into the parsed buffer, they are null terminated
+ * and unescaped in place.
+ *
+ * @param key member key
+ * @param value member value, string content or the literal of a number,
+ * true, false or null
+ * @param ctx
+ * @return ESP_OK to continue parsing, the parsing stops with the error
+ * otherwise.
+ */
+typedef esp_err_t (*json_member_fn)(
+	const char *key, const char *value, void *ctx);
+
+/**
+ * @brief json_parse_object parses a flat JSON object in place without
+ * allocating memory, nested objects and arrays are not supported.
+ * The buffer is modified to terminate & unescape the strings.
+ *
+ * @param buffer JSON text, modified in place
+ * @param length buffer length
+ * @param fn function called for each member
+ * @param ctx context passed to the function
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_INVALID_ARG if the JSON is invalid or not supported.
+ * @return error returned by the member function.
+ */
+esp_err_t json_parse_object(
+	char *buffer, size_t length, json_member_fn fn, void *ctx);
+
+#endif // JSON_H
@@ -0,0 +1,91 @@
+#ifndef PAGE_H
+#define PAGE_H
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+#include "asset.h"
+
+/**
+ * @brief PAGE_TEMPLATE_SUFFIX is the suffix of the page templates compiled
+ * by tools/build_assets.py, such as '/setting/index.html.tpl'.
+ *
+ * Header: 'TPL', u8 flags, u16 op count, u16 tail length, u8 locale count,
+ * 3 bytes reserved. The u32 crc32 & u32 size of the page of each locale
+ * before the state slot, the whole page if no slot. The ops, u16 length of
+ * the literal content and u16 ID of the string sent after it. The literal
+ * contents, then the tail content after the state slot.
+ * The literal contents of the '.gz' variant are deflate blocks ending at a
+ * byte boundary. The integers are little endian.
+ */
+#define PAGE_TEMPLATE_SUFFIX ".tpl"
+
+#define PAGE_TEMPLATE_FLAG_GZIP 0x01
+#define PAGE_TEMPLATE_FLAG_SLOT 0x02
+
+// String ID of no string.
+#define PAGE_STRING_NONE 0xffff
+// String ID of the state slot, only the last op.
+#define PAGE_STRING_STATE 0xfffe
+
+/**
+ * @brief PAGE_SLOT_TAIL_MAX_SIZE is the max size of the template content
+ * after the state slot.
+ */
+#define PAGE_SLOT_TAIL_MAX_SIZE 256
+
+/**
+ * @brief page_stats is the statistics of the rendered pages.
+ */
+struct page_stats {
+	uint32_t renders;           // rendered pages
+	uint32_t first_byte_max_us; // max time to send the first chunk
+	int64_t first_byte_us;      // total time to send the first chunk
+	int64_t render_us;          // total time to send the pages
+};
+
+/**
+ * @brief page_resolve resolves the URI path to the template of the page,
+ * the path of a directory is resolved to the index.html under it.
+ *
+ * @param path URI path without query, such as '/setting/'
+ * @param template [out] URI path of the template
+ * @param size template size
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_NOT_FOUND if the page has no template.
+ */
+esp_err_t page_resolve(const char *path, char *template, size_t size);
+
+/**
+ * @brief page_has_state detects whether the page has the state slot, such
+ * a page must not be cached by the client.
+ *
+ * @param template loaded template
+ * @return bool
+ */
+bool page_has_state(const struct asset *template);
+
+/**
+ * @brief page_send renders the page of the locale from the template.
+ * The literal contents and the strings are sent in http chunks directly
+ * from the template and the string tables, the settings JSON is filled
+ * into the state slot.
+ *
+ * @param req
+ * @param template loaded template, the gzip variant is sent with the gzip
+ * content encoding
+ * @param locale
+ * @return esp_err_t
+ */
+esp_err_t page_send(
+	httpd_req_t *req, const struct asset *template, int locale);
+
+/**
+ * @brief page_get_stats gets the statistics of the rendered pages.
+ *
+ * @param stats [out]
+ */
+void page_get_stats(struct page_stats *stats);
+
+#endif // PAGE_H
@@ -0,0 +1,77 @@
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include <esp_err.h>
+
+#include "config.h"
+
+/**
+ * @brief PERSIST_DEFAULT_DELAY_MS is the default window to coalesce the
+ * config save requests before writing to flash.
+ */
+#define PERSIST_DEFAULT_DELAY_MS 2000
+
+/**
+ * @brief persist_snapshot_fn copies the current config into the provided
+ * config obj, it is called by the persistence task before writing.
+ */
+typedef void (*persist_snapshot_fn)(struct config *config);
+
+/**
+ * @brief persistence statistics.
+ */
+struct persist_stats {
+	uint32_t requests;     // save requests
+	uint32_t writes;       // config written to flash
+	uint32_t journal_writes; // writes appended to the journal
+	uint32_t compactions;  // writes of the whole config snapshot
+	uint32_t failures;     // failed writes
+	int64_t last_flush_us; // latency of the last flush
+	int64_t max_flush_us;  // max latency of flushes
+};
+
+/**
+ * @brief persist_load_config loads the config from the NVS snapshot and
+ * replays the change journal on top of it, the config file is used as a
+ * fallback if the snapshot is missing or corrupted.
+ * It should be called before init_persist_task.
+ *
+ * @return struct config*, NULL if failed.
+ */
+struct config *persist_load_config();
+
+/**
+ * @brief init_persist_task starts the background config persistence task.
+ *
+ * @param snapshot function to get the current config
+ * @param delay_ms window to coalesce the save requests
+ * @return esp_err_t
+ */
+esp_err_t init_persist_task(persist_snapshot_fn snapshot, uint32_t delay_ms);
+
+/**
+ * @brief persist_request marks the config as changed, the config will be
+ * written by the persistence task after the delay window.
+ * This function does not block.
+ *
+ * @return esp_err_t
+ */
+esp_err_t persist_request();
+
+/**
+ * @brief persist_flush writes the changed config to flash immediately.
+ * Nothing is written if the config is not changed since the last flush.
+ * A failed flush is retried by the persistence task after the delay window.
+ *
+ * @return esp_err_t
+ */
+esp_err_t persist_flush();
+
+/**
+ * @brief persist_get_stats gets the persistence statistics.
+ *
+ * @param stats
+ */
+void persist_get_stats(struct persist_stats *stats);
+
+#endif // PERSIST_H
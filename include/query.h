@@ -0,0 +1,35 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <esp_err.h>
+
+/**
+ * @brief query_pair_fn is called for each key value pair of the parsed
+ * query string. The key & value point into the parsed query, they are
+ * null terminated and percent-decoded in place.
+ *
+ * @param key
+ * @param value empty if the pair has no '='
+ * @param ctx
+ * @return ESP_OK to continue parsing, the parsing stops with the error
+ * otherwise.
+ */
+typedef esp_err_t (*query_pair_fn)(
+	const char *key, const char *value, void *ctx);
+
+/**
+ * @brief query_parse parses the 'application/x-www-form-urlencoded' query
+ * string in one pass, the pairs are decoded in place ('+' to space and
+ * '%XX' to the byte) and passed to the function in order.
+ * The query string is modified.
+ *
+ * @param query null terminated query string without the leading '?'
+ * @param fn function called for each pair
+ * @param ctx context passed to the function
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_INVALID_ARG if the query has invalid percent-encoding.
+ * @return error returned by the pair function.
+ */
+esp_err_t query_parse(char *query, query_pair_fn fn, void *ctx);
+
+#endif // QUERY_H
@@ -5,6 +5,31 @@
 #include <esp_http_server.h>
 
 #include "config.h"
+#include "arena.h"
+
+/**
+ * @brief HTTP_ARENA_SIZE is the size budget of the request arena of each
+ * worker, it must hold the largest request body and the stream buffer.
+ */
+#define HTTP_ARENA_SIZE 2560
+
+/**
+ * @brief HTTP_ASYNC_WORKERS is the number of the async workers handling
+ * the requests which read the file system.
+ */
+#define HTTP_ASYNC_WORKERS 2
+
+/**
+ * @brief HTTP_ARENA_MAX_WORKERS is the max number of tasks handling the
+ * requests, the server task and the async workers, each of them has its
+ * own request arena.
+ */
+#define HTTP_ARENA_MAX_WORKERS (1 + HTTP_ASYNC_WORKERS)
+
+/**
+ * @brief httpd_req_handler_t is the request handler function.
+ */
+typedef esp_err_t (*httpd_req_handler_t)(httpd_req_t *req);
 
 /**
  * @brief start default web server and get the server handle
@@ -23,4 +48,41 @@ esp_err_t start_default_http_server(httpd_handle_t *, struct config*);
  */
 esp_err_t stop_default_http_server(httpd_handle_t handle);
 
+/**
+ * @brief http_req_arena gets the request arena of the worker handling the
+ * request, the arena is preallocated when the server starts.
+ * The memory allocated in a handler must be released by arena_rewind
+ * before the response is completed, so the request path does not use the
+ * heap.
+ *
+ * @param req
+ * @return struct arena*, NULL if there are too many workers
+ */
+struct arena *http_req_arena(httpd_req_t *req);
+
+/**
+ * @brief http_req_submit_async hands the request over to an idle async
+ * worker, the handler is called again with a copy of the request on the
+ * worker task. The handler must only use the per-request state.
+ *
+ * @param req
+ * @param handler
+ * @return ESP_OK if the request is submitted, the caller must return
+ * without responding.
+ * @return ESP_ERR_INVALID_STATE if called on a worker or the workers are
+ * not started.
+ * @return ESP_ERR_TIMEOUT if all the workers are busy.
+ * @return error if failed, the caller should handle the request itself.
+ */
+esp_err_t http_req_submit_async(
+	httpd_req_t *req, httpd_req_handler_t handler);
+
+/**
+ * @brief http_arena_get_stats gets the usage of the request arenas, the
+ * high-water mark is the max of all workers.
+ *
+ * @param stats [out]
+ */
+void http_arena_get_stats(struct arena_stats *stats);
+
 #endif // SERVER_H
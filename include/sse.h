@@ -0,0 +1,58 @@
+#ifndef SSE_H
+#define SSE_H
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/**
+ * @brief SSE_MAX_CLIENTS is the max number of the '/events' subscribers.
+ */
+#define SSE_MAX_CLIENTS 4
+
+/**
+ * @brief SSE_RING_SIZE is the size of the event ring buffer shared by all
+ * subscribers, a subscriber falling behind more than the ring size is
+ * disconnected.
+ */
+#define SSE_RING_SIZE 2048
+
+/**
+ * @brief SSE_CLIENT_BUDGET is the max bytes sent to one subscriber in a
+ * send round, so a slow client does not delay the others.
+ */
+#define SSE_CLIENT_BUDGET 512
+
+/**
+ * @brief SSE_POLL_INTERVAL_MS is the interval to check the duty changes.
+ */
+#define SSE_POLL_INTERVAL_MS 200
+
+/**
+ * @brief SSE_TELEMETRY_INTERVAL_MS is the interval of the telemetry events.
+ */
+#define SSE_TELEMETRY_INTERVAL_MS 1000
+
+/**
+ * @brief register_sse_handler registers the '/events' Server-Sent Events
+ * handler and starts the event publisher.
+ *
+ * Events:
+ * - 'duty': PWM duty & config generation, sent when the config changes.
+ * - 'telemetry': free & min free heap, uptime, connected stations,
+ *   subscribers and the controller tick statistics, sent every
+ *   SSE_TELEMETRY_INTERVAL_MS.
+ *
+ * @param server
+ * @return esp_err_t
+ */
+esp_err_t register_sse_handler(httpd_handle_t server);
+
+/**
+ * @brief sse_close_client removes the subscriber of the socket, it must
+ * be called when the server closes a socket.
+ *
+ * @param sockfd
+ */
+void sse_close_client(int sockfd);
+
+#endif // SSE_H
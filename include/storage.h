@@ -27,6 +27,35 @@ int read_file(char** p, const char *filename);
  */
 int write_file(char *filename, char *content);
 
+/**
+ * @brief STORAGE_TMP_SUFFIX is appended to the filename of the temporary
+ * file written by `write_file_atomic`.
+ */
+#define STORAGE_TMP_SUFFIX ".tmp"
+
+/**
+ * @brief write_file_atomic writes content into a temporary file and
+ * renames it to the filename after the data is synced, so the file will
+ * never be half written on power loss.
+ * NOTE: SPIFFS can not rename over an existing file, the old file is
+ * removed before renaming, use `open_file_atomic` to read the file.
+ *
+ * @param filename
+ * @param content
+ * @return int write data length, 0 if failed
+ */
+int write_file_atomic(const char *filename, const char *content);
+
+/**
+ * @brief open_file_atomic opens the file written by `write_file_atomic`
+ * for reading. If the power lost after the old file was removed,
+ * the temporary file will be renamed to the filename and opened.
+ *
+ * @param filename
+ * @return file descriptor, -1 if failed
+ */
+int open_file_atomic(const char *filename);
+
 /**
  * @brief is_regular_file detects if the file is a regular file
  * by using S_ISREG.
@@ -0,0 +1,121 @@
+#ifndef TRAFFIC_H
+#define TRAFFIC_H
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/**
+ * @brief TRAFFIC_MAX_OPEN_SOCKETS is the max number of the http server
+ * connections, at most CONFIG_LWIP_MAX_SOCKETS - 3. The other sockets are
+ * the server listen & control sockets and the UDP control listener.
+ */
+#define TRAFFIC_MAX_OPEN_SOCKETS 7
+
+/**
+ * @brief TRAFFIC_CONTROL_RESERVED_SOCKETS is the number of the sockets kept
+ * for the control requests. When a new connection leaves fewer free
+ * sockets, the least recently used idle asset connection is closed, and a
+ * new connection taking the last free socket is refused, so the server LRU
+ * purge never closes a control connection. An asset or stream request on a
+ * connection over the rest of the sockets is answered with 503 if no idle
+ * asset connection can be closed.
+ */
+#define TRAFFIC_CONTROL_RESERVED_SOCKETS 2
+
+/**
+ * @brief traffic_class is the class of the requests.
+ */
+enum traffic_class {
+	TRAFFIC_CONTROL = 0, // settings, duty & state requests
+	TRAFFIC_ASSET,       // static files
+	TRAFFIC_STREAM,      // long lived event streams
+	TRAFFIC_CLASS_MAX,
+};
+
+/**
+ * @brief traffic_stats is the statistics of a request class.
+ */
+struct traffic_stats {
+	uint32_t requests;       // completed requests
+	uint32_t active;         // requests being handled or queued
+	uint32_t active_max;     // max active requests
+	uint32_t evicted;        // idle connections closed for the reservation
+	uint32_t refused;        // connections refused for the reservation
+	uint32_t latency_max_us; // max request latency
+	int64_t latency_us;      // total request latency
+};
+
+/**
+ * @brief traffic_req is the accounting of a request being handled.
+ */
+struct traffic_req {
+	int fd;
+	enum traffic_class class;
+	int64_t start;
+};
+
+/**
+ * @brief traffic_register_uri_handler registers the URI handler with the
+ * request class, the requests are counted and timed by the class.
+ *
+ * @param server
+ * @param uri
+ * @param class
+ * @return esp_err_t
+ */
+esp_err_t traffic_register_uri_handler(
+	httpd_handle_t server, const httpd_uri_t *uri, enum traffic_class class);
+
+/**
+ * @brief traffic_defer moves the current request out of its handler, it
+ * is called when the request is handed over to another task, which must
+ * call traffic_end after completing the response.
+ *
+ * @param req [out]
+ */
+void traffic_defer(struct traffic_req *req);
+
+/**
+ * @brief traffic_end records the completed request.
+ *
+ * @param req
+ */
+void traffic_end(const struct traffic_req *req);
+
+/**
+ * @brief traffic_open_fn tracks the new socket and closes an idle asset
+ * connection if the reserved sockets are used, it must be called by the
+ * server open_fn.
+ *
+ * @param server
+ * @param sockfd
+ * @return ESP_FAIL if the connection takes the last free socket
+ */
+esp_err_t traffic_open_fn(httpd_handle_t server, int sockfd);
+
+/**
+ * @brief traffic_close_fn stops tracking the socket, it must be called by
+ * the server close_fn.
+ *
+ * @param sockfd
+ */
+void traffic_close_fn(int sockfd);
+
+/**
+ * @brief traffic_class_name gets the name of the request class.
+ *
+ * @param class
+ * @return const char*
+ */
+const char *traffic_class_name(enum traffic_class class);
+
+/**
+ * @brief traffic_get_stats gets the statistics of the request class.
+ *
+ * @param class
+ * @param stats [out]
+ */
+void traffic_get_stats(enum traffic_class class, struct traffic_stats *stats);
+
+#endif // TRAFFIC_H
@@ -0,0 +1,55 @@
+#ifndef UDP_H
+#define UDP_H
+
+#include <stdint.h>
+#include <esp_err.h>
+
+#include "config.h"
+
+/**
+ * @brief UDP_CONTROL_PORT is the port of the UDP control listener.
+ */
+#define UDP_CONTROL_PORT 4210
+
+/**
+ * @brief UDP_MAX_PEERS is the max number of the tracked peer sessions,
+ * the least recently seen peer is replaced when the table is full.
+ */
+#define UDP_MAX_PEERS 4
+
+/**
+ * @brief udp_stats is the statistics of the UDP control listener.
+ */
+struct udp_stats {
+	uint32_t received; // packets received
+	uint32_t applied;  // duty packets applied
+	uint32_t stale;    // packets dropped for an old sequence number
+	uint32_t invalid;  // packets dropped or rejected for invalid content
+	uint32_t apply_us; // time to apply the last duty packet
+	uint32_t apply_max_us; // max time to apply a duty packet
+};
+
+/**
+ * @brief start_udp_control starts the UDP control listener on the soft AP
+ * address, see udp_proto.h for the packet format.
+ *
+ * Every accepted packet is answered by an ack with the same sequence
+ * number and the current duties. The sequence number of each peer must
+ * increase: an older packet is dropped, a repeated one is acked again
+ * without being applied, and 0 restarts the peer session.
+ * The duty records of a packet are validated and applied together, the
+ * config is saved by the persistence task.
+ *
+ * @param config
+ * @return esp_err_t
+ */
+esp_err_t start_udp_control(const struct config *config);
+
+/**
+ * @brief udp_get_stats copies the statistics of the UDP control listener.
+ *
+ * @param stats [out]
+ */
+void udp_get_stats(struct udp_stats *stats);
+
+#endif // UDP_H
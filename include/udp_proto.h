@@ -0,0 +1,105 @@
+#ifndef UDP_PROTO_H
+#define UDP_PROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+/**
+ * Binary UDP control protocol, all integers are little endian.
+ *
+ * Header (UDP_PROTO_HEADER_SIZE bytes):
+ *   magic (uint8, UDP_PROTO_MAGIC), version (uint8, UDP_PROTO_VERSION),
+ *   type (uint8, enum udp_proto_type), status (uint8, enum
+ *   udp_proto_status, 0 in the requests), seq (uint32).
+ * Followed by the duty records (UDP_PROTO_RECORD_SIZE bytes each):
+ *   PWM id (uint8), duty (uint16).
+ *
+ * The record count is given by the packet length.
+ */
+#define UDP_PROTO_MAGIC 0xD7
+#define UDP_PROTO_VERSION 1
+#define UDP_PROTO_HEADER_SIZE 8
+#define UDP_PROTO_RECORD_SIZE 3
+
+/**
+ * @brief UDP_PROTO_MAX_RECORDS is the max number of duty records in a
+ * packet.
+ */
+#define UDP_PROTO_MAX_RECORDS 8
+
+#define UDP_PROTO_MAX_PACKET_SIZE \
+	(UDP_PROTO_HEADER_SIZE + UDP_PROTO_RECORD_SIZE * UDP_PROTO_MAX_RECORDS)
+
+/**
+ * @brief udp_proto_type is the packet type.
+ */
+enum udp_proto_type {
+	UDP_PROTO_SET_DUTY = 1, // set the duty of the records
+	UDP_PROTO_GET_DUTY = 2, // query the duties, no records
+	UDP_PROTO_ACK = 3,      // reply with the current duties
+};
+
+/**
+ * @brief udp_proto_status is the result of the request in the ack.
+ */
+enum udp_proto_status {
+	UDP_PROTO_STATUS_OK = 0,
+	UDP_PROTO_STATUS_INVALID = 1, // duty rejected, nothing applied
+	UDP_PROTO_STATUS_FAILED = 2,  // failed to apply the duty
+};
+
+struct udp_proto_duty {
+	uint8_t pwm;
+	uint16_t duty;
+};
+
+/**
+ * @brief udp_proto_packet is the decoded packet.
+ */
+struct udp_proto_packet {
+	uint8_t type;
+	uint8_t status;
+	uint32_t seq;
+	uint8_t count;
+	struct udp_proto_duty duties[UDP_PROTO_MAX_RECORDS];
+};
+
+/**
+ * @brief udp_proto_decode decodes and checks a received packet.
+ *
+ * @param buffer
+ * @param length
+ * @param packet [out]
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_INVALID_VERSION if the magic or version does not match.
+ * @return ESP_ERR_INVALID_SIZE if the length is not a valid packet size.
+ * @return ESP_ERR_INVALID_ARG if the type is unknown.
+ */
+esp_err_t udp_proto_decode(
+	const uint8_t *buffer, size_t length, struct udp_proto_packet *packet);
+
+/**
+ * @brief udp_proto_encode encodes the packet into the buffer.
+ *
+ * @param packet
+ * @param buffer
+ * @param size buffer size, UDP_PROTO_MAX_PACKET_SIZE is always enough
+ * @return length of the encoded packet, 0 if the buffer is too small or
+ * the packet is invalid.
+ */
+size_t udp_proto_encode(
+	const struct udp_proto_packet *packet, uint8_t *buffer, size_t size);
+
+/**
+ * @brief udp_proto_seq_newer checks if the sequence number is newer than
+ * the last one, the sequence numbers wrap around.
+ *
+ * @param seq
+ * @param last
+ * @return bool
+ */
+bool udp_proto_seq_newer(uint32_t seq, uint32_t last);
+
+#endif // UDP_PROTO_H
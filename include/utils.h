@@ -40,4 +40,13 @@ char* str_clone(const char *const value);
  */
 esp_ip4_addr_t str2ipv4(const char *const value);
 
+/**
+ * @brief crc32 calculates the CRC-32 (IEEE 802.3, same as zlib) checksum.
+ *
+ * @param data
+ * @param length
+ * @return uint32_t
+ */
+uint32_t crc32(const void *data, size_t length);
+
 #endif
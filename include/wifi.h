@@ -6,4 +6,12 @@
 
 esp_err_t init_controller_wifi_softap(struct config *);
 
+/**
+ * @brief controller_wifi_station_count gets the number of stations
+ * connected to the soft AP.
+ *
+ * @return int
+ */
+int controller_wifi_station_count();
+
 #endif
@@ -0,0 +1,35 @@
+#ifndef WS_H
+#define WS_H
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/**
+ * @brief WS_DUTY_RECORD_SIZE is the size of a duty record in the binary
+ * websocket frames: PWM id (uint8) and duty (uint16, little endian).
+ */
+#define WS_DUTY_RECORD_SIZE 3
+
+/**
+ * @brief WS_PERSIST_IDLE_MS is the idle time after the last duty frame
+ * before the config is saved.
+ */
+#define WS_PERSIST_IDLE_MS 3000
+
+/**
+ * @brief register_ws_handler registers the '/ws' websocket handler for
+ * the live duty control.
+ *
+ * Each binary frame from the client holds one or more duty records, the
+ * duty is posted to the controller tick without waiting for the config
+ * to be saved. The server replies a binary
+ * frame with the duty records of all PWM outputs after applying.
+ * The config is saved after the duty frames are idle for
+ * WS_PERSIST_IDLE_MS.
+ *
+ * @param server
+ * @return esp_err_t
+ */
+esp_err_t register_ws_handler(httpd_handle_t server);
+
+#endif // WS_H
@@ -0,0 +1,492 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "api.h"
+#include "config.h"
+#include "controller.h"
+#include "json.h"
+#include "server.h"
+#include "arena.h"
+#include "traffic.h"
+#include "page.h"
+
+#define TAG "API"
+
+// The body is received into the request arena.
+_Static_assert(API_BODY_MAX_SIZE + ARENA_ALIGN <= HTTP_ARENA_SIZE,
+	"HTTP_ARENA_SIZE too small for the request body");
+
+// A body not received within the limits is answered with 408, so a slow
+// client can not hold the server task.
+#define API_RECV_MAX_RETRIES 1
+#define API_RECV_TIMEOUT_US (5 * 1000 * 1000)
+
+/**
+ * @brief settings_json_cache keeps the rendered settings JSON of the
+ * config generation, so repeated reads don't need to render again.
+ * The pages with the state slot read it from the async workers, so it is
+ * protected by the lock.
+ */
+static struct {
+	SemaphoreHandle_t lock;
+	bool valid;
+	uint32_t generation;
+	size_t length;
+	char data[API_SETTINGS_JSON_SIZE];
+} settings_json_cache;
+
+static esp_err_t settings_json_cache_writer(
+	void *ctx, const char *data, size_t length
+) {
+	if (settings_json_cache.length + length >
+		sizeof(settings_json_cache.data)) {
+		return ESP_ERR_NO_MEM;
+	}
+	memcpy(settings_json_cache.data + settings_json_cache.length,
+		data, length);
+	settings_json_cache.length += length;
+	return ESP_OK;
+}
+
+static esp_err_t settings_json_chunk_writer(
+	void *ctx, const char *data, size_t length
+) {
+	return httpd_resp_send_chunk((httpd_req_t*) ctx, data, length);
+}
+
+/**
+ * @brief settings_json_cache_render renders the cache again if the config
+ * generation changed, the cache lock must be held.
+ *
+ * @return ESP_OK if the cache is valid.
+ * @return ESP_ERR_NO_MEM if the JSON does not fit into the cache.
+ * @return ESP_FAIL if failed.
+ */
+static esp_err_t settings_json_cache_render()
+{
+	uint32_t generation = global_controller_config_generation();
+	if (settings_json_cache.valid &&
+		settings_json_cache.generation == generation) {
+		return ESP_OK;
+	}
+	settings_json_cache.valid = false;
+	settings_json_cache.length = 0;
+	esp_err_t ret = global_controller_config_marshal_json(
+		settings_json_cache_writer, NULL);
+	if (ret == ESP_OK) {
+		settings_json_cache.valid = true;
+		settings_json_cache.generation = generation;
+	}
+	return ret;
+}
+
+/**
+ * @brief send_settings_json_locked sends the config JSON, the cache lock
+ * must be held.
+ */
+static esp_err_t send_settings_json_locked(
+	httpd_req_t *req, const char *prefix, const char *suffix
+) {
+	esp_err_t ret = settings_json_cache_render();
+	bool chunked = prefix != NULL || suffix != NULL;
+	if (settings_json_cache.valid && !chunked) {
+		return httpd_resp_send(req, settings_json_cache.data,
+			settings_json_cache.length);
+	}
+	if (!settings_json_cache.valid && ret != ESP_ERR_NO_MEM) {
+		return httpd_resp_send_err(
+			req,
+			HTTPD_500_INTERNAL_SERVER_ERROR,
+			"500: config_marshal_json failed"
+		);
+	}
+
+	if (prefix != NULL &&
+		(ret = httpd_resp_sendstr_chunk(req, prefix)) != ESP_OK) {
+		return ret;
+	}
+	if (settings_json_cache.valid) {
+		ret = httpd_resp_send_chunk(req, settings_json_cache.data,
+			settings_json_cache.length);
+	} else {
+		ESP_LOGW(TAG, "send_settings_json: "
+			"cache too small, send in chunks");
+		ret = global_controller_config_marshal_json(
+			settings_json_chunk_writer, req);
+	}
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "send_settings_json: "
+			"config_marshal_json failed: %d", ret);
+		return ret;
+	}
+	if (suffix != NULL &&
+		(ret = httpd_resp_sendstr_chunk(req, suffix)) != ESP_OK) {
+		return ret;
+	}
+	return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/**
+ * @brief send_settings_json sends the config JSON from the cache, the cache
+ * is rendered again if the config generation changed.
+ * If the prefix or the suffix is provided, or the JSON does not fit into
+ * the cache, the JSON is sent in http chunks.
+ *
+ * @param req
+ * @param prefix data sent before the JSON, nullable
+ * @param suffix data sent after the JSON, nullable
+ * @return esp_err_t
+ */
+static esp_err_t send_settings_json(
+	httpd_req_t *req, const char *prefix, const char *suffix
+) {
+	xSemaphoreTake(settings_json_cache.lock, portMAX_DELAY);
+	esp_err_t ret = send_settings_json_locked(req, prefix, suffix);
+	xSemaphoreGive(settings_json_cache.lock);
+	return ret;
+}
+
+esp_err_t api_copy_settings_json(char *buffer, size_t size, size_t *length)
+{
+	if (buffer == NULL || length == NULL ||
+		settings_json_cache.lock == NULL) {
+		ESP_LOGE(TAG, "api_copy_settings_json: invalid param");
+		return ESP_FAIL;
+	}
+	xSemaphoreTake(settings_json_cache.lock, portMAX_DELAY);
+	esp_err_t ret = settings_json_cache_render();
+	if (ret == ESP_OK && settings_json_cache.length > size) {
+		ret = ESP_ERR_NO_MEM;
+	}
+	if (ret == ESP_OK) {
+		memcpy(buffer, settings_json_cache.data,
+			settings_json_cache.length);
+		*length = settings_json_cache.length;
+	}
+	xSemaphoreGive(settings_json_cache.lock);
+	return ret;
+}
+
+esp_err_t api_send_settings_json(httpd_req_t *req)
+{
+	int ret = httpd_resp_set_type(req, "application/json");
+	if (ret != ESP_OK) {
+		return ret;
+	}
+	return send_settings_json(req, NULL, NULL);
+}
+
+/**
+ * @brief api_send_error sends the JSON error message with the status.
+ *
+ * @param req
+ * @param status http status line, such as '400 Bad Request'
+ * @param message error message, must not contain characters need escaping
+ * @return esp_err_t
+ */
+static esp_err_t api_send_error(
+	httpd_req_t *req, const char *status, const char *message
+) {
+	char body[96];
+	snprintf(body, sizeof(body), "{\"error\": \"%s\"}\n", message);
+	httpd_resp_set_status(req, status);
+	httpd_resp_set_type(req, "application/json");
+	return httpd_resp_sendstr(req, body);
+}
+
+/**
+ * @brief api_format_traffic formats the statistics of the request classes.
+ */
+static int api_format_traffic(char *buffer, size_t size)
+{
+	int n = snprintf(buffer, size, "\"traffic\": {");
+	for (int class = 0; class < TRAFFIC_CLASS_MAX && (size_t) n < size; class++) {
+		struct traffic_stats stats;
+		traffic_get_stats(class, &stats);
+		uint32_t latency_avg = stats.requests == 0 ? 0 :
+			stats.latency_us / stats.requests;
+		n += snprintf(buffer + n, size - n,
+			"%s\"%s\": {\"requests\": %u, \"active\": %u, "
+			"\"active_max\": %u, \"evicted\": %u, \"refused\": %u, "
+			"\"latency_avg_us\": %u, \"latency_max_us\": %u}",
+			class == 0 ? "" : ", ", traffic_class_name(class),
+			(unsigned int) stats.requests,
+			(unsigned int) stats.active,
+			(unsigned int) stats.active_max,
+			(unsigned int) stats.evicted,
+			(unsigned int) stats.refused,
+			(unsigned int) latency_avg,
+			(unsigned int) stats.latency_max_us);
+	}
+	if ((size_t) n < size) {
+		n += snprintf(buffer + n, size - n, "}");
+	}
+	return n;
+}
+
+/**
+ * @brief api_send_state sends the controller state with the settings.
+ */
+static esp_err_t api_send_state(httpd_req_t *req)
+{
+	struct arena_stats arena;
+	http_arena_get_stats(&arena);
+	struct page_stats pages;
+	page_get_stats(&pages);
+	uint32_t renders = pages.renders > 0 ? pages.renders : 1;
+	char prefix[768];
+	int n = snprintf(prefix, sizeof(prefix),
+		"{\n\"generation\": %u,\n\"uptime_ms\": %lld,\n"
+		"\"arena\": {\"size\": %u, \"high_water\": %u, "
+		"\"failures\": %u},\n"
+		"\"pages\": {\"renders\": %u, \"first_byte_avg_us\": %u, "
+		"\"first_byte_max_us\": %u, \"render_avg_us\": %u},\n",
+		(unsigned int) global_controller_config_generation(),
+		(long long) (esp_timer_get_time() / 1000),
+		(unsigned int) arena.size, (unsigned int) arena.high_water,
+		(unsigned int) arena.failures,
+		(unsigned int) pages.renders,
+		(unsigned int) (pages.first_byte_us / renders),
+		(unsigned int) pages.first_byte_max_us,
+		(unsigned int) (pages.render_us / renders));
+	if ((size_t) n < sizeof(prefix)) {
+		n += api_format_traffic(prefix + n, sizeof(prefix) - n);
+	}
+	if ((size_t) n < sizeof(prefix)) {
+		n += snprintf(prefix + n, sizeof(prefix) - n,
+			",\n\"settings\": ");
+	}
+	if ((size_t) n >= sizeof(prefix)) {
+		return api_send_error(req, "500 Internal Server Error",
+			"state too large");
+	}
+	int ret = httpd_resp_set_type(req, "application/json");
+	if (ret != ESP_OK) {
+		return ret;
+	}
+	// Dynamic state, must not be cached by the client.
+	httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+	return send_settings_json(req, prefix, "}\n");
+}
+
+/**
+ * @brief handle GET '/api/state' request, it only reads the state.
+ */
+static esp_err_t handle_api_state(httpd_req_t *req)
+{
+	return api_send_state(req);
+}
+
+/**
+ * @brief settings update request context.
+ */
+struct api_settings_ctx {
+	char *body;
+	size_t length;
+	struct config *staged;
+	const char *error; // error message of the failed member
+	char error_buffer[64];
+};
+
+static esp_err_t api_set_setting(
+	const char *key, const char *value, void *ctx
+) {
+	struct api_settings_ctx *c = ctx;
+	const struct config_schema *schema = config_schema_lookup(key);
+	if (schema == NULL || !(schema->flags & CONFIG_FLAG_QUERY)) {
+		c->error = "unknown or read-only setting";
+		return ESP_ERR_NOT_FOUND;
+	}
+	if (strcmp(value, "true") == 0) {
+		value = "1";
+	} else if (strcmp(value, "false") == 0) {
+		value = "0";
+	}
+	// The value is rejected instead of being reset to the default.
+	if (config_parse_value(c->staged, key, value) != ESP_OK) {
+		// The schema key needs no escaping in the error message.
+		snprintf(c->error_buffer, sizeof(c->error_buffer),
+			"invalid value of %s", schema->key);
+		c->error = c->error_buffer;
+		return ESP_ERR_INVALID_ARG;
+	}
+	ESP_LOGI(TAG, "api settings: %s=%s", key, value);
+	return ESP_OK;
+}
+
+static esp_err_t api_stage_settings(struct config *staged, void *ctx)
+{
+	struct api_settings_ctx *c = ctx;
+	c->staged = staged;
+	esp_err_t ret = json_parse_object(
+		c->body, c->length, api_set_setting, c);
+	if (ret == ESP_ERR_INVALID_ARG && c->error == NULL) {
+		c->error = "invalid JSON object";
+	}
+	return ret;
+}
+
+/**
+ * @brief api_recv_body receives the request body into a buffer allocated
+ * from the request arena.
+ *
+ * @param req
+ * @param arena
+ * @param body [out] body buffer, released with the arena
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_TIMEOUT if the body is not received in time.
+ * @return ESP_ERR_NO_MEM or ESP_FAIL if failed.
+ */
+static esp_err_t api_recv_body(
+	httpd_req_t *req, struct arena *arena, char **body
+) {
+	size_t length = req->content_len;
+	char *buffer = arena_alloc(arena, length + 1);
+	if (buffer == NULL) {
+		return ESP_ERR_NO_MEM;
+	}
+	size_t received = 0;
+	int retries = 0;
+	int64_t deadline = esp_timer_get_time() + API_RECV_TIMEOUT_US;
+	while (received < length) {
+		if (esp_timer_get_time() > deadline) {
+			return ESP_ERR_TIMEOUT;
+		}
+		int n = httpd_req_recv(req, buffer + received, length - received);
+		if (n == HTTPD_SOCK_ERR_TIMEOUT) {
+			if (++retries > API_RECV_MAX_RETRIES) {
+				return ESP_ERR_TIMEOUT;
+			}
+			continue;
+		}
+		if (n <= 0) {
+			return ESP_FAIL;
+		}
+		received += n;
+	}
+	buffer[length] = '\0';
+	*body = buffer;
+	return ESP_OK;
+}
+
+/**
+ * @brief handle PATCH '/api/settings' request.
+ * The JSON object in the body is applied as one batch, either all settings
+ * are updated or none of them. The response is the updated state.
+ */
+static esp_err_t handle_api_settings(httpd_req_t *req)
+{
+	if (req->content_len == 0) {
+		return api_send_error(req, "400 Bad Request", "empty body");
+	}
+	if (req->content_len > API_BODY_MAX_SIZE) {
+		return api_send_error(req, "413 Payload Too Large",
+			"body too large");
+	}
+	struct api_settings_ctx ctx = { 0 };
+	struct arena *arena = http_req_arena(req);
+	size_t mark = arena_mark(arena);
+	esp_err_t ret = api_recv_body(req, arena, &ctx.body);
+	if (ret == ESP_ERR_TIMEOUT) {
+		arena_rewind(arena, mark);
+		ESP_LOGW(TAG, "handle_api_settings: body timeout");
+		api_send_error(req, "408 Request Timeout", "body timeout");
+		// Close the connection, the rest of the body is not read.
+		return ESP_FAIL;
+	}
+	if (ret != ESP_OK) {
+		arena_rewind(arena, mark);
+		ESP_LOGE(TAG, "handle_api_settings: "
+			"failed to receive body: %d", ret);
+		return ESP_FAIL;
+	}
+	ctx.length = req->content_len;
+	ret = global_controller_update_config_batch(api_stage_settings, &ctx);
+	arena_rewind(arena, mark);
+	if (ret == ESP_ERR_INVALID_ARG || ret == ESP_ERR_NOT_FOUND) {
+		return api_send_error(req, "400 Bad Request", ctx.error);
+	}
+	if (ret != ESP_OK) {
+		return api_send_error(req, "500 Internal Server Error",
+			"failed to update settings");
+	}
+	return api_send_state(req);
+}
+
+/**
+ * @brief handle POST '/api/restart' request.
+ */
+static esp_err_t handle_api_restart(httpd_req_t *req)
+{
+	httpd_resp_set_type(req, "application/json");
+	int ret = httpd_resp_sendstr(req, "{\"restart\": true}\n");
+	global_controller_stop();
+	return ret;
+}
+
+/**
+ * @brief handle POST '/api/reset' request, the response is the state with
+ * the default settings.
+ */
+static esp_err_t handle_api_reset(httpd_req_t *req)
+{
+	if (global_controller_reset_default() != ESP_OK) {
+		return api_send_error(req, "500 Internal Server Error",
+			"failed to reset settings");
+	}
+	return api_send_state(req);
+}
+
+static const httpd_uri_t api_handlers[API_MAX_URI_HANDLERS] = {
+	{
+		.uri = "/api/state",
+		.method = HTTP_GET,
+		.handler = handle_api_state,
+	},
+	{
+		.uri = "/api/settings",
+		.method = HTTP_PATCH,
+		.handler = handle_api_settings,
+	},
+	{
+		.uri = "/api/restart",
+		.method = HTTP_POST,
+		.handler = handle_api_restart,
+	},
+	{
+		.uri = "/api/reset",
+		.method = HTTP_POST,
+		.handler = handle_api_reset,
+	},
+};
+
+esp_err_t register_api_handlers(httpd_handle_t server)
+{
+	if (settings_json_cache.lock == NULL) {
+		settings_json_cache.lock = xSemaphoreCreateMutex();
+		if (settings_json_cache.lock == NULL) {
+			ESP_LOGE(TAG, "register_api_handlers: "
+				"create mutex failed");
+			return ESP_FAIL;
+		}
+	}
+	for (int i = 0; i < API_MAX_URI_HANDLERS; i++) {
+		esp_err_t ret = traffic_register_uri_handler(
+			server, &api_handlers[i], TRAFFIC_CONTROL);
+		if (ret != ESP_OK) {
+			ESP_LOGE(TAG, "register_api_handlers: "
+				"register %s failed: [%d]",
+				api_handlers[i].uri, ret);
+			return ret;
+		}
+	}
+	return ESP_OK;
+}
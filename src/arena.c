@@ -0,0 +1,53 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+esp_err_t arena_init(struct arena *arena, size_t size)
+{
+	if (arena == NULL || size == 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	memset(arena, 0, sizeof(struct arena));
+	arena->base = malloc(size);
+	if (arena->base == NULL) {
+		return ESP_ERR_NO_MEM;
+	}
+	arena->size = size;
+	return ESP_OK;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	if (arena == NULL || arena->base == NULL) {
+		return NULL;
+	}
+	size_t aligned = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+	if (aligned < size || aligned > arena->size - arena->used) {
+		arena->failures++;
+		return NULL;
+	}
+	void *p = arena->base + arena->used;
+	arena->used += aligned;
+	if (arena->used > arena->high_water) {
+		arena->high_water = arena->used;
+	}
+	return p;
+}
+
+size_t arena_mark(const struct arena *arena)
+{
+	return arena != NULL ? arena->used : 0;
+}
+
+void arena_rewind(struct arena *arena, size_t mark)
+{
+	if (arena != NULL && mark <= arena->used) {
+		arena->used = mark;
+	}
+}
+
+void arena_reset(struct arena *arena)
+{
+	arena_rewind(arena, 0);
+}
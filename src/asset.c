@@ -0,0 +1,398 @@
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "asset.h"
+#include "storage.h"
+
+#define TAG "ASSET"
+
+/**
+ * @brief cached asset entry.
+ */
+struct asset_entry {
+	uint32_t hash;  // hash of the URI path
+	char *path;     // URI path
+	bool gzip;      // looked up with gzip accepted
+	struct asset asset;
+};
+
+/**
+ * @brief ETag of a file in the asset manifest.
+ */
+struct asset_manifest_entry {
+	uint32_t hash;  // hash of the file path
+	uint32_t etag;  // crc32 of the file content
+	char *path;     // file path under the base path
+};
+
+/**
+ * @brief private asset cache state.
+ */
+static struct {
+	char base_path[16];
+	SemaphoreHandle_t lock; // serializes the cache updates
+	struct asset_entry entries[ASSET_CACHE_MAX_ENTRIES];
+	struct asset_stats stats;
+	struct asset_manifest_entry manifest[ASSET_MANIFEST_MAX_ENTRIES];
+	int manifest_entries;
+} cache;
+
+/**
+ * @brief asset_mime_types maps the file extensions to the MIME types.
+ */
+static const struct {
+	const char *ext;
+	const char *mime;
+} asset_mime_types[] = {
+	{ ".html", "text/html" },
+	{ ".css", "text/css" },
+	{ ".js", "application/javascript" },
+	{ ".json", "application/json" },
+	{ ".svg", "image/svg+xml" },
+	{ ".ico", "image/x-icon" },
+	{ ".png", "image/png" },
+	{ ".jpg", "image/jpeg" },
+	{ ".jpeg", "image/jpeg" },
+	{ ".pdf", "application/pdf" },
+};
+
+const char *asset_mime_type(const char *filename)
+{
+	const char *ext = strrchr(filename, '.');
+	if (ext == NULL || strchr(ext, '/') != NULL) {
+		return "text/plain";
+	}
+	for (size_t i = 0; i < sizeof(asset_mime_types) /
+		sizeof(asset_mime_types[0]); i++) {
+		if (strcasecmp(ext, asset_mime_types[i].ext) == 0) {
+			return asset_mime_types[i].mime;
+		}
+	}
+	return "text/plain";
+}
+
+/**
+ * @brief asset_hash is the FNV-1a hash of the path.
+ */
+static uint32_t asset_hash(const char *path)
+{
+	uint32_t hash = 2166136261u;
+	while (*path) {
+		hash ^= (uint8_t) *path++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static struct asset_entry *asset_cache_find(
+	const char *path, uint32_t hash, bool gzip
+) {
+	for (uint32_t i = 0; i < cache.stats.entries; i++) {
+		struct asset_entry *entry = &cache.entries[i];
+		if (entry->hash == hash && entry->gzip == gzip &&
+			strcmp(entry->path, path) == 0) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief asset_manifest_find finds the ETag of the file in the manifest.
+ */
+static struct asset_manifest_entry *asset_manifest_find(const char *path)
+{
+	uint32_t hash = asset_hash(path);
+	for (int i = 0; i < cache.manifest_entries; i++) {
+		struct asset_manifest_entry *entry = &cache.manifest[i];
+		if (entry->hash == hash && strcmp(entry->path, path) == 0) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief asset_load_manifest loads the ETag manifest generated by
+ * tools/build_assets.py, lines of '<crc32 hex> <path>'.
+ */
+static void asset_load_manifest()
+{
+	char filepath[ASSET_PATH_MAX_LEN];
+	snprintf(filepath, sizeof(filepath), "%s/%s",
+		cache.base_path, ASSET_MANIFEST_FILE);
+	FILE *fd = fopen(filepath, "r");
+	if (fd == NULL) {
+		ESP_LOGW(TAG, "%s not found, ETag disabled", filepath);
+		return;
+	}
+	char line[ASSET_PATH_MAX_LEN + 16];
+	char path[ASSET_PATH_MAX_LEN];
+	unsigned int etag = 0;
+	while (fgets(line, sizeof(line), fd) != NULL &&
+		cache.manifest_entries < ASSET_MANIFEST_MAX_ENTRIES) {
+		if (sscanf(line, "%8x %63s", &etag, path) != 2 ||
+			asset_manifest_find(path) != NULL) {
+			continue;
+		}
+		char *key = strdup(path);
+		if (key == NULL) {
+			break;
+		}
+		struct asset_manifest_entry *entry =
+			&cache.manifest[cache.manifest_entries++];
+		entry->hash = asset_hash(path);
+		entry->etag = etag;
+		entry->path = key;
+	}
+	fclose(fd);
+	ESP_LOGI(TAG, "loaded [%d] asset ETags", cache.manifest_entries);
+}
+
+/**
+ * @brief asset_resolve resolves the URI path to the file path under the
+ * base path, the path of a directory is resolved to the index.html under
+ * it, the '.gz' variant is preferred if gzip is accepted.
+ * Files are resolved by the manifest if it is loaded, so the file system
+ * is not accessed.
+ *
+ * @param path URI path
+ * @param gzip gzip accepted
+ * @param filepath [out] file path, size of ASSET_PATH_MAX_LEN
+ * @param asset [out] mime, gzip & etag of the asset
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_NOT_FOUND if the file does not exist.
+ */
+static esp_err_t asset_resolve(
+	const char *path, bool gzip, char *filepath, struct asset *asset
+) {
+	size_t base = strlen(cache.base_path);
+	char *name = filepath + base;
+	size_t size = ASSET_PATH_MAX_LEN - base;
+	strcpy(filepath, cache.base_path);
+
+	int n = snprintf(name, size, "%s", path);
+	if (n < 0 || (size_t) n >= size) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	bool manifest = cache.manifest_entries > 0;
+	struct asset_manifest_entry *entry = NULL;
+	bool found = manifest ? (entry = asset_manifest_find(name)) != NULL
+		: is_regular_file(filepath);
+	if (!found) {
+		// the filepath may not exists or maybe a directory.
+		if (n > 0 && name[n-1] == '/') {
+			name[--n] = '\0';
+		}
+		int m = snprintf(name + n, size - n, "/index.html");
+		if (m < 0 || (size_t) m >= size - n) {
+			return ESP_ERR_NOT_FOUND;
+		}
+		n += m;
+		if (manifest &&
+			(entry = asset_manifest_find(name)) == NULL) {
+			return ESP_ERR_NOT_FOUND;
+		}
+	}
+	asset->mime = asset_mime_type(name);
+	asset->gzip = false;
+	asset->etag = entry != NULL ? entry->etag : 0;
+	if (!gzip || n + sizeof(ASSET_GZIP_SUFFIX) > size) {
+		return ESP_OK;
+	}
+
+	strcpy(name + n, ASSET_GZIP_SUFFIX);
+	if (manifest) {
+		struct asset_manifest_entry *gz = asset_manifest_find(name);
+		if (gz != NULL) {
+			asset->gzip = true;
+			asset->etag = gz->etag;
+		}
+	} else {
+		asset->gzip = is_regular_file(filepath);
+	}
+	if (!asset->gzip) {
+		name[n] = '\0';
+	}
+	return ESP_OK;
+}
+
+/**
+ * @brief asset_load reads the asset from the file system, files larger
+ * than ASSET_CACHE_MAX_FILE_SIZE are not read but streamed by the caller.
+ */
+static esp_err_t asset_load(const char *path, bool gzip, struct asset *asset)
+{
+	char *filepath = asset->file;
+	esp_err_t ret = asset_resolve(path, gzip, filepath, asset);
+	if (ret != ESP_OK) {
+		return ret;
+	}
+	struct stat st;
+	if (stat(filepath, &st) != 0) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	asset->cached = false;
+	if (st.st_size > ASSET_CACHE_MAX_FILE_SIZE) {
+		asset->data = NULL;
+		asset->length = st.st_size;
+		return ESP_OK;
+	}
+	char *content = NULL;
+	int size = read_file(&content, filepath);
+	if (content == NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	asset->data = content;
+	asset->length = size;
+	asset->cached = false;
+	return ESP_OK;
+}
+
+esp_err_t asset_etag(const char *path, bool gzip, uint32_t *etag)
+{
+	if (path == NULL || etag == NULL || cache.manifest_entries == 0) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	char filepath[ASSET_PATH_MAX_LEN];
+	struct asset asset = { 0 };
+	esp_err_t ret = asset_resolve(path, gzip, filepath, &asset);
+	if (ret != ESP_OK) {
+		return ret;
+	}
+	*etag = asset.etag;
+	return ESP_OK;
+}
+
+bool asset_exists(const char *path)
+{
+	if (path == NULL || cache.lock == NULL) {
+		return false;
+	}
+	char filepath[ASSET_PATH_MAX_LEN];
+	struct asset asset = { 0 };
+	return asset_resolve(path, false, filepath, &asset) == ESP_OK;
+}
+
+esp_err_t init_asset_cache(const char *base_path)
+{
+	if (base_path == NULL || strlen(base_path) >= sizeof(cache.base_path)) {
+		ESP_LOGE(TAG, "init_asset_cache: invalid param");
+		return ESP_FAIL;
+	}
+	if (cache.lock == NULL) {
+		cache.lock = xSemaphoreCreateMutex();
+		if (cache.lock == NULL) {
+			ESP_LOGE(TAG, "init_asset_cache: create mutex failed");
+			return ESP_FAIL;
+		}
+	}
+	strcpy(cache.base_path, base_path);
+	if (cache.manifest_entries == 0) {
+		asset_load_manifest();
+	}
+	return ESP_OK;
+}
+
+esp_err_t asset_cache_get(const char *path, bool gzip, struct asset *asset)
+{
+	if (path == NULL || asset == NULL || cache.lock == NULL) {
+		ESP_LOGE(TAG, "asset_cache_get: invalid param");
+		return ESP_FAIL;
+	}
+	int64_t start = esp_timer_get_time();
+	uint32_t hash = asset_hash(path);
+	xSemaphoreTake(cache.lock, portMAX_DELAY);
+	struct asset_entry *entry = asset_cache_find(path, hash, gzip);
+	if (entry != NULL) {
+		*asset = entry->asset;
+		cache.stats.hits++;
+		cache.stats.hit_us += esp_timer_get_time() - start;
+		xSemaphoreGive(cache.lock);
+		return ESP_OK;
+	}
+
+	xSemaphoreGive(cache.lock);
+
+	// Loaded without the lock, the lookups of the server task don't wait
+	// for the file system.
+	esp_err_t ret = asset_load(path, gzip, asset);
+
+	xSemaphoreTake(cache.lock, portMAX_DELAY);
+	if (ret == ESP_OK && asset->data == NULL) {
+		cache.stats.streams++;
+	} else if (ret == ESP_OK &&
+		(entry = asset_cache_find(path, hash, gzip)) != NULL) {
+		// Cached by a concurrent miss of the same asset.
+		asset_release(asset);
+		*asset = entry->asset;
+	} else if (ret == ESP_OK &&
+		cache.stats.entries < ASSET_CACHE_MAX_ENTRIES &&
+		cache.stats.size + asset->length <= ASSET_CACHE_MAX_SIZE) {
+		char *key = strdup(path);
+		if (key != NULL) {
+			entry = &cache.entries[cache.stats.entries++];
+			entry->hash = hash;
+			entry->path = key;
+			entry->gzip = gzip;
+			entry->asset = *asset;
+			entry->asset.cached = true;
+			asset->cached = true;
+			cache.stats.size += asset->length;
+			ESP_LOGD(TAG, "cached %s: size [%u]", path,
+				(unsigned int) asset->length);
+		}
+	}
+	cache.stats.misses++;
+	cache.stats.miss_us += esp_timer_get_time() - start;
+	xSemaphoreGive(cache.lock);
+	return ret;
+}
+
+esp_err_t asset_cache_lookup(const char *path, bool gzip, struct asset *asset)
+{
+	if (path == NULL || asset == NULL || cache.lock == NULL) {
+		ESP_LOGE(TAG, "asset_cache_lookup: invalid param");
+		return ESP_FAIL;
+	}
+	int64_t start = esp_timer_get_time();
+	uint32_t hash = asset_hash(path);
+	esp_err_t ret = ESP_ERR_NOT_FOUND;
+	xSemaphoreTake(cache.lock, portMAX_DELAY);
+	struct asset_entry *entry = asset_cache_find(path, hash, gzip);
+	if (entry != NULL) {
+		*asset = entry->asset;
+		cache.stats.hits++;
+		cache.stats.hit_us += esp_timer_get_time() - start;
+		ret = ESP_OK;
+	}
+	xSemaphoreGive(cache.lock);
+	return ret;
+}
+
+void asset_release(struct asset *asset)
+{
+	if (asset == NULL || asset->cached || asset->data == NULL) {
+		return;
+	}
+	free((char*) asset->data);
+	asset->data = NULL;
+	asset->length = 0;
+}
+
+void asset_cache_get_stats(struct asset_stats *stats)
+{
+	if (stats == NULL) {
+		return;
+	}
+	memcpy(stats, &cache.stats, sizeof(struct asset_stats));
+}
@@ -1,5 +1,10 @@
 #include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <esp_log.h>
 #include <esp_err.h>
@@ -9,53 +14,360 @@
 #include "utils.h"
 
 #define TAG "CONFIG"
-#define BUFF_SIZE (128 * sizeof(char))
+#define CONFIG_LINE_SIZE 128
 
 /**
- * @brief new_config_by_config_file_data will parse the config file data,
- * if the config value in the data is invalid, it will be reset to the
+ * @brief new_config_by_parse_file builds config struct object from the
+ * config file. The file is read by a fixed size stack buffer and parsed line
+ * by line in place, no heap memory is allocated while parsing.
+ * If the config value in the file is invalid, it will be reset to the
  * default value.
- * This function will ensure the returned config is a valid config object.
  *
- * @param data config file data
- * @param length config file data length
- * @return const struct config*
+ * @param filename config file path
+ * @return struct config*, NULL if failed to read the file.
  */
-struct config* new_config_by_config_file_data(
-	const char *data,
-	int length
-);
+static struct config* new_config_by_parse_file(const char *filename);
 
 bool is_valid_config_value(char c);
 
 struct config* new_config_by_load_file()
 {
-	char *content = NULL;
-	int ret = read_file(&content, CONFIG_FILE);
-	if (content == NULL || ret <= 0) {
-		ESP_LOGE(TAG, "failed to open config %s: %d",
-			CONFIG_FILE, ret);
+	return new_config_by_parse_file(CONFIG_FILE);
+}
+
+struct config* new_config_by_load_default_file()
+{
+	return new_config_by_parse_file(CONFIG_FILE_DEFAULT);
+}
+
+#define CONFIG_FILE_MAX_SIZE 1024
+#define CONFIG_VALUE_SIZE 72
+#define CONFIG_JSON_BUFFER_SIZE 128
+
+#ifndef MIN
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#endif
+
+#define CONFIG_SCHEMA_SLOTS 32
+
+#define CONFIG_SCHEMA_NUM(_id, _key, _type, _field, \
+	_flags, _min, _max, _def) \
+	[_id] = { \
+		.key = _key, .id = _id, .type = _type, \
+		.offset = offsetof(struct config, _field), .flags = _flags, \
+		.min = _min, .max = _max, .def = _def, .def_str = NULL, \
+	}
+
+#define CONFIG_SCHEMA_STR(_id, _key, _field, _flags, _min, _max, _def) \
+	[_id] = { \
+		.key = _key, .id = _id, .type = CONFIG_TYPE_STR, \
+		.offset = offsetof(struct config, _field), \
+		.flags = _flags, .min = _min, .max = _max, .def = 0, \
+		.def_str = _def, \
+	}
+
+/**
+ * @brief config_schema describes all config keys, indexed by CONFIG_ID_*.
+ */
+static const struct config_schema config_schema[CONFIG_ID_MAX] = {
+	CONFIG_SCHEMA_NUM(CONFIG_ID_PWM_FAN_CHANNEL,
+		CONFIG_KEY_PWM_FAN_CHANNEL, CONFIG_TYPE_U8,
+		pwm_fan.channel, CONFIG_FLAG_QUERY, 0, 5, 0),
+	CONFIG_SCHEMA_NUM(CONFIG_ID_PWM_FAN_FREQUENCY,
+		CONFIG_KEY_PWM_FAN_FREQUENCY, CONFIG_TYPE_U32,
+		pwm_fan.frequency, CONFIG_FLAG_QUERY, 1000, 100000, 25000),
+	CONFIG_SCHEMA_NUM(CONFIG_ID_PWM_FAN_GPIO,
+		CONFIG_KEY_PWM_FAN_GPIO, CONFIG_TYPE_U8,
+		pwm_fan.gpio, CONFIG_FLAG_QUERY, 0, 30, 4),
+	CONFIG_SCHEMA_NUM(CONFIG_ID_PWM_FAN_DUTY,
+		CONFIG_KEY_PWM_FAN_DUTY, CONFIG_TYPE_U8,
+		pwm_fan.duty,
+		CONFIG_FLAG_QUERY | CONFIG_FLAG_JOURNAL, 0, 255, 100),
+	CONFIG_SCHEMA_NUM(CONFIG_ID_PWM_FAN_DUTY_MIN,
+		CONFIG_KEY_PWM_FAN_DUTY_MIN, CONFIG_TYPE_U8,
+		pwm_fan.duty_min, 0, 0, 255, 30),
+	CONFIG_SCHEMA_NUM(CONFIG_ID_PWM_FAN_DUTY_MAX,
+		CONFIG_KEY_PWM_FAN_DUTY_MAX, CONFIG_TYPE_U8,
+		pwm_fan.duty_max, 0, 0, 255, 255),
+	CONFIG_SCHEMA_NUM(CONFIG_ID_PWM_MOS_CHANNEL,
+		CONFIG_KEY_PWM_MOS_CHANNEL, CONFIG_TYPE_U8,
+		pwm_mos.channel, CONFIG_FLAG_QUERY, 0, 5, 1),
+	CONFIG_SCHEMA_NUM(CONFIG_ID_PWM_MOS_FREQUENCY,
+		CONFIG_KEY_PWM_MOS_FREQUENCY, CONFIG_TYPE_U32,
+		pwm_mos.frequency, CONFIG_FLAG_QUERY, 1000, 100000, 25000),
+	CONFIG_SCHEMA_NUM(CONFIG_ID_PWM_MOS_GPIO,
+		CONFIG_KEY_PWM_MOS_GPIO, CONFIG_TYPE_U8,
+		pwm_mos.gpio, CONFIG_FLAG_QUERY, 0, 30, 8),
+	CONFIG_SCHEMA_NUM(CONFIG_ID_PWM_MOS_DUTY,
+		CONFIG_KEY_PWM_MOS_DUTY, CONFIG_TYPE_U8,
+		pwm_mos.duty,
+		CONFIG_FLAG_QUERY | CONFIG_FLAG_JOURNAL, 0, 255, 255),
+	CONFIG_SCHEMA_NUM(CONFIG_ID_PWM_MOS_DUTY_MIN,
+		CONFIG_KEY_PWM_MOS_DUTY_MIN, CONFIG_TYPE_U8,
+		pwm_mos.duty_min, 0, 0, 255, 26),
+	CONFIG_SCHEMA_NUM(CONFIG_ID_PWM_MOS_DUTY_MAX,
+		CONFIG_KEY_PWM_MOS_DUTY_MAX, CONFIG_TYPE_U8,
+		pwm_mos.duty_max, 0, 0, 255, 35),
+	CONFIG_SCHEMA_STR(CONFIG_ID_WIFI_SSID,
+		CONFIG_KEY_WIFI_SSID, wifi.ssid,
+		CONFIG_FLAG_QUERY, 1, CONFIG_WIFI_SSID_MAX_LEN,
+		"PWM_FAN_CONTROLLER"),
+	CONFIG_SCHEMA_STR(CONFIG_ID_WIFI_PASSWORD,
+		CONFIG_KEY_WIFI_PASSWORD, wifi.password,
+		CONFIG_FLAG_QUERY, 0, CONFIG_WIFI_PASSWORD_MAX_LEN,
+		"testpassword123"),
+	CONFIG_SCHEMA_NUM(CONFIG_ID_WIFI_CHANNEL,
+		CONFIG_KEY_WIFI_CHANNEL, CONFIG_TYPE_U8,
+		wifi.channel, CONFIG_FLAG_QUERY, 1, 11, 1),
+	CONFIG_SCHEMA_NUM(CONFIG_ID_DHCPS_IP,
+		CONFIG_KEY_DHCPS_IP, CONFIG_TYPE_IPV4,
+		dhcps.ip, CONFIG_FLAG_QUERY, 0, 0, 0x010A0A0A), // 10.10.10.1
+	CONFIG_SCHEMA_NUM(CONFIG_ID_DHCPS_NETMASK,
+		CONFIG_KEY_DHCPS_NETMASK, CONFIG_TYPE_NETMASK,
+		dhcps.netmask, CONFIG_FLAG_QUERY, 0, 0, 0x00ffffff), // 255.255.255.0
+	CONFIG_SCHEMA_NUM(CONFIG_ID_DHCPS_AS_ROUTER,
+		CONFIG_KEY_DHCPS_AS_ROUTER, CONFIG_TYPE_U8,
+		dhcps.as_router, CONFIG_FLAG_QUERY, 0, 1, 0),
+};
+
+/**
+ * @brief config_schema_slots maps the config_key_hash of every CONFIG_KEY_*
+ * to its CONFIG_ID_* index (-1 for empty slots).
+ * The hash has no collisions for the current keys, so the lookup only needs
+ * a single strcmp to verify the key.
+ * NOTE: regenerate this table with tools/config_schema_slots.py when adding
+ * or renaming config keys, the host tests check it is up to date.
+ */
+static const int8_t config_schema_slots[CONFIG_SCHEMA_SLOTS] = {
+	 5, -1,  6,  1, -1, -1, 10, -1,
+	17,  9, -1, -1, -1, -1, 12,  2,
+	11, -1,  0,  7, -1, -1,  4, -1,
+	15,  3, -1, -1, 14, 16, 13,  8,
+};
+
+static inline int config_key_hash(const char *key, size_t len)
+{
+	return (len * 2 + (uint8_t) key[5] * 8 + (uint8_t) key[len - 1])
+		& (CONFIG_SCHEMA_SLOTS - 1);
+}
+
+const struct config_schema *config_schema_lookup(const char *key)
+{
+	if (key == NULL) {
 		return NULL;
 	}
-	struct config *config = new_config_by_config_file_data(content, ret);
-	free(content);
-	content = NULL;
-	return config;
+	size_t len = strlen(key);
+	if (len < 6) {
+		return NULL;
+	}
+	int id = config_schema_slots[config_key_hash(key, len)];
+	if (id < 0 || strcmp(config_schema[id].key, key) != 0) {
+		return NULL;
+	}
+	return &config_schema[id];
 }
 
-struct config* new_config_by_load_default_file()
+const struct config_schema *config_schema_get(enum config_key_id id)
 {
-	char *content = NULL;
-	int ret = read_file(&content, CONFIG_FILE_DEFAULT);
-	if (content == NULL || ret <= 0) {
-		ESP_LOGE(TAG, "failed to open config %s: %d",
-			CONFIG_FILE_DEFAULT, ret);
+	if (id < 0 || id >= CONFIG_ID_MAX) {
 		return NULL;
 	}
-	struct config *config = new_config_by_config_file_data(content, ret);
-	free(content);
-	content = NULL;
-	return config;
+	return &config_schema[id];
+}
+
+/**
+ * @brief config_value_ptr returns the pointer to the value of the schema
+ * in the config.
+ */
+static inline void *config_value_ptr(
+	struct config *config, const struct config_schema *schema
+) {
+	return (uint8_t*) config + schema->offset;
+}
+
+/**
+ * @brief config_set_string copies the string into the inline char array of
+ * the schema, the unused bytes are cleared so the config can be compared
+ * by memcmp.
+ */
+static void config_set_string(
+	struct config *config, const struct config_schema *schema,
+	const char *value
+) {
+	char *p = config_value_ptr(config, schema);
+	size_t len = strnlen(value, schema->max);
+	memset(p, 0, schema->max + 1);
+	memcpy(p, value, len);
+}
+
+/**
+ * @brief config_value_uint reads the numeric value of the schema.
+ */
+static uint32_t config_value_uint(
+	struct config *config, const struct config_schema *schema
+) {
+	void *p = config_value_ptr(config, schema);
+	switch (schema->type) {
+	case CONFIG_TYPE_U8:
+		return *(uint8_t*) p;
+	case CONFIG_TYPE_U32:
+		return *(uint32_t*) p;
+	case CONFIG_TYPE_IPV4:
+	case CONFIG_TYPE_NETMASK:
+		return ((esp_ip4_addr_t*) p)->addr;
+	default:
+		return 0;
+	}
+}
+
+static bool is_valid_ipv4(uint32_t addr)
+{
+	// The first and the last byte of the interface addr can not be 0.
+	return (addr & 0x000000ff) && (addr & 0xff000000);
+}
+
+static bool is_valid_netmask(uint32_t addr)
+{
+	// Convert to host byte order, the mask bits should be continuous.
+	uint32_t mask = ((addr & 0x000000ff) << 24) |
+		((addr & 0x0000ff00) << 8) |
+		((addr & 0x00ff0000) >> 8) |
+		((addr & 0xff000000) >> 24);
+	if ((mask & 0xff000000) == 0 || (mask & 0x000000ff) != 0) {
+		return false;
+	}
+	return ((~mask + 1) & ~mask) == 0;
+}
+
+static bool is_valid_config_string(
+	const struct config_schema *schema, const char *s
+) {
+	if (s == NULL) {
+		return false;
+	}
+	size_t len = strlen(s);
+	if (len < schema->min || len > schema->max) {
+		return false;
+	}
+	for (int i = 0; s[i] != '\0'; i++) {
+		if (!is_valid_config_value(s[i])) {
+			return false;
+		}
+	}
+	// The config file parser trims the trailing spaces of a line.
+	return len == 0 || s[len - 1] != ' ';
+}
+
+/**
+ * @brief is_valid_uint_value checks the value of a non-string key, it is
+ * the validation shared by all the setters.
+ */
+static bool is_valid_uint_value(
+	const struct config_schema *schema, uint32_t v
+) {
+	switch (schema->type) {
+	case CONFIG_TYPE_U8:
+	case CONFIG_TYPE_U32:
+		return v >= schema->min && v <= schema->max;
+	case CONFIG_TYPE_IPV4:
+		return is_valid_ipv4(v);
+	case CONFIG_TYPE_NETMASK:
+		return is_valid_netmask(v);
+	case CONFIG_TYPE_STR:
+		break;
+	}
+	return false;
+}
+
+/**
+ * @brief is_valid_schema_value checks the value of the schema in the config.
+ */
+static bool is_valid_schema_value(
+	struct config *config, const struct config_schema *schema
+) {
+	void *p = config_value_ptr(config, schema);
+	if (schema->type == CONFIG_TYPE_STR) {
+		// The string is always null terminated by the inline array.
+		return strnlen(p, schema->max + 1) <= schema->max &&
+			is_valid_config_string(schema, p);
+	}
+	return is_valid_uint_value(schema, config_value_uint(config, schema));
+}
+
+/**
+ * @brief config_buffer_printf appends the formatted string to the buffer
+ * at the position pos, and moves pos to the end of the string.
+ *
+ * @return false if the buffer is too small.
+ */
+static bool config_buffer_printf(
+	char *buffer, size_t size, size_t *pos, const char *fmt, ...
+) {
+	if (*pos >= size) {
+		return false;
+	}
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf(buffer + *pos, size - *pos, fmt, args);
+	va_end(args);
+	if (n < 0 || (size_t) n >= size - *pos) {
+		return false;
+	}
+	*pos += n;
+	return true;
+}
+
+/**
+ * @brief config_format_value appends the value of the schema as string
+ * to the buffer.
+ *
+ * @return false if the buffer is too small.
+ */
+static bool config_format_value(
+	struct config *config, const struct config_schema *schema,
+	char *buffer, size_t size, size_t *pos
+) {
+	void *p = config_value_ptr(config, schema);
+	esp_ip4_addr_t ip;
+	switch (schema->type) {
+	case CONFIG_TYPE_U8:
+	case CONFIG_TYPE_U32:
+		return config_buffer_printf(buffer, size, pos, "%u",
+			(unsigned int) config_value_uint(config, schema));
+	case CONFIG_TYPE_STR:
+		return config_buffer_printf(buffer, size, pos, "%s",
+			(const char*) p);
+	case CONFIG_TYPE_IPV4:
+	case CONFIG_TYPE_NETMASK:
+		ip.addr = config_value_uint(config, schema);
+		return config_buffer_printf(buffer, size, pos,
+			IPSTR, IP2STR(&ip));
+	}
+	return false;
+}
+
+/**
+ * @brief config_set_default resets the value of the schema to default.
+ */
+static void config_set_default(
+	struct config *config, const struct config_schema *schema
+) {
+	void *p = config_value_ptr(config, schema);
+	switch (schema->type) {
+	case CONFIG_TYPE_U8:
+		*(uint8_t*) p = schema->def;
+		break;
+	case CONFIG_TYPE_U32:
+		*(uint32_t*) p = schema->def;
+		break;
+	case CONFIG_TYPE_STR:
+		config_set_string(config, schema, schema->def_str);
+		break;
+	case CONFIG_TYPE_IPV4:
+	case CONFIG_TYPE_NETMASK:
+		((esp_ip4_addr_t*) p)->addr = schema->def;
+		break;
+	}
 }
 
 esp_err_t save_config_file(struct config *config)
@@ -64,58 +376,34 @@ esp_err_t save_config_file(struct config *config)
 		ESP_LOGE(TAG, "save_config_file failed: invalid config");
 		return ESP_FAIL;
 	}
-	char *buffer = malloc(BUFF_SIZE * 128);
-	memset(buffer, 0, BUFF_SIZE * 128);
-
-	static const char* config_template =
-		CONFIG_KEY_PWM_FAN_CHANNEL"=%u\n"
-		CONFIG_KEY_PWM_FAN_FREQUENCY"=%u\n"
-		CONFIG_KEY_PWM_FAN_GPIO"=%u\n"
-		CONFIG_KEY_PWM_FAN_DUTY"=%u\n"
-		CONFIG_KEY_PWM_FAN_DUTY_MIN"=%u\n"
-		CONFIG_KEY_PWM_FAN_DUTY_MAX"=%u\n"
-		CONFIG_KEY_PWM_MOS_CHANNEL"=%u\n"
-		CONFIG_KEY_PWM_MOS_FREQUENCY"=%u\n"
-		CONFIG_KEY_PWM_MOS_GPIO"=%u\n"
-		CONFIG_KEY_PWM_MOS_DUTY"=%u\n"
-		CONFIG_KEY_PWM_MOS_DUTY_MIN"=%u\n"
-		CONFIG_KEY_PWM_MOS_DUTY_MAX"=%u\n"
-		CONFIG_KEY_WIFI_SSID"=%s\n"
-		CONFIG_KEY_WIFI_PASSWORD"=%s\n"
-		CONFIG_KEY_WIFI_CHANNEL"=%u\n"
-		CONFIG_KEY_DHCPS_IP"="IPSTR"\n"
-		CONFIG_KEY_DHCPS_NETMASK"="IPSTR"\n"
-		CONFIG_KEY_DHCPS_AS_ROUTER"=%u\n"
-		;
-
-	sprintf(buffer,
-		config_template,
-		(unsigned int) config->pwm_fan->channel,
-		(unsigned int) config->pwm_fan->frequency,
-		(unsigned int) config->pwm_fan->gpio,
-		(unsigned int) config->pwm_fan->duty,
-		(unsigned int) config->pwm_fan->duty_min,
-		(unsigned int) config->pwm_fan->duty_max,
-		(unsigned int) config->pwm_mos->channel,
-		(unsigned int) config->pwm_mos->frequency,
-		(unsigned int) config->pwm_mos->gpio,
-		(unsigned int) config->pwm_mos->duty,
-		(unsigned int) config->pwm_mos->duty_min,
-		(unsigned int) config->pwm_mos->duty_max,
-		config->wifi->ssid,
-		config->wifi->password,
-		config->wifi->channel,
-		IP2STR(&config->dhcps->ip),
-		IP2STR(&config->dhcps->netmask),
-		(unsigned int) config->dhcps->as_router
-	);
+	char *buffer = malloc(CONFIG_FILE_MAX_SIZE);
+	if (buffer == NULL) {
+		ESP_LOGE(TAG, "save_config_file failed: malloc failed");
+		return ESP_FAIL;
+	}
+
+	size_t pos = 0;
+	for (int i = 0; i < CONFIG_ID_MAX; i++) {
+		const struct config_schema *schema = &config_schema[i];
+		if (!config_buffer_printf(buffer, CONFIG_FILE_MAX_SIZE, &pos,
+				"%s=", schema->key) ||
+			!config_format_value(config, schema,
+				buffer, CONFIG_FILE_MAX_SIZE, &pos) ||
+			!config_buffer_printf(buffer, CONFIG_FILE_MAX_SIZE, &pos,
+				"\n")) {
+			ESP_LOGE(TAG, "save_config_file failed: "
+				"buffer too small");
+			free(buffer);
+			return ESP_FAIL;
+		}
+	}
 
 	ESP_LOGI(TAG, "save_config_file:\n%s", buffer);
-	int ret = write_file(CONFIG_FILE, buffer);
+	int ret = write_file_atomic(CONFIG_FILE, buffer);
 	if (ret <= 0) {
 		ESP_LOGE(TAG, "save_config_file: write_file failed: %d", ret);
 		free(buffer);
-		return ret;
+		return ESP_FAIL;
 	}
 	free(buffer);
 	return ESP_OK;
@@ -140,93 +428,23 @@ esp_err_t config_get_value(
 		return ESP_FAIL;
 	}
 
-	uint32_t *pi = value;
-	char* ps = value;
-	if (strcmp(key, CONFIG_KEY_PWM_FAN_CHANNEL) == 0) {
-		*pi = config->pwm_fan->channel;
-		return ESP_OK;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_FAN_FREQUENCY) == 0) {
-		*pi = config->pwm_fan->frequency;
-		return ESP_OK;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_FAN_GPIO) == 0) {
-		*pi = config->pwm_fan->gpio;
-		return ESP_OK;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_FAN_DUTY) == 0) {
-		*pi = config->pwm_fan->duty;
-		return ESP_OK;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_FAN_DUTY_MIN) == 0) {
-		*pi = config->pwm_fan->duty_min;
-		return ESP_OK;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_FAN_DUTY_MAX) == 0) {
-		*pi = config->pwm_fan->duty_max;
-		return ESP_OK;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_MOS_CHANNEL) == 0) {
-		*pi = config->pwm_mos->channel;
-		return ESP_OK;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_MOS_FREQUENCY) == 0) {
-		*pi = config->pwm_mos->frequency;
-		return ESP_OK;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_MOS_GPIO) == 0) {
-		*pi = config->pwm_mos->gpio;
-		return ESP_OK;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_MOS_DUTY) == 0) {
-		*pi = config->pwm_mos->duty;
-		return ESP_OK;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_MOS_DUTY_MIN) == 0) {
-		*pi = config->pwm_mos->duty_min;
-		return ESP_OK;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_MOS_DUTY_MAX) == 0) {
-		*pi = config->pwm_mos->duty_max;
-		return ESP_OK;
-	}
-	if (strcmp(key, CONFIG_KEY_WIFI_SSID) == 0) {
-		if (strlen(config->wifi->ssid) > size) {
-			ESP_LOGE(TAG, "config_get_value failed: "
-				"failed to get "CONFIG_KEY_WIFI_SSID": "
-				"size too small");
-			return ESP_FAIL;
-		}
-		strcpy(ps, config->wifi->ssid);
-		return ESP_OK;
-	}
-	if (strcmp(key, CONFIG_KEY_WIFI_PASSWORD) == 0) {
-		if (strlen(config->wifi->password) > size) {
-			ESP_LOGE(TAG, "config_get_value failed: "
-				"failed to get "CONFIG_KEY_WIFI_PASSWORD": "
-				"size too small");
-			return ESP_FAIL;
-		}
-		strcpy(ps, config->wifi->password);
-		return ESP_OK;
-	}
-	if (strcmp(key, CONFIG_KEY_WIFI_CHANNEL) == 0) {
-		*pi = config->wifi->channel;
-		return ESP_OK;
-	}
-	if (strcmp(key, CONFIG_KEY_DHCPS_IP) == 0) {
-		*pi = config->dhcps->ip.addr;
-		return ESP_OK;
+	const struct config_schema *schema = config_schema_lookup(key);
+	if (schema == NULL) {
+		return ESP_FAIL;
 	}
-	if (strcmp(key, CONFIG_KEY_DHCPS_NETMASK) == 0) {
-		*pi = config->dhcps->netmask.addr;
+	if (schema->type != CONFIG_TYPE_STR) {
+		*(uint32_t*) value = config_value_uint(config, schema);
 		return ESP_OK;
 	}
-	if (strcmp(key, CONFIG_KEY_DHCPS_AS_ROUTER) == 0) {
-		*pi = config->dhcps->as_router;
-		return ESP_OK;
+
+	const char *s = config_value_ptr(config, schema);
+	if (strlen(s) >= (size_t) size) {
+		ESP_LOGE(TAG, "config_get_value failed: "
+			"failed to get %s: size too small", key);
+		return ESP_FAIL;
 	}
-	return ESP_FAIL;
+	strcpy(value, s);
+	return ESP_OK;
 }
 
 
@@ -236,135 +454,33 @@ bool is_valid_config(struct config *config)
 		ESP_LOGD(TAG, "is_valid_config: config is NULL");
 		return false;
 	}
-	if (!config->pwm_fan) {
-		ESP_LOGD(TAG, "is_valid_config: pwm_fan is NULL");
-		return false;
-	}
-	if (config->pwm_fan->channel > 30) {
-		ESP_LOGD(TAG, "is_valid_config: pwm_fan->channel: "
-			"invalid value");
-		return false;
-	}
-	if (config->pwm_fan->frequency > 100000 ||
-		config->pwm_fan->frequency < 1000) {
-		ESP_LOGD(TAG, "is_valid_config: pwm_fan->frequency: "
-			"invalid value");
-		return false;
-	}
-	if (config->pwm_fan->gpio > 30) {
-		ESP_LOGD(TAG, "is_valid_config: pwm_fan->gpio: "
-			"invalid value");
-		return false;
-	}
-	// config->pwm_fan->duty will always been 0-255.
-	if (config->pwm_fan->duty_min >= config->pwm_fan->duty_max) {
-		ESP_LOGD(TAG, "is_valid_config: pwm_fan->duty_min/max: "
-			"invalid value");
-		return false;
-	}
-
-	if (!config->pwm_mos) {
-		ESP_LOGD(TAG, "is_valid_config: pwm_mos is NULL");
-		return false;
-	}
-	if (config->pwm_mos->channel > 30) {
-		ESP_LOGD(TAG, "is_valid_config: pwm_mos->channel: "
-			"invalid value");
-		return false;
-	}
-	if (config->pwm_mos->frequency > 100000 ||
-		config->pwm_mos->frequency < 1000) {
-		ESP_LOGD(TAG, "is_valid_config: pwm_mos->frequency: "
-			"invalid value");
-		return false;
-	}
-	if (config->pwm_mos->gpio > 30) {
-		ESP_LOGD(TAG, "is_valid_config: pwm_mos->gpio: "
-			"invalid value");
-		return false;
-	}
-	// config->pwm_mos->duty will always been 0-255.
-	if (config->pwm_mos->duty_min >= config->pwm_mos->duty_max) {
-		ESP_LOGD(TAG, "is_valid_config: pwm_mos->duty_min/max: "
-			"invalid value");
-		return false;
-	}
-
-	if (!config->wifi) {
-		ESP_LOGD(TAG, "is_valid_config: wifi is NULL");
-		return false;
-	}
-	if (!config->wifi->password) {
-		ESP_LOGD(TAG, "is_valid_config: wifi->password is NULL");
-		return false;
-	}
-	const char* p = config->wifi->password;
-	int len = strlen(p);
-	if (len > 30 || len < 8) {
-		ESP_LOGD(TAG, "is_valid_config: wifi->password: "
-			"invalid password length");
-	}
-	for (int i = 0; p[i] != '\0'; i++) {
-		if (is_valid_config_value(p[i])) {
-			continue;
-		}
-		ESP_LOGD(TAG, "is_valid_config: wifi->password: "
-			"invalid char [%c]", p[i]);
-		return false;
-	}
-	if (!config->wifi->ssid) {
-		ESP_LOGD(TAG, "is_valid_config: wifi->ssid is NULL");
-		return false;
-	}
-	p = config->wifi->ssid;
-	len = strlen(p);
-	if (len > 30 || len < 1) {
-		ESP_LOGD(TAG, "is_valid_config: wifi->ssid: "
-			"invalid ssid length");
-	}
-	for (int i = 0; p[i] != '\0'; i++) {
-		if (is_valid_config_value(p[i])) {
+	for (int i = 0; i < CONFIG_ID_MAX; i++) {
+		if (is_valid_schema_value(config, &config_schema[i])) {
 			continue;
 		}
-		ESP_LOGD(TAG, "is_valid_config: wifi->ssid: "
-			"invalid char [%c]", p[i]);
+		ESP_LOGD(TAG, "is_valid_config: %s: invalid value",
+			config_schema[i].key);
 		return false;
 	}
-	if (!config->dhcps) {
-		ESP_LOGD(TAG, "is_valid_config: dhcps is NULL");
-		return false;
-	}
-	if ((config->dhcps->ip.addr & 0x000000ff) == 0) { // 255.0.0.0
-		ESP_LOGD(TAG, "is_valid_config: dhcps->ip: "
+	if (config->pwm_fan.duty_min >= config->pwm_fan.duty_max) {
+		ESP_LOGD(TAG, "is_valid_config: pwm_fan->duty_min/max: "
 			"invalid value");
 		return false;
 	}
-	if ((config->dhcps->netmask.addr & 0x000000ff) == 0 || // 255.0.0.0
-		(config->dhcps->netmask.addr & 0xff000000) > 0) { // 0.0.0.255
-		ESP_LOGD(TAG, "is_valid_config: dhcps->ip: "
+	if (config->pwm_mos.duty_min >= config->pwm_mos.duty_max) {
+		ESP_LOGD(TAG, "is_valid_config: pwm_mos->duty_min/max: "
 			"invalid value");
 		return false;
 	}
-	// as_router is used as a bool value.
 
 	return true;
 }
 
 bool is_valid_config_value(char c)
 {
-	if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
-		(c >= '0' && c <= '9')) {
-		return true;
-	}
-
-	static const char *const valid = "!@#$%%^&*()-_+.";
-	int l = strlen(valid);
-	for (int i = 0; i < l; ++i) {
-		if (c == valid[i]) {
-			return true;
-		}
-	}
-	return false;
+	// Printable ASCII, so SSIDs and passwords may contain spaces.
+	// '<' is excluded, the settings JSON is inlined into the pages.
+	return c >= ' ' && c <= '~' && c != '<';
 }
 
 struct config* new_config_default_value()
@@ -374,124 +490,179 @@ struct config* new_config_default_value()
 		ESP_LOGE(TAG, "new_config_default_value failed: malloc fail");
 		return NULL;
 	}
-	config->pwm_fan = malloc(sizeof(struct pwm_config));
-	config->pwm_mos = malloc(sizeof(struct pwm_config));
-	config->wifi = malloc(sizeof(struct wifi_config));
-	config->dhcps = malloc(sizeof(struct dhcps_config));
-	if (!config->pwm_fan || !config->pwm_mos || !config->wifi ||
-		!config->dhcps) {
-		release_config(&config);
-		ESP_LOGE(TAG, "new_config_default_value failed: malloc fail");
-		return NULL;
+	config_reset_default(config);
+	return config;
+}
+
+void config_reset_default(struct config *config)
+{
+	// Clear the padding bytes so the config can be compared by memcmp.
+	memset(config, 0, sizeof(struct config));
+	for (int i = 0; i < CONFIG_ID_MAX; i++) {
+		config_set_default(config, &config_schema[i]);
 	}
+}
 
-	// Init config with default values.
-	config->pwm_fan->channel = 0;
-	config->pwm_fan->frequency = 25000;
-	config->pwm_fan->gpio = 4;
-	config->pwm_fan->duty = 100;
-	config->pwm_fan->duty_min = 30;
-	config->pwm_fan->duty_max = 255;
-
-	config->pwm_mos->channel = 1;
-	config->pwm_mos->frequency = 25000;
-	config->pwm_mos->gpio = 8;
-	config->pwm_mos->duty = 255;
-	config->pwm_mos->duty_min = 26;
-	config->pwm_mos->duty_max = 35;
-
-	config->wifi->ssid = str_clone("PWM_FAN_CONTROLLER");
-	config->wifi->password = str_clone("testpassword123");
-	config->wifi->channel = 1;
-	config->dhcps->ip.addr = 0x010A0A0A; // 10.10.10.1
-	config->dhcps->netmask.addr = 0x00ffffff; // 255.255.255.0
-	config->dhcps->as_router = 0;
-	return config;
+void config_copy(struct config *dst, const struct config *src)
+{
+	memcpy(dst, src, sizeof(struct config));
 }
 
-struct config* new_config_by_config_file_data(
-	const char *content, int length
+bool config_equal(const struct config *a, const struct config *b)
+{
+	return memcmp(a, b, sizeof(struct config)) == 0;
+}
+
+uint32_t config_diff(const struct config *a, const struct config *b)
+{
+	uint32_t diff = 0;
+	for (int i = 0; i < CONFIG_ID_MAX; i++) {
+		const struct config_schema *schema = &config_schema[i];
+		size_t size = 0;
+		switch (schema->type) {
+		case CONFIG_TYPE_U8:
+			size = sizeof(uint8_t);
+			break;
+		case CONFIG_TYPE_U32:
+			size = sizeof(uint32_t);
+			break;
+		case CONFIG_TYPE_STR:
+			size = schema->max + 1;
+			break;
+		case CONFIG_TYPE_IPV4:
+		case CONFIG_TYPE_NETMASK:
+			size = sizeof(esp_ip4_addr_t);
+			break;
+		}
+		if (memcmp((const uint8_t*) a + schema->offset,
+			(const uint8_t*) b + schema->offset, size) != 0) {
+			diff |= CONFIG_ID_BIT(i);
+		}
+	}
+	return diff;
+}
+
+esp_err_t config_get_uint(
+	const struct config *config, enum config_key_id id, uint32_t *value
 ) {
-	if (content == NULL) {
-		ESP_LOGE(TAG, "new_config_by_config_file_data failed: "
-			"content is NULL");
-		return NULL;
+	const struct config_schema *schema = config_schema_get(id);
+	if (config == NULL || value == NULL || schema == NULL ||
+		schema->type == CONFIG_TYPE_STR) {
+		return ESP_FAIL;
 	}
+	*value = config_value_uint((struct config*) config, schema);
+	return ESP_OK;
+}
 
-	struct config *config = new_config_default_value();
-	if (config == NULL) {
-		return NULL;
+esp_err_t config_set_uint(
+	struct config *config, enum config_key_id id, uint32_t value
+) {
+	const struct config_schema *schema = config_schema_get(id);
+	if (config == NULL || schema == NULL ||
+		!is_valid_uint_value(schema, value)) {
+		return ESP_FAIL;
+	}
+	void *p = config_value_ptr(config, schema);
+	switch (schema->type) {
+	case CONFIG_TYPE_U8:
+		*(uint8_t*) p = value;
+		return ESP_OK;
+	case CONFIG_TYPE_U32:
+		*(uint32_t*) p = value;
+		return ESP_OK;
+	case CONFIG_TYPE_IPV4:
+	case CONFIG_TYPE_NETMASK:
+		((esp_ip4_addr_t*) p)->addr = value;
+		return ESP_OK;
+	case CONFIG_TYPE_STR:
+		break;
 	}
+	return ESP_FAIL;
+}
 
-	char *key = malloc(BUFF_SIZE);
-	char *value = malloc(BUFF_SIZE);
-	if (key == NULL || value == NULL) {
-		free(key);
-		free(value);
-		ESP_LOGE(TAG, "new_config_by_config_file_data failed: "
-			"malloc failed");
+/**
+ * @brief config_parse_line parses a 'key=value' line in place.
+ * Empty lines and lines start with '#' are ignored, the trailing '\r' of
+ * the CRLF line ending is removed.
+ *
+ * @param config
+ * @param line null terminated line without '\n', will be modified.
+ * @param length line length
+ */
+static void config_parse_line(struct config *config, char *line, size_t length)
+{
+	while (length > 0 && (line[length-1] == '\r' ||
+		line[length-1] == ' ' || line[length-1] == '\t')) {
+		line[--length] = '\0';
+	}
+	if (length == 0 || line[0] == '#') {
+		return;
+	}
+	char *value = memchr(line, '=', length);
+	if (value == NULL) {
+		ESP_LOGE(TAG, "config_parse_line: invalid line [%s]", line);
+		return;
+	}
+	*value++ = '\0';
+	ESP_LOGD(TAG, "read key [%s] value [%s]", line, value);
+	if (config_set_value(config, line, value) != ESP_OK) {
+		ESP_LOGE(TAG, "config_set_value failed: "
+			"key %s, value %s", line, value);
+	}
+}
+
+static struct config* new_config_by_parse_file(const char *filename)
+{
+	int fd = open_file_atomic(filename);
+	if (fd < 0) {
+		ESP_LOGE(TAG, "failed to open config %s: %d", filename, errno);
+		return NULL;
+	}
+	struct config *config = new_config_default_value();
+	if (config == NULL) {
+		close(fd);
 		return NULL;
 	}
-	memset(key, 0, BUFF_SIZE);
-	memset(value, 0, BUFF_SIZE);
 
-	int key_pos = 0;
-	int value_pos = 0;
-	bool is_value = false;
-	for (int i = 0; i < length; ++i) {
-		if (content[i] == '\0') {
-			break;
-		}
-		if (content[i] == '=') {
-			if (is_value) {
-				continue;
-			}
-			is_value = true;
-			value_pos = i+1;
-			if (value_pos >= length) {
-				break;
+	char buffer[CONFIG_LINE_SIZE + 1];
+	size_t length = 0;
+	// discard is set when the buffer is filled by an over-long line,
+	// the remaining data of the line will be discarded.
+	bool discard = false;
+	ssize_t n = 0;
+	while ((n = read(fd, buffer + length, CONFIG_LINE_SIZE - length)) > 0) {
+		length += n;
+		char *start = buffer;
+		char *end = NULL;
+		while ((end = memchr(start, '\n', buffer + length - start))) {
+			*end = '\0';
+			if (!discard) {
+				config_parse_line(config, start, end - start);
 			}
-			if (i - key_pos > BUFF_SIZE-1) {
-				free(key);
-				free(value);
-				ESP_LOGE(TAG,
-					"new_config_by_config_file_data: "
-					"key length out of range");
-				return config;
-			}
-			memcpy(key, content + key_pos,
-				(i-key_pos) * sizeof(char));
-			key[i-key_pos] = '\0';
-			continue;
+			discard = false;
+			start = end + 1;
 		}
-		if (content[i] == '\n' || content[i] == '\0' || i >= length) {
-			is_value = false;
-			key_pos = i+1;
-			if (value_pos >= length) {
-				break;
+		length = buffer + length - start;
+		if (length == CONFIG_LINE_SIZE) {
+			if (!discard) {
+				ESP_LOGE(TAG, "new_config_by_parse_file: "
+					"line length out of range, ignored");
 			}
-			if (i - value_pos > BUFF_SIZE-1) {
-				free(key);
-				free(value);
-				ESP_LOGE(TAG, "process_config_content failed: "
-					"value length out of range");
-				return config;
-			}
-			memcpy(value, content + value_pos, i - value_pos);
-			value[i-value_pos] = '\0';
-			ESP_LOGD(TAG, "read key [%s] value [%s]", key, value);
-			int ret = config_set_value(config, key, value);\
-			if (ret != ESP_OK) {
-				ESP_LOGE(TAG, "config_set_value failed: "
-					"key %s, value %s", key, value);
-			}
-
-			key[0] = '\0';
-			value[0] = '\0';
-			value_pos = key_pos;
+			discard = true;
+			length = 0;
 			continue;
 		}
+		memmove(buffer, start, length);
 	}
+	if (n < 0) {
+		ESP_LOGE(TAG, "failed to read config %s: %d", filename, errno);
+	}
+	if (length > 0 && !discard) {
+		// The last line does not end with '\n'.
+		buffer[length] = '\0';
+		config_parse_line(config, buffer, length);
+	}
+	close(fd);
 	return config;
 }
 
@@ -502,250 +673,251 @@ esp_err_t config_set_value(
 		ESP_LOGE(TAG, "config_set_value failed: config NULL ptr");
 		return ESP_FAIL;
 	}
-	if (!config->dhcps || !config->pwm_fan || !config->wifi) {
-		ESP_LOGE(TAG, "config_set_value failed: config NULL ptr");
+	const struct config_schema *schema = config_schema_lookup(key);
+	if (schema == NULL) {
+		ESP_LOGE(TAG, "config_set_value: unrecognized key [%s]", key);
 		return ESP_FAIL;
 	}
-	if (strcmp(key, CONFIG_KEY_PWM_FAN_CHANNEL) == 0) {
-		int v = str2int(value);
-		if (v > 5) {
-			ESP_LOGE(TAG, "invalid PWM channel [%d], "
-				"set to default 0", v);
-			v = 0;
+	void *p = config_value_ptr(config, schema);
+	int v = 0;
+	esp_ip4_addr_t ip;
+	switch (schema->type) {
+	case CONFIG_TYPE_U8:
+	case CONFIG_TYPE_U32:
+		v = str2int(value);
+		if (v < 0 || !is_valid_uint_value(schema, v)) {
+			ESP_LOGE(TAG, "invalid %s [%d], set to default %u",
+				key, v, (unsigned int) schema->def);
+			v = schema->def;
 		}
-		config->pwm_fan->channel = v;
-		return 0;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_FAN_FREQUENCY) == 0) {
-		int v = str2int(value);
-		if (v > 100000 || v < 1000) {
-			ESP_LOGE(TAG, "invalid PWM frequency [%d], "
-				"set to default 25000", v);
-			v = 25000;
-		}
-		config->pwm_fan->frequency = v;
-		return 0;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_FAN_GPIO) == 0) {
-		int v = str2int(value);
-		if (v > 30 || v < 0) {
-			ESP_LOGE(TAG, "invalid "CONFIG_KEY_PWM_FAN_GPIO" [%d], "
-				"set to default 4", v);
-			v = 4;
+		if (schema->type == CONFIG_TYPE_U8) {
+			*(uint8_t*) p = v;
+		} else {
+			*(uint32_t*) p = v;
 		}
-		config->pwm_fan->gpio = v;
-		return 0;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_FAN_DUTY) == 0) {
-		int v = str2int(value);
-		if (v > 255 || v < 0) {
-			ESP_LOGE(TAG, "invalid "CONFIG_KEY_PWM_FAN_DUTY" [%d], "
-				"set to default 100", v);
-			v = 100;
+		return ESP_OK;
+	case CONFIG_TYPE_STR:
+		if (!is_valid_config_string(schema, value)) {
+			ESP_LOGE(TAG, "invalid %s [%s]", key, value);
+			return ESP_FAIL;
 		}
-		config->pwm_fan->duty = v;
-		return 0;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_FAN_DUTY_MIN) == 0) {
-		int v = str2int(value);
-		if (v > 255 || v < 0) {
-			ESP_LOGE(TAG, "invalid "CONFIG_KEY_PWM_FAN_DUTY_MIN" [%d], "
-				"set to default 30", v);
-			v = 30;
+		config_set_string(config, schema, value);
+		return ESP_OK;
+	case CONFIG_TYPE_IPV4:
+	case CONFIG_TYPE_NETMASK:
+		ip = str2ipv4(value);
+		if (!is_valid_uint_value(schema, ip.addr)) {
+			ip.addr = schema->def;
+			ESP_LOGE(TAG, "invalid %s [%s], set to default "IPSTR,
+				key, value, IP2STR(&ip));
 		}
-		config->pwm_fan->duty_min = v;
-		return 0;
+		ESP_LOGD(TAG, "set config %s [0x%8X] "IPSTR,
+			key, (unsigned int) ip.addr, IP2STR(&ip));
+		*(esp_ip4_addr_t*) p = ip;
+		return ESP_OK;
 	}
-	if (strcmp(key, CONFIG_KEY_PWM_FAN_DUTY_MAX) == 0) {
-		int v = str2int(value);
-		if (v > 255 || v < 0) {
-			ESP_LOGE(TAG, "invalid "CONFIG_KEY_PWM_FAN_DUTY_MAX" [%d], "
-				"set to default 100", v);
-			v = 255;
-		}
-		config->pwm_fan->duty_max = v;
-		return 0;
+
+	return ESP_FAIL;
+}
+
+/**
+ * @brief config_parse_uint parses a plain decimal number, signs, spaces
+ * and other characters are rejected.
+ *
+ * @return false if the string is not a number or out of the uint32 range.
+ */
+static bool config_parse_uint(const char *s, uint32_t *value)
+{
+	uint64_t v = 0;
+	if (*s == '\0') {
+		return false;
 	}
-	if (strcmp(key, CONFIG_KEY_PWM_MOS_CHANNEL) == 0) {
-		int v = str2int(value);
-		if (v > 5) {
-			ESP_LOGE(TAG, "invalid PWM mos channel [%d], "
-				"set to default 1", v);
-			v = 1;
+	for (; *s != '\0'; s++) {
+		if (*s < '0' || *s > '9') {
+			return false;
 		}
-		config->pwm_mos->channel = v;
-		return 0;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_MOS_FREQUENCY) == 0) {
-		int v = str2int(value);
-		if (v > 100000 || v < 1000) {
-			ESP_LOGE(TAG, "invalid PWM frequency [%d], "
-				"set to default 25000", v);
-			v = 25000;
+		v = v * 10 + (*s - '0');
+		if (v > UINT32_MAX) {
+			return false;
 		}
-		config->pwm_mos->frequency = v;
-		return 0;
 	}
-	if (strcmp(key, CONFIG_KEY_PWM_MOS_GPIO) == 0) {
-		int v = str2int(value);
-		if (v > 30 || v < 0) {
-			ESP_LOGE(TAG, "invalid "CONFIG_KEY_PWM_MOS_GPIO" [%d], "
-				"set to default 8", v);
-			v = 8;
+	*value = v;
+	return true;
+}
+
+/**
+ * @brief config_parse_ipv4 parses a dotted decimal IPv4 address into the
+ * esp_ip4_addr_t byte order.
+ *
+ * @return false if the string is not 4 decimal bytes separated by '.'.
+ */
+static bool config_parse_ipv4(const char *s, uint32_t *addr)
+{
+	uint32_t v = 0;
+	for (int i = 0; i < 4; i++) {
+		uint32_t byte = 0;
+		int digits = 0;
+		for (; *s >= '0' && *s <= '9' && digits < 4; s++, digits++) {
+			byte = byte * 10 + (*s - '0');
 		}
-		config->pwm_mos->gpio = v;
-		return 0;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_MOS_DUTY) == 0) {
-		int v = str2int(value);
-		if (v > 255 || v < 0) {
-			ESP_LOGE(TAG, "invalid "CONFIG_KEY_PWM_MOS_DUTY" [%d], "
-				"set to default 255", v);
-			v = 255;
+		if (digits == 0 || digits > 3 || byte > 255) {
+			return false;
 		}
-		config->pwm_mos->duty = v;
-		return 0;
-	}
-	if (strcmp(key, CONFIG_KEY_PWM_MOS_DUTY_MIN) == 0) {
-		int v = str2int(value);
-		if (v > 255 || v < 0) {
-			ESP_LOGE(TAG, "invalid "CONFIG_KEY_PWM_MOS_DUTY_MIN" [%d], "
-				"set to default 26", v);
-			v = 26;
+		v |= byte << (8 * i);
+		if (*s != (i < 3 ? '.' : '\0')) {
+			return false;
 		}
-		config->pwm_mos->duty_min = v;
-		return 0;
+		s++;
 	}
-	if (strcmp(key, CONFIG_KEY_PWM_MOS_DUTY_MAX) == 0) {
-		int v = str2int(value);
-		if (v > 255 || v < 0) {
-			ESP_LOGE(TAG, "invalid "CONFIG_KEY_PWM_MOS_DUTY_MAX" [%d], "
-				"set to default 35", v);
-			v = 35;
-		}
-		config->pwm_mos->duty_max = v;
-		return 0;
+	*addr = v;
+	return true;
+}
+
+/**
+ * @brief is_valid_wifi_password checks the password length accepted by
+ * wifi.c: empty for an open AP, or a WPA2 passphrase.
+ * The config file keeps the lenient schema range, so a stored short
+ * password is still loaded.
+ */
+static bool is_valid_wifi_password(const char *s)
+{
+	size_t len = strlen(s);
+	return len == 0 || len >= CONFIG_WIFI_PASSWORD_MIN_LEN;
+}
+
+esp_err_t config_parse_value(
+	struct config *config, const char *key, const char *value
+) {
+	if (config == NULL || key == NULL || value == NULL) {
+		ESP_LOGE(TAG, "config_parse_value failed: config NULL ptr");
+		return ESP_FAIL;
 	}
-	if (strcmp(key, CONFIG_KEY_WIFI_SSID) == 0) {
-		char *buffer = str_clone(value);
-		if (buffer == NULL) {
-			ESP_LOGE(TAG, "wifi_ssid failed: malloc failed");
-			return ESP_FAIL;
-		}
-		if (config->wifi->ssid != NULL) {
-			free(config->wifi->ssid);
-			config->wifi->ssid = NULL;
-		}
-		config->wifi->ssid = buffer;
-		return 0;
+	const struct config_schema *schema = config_schema_lookup(key);
+	if (schema == NULL) {
+		ESP_LOGE(TAG, "config_parse_value: unrecognized key [%s]", key);
+		return ESP_FAIL;
 	}
-	if (strcmp(key, CONFIG_KEY_WIFI_PASSWORD) == 0) {
-		char *buffer = str_clone(value);
-		if (buffer == NULL) {
-			ESP_LOGE(TAG, "wifi_password failed: malloc failed");
+	uint32_t v = 0;
+	bool parsed = false;
+	switch (schema->type) {
+	case CONFIG_TYPE_U8:
+	case CONFIG_TYPE_U32:
+		parsed = config_parse_uint(value, &v);
+		break;
+	case CONFIG_TYPE_IPV4:
+	case CONFIG_TYPE_NETMASK:
+		parsed = config_parse_ipv4(value, &v);
+		break;
+	case CONFIG_TYPE_STR:
+		if (!is_valid_config_string(schema, value) ||
+			(schema->id == CONFIG_ID_WIFI_PASSWORD &&
+			!is_valid_wifi_password(value))) {
+			ESP_LOGE(TAG, "invalid %s [%s]", key, value);
 			return ESP_FAIL;
 		}
-		if (config->wifi->password != NULL) {
-			free(config->wifi->password);
-			config->wifi->password = NULL;
-		}
-		config->wifi->password = buffer;
-		return 0;
+		config_set_string(config, schema, value);
+		return ESP_OK;
 	}
-	if (strcmp(key, CONFIG_KEY_WIFI_CHANNEL) == 0) {
-		int v = str2int(value);
-		if (v > 11 || v < 0) {
-			ESP_LOGE(TAG, "invalid "CONFIG_KEY_WIFI_CHANNEL" [%d], "
-				"set to default 1", v);
-			v = 1;
-		}
-		config->wifi->channel = v;
-		return 0;
+	if (!parsed || config_set_uint(config, schema->id, v) != ESP_OK) {
+		ESP_LOGE(TAG, "invalid %s [%s]", key, value);
+		return ESP_FAIL;
 	}
-	if (strcmp(key, CONFIG_KEY_DHCPS_IP) == 0) {
-		esp_ip4_addr_t ip = str2ipv4(value);
-		if (ip.addr == 0 || !(ip.addr & 0xff000000) ||
-			!(ip.addr & 0x000000ff))
-		{
-			ip.addr = 0x010A0A0A; // 10.10.10.1
-			ESP_LOGE(TAG, "invalid "CONFIG_KEY_DHCPS_IP" [%s], "
-				"set to default: 0x%8X, "IPSTR,
-				value, (unsigned int) ip.addr, IP2STR(&ip));
-		}
-		ESP_LOGD(TAG, "set config "CONFIG_KEY_DHCPS_IP" [0x%8X] "IPSTR,
-			(unsigned int) ip.addr,  IP2STR(&ip));
-		config->dhcps->ip = ip;
-		return 0;
+	return ESP_OK;
+}
+
+/**
+ * @brief config_json_buffer collects the marshaled JSON data and passes it
+ * to the writer when the buffer is full.
+ */
+struct config_json_buffer {
+	char data[CONFIG_JSON_BUFFER_SIZE];
+	size_t length;
+	config_writer_t writer;
+	void *ctx;
+	esp_err_t ret;
+};
+
+static void config_json_flush(struct config_json_buffer *b)
+{
+	if (b->ret == ESP_OK && b->length > 0) {
+		b->ret = b->writer(b->ctx, b->data, b->length);
 	}
-	if (strcmp(key, CONFIG_KEY_DHCPS_NETMASK) == 0) {
-		esp_ip4_addr_t ip = str2ipv4(value);
-		if (ip.addr == 0 || (ip.addr & 0x000000ff) == 0 ||
-			(ip.addr & 0x0f000000) > 0) {
-			ip.addr = 0x00ffffff; // 255.255.255.0
-			ESP_LOGE(TAG, "invalid "CONFIG_KEY_DHCPS_NETMASK" [%s], "
-				"set to default "IPSTR, value, IP2STR(&ip));
+	b->length = 0;
+}
+
+static void config_json_append(
+	struct config_json_buffer *b, const char *data, size_t length
+) {
+	while (b->ret == ESP_OK && length > 0) {
+		size_t n = MIN(length, sizeof(b->data) - b->length);
+		memcpy(b->data + b->length, data, n);
+		b->length += n;
+		data += n;
+		length -= n;
+		if (b->length == sizeof(b->data)) {
+			config_json_flush(b);
 		}
-		ESP_LOGD(TAG, "set config "CONFIG_KEY_DHCPS_NETMASK" [0x%8X] %s",
-			(unsigned int) ip.addr, value);
-		config->dhcps->netmask = ip;
-		return 0;
 	}
-	if (strcmp(key, CONFIG_KEY_DHCPS_AS_ROUTER) == 0) {
-		int v = str2int(value);
-		if (v < 0 || v > 1) {
-			ESP_LOGE(TAG, "invalid dhcps_as_router [%d], "
-				"set to default 0", v);
-			v = 1;
+}
+
+static void config_json_append_string(
+	struct config_json_buffer *b, const char *s
+) {
+	char escape[8];
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\') {
+			escape[0] = '\\';
+			escape[1] = *s;
+			config_json_append(b, escape, 2);
+		} else if ((uint8_t) *s < 0x20) {
+			snprintf(escape, sizeof(escape), "\\u%04x", *s);
+			config_json_append(b, escape, 6);
+		} else {
+			config_json_append(b, s, 1);
 		}
-		ESP_LOGD(TAG, "set config dhcps_as_router %d", v);
-		config->dhcps->as_router = v;
-		return 0;
 	}
-
-	ESP_LOGE(TAG, "config_set_value: unrecognized key [%s]", key);
-	return ESP_FAIL;
 }
 
-esp_err_t config_marshal_json(struct config *config, char *data)
-{
+esp_err_t config_marshal_json(
+	struct config *config, config_writer_t writer, void *ctx
+) {
 	if (!is_valid_config(config)) {
 		ESP_LOGE(TAG, "config_marshal_json: invalid config");
 		return ESP_FAIL;
 	}
-	if (data == NULL) {
+	if (writer == NULL) {
 		ESP_LOGE(TAG, "config_marshal_json: invalid param");
 		return ESP_FAIL;
 	}
 
-	char *template = NULL;
-	if (read_file(&template, CONFIG_JSON_TEMPLATE_FILE) == 0) {
-		ESP_LOGE(TAG, "config_marshal_json: failed to read "
-			CONFIG_JSON_TEMPLATE_FILE);
-		free(template);
-		return ESP_FAIL;
+	struct config_json_buffer b = {
+		.length = 0,
+		.writer = writer,
+		.ctx = ctx,
+		.ret = ESP_OK,
+	};
+	char value[CONFIG_VALUE_SIZE];
+	config_json_append(&b, "{\n", 2);
+	for (int i = 0; i < CONFIG_ID_MAX; i++) {
+		size_t pos = 0;
+		config_format_value(config, &config_schema[i],
+			value, sizeof(value), &pos);
+		config_json_append(&b, "    \"", 5);
+		config_json_append_string(&b, config_schema[i].key);
+		config_json_append(&b, "\": \"", 4);
+		config_json_append_string(&b, value);
+		if (i + 1 < CONFIG_ID_MAX) {
+			config_json_append(&b, "\",\n", 3);
+		} else {
+			config_json_append(&b, "\"\n", 2);
+		}
 	}
-	sprintf(data, template,
-		(unsigned int) config->pwm_fan->channel,
-		(unsigned int) config->pwm_fan->frequency,
-		(unsigned int) config->pwm_fan->gpio,
-		(unsigned int) config->pwm_fan->duty,
-		(unsigned int) config->pwm_fan->duty_min,
-		(unsigned int) config->pwm_fan->duty_max,
-		(unsigned int) config->pwm_mos->channel,
-		(unsigned int) config->pwm_mos->frequency,
-		(unsigned int) config->pwm_mos->gpio,
-		(unsigned int) config->pwm_mos->duty,
-		(unsigned int) config->pwm_mos->duty_min,
-		(unsigned int) config->pwm_mos->duty_max,
-		config->wifi->ssid,
-		config->wifi->password,
-		(unsigned int) config->wifi->channel,
-		IP2STR(&config->dhcps->ip),
-		IP2STR(&config->dhcps->netmask),
-		(unsigned int) config->dhcps->as_router
-	);
-	free(template);
-	return ESP_OK;
+	config_json_append(&b, "}\n", 2);
+	config_json_flush(&b);
+	if (b.ret != ESP_OK) {
+		ESP_LOGD(TAG, "config_marshal_json: writer failed: %d", b.ret);
+	}
+	return b.ret;
 }
 
 void release_config(struct config **p)
@@ -753,29 +925,6 @@ void release_config(struct config **p)
 	if (p == NULL) {
 		return;
 	}
-	struct config *config = *p;
-	if (config == NULL) {
-		return;
-	}
-	if (config->dhcps != NULL) {
-		free(config->dhcps);
-		config->dhcps = NULL;
-	}
-	if (config->pwm_fan != NULL) {
-		free(config->pwm_fan);
-		config->pwm_fan = NULL;
-	}
-	if (config->pwm_mos != NULL) {
-		free(config->pwm_mos);
-		config->pwm_mos = NULL;
-	}
-	if (config->wifi != NULL) {
-		free(config->wifi->password);
-		free(config->wifi->ssid);
-		config->wifi->password = config->wifi->ssid = NULL;
-		free(config->wifi);
-		config->wifi = NULL;
-	}
-	free(config);
+	free(*p);
 	*p = NULL;
 }
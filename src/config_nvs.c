@@ -0,0 +1,186 @@
+#include <string.h>
+#include <stdbool.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <nvs.h>
+
+#include "config.h"
+#include "utils.h"
+
+#define TAG "CONFIG_NVS"
+
+/**
+ * @brief CONFIG_IMAGE_MAGIC is 'PWMC' in little endian.
+ * Increase CONFIG_IMAGE_VERSION when the image layout changes,
+ * the image in a different version will be ignored and rebuilt from the
+ * config file.
+ * NOTE: keep the layout in sync with tools/config_nvs_image.py
+ */
+#define CONFIG_IMAGE_MAGIC 0x434d5750
+#define CONFIG_IMAGE_VERSION 2
+
+struct config_image_pwm {
+	uint8_t channel;
+	uint8_t gpio;
+	uint8_t duty;
+	uint8_t duty_min;
+	uint8_t duty_max;
+	uint8_t reserved[3];
+	uint32_t frequency;
+} __attribute__((packed));
+
+struct config_image_payload {
+	struct config_image_pwm pwm_fan;
+	struct config_image_pwm pwm_mos;
+	char wifi_ssid[33];
+	char wifi_password[64];
+	uint8_t wifi_channel;
+	uint8_t reserved[2];
+	uint32_t dhcps_ip;
+	uint32_t dhcps_netmask;
+	uint8_t dhcps_as_router;
+	uint8_t reserved2[3];
+	uint32_t journal_epoch; // epoch of the config journal based on it
+} __attribute__((packed));
+
+/**
+ * @brief config_image is the binary config snapshot stored in NVS,
+ * all fields are little endian.
+ */
+struct config_image {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t length;  // payload length
+	uint32_t crc;     // crc32 of the payload
+	struct config_image_payload payload;
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct config_image_payload) == 140,
+	"config image payload layout changed");
+
+static void config_image_pwm_load(
+	struct pwm_config *pwm, const struct config_image_pwm *image
+) {
+	pwm->channel = image->channel;
+	pwm->gpio = image->gpio;
+	pwm->duty = image->duty;
+	pwm->duty_min = image->duty_min;
+	pwm->duty_max = image->duty_max;
+	pwm->frequency = image->frequency;
+}
+
+static void config_image_pwm_store(
+	struct config_image_pwm *image, const struct pwm_config *pwm
+) {
+	image->channel = pwm->channel;
+	image->gpio = pwm->gpio;
+	image->duty = pwm->duty;
+	image->duty_min = pwm->duty_min;
+	image->duty_max = pwm->duty_max;
+	image->frequency = pwm->frequency;
+}
+
+struct config* new_config_by_load_nvs(uint32_t *journal_epoch)
+{
+	nvs_handle_t handle;
+	esp_err_t ret = nvs_open(CONFIG_NVS_NAMESPACE, NVS_READONLY, &handle);
+	if (ret != ESP_OK) {
+		ESP_LOGW(TAG, "nvs_open failed: [%d]", ret);
+		return NULL;
+	}
+	struct config_image image;
+	size_t length = sizeof(image);
+	ret = nvs_get_blob(handle, CONFIG_NVS_KEY, &image, &length);
+	nvs_close(handle);
+	if (ret != ESP_OK) {
+		ESP_LOGW(TAG, "nvs_get_blob failed: [%d]", ret);
+		return NULL;
+	}
+	if (length != sizeof(image) || image.magic != CONFIG_IMAGE_MAGIC ||
+		image.length != sizeof(image.payload)) {
+		ESP_LOGW(TAG, "new_config_by_load_nvs: invalid image");
+		return NULL;
+	}
+	if (image.version != CONFIG_IMAGE_VERSION) {
+		ESP_LOGW(TAG, "new_config_by_load_nvs: "
+			"image version [%u] mismatch", image.version);
+		return NULL;
+	}
+	if (image.crc != crc32(&image.payload, sizeof(image.payload))) {
+		ESP_LOGW(TAG, "new_config_by_load_nvs: crc mismatch");
+		return NULL;
+	}
+
+	struct config_image_payload *p = &image.payload;
+	p->wifi_ssid[sizeof(p->wifi_ssid) - 1] = '\0';
+	p->wifi_password[sizeof(p->wifi_password) - 1] = '\0';
+	struct config *config = new_config_default_value();
+	if (config == NULL) {
+		return NULL;
+	}
+	config_image_pwm_load(&config->pwm_fan, &p->pwm_fan);
+	config_image_pwm_load(&config->pwm_mos, &p->pwm_mos);
+	config->wifi.channel = p->wifi_channel;
+	config->dhcps.ip.addr = p->dhcps_ip;
+	config->dhcps.netmask.addr = p->dhcps_netmask;
+	config->dhcps.as_router = p->dhcps_as_router;
+	if (config_set_value(config, CONFIG_KEY_WIFI_SSID,
+			p->wifi_ssid) != ESP_OK ||
+		config_set_value(config, CONFIG_KEY_WIFI_PASSWORD,
+			p->wifi_password) != ESP_OK ||
+		!is_valid_config(config)) {
+		ESP_LOGW(TAG, "new_config_by_load_nvs: invalid config");
+		release_config(&config);
+		return NULL;
+	}
+	if (journal_epoch != NULL) {
+		*journal_epoch = p->journal_epoch;
+	}
+	return config;
+}
+
+esp_err_t save_config_nvs(struct config *config, uint32_t journal_epoch)
+{
+	if (!is_valid_config(config)) {
+		ESP_LOGE(TAG, "save_config_nvs failed: invalid config");
+		return ESP_FAIL;
+	}
+
+	struct config_image image;
+	memset(&image, 0, sizeof(image));
+	struct config_image_payload *p = &image.payload;
+	config_image_pwm_store(&p->pwm_fan, &config->pwm_fan);
+	config_image_pwm_store(&p->pwm_mos, &config->pwm_mos);
+	strlcpy(p->wifi_ssid, config->wifi.ssid, sizeof(p->wifi_ssid));
+	strlcpy(p->wifi_password, config->wifi.password,
+		sizeof(p->wifi_password));
+	p->wifi_channel = config->wifi.channel;
+	p->dhcps_ip = config->dhcps.ip.addr;
+	p->dhcps_netmask = config->dhcps.netmask.addr;
+	p->dhcps_as_router = config->dhcps.as_router;
+	p->journal_epoch = journal_epoch;
+	image.magic = CONFIG_IMAGE_MAGIC;
+	image.version = CONFIG_IMAGE_VERSION;
+	image.length = sizeof(image.payload);
+	image.crc = crc32(&image.payload, sizeof(image.payload));
+
+	nvs_handle_t handle;
+	esp_err_t ret = nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &handle);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "save_config_nvs: nvs_open failed: [%d]", ret);
+		return ret;
+	}
+	ret = nvs_set_blob(handle, CONFIG_NVS_KEY, &image, sizeof(image));
+	if (ret == ESP_OK) {
+		ret = nvs_commit(handle);
+	}
+	nvs_close(handle);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "save_config_nvs failed: [%d]", ret);
+		return ret;
+	}
+	ESP_LOGD(TAG, "save_config_nvs: saved %u bytes",
+		(unsigned int) sizeof(image));
+	return ESP_OK;
+}
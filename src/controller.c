@@ -2,6 +2,12 @@
 #include <esp_log.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
 
 #include "controller.h"
 #include "storage.h"
@@ -9,25 +15,44 @@
 #include "config.h"
 #include "server.h"
 #include "wifi.h"
+#include "persist.h"
+#include "udp.h"
 
 #define TAG "CONTROLLER"
 #define DEFAULT_PWM_FAN_TIMER 0
 #define DEFAULT_PWM_MOS_TIMER 1
 
+// Empty duty mailbox slot.
+#define CONTROLLER_DUTY_NONE UINT32_MAX
+
 static int default_controller_start(struct controller*);
 static int default_controller_stop(struct controller*);
 static int default_controller_save_config(struct controller*);
 static int default_controller_update_config(
 	struct controller*, const char*, const char *);
 static int default_controller_apply_pwm_duty(struct controller*);
+static void controller_snapshot_config(struct config*);
+static struct pwm_config *controller_pwm_config(
+	struct config*, enum controller_pwm);
 
 /**
  * @brief PWM Fan controller struct object.
  */
 struct controller {
 	struct config *config;
+	uint32_t config_generation; // increased when the config changes
+	SemaphoreHandle_t config_lock; // protects the config from other tasks
+	struct config staged; // batch update buffer, protected by config_lock
 	httpd_handle_t server_handle;
 
+	// Newest duty of each PWM output not applied yet, written by any task
+	// and taken by the controller tick.
+	_Atomic uint32_t duty_mailbox[CONTROLLER_PWM_MAX];
+	_Atomic uint32_t duty_coalesced;
+	struct controller_tick_stats tick_stats; // owned by the tick
+	TickType_t tick_wake;
+	int64_t tick_last_us;
+
         /**
          * @brief start starts the controller web server.
          *
@@ -45,8 +70,8 @@ struct controller {
 	int (*stop_server)(struct controller*);
 
         /**
-         * @brief save_config saves the controller config into the default
-         * config file.
+         * @brief save_config schedules saving the controller config,
+         * the config is written by the persistence task.
          *
          * @return ESP_OK if succeed.
          * @return ESP_FAIL if failed.
@@ -82,19 +107,42 @@ esp_err_t init_global_controller()
 		// re-initialize controller config if already initialized.
 		release_config(&controller->config);
 	}
+	SemaphoreHandle_t config_lock = NULL;
 	if (controller == NULL) {
 		controller = malloc(sizeof(struct controller));
+	} else {
+		config_lock = controller->config_lock;
 	}
 	memset(controller, 0, sizeof(struct controller));
+	controller->config_lock = config_lock;
+	for (int pwm = 0; pwm < CONTROLLER_PWM_MAX; pwm++) {
+		atomic_init(&controller->duty_mailbox[pwm],
+			CONTROLLER_DUTY_NONE);
+	}
 
 	ESP_LOGI(TAG, "start init global controller");
-	// Load config from default config file.
-	struct config *config = new_config_by_load_file();
+	int64_t start = esp_timer_get_time();
+	struct config *config = persist_load_config();
 	if (config == NULL) {
 		ESP_LOGE(TAG, "new_controller failed");
 		return ESP_FAIL;
 	}
+	ESP_LOGI(TAG, "config loaded in %lld us",
+		(long long) (esp_timer_get_time() - start));
 	controller->config = config;
+	if (controller->config_lock == NULL) {
+		controller->config_lock = xSemaphoreCreateMutex();
+	}
+	if (controller->config_lock == NULL) {
+		ESP_LOGE(TAG, "new_controller failed: create mutex failed");
+		return ESP_FAIL;
+	}
+	int ret = init_persist_task(
+		controller_snapshot_config, PERSIST_DEFAULT_DELAY_MS);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "init_persist_task failed: [%d]", ret);
+		return ret;
+	}
 	controller->start_server = default_controller_start;
 	controller->stop_server = default_controller_stop;
 	controller->update_config = default_controller_update_config;
@@ -135,17 +183,88 @@ bool is_global_controller_running()
 	return controller->server_handle != NULL;
 }
 
+static TickType_t controller_tick_period()
+{
+	TickType_t period = pdMS_TO_TICKS(1000 / CONTROLLER_TICK_RATE_HZ);
+	return period > 0 ? period : 1;
+}
+
+/**
+ * @brief controller_post_duty puts the duty into the mailbox of the PWM
+ * output, a duty not applied yet is replaced.
+ */
+static void controller_post_duty(enum controller_pwm pwm, uint32_t duty)
+{
+	uint32_t prev = atomic_exchange(&controller->duty_mailbox[pwm], duty);
+	if (prev != CONTROLLER_DUTY_NONE) {
+		atomic_fetch_add(&controller->duty_coalesced, 1);
+	}
+}
+
+/**
+ * @brief controller_tick applies the newest posted duty of each PWM output.
+ */
+static void controller_tick()
+{
+	struct controller_tick_stats *stats = &controller->tick_stats;
+	int64_t now = esp_timer_get_time();
+	if (controller->tick_last_us != 0) {
+		int64_t period_us = (int64_t) controller_tick_period() *
+			portTICK_PERIOD_MS * 1000;
+		int64_t jitter = now - controller->tick_last_us - period_us;
+		stats->jitter_us = jitter < 0 ? -jitter : jitter;
+		if (stats->jitter_us > stats->jitter_max_us) {
+			stats->jitter_max_us = stats->jitter_us;
+		}
+	}
+	controller->tick_last_us = now;
+	stats->ticks++;
+
+	for (int pwm = 0; pwm < CONTROLLER_PWM_MAX; pwm++) {
+		uint32_t duty = atomic_exchange(
+			&controller->duty_mailbox[pwm], CONTROLLER_DUTY_NONE);
+		if (duty == CONTROLLER_DUTY_NONE) {
+			continue;
+		}
+		int channel = controller_pwm_config(
+			controller->config, pwm)->channel;
+		esp_err_t ret = controller_pwm_set_duty(channel, duty);
+		if (ret != ESP_OK) {
+			ESP_LOGE(TAG, "controller_pwm_set_duty for channel [%d] "
+				"failed: [%d]", channel, ret);
+			continue;
+		}
+		stats->applied++;
+	}
+}
+
 bool global_controller_main_loop()
 {
 	if (!is_global_controller_running()) {
 		return false;
 	}
-	// sleep 100000 us (0.1s, 100ms).
-	usleep(50000);
+	if (controller->tick_wake == 0) {
+		controller->tick_wake = xTaskGetTickCount();
+	}
+	vTaskDelayUntil(&controller->tick_wake, controller_tick_period());
+	controller_tick();
 
 	return true;
 }
 
+void global_controller_get_tick_stats(struct controller_tick_stats *stats)
+{
+	if (stats == NULL) {
+		return;
+	}
+	if (controller == NULL) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+	memcpy(stats, &controller->tick_stats, sizeof(*stats));
+	stats->coalesced = atomic_load(&controller->duty_coalesced);
+}
+
 esp_err_t global_controller_apply_pwm_duty()
 {
 	if (!controller_initialized(controller)) {
@@ -156,6 +275,64 @@ esp_err_t global_controller_apply_pwm_duty()
 	return controller->apply_pwm_duty(controller);
 }
 
+/**
+ * @brief controller_pwm_duty_ids maps the PWM outputs to the duty keys.
+ */
+static const enum config_key_id controller_pwm_duty_ids[CONTROLLER_PWM_MAX] = {
+	[CONTROLLER_PWM_FAN] = CONFIG_ID_PWM_FAN_DUTY,
+	[CONTROLLER_PWM_MOS] = CONFIG_ID_PWM_MOS_DUTY,
+};
+
+enum config_key_id controller_pwm_duty_id(enum controller_pwm pwm)
+{
+	if (pwm >= CONTROLLER_PWM_MAX) {
+		return CONFIG_ID_MAX;
+	}
+	return controller_pwm_duty_ids[pwm];
+}
+
+static struct pwm_config *controller_pwm_config(
+	struct config *config, enum controller_pwm pwm
+) {
+	return pwm == CONTROLLER_PWM_FAN ? &config->pwm_fan : &config->pwm_mos;
+}
+
+esp_err_t global_controller_set_duty(enum controller_pwm pwm, uint32_t duty)
+{
+	if (!controller_initialized(controller) || pwm >= CONTROLLER_PWM_MAX) {
+		ESP_LOGE(TAG, "global_controller_set_duty: invalid param");
+		return ESP_FAIL;
+	}
+	xSemaphoreTake(controller->config_lock, portMAX_DELAY);
+	struct pwm_config *c = controller_pwm_config(controller->config, pwm);
+	if (c->duty == duty) {
+		xSemaphoreGive(controller->config_lock);
+		return ESP_OK;
+	}
+	esp_err_t ret = config_set_uint(controller->config,
+		controller_pwm_duty_ids[pwm], duty);
+	if (ret == ESP_OK) {
+		// Posted under the lock, so the mailboxes follow the config
+		// in the order of the writers.
+		controller->config_generation++;
+		controller_post_duty(pwm, duty);
+	}
+	xSemaphoreGive(controller->config_lock);
+	if (ret != ESP_OK) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	return ESP_OK;
+}
+
+uint32_t global_controller_get_duty(enum controller_pwm pwm)
+{
+	if (controller == NULL || controller->config == NULL ||
+		pwm >= CONTROLLER_PWM_MAX) {
+		return 0;
+	}
+	return controller_pwm_config(controller->config, pwm)->duty;
+}
+
 esp_err_t global_controller_update_config(const char* k, const char* v)
 {
 	if (!controller_initialized(controller)) {
@@ -176,9 +353,73 @@ esp_err_t global_controller_save_config()
 	return controller->save_config(controller);
 }
 
-esp_err_t global_controller_config_marshal_json(char *data)
+esp_err_t global_controller_update_config_batch(
+	config_batch_fn stage, void *ctx
+) {
+	if (!controller_initialized(controller) || stage == NULL) {
+		ESP_LOGE(TAG, "global_controller_update_config_batch: "
+			"not initialized");
+		return ESP_FAIL;
+	}
+	xSemaphoreTake(controller->config_lock, portMAX_DELAY);
+	struct config *staged = &controller->staged;
+	config_copy(staged, controller->config);
+	esp_err_t ret = stage(staged, ctx);
+	if (ret == ESP_OK && !is_valid_config(staged)) {
+		ret = ESP_FAIL;
+	}
+	if (ret != ESP_OK) {
+		xSemaphoreGive(controller->config_lock);
+		ESP_LOGE(TAG, "global_controller_update_config_batch: "
+			"batch discarded: [%d]", ret);
+		return ret;
+	}
+	uint32_t diff = config_diff(controller->config, staged);
+	if (diff != 0) {
+		config_copy(controller->config, staged);
+		controller->config_generation++;
+	}
+	// Other keys take effect after reboot.
+	if (diff & CONFIG_ID_BIT(CONFIG_ID_PWM_FAN_DUTY)) {
+		controller_post_duty(CONTROLLER_PWM_FAN,
+			controller->config->pwm_fan.duty);
+	}
+	if (diff & CONFIG_ID_BIT(CONFIG_ID_PWM_MOS_DUTY)) {
+		controller_post_duty(CONTROLLER_PWM_MOS,
+			controller->config->pwm_mos.duty);
+	}
+	xSemaphoreGive(controller->config_lock);
+	if (diff == 0) {
+		return ESP_OK;
+	}
+
+	if (controller->save_config(controller) != ESP_OK) {
+		ESP_LOGW(TAG, "global_controller_update_config_batch: "
+			"failed to schedule saving config");
+	}
+	return ret;
+}
+
+uint32_t global_controller_config_generation()
 {
-	return config_marshal_json(controller->config, data);
+	if (controller == NULL) {
+		return 0;
+	}
+	return controller->config_generation;
+}
+
+esp_err_t global_controller_config_marshal_json(
+	config_writer_t writer, void *ctx
+) {
+	if (!controller_initialized(controller)) {
+		ESP_LOGE(TAG, "global_controller_config_marshal_json: "
+			"not initialized");
+		return ESP_FAIL;
+	}
+	// Marshal a snapshot, the writer may block on the network.
+	struct config config;
+	controller_snapshot_config(&config);
+	return config_marshal_json(&config, writer, ctx);
 }
 
 esp_err_t global_controller_stop()
@@ -197,13 +438,27 @@ esp_err_t global_controller_reset_default()
 			"not initialized");
 		return ESP_FAIL;
 	}
-	release_config(&controller->config);
-	controller->config = new_config_by_load_default_file();
-	if (controller->config == NULL) {
+	struct config *config = new_config_by_load_default_file();
+	if (config == NULL) {
 		ESP_LOGE(TAG, "global_controller_reset_default: "
 			"new_config_by_load_default_file failed");
 		return ESP_FAIL;
 	}
+	// Copy into the existing config block instead of replacing it,
+	// the http server keeps the config pointer.
+	xSemaphoreTake(controller->config_lock, portMAX_DELAY);
+	config_copy(controller->config, config);
+	controller->config_generation++;
+	controller_post_duty(CONTROLLER_PWM_FAN,
+		controller->config->pwm_fan.duty);
+	controller_post_duty(CONTROLLER_PWM_MOS,
+		controller->config->pwm_mos.duty);
+	xSemaphoreGive(controller->config_lock);
+	release_config(&config);
+	if (controller->save_config(controller) != ESP_OK) {
+		ESP_LOGW(TAG, "global_controller_reset_default: "
+			"failed to schedule saving config");
+	}
 	return 0;
 }
 
@@ -213,8 +468,10 @@ bool controller_initialized(struct controller *c)
 		ESP_LOGD(TAG, "controller_initialized: c is NULL");
 		return false;
 	}
-	if (!is_valid_config(c->config)) {
-		ESP_LOGD(TAG, "controller_initialized: config is invalid");
+	// The config is only read and validated by the paths holding the
+	// config lock, other tasks may be updating it.
+	if (!c->config) {
+		ESP_LOGD(TAG, "controller_initialized: config is NULL");
 		return false;
 	}
 	if (!c->start_server || !c->stop_server) {
@@ -251,20 +508,25 @@ static int default_controller_start(struct controller* c)
 		return ret;
 	}
 
+	// The UDP control is optional, the web server still works without it.
+	if (start_udp_control(c->config) != ESP_OK) {
+		ESP_LOGW(TAG, "start_udp_control failed");
+	}
+
 	// init PWM for fan.
 	ret = init_controller_pwm(
-		controller->config->pwm_fan->gpio,
-		controller->config->pwm_fan->channel,
+		controller->config->pwm_fan.gpio,
+		controller->config->pwm_fan.channel,
 		DEFAULT_PWM_FAN_TIMER,
-		controller->config->pwm_fan->frequency);
+		controller->config->pwm_fan.frequency);
 	if (ret != ESP_OK) {
 		ESP_LOGE(TAG, "init_controller_pwm for pwm_fan failed: "
 			"[%d]", ret);
 		return ret;
 	}
 	ret = controller_pwm_set_duty(
-		controller->config->pwm_fan->channel,
-		controller->config->pwm_fan->duty);
+		controller->config->pwm_fan.channel,
+		controller->config->pwm_fan.duty);
 	if (ret != ESP_OK) {
 		ESP_LOGE(TAG, "controller_pwm_set_duty for pwm_fan failed: "
 			"[%d]", ret);
@@ -273,18 +535,18 @@ static int default_controller_start(struct controller* c)
 
 	// init PWM for MOSFET (or LED).
 	ret = init_controller_pwm(
-		controller->config->pwm_mos->gpio,
-		controller->config->pwm_mos->channel,
+		controller->config->pwm_mos.gpio,
+		controller->config->pwm_mos.channel,
 		DEFAULT_PWM_MOS_TIMER,
-		controller->config->pwm_mos->frequency);
+		controller->config->pwm_mos.frequency);
 	if (ret != ESP_OK) {
 		ESP_LOGE(TAG, "init_controller_pwm for pwm_mos failed: "
 			"[%d]", ret);
 		return ret;
 	}
 	ret = controller_pwm_set_duty(
-		controller->config->pwm_mos->channel,
-		controller->config->pwm_mos->duty);
+		controller->config->pwm_mos.channel,
+		controller->config->pwm_mos.duty);
 	if (ret != ESP_OK) {
 		ESP_LOGE(TAG, "controller_pwm_set_duty for pwm_mos failed: "
 			"[%d]", ret);
@@ -302,9 +564,9 @@ static int default_controller_stop(struct controller* c)
 	}
 	ESP_LOGI(TAG, "controller server will restart");
 	int ret = 0;
-	if ((ret = save_config_file(c->config)) != 0) {
+	if ((ret = persist_flush()) != 0) {
 		ESP_LOGW(TAG, "default_controller_stop: "
-			"save_config_file: [%d]", ret);
+			"persist_flush: [%d]", ret);
 	}
 	ESP_LOGW(TAG, "server will restart now!");
 	ESP_ERROR_CHECK(ESP_FAIL);
@@ -313,31 +575,36 @@ static int default_controller_stop(struct controller* c)
 
 static int default_controller_save_config(struct controller* c)
 {
-	return save_config_file(c->config);
+	return persist_request();
 }
 
 static int default_controller_update_config(
 	struct controller *c, const char* k, const char *v
 ) {
-	return config_set_value(c->config, k, v);
+	xSemaphoreTake(c->config_lock, portMAX_DELAY);
+	int ret = config_set_value(c->config, k, v);
+	c->config_generation++;
+	xSemaphoreGive(c->config_lock);
+	return ret;
+}
+
+/**
+ * @brief controller_snapshot_config copies the controller config for the
+ * persistence task.
+ */
+static void controller_snapshot_config(struct config *config)
+{
+	xSemaphoreTake(controller->config_lock, portMAX_DELAY);
+	config_copy(config, controller->config);
+	xSemaphoreGive(controller->config_lock);
 }
 
 static int default_controller_apply_pwm_duty(struct controller* c) {
-	// Update fan PWM duty & MOSFET duty without reboot.
-	int ret = 0;
-	ret = controller_pwm_set_duty(
-		c->config->pwm_fan->channel, c->config->pwm_fan->duty);
-	if (ret != ESP_OK) {
-		ESP_LOGE(TAG, "controller_pwm_set_duty for pwm_fan failed: "
-			"[%d]", ret);
-		return ret;
-	}
-	ret = controller_pwm_set_duty(
-		c->config->pwm_mos->channel, c->config->pwm_mos->duty);
-	if (ret != ESP_OK) {
-		ESP_LOGE(TAG, "controller_pwm_set_duty for pwm_mos failed: "
-			"[%d]", ret);
-		return ret;
-	}
+	// Update fan PWM duty & MOSFET duty without reboot, the duty is
+	// applied by the controller tick.
+	xSemaphoreTake(c->config_lock, portMAX_DELAY);
+	controller_post_duty(CONTROLLER_PWM_FAN, c->config->pwm_fan.duty);
+	controller_post_duty(CONTROLLER_PWM_MOS, c->config->pwm_mos.duty);
+	xSemaphoreGive(c->config_lock);
 	return 0;
 }
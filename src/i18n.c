@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+
+#include "i18n.h"
+#include "storage.h"
+
+#define TAG "I18N"
+
+#define I18N_HEADER_SIZE 8
+
+static struct {
+	char *data;
+	size_t length;
+	int locales;
+	int strings;
+	const uint8_t *index; // u16 offset & u16 length of the strings
+	const char *blob;
+} i18n;
+
+static uint16_t i18n_get_le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+/**
+ * @brief i18n_validate checks the string tables are within the file.
+ */
+static esp_err_t i18n_validate(const char *data, size_t length)
+{
+	const uint8_t *p = (const uint8_t *) data;
+	if (length < I18N_HEADER_SIZE || memcmp(data, "I18N", 4) != 0) {
+		return ESP_FAIL;
+	}
+	int locales = p[4];
+	int strings = i18n_get_le16(p + 6);
+	size_t blob = I18N_HEADER_SIZE + locales * I18N_CODE_MAX_LEN +
+		locales * strings * 4;
+	if (locales == 0 || blob > length) {
+		return ESP_FAIL;
+	}
+	for (int i = 0; i < locales; i++) {
+		const char *code = data + I18N_HEADER_SIZE +
+			i * I18N_CODE_MAX_LEN;
+		if (memchr(code, '\0', I18N_CODE_MAX_LEN) == NULL) {
+			return ESP_FAIL;
+		}
+	}
+	const uint8_t *index = p + I18N_HEADER_SIZE +
+		locales * I18N_CODE_MAX_LEN;
+	for (int i = 0; i < locales * strings; i++) {
+		size_t offset = i18n_get_le16(index + i * 4);
+		size_t size = i18n_get_le16(index + i * 4 + 2);
+		if (blob + offset + I18N_STRING_HEADER_SIZE + size > length) {
+			return ESP_FAIL;
+		}
+	}
+	i18n.locales = locales;
+	i18n.strings = strings;
+	i18n.index = index;
+	i18n.blob = data + blob;
+	return ESP_OK;
+}
+
+esp_err_t init_i18n(const char *base_path)
+{
+	if (base_path == NULL) {
+		ESP_LOGE(TAG, "init_i18n: invalid param");
+		return ESP_FAIL;
+	}
+	if (i18n.data != NULL) {
+		return ESP_OK;
+	}
+	char filepath[32];
+	snprintf(filepath, sizeof(filepath), "%s/%s", base_path, I18N_FILE);
+	if (!is_regular_file(filepath)) {
+		ESP_LOGW(TAG, "%s not found, templates disabled", filepath);
+		return ESP_ERR_NOT_FOUND;
+	}
+	char *data = NULL;
+	int length = read_file(&data, filepath);
+	if (data == NULL || length <= 0) {
+		ESP_LOGE(TAG, "init_i18n: read %s failed", filepath);
+		free(data);
+		return ESP_FAIL;
+	}
+	if (i18n_validate(data, length) != ESP_OK) {
+		ESP_LOGE(TAG, "init_i18n: invalid %s", filepath);
+		free(data);
+		return ESP_FAIL;
+	}
+	i18n.data = data;
+	i18n.length = length;
+	ESP_LOGI(TAG, "loaded [%d] locales of [%d] strings",
+		i18n.locales, i18n.strings);
+	return ESP_OK;
+}
+
+int i18n_locale_count()
+{
+	return i18n.data != NULL ? i18n.locales : 0;
+}
+
+const char *i18n_locale_code(int locale)
+{
+	if (locale < 0 || locale >= i18n_locale_count()) {
+		return NULL;
+	}
+	return i18n.data + I18N_HEADER_SIZE + locale * I18N_CODE_MAX_LEN;
+}
+
+int i18n_find_locale(const char *code, size_t length)
+{
+	for (int i = 0; i < i18n_locale_count(); i++) {
+		const char *c = i18n_locale_code(i);
+		if (strlen(c) == length && strncasecmp(c, code, length) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int i18n_negotiate(httpd_req_t *req)
+{
+	char value[128] = { 0 };
+	size_t size = sizeof(value);
+	if (httpd_req_get_cookie_val(req, I18N_COOKIE, value, &size)
+		== ESP_OK) {
+		int locale = i18n_find_locale(value, strlen(value));
+		if (locale >= 0) {
+			return locale;
+		}
+	}
+
+	// Such as 'zh-CN,zh;q=0.9,en;q=0.8'.
+	memset(value, 0, sizeof(value));
+	esp_err_t ret = httpd_req_get_hdr_value_str(
+		req, "Accept-Language", value, sizeof(value));
+	if (ret != ESP_OK && ret != ESP_ERR_HTTPD_RESULT_TRUNC) {
+		return 0;
+	}
+	int best = 0;
+	double best_q = 0;
+	char *saveptr = NULL;
+	for (char *token = strtok_r(value, ",", &saveptr); token != NULL;
+		token = strtok_r(NULL, ",", &saveptr)) {
+		while (*token == ' ') {
+			token++;
+		}
+		int locale = i18n_find_locale(token, strcspn(token, "-_; "));
+		if (locale < 0) {
+			continue;
+		}
+		const char *q = strstr(token, "q=");
+		double quality = q != NULL ? strtod(q + 2, NULL) : 1;
+		if (quality > best_q) {
+			best = locale;
+			best_q = quality;
+		}
+	}
+	return best;
+}
+
+esp_err_t i18n_get_string(
+	int locale, uint16_t id, const char **string, size_t *length
+) {
+	if (locale < 0 || locale >= i18n_locale_count() ||
+		id >= i18n.strings || string == NULL || length == NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	const uint8_t *entry = i18n.index + (locale * i18n.strings + id) * 4;
+	*string = i18n.blob + i18n_get_le16(entry) + I18N_STRING_HEADER_SIZE;
+	*length = i18n_get_le16(entry + 2);
+	return ESP_OK;
+}
@@ -0,0 +1,159 @@
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+
+#include "journal.h"
+#include "config.h"
+
+#define TAG "JOURNAL"
+
+/**
+ * @brief CONFIG_JOURNAL_MAGIC is 'PWMJ' in little endian.
+ */
+#define CONFIG_JOURNAL_MAGIC 0x4a4d5750
+
+/**
+ * @brief journal file header.
+ */
+struct journal_header {
+	uint32_t magic;
+	uint32_t epoch; // the same as the epoch in the config snapshot
+} __attribute__((packed));
+
+/**
+ * @brief journal record of a key value delta, all fields are little endian.
+ */
+struct journal_record {
+	uint8_t id;     // CONFIG_ID_* index
+	uint32_t value; // numeric value
+	uint8_t crc;    // crc8 of the id & value
+} __attribute__((packed));
+
+static uint8_t journal_crc8(const uint8_t *data, size_t length)
+{
+	uint8_t crc = 0xff;
+	for (size_t i = 0; i < length; i++) {
+		crc ^= data[i];
+		for (int j = 0; j < 8; j++) {
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+esp_err_t config_journal_replay(struct config *config, uint32_t epoch)
+{
+	if (config == NULL) {
+		return ESP_FAIL;
+	}
+	FILE *fd = fopen(CONFIG_JOURNAL_FILE, "rb");
+	if (fd == NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	struct journal_header header;
+	if (fread(&header, sizeof(header), 1, fd) != 1 ||
+		header.magic != CONFIG_JOURNAL_MAGIC || header.epoch != epoch) {
+		ESP_LOGW(TAG, "config_journal_replay: journal ignored");
+		fclose(fd);
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	esp_err_t ret = ESP_OK;
+	int count = 0;
+	struct journal_record record;
+	size_t n = 0;
+	while ((n = fread(&record, 1, sizeof(record), fd)) == sizeof(record)) {
+		if (record.crc != journal_crc8((uint8_t*) &record,
+			offsetof(struct journal_record, crc))) {
+			ESP_LOGW(TAG, "config_journal_replay: "
+				"corrupted record [%d]", count);
+			ret = ESP_ERR_INVALID_SIZE;
+			break;
+		}
+		if (config_set_uint(config, record.id, record.value) != ESP_OK) {
+			ESP_LOGW(TAG, "config_journal_replay: "
+				"invalid record [%d]", count);
+		}
+		count++;
+	}
+	if (ret == ESP_OK && n != 0) {
+		ESP_LOGW(TAG, "config_journal_replay: incomplete record");
+		ret = ESP_ERR_INVALID_SIZE;
+	}
+	fclose(fd);
+	ESP_LOGI(TAG, "replayed %d journal records", count);
+	return ret;
+}
+
+esp_err_t config_journal_append(const struct config *config, uint32_t keys)
+{
+	struct journal_record records[CONFIG_ID_MAX];
+	size_t count = 0;
+	for (int i = 0; i < CONFIG_ID_MAX; i++) {
+		if (!(keys & CONFIG_ID_BIT(i))) {
+			continue;
+		}
+		struct journal_record *record = &records[count];
+		uint32_t value = 0;
+		if (config_get_uint(config, i, &value) != ESP_OK) {
+			ESP_LOGE(TAG, "config_journal_append: "
+				"key [%d] can not be appended", i);
+			return ESP_FAIL;
+		}
+		record->id = i;
+		record->value = value;
+		record->crc = journal_crc8((uint8_t*) record,
+			offsetof(struct journal_record, crc));
+		count++;
+	}
+	if (count == 0) {
+		return ESP_OK;
+	}
+
+	FILE *fd = fopen(CONFIG_JOURNAL_FILE, "ab");
+	if (fd == NULL) {
+		ESP_LOGE(TAG, "failed to open: %s", CONFIG_JOURNAL_FILE);
+		return ESP_FAIL;
+	}
+	size_t n = fwrite(records, sizeof(struct journal_record), count, fd);
+	if (fclose(fd) != 0 || n != count) {
+		ESP_LOGE(TAG, "failed to append: %s", CONFIG_JOURNAL_FILE);
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+esp_err_t config_journal_reset(uint32_t epoch)
+{
+	struct journal_header header = {
+		.magic = CONFIG_JOURNAL_MAGIC,
+		.epoch = epoch,
+	};
+	// The file is not replaced atomically, a torn header will not match
+	// the epoch of the snapshot and the journal will be ignored.
+	FILE *fd = fopen(CONFIG_JOURNAL_FILE, "wb");
+	if (fd == NULL) {
+		ESP_LOGE(TAG, "failed to open: %s", CONFIG_JOURNAL_FILE);
+		return ESP_FAIL;
+	}
+	size_t n = fwrite(&header, sizeof(header), 1, fd);
+	if (fclose(fd) != 0 || n != 1) {
+		ESP_LOGE(TAG, "failed to reset: %s", CONFIG_JOURNAL_FILE);
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+size_t config_journal_size()
+{
+	struct stat s;
+	if (stat(CONFIG_JOURNAL_FILE, &s) != 0) {
+		return 0;
+	}
+	return s.st_size;
+}
@@ -0,0 +1,196 @@
+#include <string.h>
+#include <stdbool.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+
+#include "json.h"
+
+#define TAG "JSON"
+
+/**
+ * @brief json tokenizer state, all tokens point into the buffer.
+ */
+struct json_parser {
+	char *p;   // current position
+	char *end; // end of the buffer
+};
+
+static void json_skip_space(struct json_parser *parser)
+{
+	while (parser->p < parser->end && (*parser->p == ' ' ||
+		*parser->p == '\t' || *parser->p == '\r' || *parser->p == '\n')) {
+		parser->p++;
+	}
+}
+
+static bool json_expect(struct json_parser *parser, char c)
+{
+	json_skip_space(parser);
+	if (parser->p >= parser->end || *parser->p != c) {
+		return false;
+	}
+	parser->p++;
+	return true;
+}
+
+/**
+ * @brief json_parse_string unescapes the string at the position in place,
+ * the string is terminated at its closing quote.
+ * Only '\u' escapes of ASCII characters are supported.
+ */
+static char *json_parse_string(struct json_parser *parser)
+{
+	if (!json_expect(parser, '"')) {
+		return NULL;
+	}
+	char *start = parser->p;
+	char *out = parser->p;
+	while (parser->p < parser->end) {
+		char c = *parser->p++;
+		if (c == '"') {
+			*out = '\0';
+			return start;
+		}
+		if ((unsigned char) c < 0x20) {
+			return NULL;
+		}
+		if (c != '\\') {
+			*out++ = c;
+			continue;
+		}
+		if (parser->p >= parser->end) {
+			return NULL;
+		}
+		switch (c = *parser->p++) {
+		case '"':
+		case '\\':
+		case '/':
+			*out++ = c;
+			break;
+		case 'b':
+			*out++ = '\b';
+			break;
+		case 'f':
+			*out++ = '\f';
+			break;
+		case 'n':
+			*out++ = '\n';
+			break;
+		case 'r':
+			*out++ = '\r';
+			break;
+		case 't':
+			*out++ = '\t';
+			break;
+		case 'u':
+		{
+			unsigned int code = 0;
+			for (int i = 0; i < 4; i++) {
+				if (parser->p >= parser->end) {
+					return NULL;
+				}
+				char h = *parser->p++;
+				code <<= 4;
+				if (h >= '0' && h <= '9') {
+					code |= h - '0';
+				} else if (h >= 'a' && h <= 'f') {
+					code |= h - 'a' + 10;
+				} else if (h >= 'A' && h <= 'F') {
+					code |= h - 'A' + 10;
+				} else {
+					return NULL;
+				}
+			}
+			if (code == 0 || code > 0x7f) {
+				return NULL;
+			}
+			*out++ = code;
+			break;
+		}
+		default:
+			return NULL;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief json_parse_literal parses the number, true, false or null literal
+ * at the position, the literal is terminated in place after its delimiter
+ * is checked.
+ */
+static char *json_parse_literal(struct json_parser *parser)
+{
+	char *start = parser->p;
+	while (parser->p < parser->end && ((*parser->p >= '0' &&
+		*parser->p <= '9') || (*parser->p >= 'a' && *parser->p <= 'z') ||
+		*parser->p == '-' || *parser->p == '+' || *parser->p == '.' ||
+		*parser->p == 'E')) {
+		parser->p++;
+	}
+	if (parser->p == start) {
+		return NULL;
+	}
+	return start;
+}
+
+esp_err_t json_parse_object(
+	char *buffer, size_t length, json_member_fn fn, void *ctx
+) {
+	if (buffer == NULL || fn == NULL) {
+		ESP_LOGE(TAG, "json_parse_object: invalid param");
+		return ESP_ERR_INVALID_ARG;
+	}
+	struct json_parser parser = {
+		.p = buffer,
+		.end = buffer + length,
+	};
+	if (!json_expect(&parser, '{')) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (json_expect(&parser, '}')) {
+		json_skip_space(&parser);
+		return parser.p == parser.end ? ESP_OK : ESP_ERR_INVALID_ARG;
+	}
+	while (true) {
+		char *key = json_parse_string(&parser);
+		if (key == NULL || !json_expect(&parser, ':')) {
+			return ESP_ERR_INVALID_ARG;
+		}
+		json_skip_space(&parser);
+		if (parser.p >= parser.end) {
+			return ESP_ERR_INVALID_ARG;
+		}
+		char *value = NULL;
+		char *literal_end = NULL;
+		if (*parser.p == '"') {
+			value = json_parse_string(&parser);
+		} else {
+			value = json_parse_literal(&parser);
+			literal_end = parser.p;
+		}
+		if (value == NULL) {
+			return ESP_ERR_INVALID_ARG;
+		}
+		bool last = false;
+		if (json_expect(&parser, '}')) {
+			last = true;
+		} else if (!json_expect(&parser, ',')) {
+			return ESP_ERR_INVALID_ARG;
+		}
+		if (literal_end != NULL) {
+			// The delimiter is checked, terminate the literal.
+			*literal_end = '\0';
+		}
+		esp_err_t ret = fn(key, value, ctx);
+		if (ret != ESP_OK) {
+			return ret;
+		}
+		if (last) {
+			break;
+		}
+	}
+	json_skip_space(&parser);
+	return parser.p == parser.end ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <esp_rom_crc.h>
+
+#include "page.h"
+#include "i18n.h"
+#include "api.h"
+#include "arena.h"
+#include "server.h"
+
+#define TAG "PAGE"
+
+#define PAGE_HEADER_SIZE 12
+#define PAGE_STORED_BLOCK_SIZE 5
+#define PAGE_GZIP_TRAILER_SIZE 8
+// Max size of the state slot buffer of page_send_state.
+#define PAGE_STATE_BUFFER_MAX_SIZE (API_SETTINGS_JSON_SIZE + \
+	PAGE_SLOT_TAIL_MAX_SIZE + 2 * PAGE_STORED_BLOCK_SIZE + \
+	PAGE_GZIP_TRAILER_SIZE)
+
+// The state slot buffer is allocated from the request arena after the
+// path buffers of http_default_handler and http_handle_page_req.
+_Static_assert(CONFIG_HTTPD_MAX_URI_LEN + ASSET_PATH_MAX_LEN +
+	PAGE_STATE_BUFFER_MAX_SIZE + 3 * ARENA_ALIGN <= HTTP_ARENA_SIZE,
+	"HTTP_ARENA_SIZE too small for the state slot pages");
+
+// Gzip header of the rendered '.gz' pages: deflate, no flags, mtime 0,
+// max compression, unknown OS.
+static const uint8_t page_gzip_header[] = {
+	0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0xff,
+};
+
+/**
+ * @brief page_template is the parsed template of a locale.
+ */
+struct page_template {
+	uint8_t flags;
+	int ops;
+	const uint8_t *op;    // u16 literal length & u16 string ID of the ops
+	const char *literals;
+	const char *tail;     // content after the state slot
+	size_t tail_length;
+	uint32_t crc;         // crc32 of the page of the locale before the slot
+	uint32_t size;        // size of the page of the locale before the slot
+};
+
+/**
+ * @brief page_render is the progress of a page being sent.
+ */
+struct page_render {
+	httpd_req_t *req;
+	int64_t start;
+	int64_t first_byte; // 0 if nothing is sent
+};
+
+static struct {
+	portMUX_TYPE lock;
+	struct page_stats stats;
+} page = {
+	.lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static uint16_t page_get_le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static uint32_t page_get_le32(const uint8_t *p)
+{
+	return page_get_le16(p) | (uint32_t) page_get_le16(p + 2) << 16;
+}
+
+static size_t page_put_le32(uint8_t *p, uint32_t value)
+{
+	for (int i = 0; i < 4; i++) {
+		p[i] = value >> (8 * i);
+	}
+	return 4;
+}
+
+/**
+ * @brief page_put_stored_block writes the header of a deflate stored block
+ * of the length, the stream is at a byte boundary.
+ */
+static size_t page_put_stored_block(uint8_t *p, size_t length, bool final)
+{
+	p[0] = final ? 0x01 : 0x00; // BFINAL, BTYPE 00
+	p[1] = length & 0xff;
+	p[2] = length >> 8;
+	p[3] = ~p[1];
+	p[4] = ~p[2];
+	return PAGE_STORED_BLOCK_SIZE;
+}
+
+/**
+ * @brief page_parse validates the template and gets the checksum of the
+ * page of the locale.
+ */
+static esp_err_t page_parse(
+	const struct asset *asset, int locale, struct page_template *t
+) {
+	const uint8_t *p = (const uint8_t *) asset->data;
+	if (p == NULL || asset->length < PAGE_HEADER_SIZE ||
+		memcmp(p, "TPL", 3) != 0) {
+		return ESP_FAIL;
+	}
+	int locales = p[8];
+	if (locales != i18n_locale_count() || locale < 0 ||
+		locale >= locales) {
+		return ESP_FAIL;
+	}
+	t->flags = p[3];
+	t->ops = page_get_le16(p + 4);
+	t->tail_length = page_get_le16(p + 6);
+	t->crc = page_get_le32(p + PAGE_HEADER_SIZE + locale * 8);
+	t->size = page_get_le32(p + PAGE_HEADER_SIZE + locale * 8 + 4);
+	t->op = p + PAGE_HEADER_SIZE + locales * 8;
+	size_t offset = PAGE_HEADER_SIZE + locales * 8 + t->ops * 4;
+	for (int i = 0; i < t->ops; i++) {
+		offset += page_get_le16(t->op + i * 4);
+	}
+	if (offset + t->tail_length != asset->length) {
+		return ESP_FAIL;
+	}
+	if (t->flags & PAGE_TEMPLATE_FLAG_SLOT) {
+		if (t->ops == 0 || t->tail_length > PAGE_SLOT_TAIL_MAX_SIZE ||
+			page_get_le16(t->op + (t->ops - 1) * 4 + 2) !=
+			PAGE_STRING_STATE) {
+			return ESP_FAIL;
+		}
+	}
+	t->literals = asset->data + PAGE_HEADER_SIZE + locales * 8 +
+		t->ops * 4;
+	t->tail = asset->data + offset;
+	return ESP_OK;
+}
+
+static esp_err_t page_send_chunk(
+	struct page_render *r, const void *data, size_t length
+) {
+	if (length == 0) {
+		return ESP_OK;
+	}
+	esp_err_t ret = httpd_resp_send_chunk(r->req, data, length);
+	if (r->first_byte == 0) {
+		r->first_byte = esp_timer_get_time();
+	}
+	return ret;
+}
+
+/**
+ * @brief page_send_state sends the settings JSON of the state slot and the
+ * tail content. For the gzip variant, they are sent in stored blocks, then
+ * the gzip trailer, the crc32 continues from the content before the slot.
+ */
+static esp_err_t page_send_state(
+	struct page_render *r, const struct page_template *t
+) {
+	struct arena *arena = http_req_arena(r->req);
+	size_t mark = arena_mark(arena);
+	bool gzip = t->flags & PAGE_TEMPLATE_FLAG_GZIP;
+	uint8_t *buffer = arena_alloc(arena, API_SETTINGS_JSON_SIZE +
+		t->tail_length + 2 * PAGE_STORED_BLOCK_SIZE +
+		PAGE_GZIP_TRAILER_SIZE);
+	if (buffer == NULL) {
+		ESP_LOGE(TAG, "page_send_state: out of memory");
+		return ESP_ERR_NO_MEM;
+	}
+	uint8_t *state = gzip ? buffer + PAGE_STORED_BLOCK_SIZE : buffer;
+	size_t length = 0;
+	if (api_copy_settings_json((char *) state,
+		API_SETTINGS_JSON_SIZE, &length) != ESP_OK) {
+		// The page requests the state.
+		ESP_LOGW(TAG, "page_send_state: state not filled");
+		length = 0;
+	}
+	uint8_t *p = state + length;
+	if (gzip) {
+		page_put_stored_block(buffer, length, false);
+		p += page_put_stored_block(p, t->tail_length, true);
+	}
+	memcpy(p, t->tail, t->tail_length);
+	p += t->tail_length;
+	if (gzip) {
+		uint32_t crc = esp_rom_crc32_le(t->crc, state, length);
+		crc = esp_rom_crc32_le(crc,
+			(const uint8_t *) t->tail, t->tail_length);
+		p += page_put_le32(p, crc);
+		p += page_put_le32(p, t->size + length + t->tail_length);
+	}
+	esp_err_t ret = page_send_chunk(r, buffer, p - buffer);
+	arena_rewind(arena, mark);
+	return ret;
+}
+
+/**
+ * @brief page_send_end ends the deflate stream by an empty final stored
+ * block, then sends the gzip trailer.
+ */
+static esp_err_t page_send_end(
+	struct page_render *r, const struct page_template *t
+) {
+	uint8_t end[PAGE_STORED_BLOCK_SIZE + PAGE_GZIP_TRAILER_SIZE];
+	uint8_t *p = end;
+	p += page_put_stored_block(p, 0, true);
+	p += page_put_le32(p, t->crc);
+	p += page_put_le32(p, t->size);
+	return page_send_chunk(r, end, p - end);
+}
+
+static esp_err_t page_send_body(
+	struct page_render *r, const struct page_template *t, int locale
+) {
+	bool gzip = t->flags & PAGE_TEMPLATE_FLAG_GZIP;
+	esp_err_t ret = ESP_OK;
+	if (gzip) {
+		ret = page_send_chunk(r, page_gzip_header,
+			sizeof(page_gzip_header));
+	}
+	const char *literal = t->literals;
+	for (int i = 0; i < t->ops && ret == ESP_OK; i++) {
+		size_t length = page_get_le16(t->op + i * 4);
+		uint16_t id = page_get_le16(t->op + i * 4 + 2);
+		ret = page_send_chunk(r, literal, length);
+		literal += length;
+		if (ret != ESP_OK || id == PAGE_STRING_NONE ||
+			id == PAGE_STRING_STATE) {
+			continue;
+		}
+		const char *string = NULL;
+		if (i18n_get_string(locale, id, &string, &length) != ESP_OK) {
+			ESP_LOGE(TAG, "page_send: string [%u] not found",
+				(unsigned int) id);
+			return ESP_FAIL;
+		}
+		if (gzip) {
+			// Sent with its stored block header.
+			string -= I18N_STRING_HEADER_SIZE;
+			length += I18N_STRING_HEADER_SIZE;
+		}
+		ret = page_send_chunk(r, string, length);
+	}
+	if (ret != ESP_OK) {
+		return ret;
+	}
+	if (t->flags & PAGE_TEMPLATE_FLAG_SLOT) {
+		return page_send_state(r, t);
+	}
+	if (gzip) {
+		return page_send_end(r, t);
+	}
+	return ESP_OK;
+}
+
+esp_err_t page_resolve(const char *path, char *template, size_t size)
+{
+	if (path == NULL || template == NULL || i18n_locale_count() == 0) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	size_t n = strlen(path);
+	int m = 0;
+	if (n > 0 && path[n-1] == '/') {
+		m = snprintf(template, size, "%sindex.html%s",
+			path, PAGE_TEMPLATE_SUFFIX);
+	} else {
+		m = snprintf(template, size, "%s%s",
+			path, PAGE_TEMPLATE_SUFFIX);
+		if (m > 0 && (size_t) m < size && asset_exists(template)) {
+			return ESP_OK;
+		}
+		m = snprintf(template, size, "%s/index.html%s",
+			path, PAGE_TEMPLATE_SUFFIX);
+	}
+	if (m > 0 && (size_t) m < size && asset_exists(template)) {
+		return ESP_OK;
+	}
+	return ESP_ERR_NOT_FOUND;
+}
+
+bool page_has_state(const struct asset *template)
+{
+	return template != NULL && template->data != NULL &&
+		template->length >= PAGE_HEADER_SIZE &&
+		(template->data[3] & PAGE_TEMPLATE_FLAG_SLOT);
+}
+
+esp_err_t page_send(
+	httpd_req_t *req, const struct asset *template, int locale
+) {
+	struct page_template t;
+	if (template == NULL || page_parse(template, locale, &t) != ESP_OK) {
+		ESP_LOGE(TAG, "page_send: invalid template %s",
+			template != NULL ? template->file : "");
+		return httpd_resp_send_err(req,
+			HTTPD_500_INTERNAL_SERVER_ERROR, "invalid template");
+	}
+	struct page_render r = {
+		.req = req,
+		.start = esp_timer_get_time(),
+	};
+	esp_err_t ret = httpd_resp_set_type(req, "text/html");
+	if (ret == ESP_OK && (t.flags & PAGE_TEMPLATE_FLAG_GZIP)) {
+		ret = httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+	}
+	if (ret == ESP_OK) {
+		ret = page_send_body(&r, &t, locale);
+	}
+	if (ret != ESP_OK) {
+		// The response may be started, abort the connection.
+		ESP_LOGE(TAG, "page_send: %s failed: %d", template->file, ret);
+		return ret;
+	}
+	ret = httpd_resp_send_chunk(req, NULL, 0);
+
+	int64_t end = esp_timer_get_time();
+	uint32_t first_byte = (r.first_byte != 0 ? r.first_byte : end) -
+		r.start;
+	portENTER_CRITICAL(&page.lock);
+	page.stats.renders++;
+	page.stats.first_byte_us += first_byte;
+	if (first_byte > page.stats.first_byte_max_us) {
+		page.stats.first_byte_max_us = first_byte;
+	}
+	page.stats.render_us += end - r.start;
+	portEXIT_CRITICAL(&page.lock);
+	return ret;
+}
+
+void page_get_stats(struct page_stats *stats)
+{
+	if (stats == NULL) {
+		return;
+	}
+	portENTER_CRITICAL(&page.lock);
+	memcpy(stats, &page.stats, sizeof(*stats));
+	portEXIT_CRITICAL(&page.lock);
+}
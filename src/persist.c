@@ -0,0 +1,223 @@
+#include <string.h>
+#include <stdbool.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+#include "persist.h"
+#include "config.h"
+#include "journal.h"
+
+#define TAG "PERSIST"
+#define PERSIST_TASK_STACK_SIZE 4096
+#define PERSIST_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+
+/**
+ * @brief private persistence state.
+ */
+static struct {
+	TaskHandle_t task;
+	SemaphoreHandle_t lock; // serializes the flushes
+	persist_snapshot_fn snapshot;
+	uint32_t delay_ms;
+	volatile bool dirty;
+	struct persist_stats stats;
+	uint32_t epoch;       // journal epoch of the NVS snapshot
+	bool compact;         // journal is unusable, compact on next flush
+	struct config saved;  // config persisted in the snapshot & journal
+	struct config config; // snapshot buffer used by the flush
+} persist;
+
+/**
+ * @brief persist_journal_keys gets the mask of the keys can be journaled.
+ */
+static uint32_t persist_journal_keys()
+{
+	uint32_t keys = 0;
+	for (int i = 0; i < CONFIG_ID_MAX; i++) {
+		const struct config_schema *schema = config_schema_get(i);
+		if (schema != NULL && (schema->flags & CONFIG_FLAG_JOURNAL)) {
+			keys |= CONFIG_ID_BIT(i);
+		}
+	}
+	return keys;
+}
+
+/**
+ * @brief persist_compact writes the whole config to the NVS snapshot and
+ * the config file, then starts a new journal epoch.
+ * The snapshot is written before resetting the journal, so the journal of
+ * the old epoch is ignored if the reset is interrupted.
+ */
+static esp_err_t persist_compact(struct config *config)
+{
+	uint32_t epoch = persist.epoch + 1;
+	esp_err_t ret = save_config_nvs(config, epoch);
+	if (ret != ESP_OK) {
+		return ret;
+	}
+	persist.epoch = epoch;
+	persist.compact = true;
+	// Keep the config file in sync for exporting and as a fallback.
+	ret = save_config_file(config);
+	if (ret != ESP_OK) {
+		return ret;
+	}
+	ret = config_journal_reset(epoch);
+	if (ret != ESP_OK) {
+		return ret;
+	}
+	persist.compact = false;
+	persist.stats.compactions++;
+	return ESP_OK;
+}
+
+struct config *persist_load_config()
+{
+	uint32_t epoch = 0;
+	struct config *config = new_config_by_load_nvs(&epoch);
+	if (config != NULL) {
+		persist.epoch = epoch;
+		esp_err_t ret = config_journal_replay(config, epoch);
+		if (ret == ESP_ERR_NOT_FOUND) {
+			// The snapshot holds everything, start an empty journal.
+			persist.compact = config_journal_reset(epoch) != ESP_OK;
+		} else if (ret != ESP_OK) {
+			// Records after a torn append can not be read back, move
+			// the replayed config into a new snapshot.
+			persist.compact = persist_compact(config) != ESP_OK;
+		}
+	} else {
+		config = new_config_by_load_file();
+		if (config == NULL) {
+			return NULL;
+		}
+		persist.epoch = 0;
+		if (persist_compact(config) != ESP_OK) {
+			ESP_LOGW(TAG, "failed to rebuild config snapshot");
+		}
+	}
+	config_copy(&persist.saved, config);
+	return config;
+}
+
+static void persist_task(void *arg)
+{
+	while (true) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		// Requests arriving in the delay window are written together.
+		vTaskDelay(pdMS_TO_TICKS(persist.delay_ms));
+		ulTaskNotifyTake(pdTRUE, 0);
+		persist_flush();
+	}
+}
+
+esp_err_t init_persist_task(persist_snapshot_fn snapshot, uint32_t delay_ms)
+{
+	if (snapshot == NULL) {
+		ESP_LOGE(TAG, "init_persist_task: invalid param");
+		return ESP_FAIL;
+	}
+	if (persist.task != NULL) {
+		persist.snapshot = snapshot;
+		persist.delay_ms = delay_ms;
+		return ESP_OK;
+	}
+	persist.snapshot = snapshot;
+	persist.delay_ms = delay_ms;
+	persist.lock = xSemaphoreCreateMutex();
+	if (persist.lock == NULL) {
+		ESP_LOGE(TAG, "init_persist_task: create mutex failed");
+		return ESP_FAIL;
+	}
+	BaseType_t ret = xTaskCreate(persist_task, "persist",
+		PERSIST_TASK_STACK_SIZE, NULL, PERSIST_TASK_PRIORITY,
+		&persist.task);
+	if (ret != pdPASS) {
+		ESP_LOGE(TAG, "init_persist_task: xTaskCreate failed");
+		return ESP_FAIL;
+	}
+	ESP_LOGI(TAG, "persistence task started, delay [%u] ms",
+		(unsigned int) delay_ms);
+	return ESP_OK;
+}
+
+esp_err_t persist_request()
+{
+	if (persist.task == NULL) {
+		ESP_LOGE(TAG, "persist_request: not initialized");
+		return ESP_FAIL;
+	}
+	persist.dirty = true;
+	persist.stats.requests++;
+	xTaskNotifyGive(persist.task);
+	return ESP_OK;
+}
+
+esp_err_t persist_flush()
+{
+	if (persist.task == NULL) {
+		ESP_LOGE(TAG, "persist_flush: not initialized");
+		return ESP_FAIL;
+	}
+	xSemaphoreTake(persist.lock, portMAX_DELAY);
+	if (!persist.dirty) {
+		xSemaphoreGive(persist.lock);
+		return ESP_OK;
+	}
+	// Clear the flag before taking the snapshot, changes made after the
+	// snapshot will set the flag again and be written by the next flush.
+	persist.dirty = false;
+	int64_t start = esp_timer_get_time();
+	persist.snapshot(&persist.config);
+	esp_err_t ret = ESP_OK;
+	uint32_t diff = config_diff(&persist.saved, &persist.config);
+	bool journal = !persist.compact && diff != 0 &&
+		(diff & ~persist_journal_keys()) == 0 &&
+		config_journal_size() < CONFIG_JOURNAL_MAX_SIZE;
+	if (journal) {
+		// Only the frequently changed numeric keys are modified, append
+		// the deltas instead of rewriting the whole config.
+		ret = config_journal_append(&persist.config, diff);
+		if (ret == ESP_OK) {
+			persist.stats.journal_writes++;
+		} else {
+			ret = persist_compact(&persist.config);
+		}
+	} else if (diff != 0 || persist.compact) {
+		ret = persist_compact(&persist.config);
+	}
+	int64_t latency = esp_timer_get_time() - start;
+	if (ret != ESP_OK) {
+		persist.dirty = true;
+		persist.stats.failures++;
+		xSemaphoreGive(persist.lock);
+		ESP_LOGE(TAG, "persist_flush failed: [%d]", ret);
+		// Retry after the delay window, even if nothing changes.
+		xTaskNotifyGive(persist.task);
+		return ret;
+	}
+	config_copy(&persist.saved, &persist.config);
+	persist.stats.writes++;
+	persist.stats.last_flush_us = latency;
+	if (latency > persist.stats.max_flush_us) {
+		persist.stats.max_flush_us = latency;
+	}
+	ESP_LOGI(TAG, "config flushed in %lld us, requests [%u] writes [%u]",
+		(long long) latency, (unsigned int) persist.stats.requests,
+		(unsigned int) persist.stats.writes);
+	xSemaphoreGive(persist.lock);
+	return ESP_OK;
+}
+
+void persist_get_stats(struct persist_stats *stats)
+{
+	if (stats == NULL) {
+		return;
+	}
+	memcpy(stats, &persist.stats, sizeof(struct persist_stats));
+}
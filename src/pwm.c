@@ -47,7 +47,7 @@ esp_err_t controller_pwm_set_duty(int channel, uint32_t duty)
 	if (ret != ESP_OK) {
 		return ret;
 	}
-	ESP_LOGI(TAG, "update pwm channel [%d] duty [0x%X]",
+	ESP_LOGD(TAG, "update pwm channel [%d] duty [0x%X]",
 		channel, (unsigned) duty);
 	return ledc_update_duty(LEDC_LOW_SPEED_MODE, channel);
 }
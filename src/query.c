@@ -0,0 +1,74 @@
+#include <string.h>
+#include <stdbool.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+
+#include "query.h"
+
+#define TAG "QUERY"
+
+static int query_hex_value(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+esp_err_t query_parse(char *query, query_pair_fn fn, void *ctx)
+{
+	if (query == NULL || fn == NULL) {
+		ESP_LOGE(TAG, "query_parse: invalid param");
+		return ESP_ERR_INVALID_ARG;
+	}
+	char *in = query;
+	while (*in != '\0') {
+		// The decoded pair is never longer than the encoded one,
+		// it is written to the same buffer.
+		char *key = in;
+		char *value = NULL;
+		char *out = in;
+		while (*in != '\0' && *in != '&') {
+			char c = *in++;
+			if (c == '=' && value == NULL) {
+				*out++ = '\0';
+				value = out;
+				continue;
+			}
+			if (c == '+') {
+				c = ' ';
+			} else if (c == '%') {
+				int h = query_hex_value(in[0]);
+				int l = h < 0 ? -1 : query_hex_value(in[1]);
+				if (l < 0 || (h == 0 && l == 0)) {
+					return ESP_ERR_INVALID_ARG;
+				}
+				c = (h << 4) | l;
+				in += 2;
+			}
+			*out++ = c;
+		}
+		if (*in == '&') {
+			in++;
+		}
+		*out = '\0';
+		if (value == NULL) {
+			value = out;
+		}
+		if (*key == '\0') {
+			continue;
+		}
+		esp_err_t ret = fn(key, value, ctx);
+		if (ret != ESP_OK) {
+			return ret;
+		}
+	}
+	return ESP_OK;
+}
@@ -1,46 +1,223 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
 #include <esp_log.h>
 #include <esp_vfs.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
 
 #include "server.h"
 #include "storage.h"
 #include "controller.h"
+#include "asset.h"
+#include "api.h"
+#include "query.h"
+#include "ws.h"
+#include "sse.h"
+#include "arena.h"
+#include "traffic.h"
+#include "i18n.h"
+#include "page.h"
 
 #define TAG "SERVER"
 
 #define HTTP_SERVER_PORT 80
+#define HTTP_CHUNK_SIZE 1024
+#define HTTP_MAX_URI_HANDLERS 12
+#define HTTP_ASYNC_TASK_STACK_SIZE 4096
+// Lower than the server task, so the control requests go first.
+#define HTTP_ASYNC_TASK_PRIORITY (tskIDLE_PRIORITY + 3)
 
 #ifndef MIN
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 #endif
-
-#define IS_FILE_EXT(filename, ext) \
-    (strcasecmp(&filename[strlen(filename) - sizeof(ext) + 1], ext) == 0)
+#ifndef MAX
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#endif
 
 struct http_context {
 	char base_path[16];
 	struct config *config;
 };
 
-/* Set HTTP response content type according to file extension */
-static esp_err_t set_content_type_from_file(
-	httpd_req_t *req, const char *filename
+/**
+ * @brief http_worker is a task handling the requests and its arena.
+ */
+struct http_worker {
+	TaskHandle_t task; // NULL if the slot is free
+	struct arena arena;
+};
+
+static struct http_worker http_workers[HTTP_ARENA_MAX_WORKERS];
+static portMUX_TYPE http_workers_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief init_http_arenas preallocates the arenas of the workers, the
+ * arenas are kept when the server restarts.
+ */
+static esp_err_t init_http_arenas()
+{
+	for (int i = 0; i < HTTP_ARENA_MAX_WORKERS; i++) {
+		if (http_workers[i].arena.base != NULL) {
+			continue;
+		}
+		esp_err_t ret = arena_init(
+			&http_workers[i].arena, HTTP_ARENA_SIZE);
+		if (ret != ESP_OK) {
+			ESP_LOGE(TAG, "arena_init failed: %d", ret);
+			return ret;
+		}
+	}
+	return ESP_OK;
+}
+
+struct arena *http_req_arena(httpd_req_t *req)
+{
+	TaskHandle_t task = xTaskGetCurrentTaskHandle();
+	struct arena *arena = NULL;
+	portENTER_CRITICAL(&http_workers_lock);
+	for (int i = 0; i < HTTP_ARENA_MAX_WORKERS && !arena; i++) {
+		if (http_workers[i].task == task) {
+			arena = &http_workers[i].arena;
+		}
+	}
+	for (int i = 0; i < HTTP_ARENA_MAX_WORKERS && !arena; i++) {
+		if (http_workers[i].task == NULL) {
+			http_workers[i].task = task;
+			arena = &http_workers[i].arena;
+		}
+	}
+	portEXIT_CRITICAL(&http_workers_lock);
+	if (arena == NULL) {
+		ESP_LOGE(TAG, "http_req_arena: too many workers");
+	}
+	return arena;
+}
+
+/**
+ * @brief http_async_req is a request handed over to the async workers.
+ */
+struct http_async_req {
+	httpd_req_t *req; // copy of the request by httpd_req_async_handler_begin
+	httpd_req_handler_t handler;
+	struct traffic_req traffic; // accounting of the request
+};
+
+static struct {
+	QueueHandle_t queue;
+	SemaphoreHandle_t idle; // counts the idle workers
+	TaskHandle_t tasks[HTTP_ASYNC_WORKERS];
+} http_async;
+
+static bool http_is_async_worker()
+{
+	TaskHandle_t task = xTaskGetCurrentTaskHandle();
+	for (int i = 0; i < HTTP_ASYNC_WORKERS; i++) {
+		if (http_async.tasks[i] == task) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void http_async_worker(void *arg)
+{
+	struct http_async_req item;
+	while (true) {
+		if (xQueueReceive(http_async.queue, &item, portMAX_DELAY)
+			!= pdTRUE) {
+			continue;
+		}
+		esp_err_t ret = item.handler(item.req);
+		if (ret != ESP_OK) {
+			ESP_LOGW(TAG, "async request %s failed: %d",
+				item.req->uri, ret);
+		}
+		httpd_req_async_handler_complete(item.req);
+		traffic_end(&item.traffic);
+		xSemaphoreGive(http_async.idle);
+	}
+}
+
+/**
+ * @brief init_http_async_workers starts the async workers, the workers
+ * are kept when the server restarts.
+ */
+static esp_err_t init_http_async_workers()
+{
+	if (http_async.queue != NULL) {
+		return ESP_OK;
+	}
+	http_async.queue = xQueueCreate(
+		HTTP_ASYNC_WORKERS, sizeof(struct http_async_req));
+	http_async.idle = xSemaphoreCreateCounting(
+		HTTP_ASYNC_WORKERS, HTTP_ASYNC_WORKERS);
+	if (http_async.queue == NULL || http_async.idle == NULL) {
+		ESP_LOGE(TAG, "init_http_async_workers: "
+			"create queue failed");
+		return ESP_ERR_NO_MEM;
+	}
+	for (int i = 0; i < HTTP_ASYNC_WORKERS; i++) {
+		BaseType_t ret = xTaskCreate(http_async_worker, "http_async",
+			HTTP_ASYNC_TASK_STACK_SIZE, NULL,
+			HTTP_ASYNC_TASK_PRIORITY, &http_async.tasks[i]);
+		if (ret != pdPASS) {
+			ESP_LOGE(TAG, "init_http_async_workers: "
+				"xTaskCreate failed");
+			return ESP_FAIL;
+		}
+	}
+	return ESP_OK;
+}
+
+esp_err_t http_req_submit_async(
+	httpd_req_t *req, httpd_req_handler_t handler
 ) {
-	if (IS_FILE_EXT(filename, ".pdf")) {
-		return httpd_resp_set_type(req, "application/pdf");
-	} else if (IS_FILE_EXT(filename, ".html")) {
-		return httpd_resp_set_type(req, "text/html");
-	} else if (IS_FILE_EXT(filename, ".jpeg")) {
-		return httpd_resp_set_type(req, "image/jpeg");
-	} else if (IS_FILE_EXT(filename, ".jpg")) {
-		return httpd_resp_set_type(req, "image/jpeg");
-	} else if (IS_FILE_EXT(filename, ".png")) {
-		return httpd_resp_set_type(req, "image/png");
-	} else if (IS_FILE_EXT(filename, ".ico")) {
-		return httpd_resp_set_type(req, "image/x-icon");
-	} else if (IS_FILE_EXT(filename, ".css")) {
-		return httpd_resp_set_type(req, "text/css");
-	}
-	return httpd_resp_set_type(req, "text/plain");
+	if (http_async.queue == NULL || http_is_async_worker()) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	// Don't wait for a busy worker, the caller handles the request.
+	if (xSemaphoreTake(http_async.idle, 0) != pdTRUE) {
+		return ESP_ERR_TIMEOUT;
+	}
+	httpd_req_t *copy = NULL;
+	esp_err_t ret = httpd_req_async_handler_begin(req, &copy);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "httpd_req_async_handler_begin failed: %d", ret);
+		xSemaphoreGive(http_async.idle);
+		return ret;
+	}
+	struct http_async_req item = {
+		.req = copy,
+		.handler = handler,
+	};
+	// The request is completed by the worker.
+	traffic_defer(&item.traffic);
+	if (xQueueSend(http_async.queue, &item, 0) != pdTRUE) {
+		httpd_req_async_handler_complete(copy);
+		traffic_end(&item.traffic);
+		xSemaphoreGive(http_async.idle);
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+void http_arena_get_stats(struct arena_stats *stats)
+{
+	if (stats == NULL) {
+		return;
+	}
+	memset(stats, 0, sizeof(struct arena_stats));
+	for (int i = 0; i < HTTP_ARENA_MAX_WORKERS; i++) {
+		const struct arena *arena = &http_workers[i].arena;
+		stats->size += arena->size;
+		stats->used += arena->used;
+		stats->high_water = MAX(stats->high_water, arena->high_water);
+		stats->failures += arena->failures;
+	}
 }
 
 /**
@@ -61,11 +238,11 @@ static const char* get_path_from_uri(
 
 	const char *quest = strchr(uri, '?');
 	if (quest) {
-		pathlen = MIN(pathlen, quest - uri);
+		pathlen = MIN(pathlen, (size_t) (quest - uri));
 	}
 	const char *hash = strchr(uri, '#');
 	if (hash) {
-		pathlen = MIN(pathlen, hash - uri);
+		pathlen = MIN(pathlen, (size_t) (hash - uri));
 	}
 
 	if (base_pathlen + pathlen + 1 > destsize) {
@@ -81,18 +258,359 @@ static const char* get_path_from_uri(
 	return dest + base_pathlen;
 }
 
+/**
+ * @brief http_accept_gzip detects whether the client accepts the gzip
+ * content encoding by the Accept-Encoding header.
+ *
+ * @param req
+ * @return bool
+ */
+static bool http_accept_gzip(httpd_req_t *req)
+{
+	char value[128] = { 0 };
+	esp_err_t ret = httpd_req_get_hdr_value_str(
+		req, "Accept-Encoding", value, sizeof(value));
+	if (ret != ESP_OK && ret != ESP_ERR_HTTPD_RESULT_TRUNC) {
+		return false;
+	}
+	char *saveptr = NULL;
+	for (char *token = strtok_r(value, ",", &saveptr); token != NULL;
+		token = strtok_r(NULL, ",", &saveptr)) {
+		while (*token == ' ') {
+			token++;
+		}
+		size_t length = strcspn(token, " ;");
+		if (!(length == 4 && strncasecmp(token, "gzip", 4) == 0) &&
+			!(length == 1 && token[0] == '*')) {
+			continue;
+		}
+		// 'gzip;q=0' means gzip is not acceptable.
+		const char *q = strstr(token + length, "q=");
+		return q == NULL || strtod(q + 2, NULL) > 0;
+	}
+	return false;
+}
+
+/**
+ * @brief http_is_versioned_uri detects whether the URI has the '?v=<hash>'
+ * version query added by tools/build_assets.py, the content of a versioned
+ * URI never changes.
+ *
+ * @param req
+ * @return bool
+ */
+static bool http_is_versioned_uri(httpd_req_t *req)
+{
+	const char *query = strchr(req->uri, '?');
+	char version[16] = { 0 };
+	return query != NULL && httpd_query_key_value(
+		query + 1, "v", version, sizeof(version)) == ESP_OK;
+}
+
+/**
+ * @brief http_etag_match detects whether the If-None-Match header of the
+ * request matches the ETag.
+ *
+ * @param req
+ * @param etag quoted ETag
+ * @return bool
+ */
+static bool http_etag_match(httpd_req_t *req, const char *etag)
+{
+	char value[64] = { 0 };
+	if (httpd_req_get_hdr_value_str(
+		req, "If-None-Match", value, sizeof(value)) != ESP_OK) {
+		return false;
+	}
+	return strcmp(value, "*") == 0 || strstr(value, etag) != NULL;
+}
+
+/**
+ * @brief http_set_cache_headers sets the cache validator & policy headers.
+ * Versioned URIs are cached for a long time, others must be revalidated
+ * by the ETag on every use.
+ *
+ * @param req
+ * @param etag quoted ETag, empty if unknown
+ * @return esp_err_t
+ */
+static esp_err_t http_set_cache_headers(httpd_req_t *req, const char *etag)
+{
+	esp_err_t ret = ESP_OK;
+	if (etag[0] != '\0') {
+		ret = httpd_resp_set_hdr(req, "ETag", etag);
+	}
+	if (ret == ESP_OK) {
+		ret = httpd_resp_set_hdr(req, "Cache-Control",
+			http_is_versioned_uri(req) ?
+			"public, max-age=31536000, immutable" : "no-cache");
+	}
+	if (ret == ESP_OK) {
+		ret = httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+	}
+	return ret;
+}
+
+/**
+ * @brief http_parse_range parses the single 'bytes=' range of the Range
+ * header, the range is ignored if the If-Range header does not match the
+ * ETag of the content.
+ *
+ * @param req
+ * @param etag quoted ETag of the content, empty if unknown
+ * @param length content length
+ * @param start [out] first byte of the range
+ * @param end [out] last byte of the range, inclusive
+ * @return ESP_OK if the range is satisfiable.
+ * @return ESP_ERR_NOT_FOUND if no range is requested or the range is not
+ * supported, the whole content should be sent.
+ * @return ESP_ERR_INVALID_SIZE if the range is not satisfiable.
+ */
+static esp_err_t http_parse_range(
+	httpd_req_t *req, const char *etag, size_t length,
+	size_t *start, size_t *end
+) {
+	char value[48] = { 0 };
+	if (httpd_req_get_hdr_value_str(
+		req, "Range", value, sizeof(value)) != ESP_OK) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	char if_range[48] = { 0 };
+	if (httpd_req_get_hdr_value_str(
+		req, "If-Range", if_range, sizeof(if_range)) == ESP_OK &&
+		strcmp(if_range, etag) != 0) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	// Multiple ranges are not supported, send the whole content.
+	if (strncmp(value, "bytes=", 6) != 0 || strchr(value, ',') != NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	char *first = value + 6;
+	char *dash = strchr(first, '-');
+	char *p = NULL;
+	if (dash == NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	if (first == dash) {
+		// 'bytes=-n' requests the last n bytes.
+		unsigned long n = strtoul(dash + 1, &p, 10);
+		if (p == dash + 1 || *p != '\0') {
+			return ESP_ERR_NOT_FOUND;
+		}
+		if (n == 0 || length == 0) {
+			return ESP_ERR_INVALID_SIZE;
+		}
+		*start = n >= length ? 0 : length - n;
+		*end = length - 1;
+		return ESP_OK;
+	}
+	unsigned long from = strtoul(first, &p, 10);
+	if (p != dash) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	unsigned long to = length - 1;
+	if (dash[1] != '\0') {
+		to = strtoul(dash + 1, &p, 10);
+		if (*p != '\0' || to < from) {
+			return ESP_ERR_NOT_FOUND;
+		}
+	}
+	if (from >= length) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	*start = from;
+	*end = MIN(to, length - 1);
+	return ESP_OK;
+}
+
+/**
+ * @brief http_stream_file sends the file content in http chunks from a
+ * fixed size buffer, so the memory used does not grow with the file size.
+ *
+ * @param req
+ * @param filename
+ * @param offset first byte to send
+ * @param length number of bytes to send
+ * @return esp_err_t
+ */
+static esp_err_t http_stream_file(
+	httpd_req_t *req, const char *filename, size_t offset, size_t length
+) {
+	FILE *fd = fopen(filename, "r");
+	if (fd == NULL) {
+		ESP_LOGE(TAG, "failed to open: %s", filename);
+		return httpd_resp_send_err(req,
+			HTTPD_500_INTERNAL_SERVER_ERROR, "failed to open file");
+	}
+	struct arena *arena = http_req_arena(req);
+	size_t mark = arena_mark(arena);
+	char *buffer = arena_alloc(arena, HTTP_CHUNK_SIZE);
+	if (buffer == NULL || fseek(fd, offset, SEEK_SET) != 0) {
+		arena_rewind(arena, mark);
+		fclose(fd);
+		return httpd_resp_send_err(req,
+			HTTPD_500_INTERNAL_SERVER_ERROR, "failed to read file");
+	}
+	esp_err_t ret = ESP_OK;
+	while (length > 0) {
+		size_t n = fread(buffer, 1, MIN(length, HTTP_CHUNK_SIZE), fd);
+		if (n == 0) {
+			ESP_LOGE(TAG, "http_stream_file: read %s failed", filename);
+			ret = ESP_FAIL;
+			break;
+		}
+		if ((ret = httpd_resp_send_chunk(req, buffer, n)) != ESP_OK) {
+			ESP_LOGE(TAG, "http_stream_file: "
+				"httpd_resp_send_chunk failed: %d", ret);
+			break;
+		}
+		length -= n;
+	}
+	arena_rewind(arena, mark);
+	fclose(fd);
+	if (ret != ESP_OK) {
+		// The response is already started, abort the connection.
+		return ret;
+	}
+	return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/**
+ * @brief http_send_asset_content sends a part of the asset content, assets
+ * not read into memory are streamed from the file.
+ *
+ * @param req
+ * @param asset
+ * @param start first byte to send
+ * @param length number of bytes to send
+ * @return esp_err_t
+ */
+static esp_err_t http_send_asset_content(
+	httpd_req_t *req, const struct asset *asset,
+	size_t start, size_t length
+) {
+	if (asset->data == NULL) {
+		return http_stream_file(req, asset->file, start, length);
+	}
+	// Cached asset contents are sent without copying.
+	return httpd_resp_send(req, asset->data + start, length);
+}
+
+/**
+ * @brief http_send_asset sends the asset with its content type, encoding
+ * and cache headers, only the requested range is sent if the request has
+ * a Range header. Assets not read into memory are streamed from the file.
+ *
+ * @param req
+ * @param asset
+ * @return esp_err_t
+ */
+static esp_err_t http_send_asset(httpd_req_t *req, const struct asset *asset)
+{
+	char etag[12] = { 0 };
+	char content_range[48] = { 0 };
+	if (asset->etag != 0) {
+		snprintf(etag, sizeof(etag), "\"%08x\"",
+			(unsigned int) asset->etag);
+	}
+	esp_err_t ret = httpd_resp_set_type(req, asset->mime);
+	if (ret == ESP_OK && asset->gzip) {
+		ret = httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+	}
+	if (ret == ESP_OK) {
+		ret = http_set_cache_headers(req, etag);
+	}
+	if (ret == ESP_OK) {
+		ret = httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+	}
+	if (ret != ESP_OK) {
+		return ret;
+	}
+
+	size_t start = 0, end = 0;
+	size_t length = asset->length;
+	switch (http_parse_range(req, etag, asset->length, &start, &end)) {
+	case ESP_OK:
+		length = end - start + 1;
+		snprintf(content_range, sizeof(content_range),
+			"bytes %u-%u/%u", (unsigned int) start,
+			(unsigned int) end, (unsigned int) asset->length);
+		httpd_resp_set_status(req, "206 Partial Content");
+		httpd_resp_set_hdr(req, "Content-Range", content_range);
+		break;
+	case ESP_ERR_INVALID_SIZE:
+		snprintf(content_range, sizeof(content_range),
+			"bytes */%u", (unsigned int) asset->length);
+		httpd_resp_set_status(req, "416 Range Not Satisfiable");
+		httpd_resp_set_hdr(req, "Content-Range", content_range);
+		return httpd_resp_send(req, NULL, 0);
+	default:
+		break;
+	}
+	return http_send_asset_content(req, asset, start, length);
+}
+
+/**
+ * @brief http_send_not_modified sends '304 Not Modified' if the ETag of
+ * the asset in the manifest matches the If-None-Match header of the
+ * request, the asset file is not opened.
+ *
+ * @param req
+ * @param path URI path
+ * @param gzip gzip accepted
+ * @param sent [out] 304 is sent
+ * @return esp_err_t
+ */
+static esp_err_t http_send_not_modified(
+	httpd_req_t *req, const char *path, bool gzip, bool *sent
+) {
+	*sent = false;
+	uint32_t value = 0;
+	if (asset_etag(path, gzip, &value) != ESP_OK || value == 0) {
+		return ESP_OK;
+	}
+	char etag[12] = { 0 };
+	snprintf(etag, sizeof(etag), "\"%08x\"", (unsigned int) value);
+	if (!http_etag_match(req, etag)) {
+		return ESP_OK;
+	}
+	*sent = true;
+	esp_err_t ret = httpd_resp_set_status(req, "304 Not Modified");
+	if (ret == ESP_OK) {
+		ret = http_set_cache_headers(req, etag);
+	}
+	if (ret == ESP_OK) {
+		ret = httpd_resp_send(req, NULL, 0);
+	}
+	return ret;
+}
+
 static esp_err_t http_404_error_handler(
 	httpd_req_t *req, httpd_err_code_t err
 ) {
-	char *buffer = NULL;
-	read_file(&buffer, "/spiffs/404.html");
-	if (!buffer) {
+	struct asset asset = { 0 };
+	if (asset_cache_get("/404.html", http_accept_gzip(req), &asset)
+		!= ESP_OK) {
 		httpd_resp_send_err(
 			req, err, "<h1>404 NOT FOUND</h1>");
 		return ESP_FAIL;
 	}
-	httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, buffer);
-	free(buffer);
+	// The whole error page, without the range, validator and cache
+	// headers of the asset itself.
+	esp_err_t ret = httpd_resp_set_status(req, HTTPD_404);
+	if (ret == ESP_OK) {
+		ret = httpd_resp_set_type(req, asset.mime);
+	}
+	if (ret == ESP_OK && asset.gzip) {
+		ret = httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+	}
+	if (ret == ESP_OK) {
+		ret = httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+	}
+	if (ret == ESP_OK) {
+		http_send_asset_content(req, &asset, 0, asset.length);
+	}
+	asset_release(&asset);
 
 	return ESP_FAIL;
 }
@@ -101,11 +619,34 @@ static esp_err_t http_404_error_handler(
  * @brief processing http url query of config settings
  *
  * @param req [in] http request
- * @param has_query [out] has HTTP query
  * @return esp_err_t
  */
-static esp_err_t process_settings_query(httpd_req_t *req, bool *has_query) {
-	if (req == NULL || has_query == NULL) {
+static esp_err_t stage_settings_pair(
+	const char *key, const char *value, void *ctx
+) {
+	const struct config_schema *schema = config_schema_lookup(key);
+	if (schema == NULL || !(schema->flags & CONFIG_FLAG_QUERY)) {
+		// Other query keys are ignored.
+		return ESP_OK;
+	}
+	ESP_LOGI(TAG, "process_settings_query: "
+		"query setting: %s=%s", key, value);
+	// An invalid value fails the whole batch.
+	int ret = config_parse_value(ctx, key, value);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "process_settings_query: "
+			"failed to update setting %s: %d", key, ret);
+	}
+	return ret;
+}
+
+static esp_err_t stage_settings_query(struct config *staged, void *ctx)
+{
+	return query_parse(ctx, stage_settings_pair, staged);
+}
+
+static esp_err_t process_settings_query(httpd_req_t *req) {
+	if (req == NULL) {
 		ESP_LOGE(TAG, "process_settings_query: invalid param");
 		return ESP_FAIL;
 	}
@@ -113,66 +654,40 @@ static esp_err_t process_settings_query(httpd_req_t *req, bool *has_query) {
 	// Read URL query string length and allocate memory for
 	// length + 1, extra byte for null termination.
 	int length = httpd_req_get_url_query_len(req) + 1;
-	if (length < 1) {
+	if (length <= 1) {
 		// Query not found, return directly.
 		return ESP_OK;
 	}
 
 	int ret = 0;
-	char *buffer = malloc(length);
+	struct arena *arena = http_req_arena(req);
+	size_t mark = arena_mark(arena);
+	char *buffer = arena_alloc(arena, length);
+	if (buffer == NULL) {
+		ESP_LOGE(TAG, "process_settings_query: arena_alloc failed");
+		return ESP_ERR_NO_MEM;
+	}
 	if ((ret = httpd_req_get_url_query_str(req, buffer, length)) != 0) {
+		arena_rewind(arena, mark);
 		if (ret != ESP_ERR_NOT_FOUND) {
-			free(buffer);
 			ESP_LOGE(TAG, "httpd_req_get_url_query_str: %d", ret);
 			return ret;
 		}
+		return ESP_OK;
 	}
 
-	char param[128] = { 0 };
-	static const char keys[][24] = {
-		CONFIG_KEY_PWM_FAN_CHANNEL,
-		CONFIG_KEY_PWM_FAN_FREQUENCY,
-		CONFIG_KEY_PWM_FAN_GPIO,
-		CONFIG_KEY_PWM_FAN_DUTY,
-		CONFIG_KEY_PWM_MOS_CHANNEL,
-		CONFIG_KEY_PWM_MOS_FREQUENCY,
-		CONFIG_KEY_PWM_MOS_GPIO,
-		CONFIG_KEY_PWM_MOS_DUTY,
-		CONFIG_KEY_WIFI_SSID,
-		CONFIG_KEY_WIFI_PASSWORD,
-		CONFIG_KEY_WIFI_CHANNEL,
-		CONFIG_KEY_DHCPS_IP,
-		CONFIG_KEY_DHCPS_NETMASK,
-		CONFIG_KEY_DHCPS_AS_ROUTER
-	};
-	static int keys_num = sizeof(keys) / (sizeof(char) * 24);
-	for (int i = 0; i < keys_num; i++) {
-		if (httpd_query_key_value(buffer, (const char*) &keys[i],
-			param, sizeof(param)) == 0)
-		{
-			ESP_LOGI(TAG, "process_settings_query: "
-				"query setting: %s=%s", keys[i], param);
-			ret = global_controller_update_config(
-				(const char*) &keys[i], param);
-			if (ret != ESP_OK) {
-				ESP_LOGE(TAG, "process_settings_query: "
-					"failed to update setting %s: %d",
-					keys[i], ret);
-				free(buffer);
-				return ret;
-			}
-			*has_query = true;
-		}
-	}
-
-	free(buffer);
-	return 0;
+	// All settings in the query are applied together or not at all.
+	ret = global_controller_update_config_batch(
+		stage_settings_query, buffer);
+	arena_rewind(arena, mark);
+	return ret;
 }
 
 /**
  * @brief handler '/settings' http get request.
  * It will update the controller config by http get query,
  * and the response will be the updated config json data.
+ * NOTE: kept for compatibility, use the '/api/' handlers instead.
  *
  * @param req
  * @return esp_err_t
@@ -180,8 +695,7 @@ static esp_err_t process_settings_query(httpd_req_t *req, bool *has_query) {
 static esp_err_t handle_http_settings_req(httpd_req_t *req)
 {
 	int ret = 0;
-	bool has_query = false;
-	ret = process_settings_query(req, &has_query);
+	ret = process_settings_query(req);
 	if (ret != ESP_OK) {
 		ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
 		return httpd_resp_send_err(
@@ -191,49 +705,7 @@ static esp_err_t handle_http_settings_req(httpd_req_t *req)
 		);
 	}
 
-	char *data = malloc(sizeof(char) * 1024);
-	if (data == NULL) {
-		return httpd_resp_send_err(
-			req,
-			HTTPD_500_INTERNAL_SERVER_ERROR,
-			"500: malloc failed when marshal json"
-		);
-	}
-	memset(data, 0, sizeof(char) * 1024);
-	if ((ret = global_controller_config_marshal_json(data)) != ESP_OK) {
-		return httpd_resp_send_err(
-			req,
-			HTTPD_500_INTERNAL_SERVER_ERROR,
-			"500: config_marshal_json failed"
-		);
-	}
-	if ((ret = httpd_resp_set_type(req, "application/json")) != ESP_OK) {
-		free(data);
-		return httpd_resp_send_err(
-			req,
-			HTTPD_500_INTERNAL_SERVER_ERROR,
-			"500: httpd_resp_set_type failed"
-		);
-	}
-	if ((ret = global_controller_apply_pwm_duty()) != ESP_OK) {
-		free(data);
-		return httpd_resp_send_err(
-			req,
-			HTTPD_500_INTERNAL_SERVER_ERROR,
-			"500: global_controller_apply_pwm_duty failed"
-		);
-	}
-	if (has_query && (ret = global_controller_save_config()) != ESP_OK) {
-		free(data);
-		return httpd_resp_send_err(
-			req,
-			HTTPD_500_INTERNAL_SERVER_ERROR,
-			"500: global_controller_save_config failed"
-		);
-	}
-	ret = httpd_resp_send(req, data, HTTPD_RESP_USE_STRLEN);
-	free(data);
-	data = NULL;
+	ret = api_send_settings_json(req);
 	ESP_LOGD(TAG, "handle_http_settings_req: response config json");
 
 	return ret;
@@ -256,26 +728,148 @@ static esp_err_t handle_http_reset_settings_req(httpd_req_t *req)
 	return ret;
 }
 
+/**
+ * @brief legacy control handlers, registered before the wildcard handler
+ * so they are classified as control requests.
+ */
+static const httpd_uri_t http_control_handlers[] = {
+	{
+		.uri = "/settings",
+		.method = HTTP_GET,
+		.handler = handle_http_settings_req,
+	},
+	{
+		.uri = "/restart",
+		.method = HTTP_GET,
+		.handler = handle_http_restart_req,
+	},
+	{
+		.uri = "/reset_settings",
+		.method = HTTP_GET,
+		.handler = handle_http_reset_settings_req,
+	},
+};
+
+static esp_err_t http_default_handler(httpd_req_t *req);
+
+/**
+ * @brief http_strip_locale strips the locale prefix of the URI path, such
+ * as '/en/setting/', the prefix chooses the locale of the page.
+ *
+ * @param path URI path
+ * @param locale [out] locale of the prefix, -1 if no prefix
+ * @return the path without the prefix
+ */
+static const char *http_strip_locale(const char *path, int *locale)
+{
+	*locale = -1;
+	if (path[0] != '/') {
+		return path;
+	}
+	size_t n = strcspn(path + 1, "/");
+	int found = i18n_find_locale(path + 1, n);
+	if (n == 0 || found < 0) {
+		return path;
+	}
+	*locale = found;
+	return path[1 + n] == '\0' ? "/" : path + 1 + n;
+}
+
+/**
+ * @brief http_handle_page_req renders the page from its template in the
+ * locale of the client. The locale is chosen by the URI prefix and kept in
+ * the cookie, or negotiated by i18n_negotiate.
+ *
+ * @param req
+ * @param path URI path
+ * @param gzip gzip accepted
+ * @param handled [out] the path is a page and the request is handled
+ * @return esp_err_t
+ */
+static esp_err_t http_handle_page_req(
+	httpd_req_t *req, const char *path, bool gzip, bool *handled
+) {
+	*handled = false;
+	int locale = -1;
+	path = http_strip_locale(path, &locale);
+	char *template = arena_alloc(http_req_arena(req), ASSET_PATH_MAX_LEN);
+	if (template == NULL ||
+		page_resolve(path, template, ASSET_PATH_MAX_LEN) != ESP_OK) {
+		return ESP_OK;
+	}
+	*handled = true;
+
+	struct asset asset = { 0 };
+	esp_err_t ret = asset_cache_lookup(template, gzip, &asset);
+	if (ret == ESP_ERR_NOT_FOUND &&
+		http_req_submit_async(req, http_default_handler) == ESP_OK) {
+		return ESP_OK;
+	}
+	if (ret != ESP_OK) {
+		ret = asset_cache_get(template, gzip, &asset);
+	}
+	if (ret != ESP_OK) {
+		return httpd_resp_send_err(req,
+			HTTPD_500_INTERNAL_SERVER_ERROR,
+			"asset_cache_get failed");
+	}
+
+	char cookie[48] = { 0 };
+	if (locale >= 0) {
+		snprintf(cookie, sizeof(cookie), "%s=%s; Path=/; Max-Age=%d",
+			I18N_COOKIE, i18n_locale_code(locale), 365 * 86400);
+		ret = httpd_resp_set_hdr(req, "Set-Cookie", cookie);
+	} else {
+		locale = i18n_negotiate(req);
+	}
+	// The pages with the state are dynamic, others are validated by the
+	// template ETag and the locale.
+	char etag[24] = { 0 };
+	bool state = page_has_state(&asset);
+	if (!state && asset.etag != 0) {
+		snprintf(etag, sizeof(etag), "\"%08x-%s\"",
+			(unsigned int) asset.etag, i18n_locale_code(locale));
+		ret = httpd_resp_set_hdr(req, "ETag", etag);
+	}
+	if (ret == ESP_OK) {
+		ret = httpd_resp_set_hdr(req, "Cache-Control",
+			state ? "no-store" : "no-cache");
+	}
+	if (ret == ESP_OK) {
+		ret = httpd_resp_set_hdr(req, "Vary",
+			"Accept-Encoding, Accept-Language, Cookie");
+	}
+	if (ret == ESP_OK && etag[0] != '\0' && http_etag_match(req, etag)) {
+		ret = httpd_resp_set_status(req, "304 Not Modified");
+		if (ret == ESP_OK) {
+			ret = httpd_resp_send(req, NULL, 0);
+		}
+	} else if (ret == ESP_OK) {
+		ret = page_send(req, &asset, locale);
+	}
+	asset_release(&asset);
+	return ret;
+}
+
 /**
  * @brief default handler for handling all requests.
  * by default this handler will try to load the static html file.
- * If the URI is '/settings', the handler will update the controller config
- * by the settings http query and response the JSON settings data.
  *
  * @param req
+ * @param filepath path buffer allocated from the request arena
+ * @param size path buffer size
  * @return esp_err_t
  */
-static esp_err_t http_default_handler(httpd_req_t *req)
-{
+static esp_err_t http_handle_default_req(
+	httpd_req_t *req, char *filepath, size_t size
+) {
 	esp_err_t ret = ESP_OK;
-	static char filepath[CONFIG_HTTPD_MAX_URI_LEN] = { 0 };
-	memset(filepath, 0, CONFIG_HTTPD_MAX_URI_LEN * sizeof(char));
 	struct http_context *context = req->user_ctx;
 	const char *filename = get_path_from_uri(
 		filepath,
 		context->base_path,
 		req->uri,
-		sizeof(filepath)
+		size
 	);
 	if (!filename) {
 		return httpd_resp_send_err(
@@ -294,56 +888,58 @@ static esp_err_t http_default_handler(httpd_req_t *req)
 		);
 	}
 
-	if (strcmp(filename, "/settings") == 0) {
-		return handle_http_settings_req(req);
-	}
-	if (strcmp(filename, "/restart") == 0) {
-		return handle_http_restart_req(req);
+	bool gzip = http_accept_gzip(req);
+	bool page = false;
+	ret = http_handle_page_req(req, filename, gzip, &page);
+	if (page) {
+		return ret;
 	}
-	if (strcmp(filename, "/reset_settings") == 0) {
-		return handle_http_reset_settings_req(req);
+
+	bool not_modified = false;
+	ret = http_send_not_modified(req, filename, gzip, &not_modified);
+	if (not_modified) {
+		return ret;
 	}
 
-	char *buffer = malloc(2048 * sizeof(char));
-	if (buffer == NULL) {
-		return httpd_resp_send_err(
-			req,
-			HTTPD_500_INTERNAL_SERVER_ERROR,
-			"http_default_handler: malloc failed"
-		);
+	// The cached assets are sent from memory, the others need to read
+	// the file system and are handed over to the async workers, so they
+	// don't stall the control requests.
+	struct asset asset = { 0 };
+	ret = asset_cache_lookup(filename, gzip, &asset);
+	if (ret == ESP_ERR_NOT_FOUND &&
+		http_req_submit_async(req, http_default_handler) == ESP_OK) {
+		return ESP_OK;
 	}
-	if (is_regular_file(filepath)) {
-		// the file exists and is not a directory.
-		sprintf(buffer, "%s", filepath);
-	} else {
-		// the filepath may not exists or maybe a directory.
-		if (filepath[strlen(filepath)-1] == '/') {
-			// remove the last '/' in filepath.
-			filepath[strlen(filepath)-1] = '\0';
-		}
-		sprintf(buffer, "%s/index.html", filepath);
+	if (ret != ESP_OK) {
+		ret = asset_cache_get(filename, gzip, &asset);
 	}
-
-	char *content = NULL;
-	int size = read_file(&content, buffer);
-	if (!content) {
-		free(buffer);
+	if (ret == ESP_ERR_NOT_FOUND) {
 		return http_404_error_handler(req, HTTPD_404_NOT_FOUND);
 	}
-	ret = set_content_type_from_file(req, buffer);
 	if (ret != ESP_OK) {
-		free(buffer);
-		free(content);
-		content = NULL;
-		ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
 		return httpd_resp_send_err(req,
 			HTTPD_500_INTERNAL_SERVER_ERROR,
-			"set_content_type_from_file failed");
+			"asset_cache_get failed");
 	}
-	ret = httpd_resp_send(req, content, size);
+	ret = http_send_asset(req, &asset);
 	ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
-	free(buffer);
-	free(content);
+	asset_release(&asset);
+	return ret;
+}
+
+static esp_err_t http_default_handler(httpd_req_t *req)
+{
+	// The request memory is released when the response is completed.
+	struct arena *arena = http_req_arena(req);
+	size_t mark = arena_mark(arena);
+	char *filepath = arena_alloc(arena, CONFIG_HTTPD_MAX_URI_LEN);
+	if (filepath == NULL) {
+		return httpd_resp_send_err(req,
+			HTTPD_500_INTERNAL_SERVER_ERROR, "out of memory");
+	}
+	esp_err_t ret = http_handle_default_req(
+		req, filepath, CONFIG_HTTPD_MAX_URI_LEN);
+	arena_rewind(arena, mark);
 	return ret;
 }
 
@@ -369,6 +965,16 @@ httpd_uri_t* default_get_handler(struct config *config)
 	return http_get_handler;
 }
 
+/**
+ * @brief http_close_fn is called when the server closes a socket.
+ */
+static void http_close_fn(httpd_handle_t handle, int sockfd)
+{
+	sse_close_client(sockfd);
+	traffic_close_fn(sockfd);
+	close(sockfd);
+}
+
 esp_err_t start_default_http_server(
 	httpd_handle_t *handle,
 	struct config *config
@@ -380,6 +986,10 @@ esp_err_t start_default_http_server(
 	httpd_config_t http_config = HTTPD_DEFAULT_CONFIG();
 	http_config.lru_purge_enable = true;
 	http_config.server_port = HTTP_SERVER_PORT;
+	http_config.max_uri_handlers = HTTP_MAX_URI_HANDLERS;
+	http_config.max_open_sockets = TRAFFIC_MAX_OPEN_SOCKETS;
+	http_config.open_fn = traffic_open_fn;
+	http_config.close_fn = http_close_fn;
 
 	/*
 	 * Use the URI wildcard matching function in order to
@@ -388,6 +998,22 @@ esp_err_t start_default_http_server(
 	 */
 	http_config.uri_match_fn = httpd_uri_match_wildcard;
 	int ret = 0;
+	if ((ret = init_asset_cache("/spiffs")) != ESP_OK) {
+		ESP_LOGE(TAG, "init_asset_cache failed: [%d]", ret);
+		return ret;
+	}
+	// Pages without the string tables are served as the static files.
+	if ((ret = init_i18n("/spiffs")) != ESP_OK &&
+		ret != ESP_ERR_NOT_FOUND) {
+		ESP_LOGE(TAG, "init_i18n failed: [%d]", ret);
+		return ret;
+	}
+	if ((ret = init_http_arenas()) != ESP_OK) {
+		return ret;
+	}
+	if ((ret = init_http_async_workers()) != ESP_OK) {
+		return ret;
+	}
 	httpd_handle_t server = NULL;
 	ret = httpd_start(&server, &http_config);
 	if (ret != ESP_OK) {
@@ -396,12 +1022,34 @@ esp_err_t start_default_http_server(
 		return ret;
 	}
 
+	// API handlers are registered before the wildcard handler,
+	// handlers are matched in the registration order.
+	ret = register_api_handlers(server);
+	if (ret == ESP_OK) {
+		ret = register_ws_handler(server);
+	}
+	if (ret == ESP_OK) {
+		ret = register_sse_handler(server);
+	}
+	for (size_t i = 0; ret == ESP_OK &&
+		i < sizeof(http_control_handlers) / sizeof(httpd_uri_t); i++) {
+		ret = traffic_register_uri_handler(server,
+			&http_control_handlers[i], TRAFFIC_CONTROL);
+	}
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "controller_start_server: "
+			"register handlers failed: [%d]", ret);
+		httpd_stop(server);
+		return ret;
+	}
+
 	httpd_uri_t *http_get_handler = default_get_handler(config);
 	ESP_LOGD(TAG, "register default handler for server");
-	ret = httpd_register_uri_handler(server, http_get_handler);
+	ret = traffic_register_uri_handler(
+		server, http_get_handler, TRAFFIC_ASSET);
 	if (ret != ESP_OK) {
 		ESP_LOGE(TAG, "controller_start_server: "
-			"httpd_register_uri_handler failed: [%d]", ret);
+			"traffic_register_uri_handler failed: [%d]", ret);
 		httpd_stop(server);
 		return ret;
 	}
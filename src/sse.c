@@ -0,0 +1,302 @@
+#include <string.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <stdio.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <esp_http_server.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "sse.h"
+#include "controller.h"
+#include "wifi.h"
+#include "traffic.h"
+
+#define TAG "SSE"
+
+#define SSE_EVENT_MAX_SIZE 512
+
+// Send rounds in a row a subscriber may leave short before it is
+// disconnected.
+#define SSE_MAX_STALLS 8
+
+/**
+ * @brief subscriber of the event stream.
+ */
+struct sse_client {
+	int fd;          // socket, -1 if the slot is free
+	uint32_t cursor; // ring offset of the next byte to send
+	int stalls;      // send rounds in a row with a short write
+};
+
+/**
+ * @brief private event stream state.
+ * The ring offsets increase monotonically, the position in the ring is the
+ * offset modulo SSE_RING_SIZE.
+ */
+static struct {
+	httpd_handle_t server;
+	SemaphoreHandle_t lock; // protects the ring & clients
+	esp_timer_handle_t timer;
+	char ring[SSE_RING_SIZE];
+	uint32_t head;          // ring offset of the next event
+	struct sse_client clients[SSE_MAX_CLIENTS];
+	int client_count;
+	bool pump_pending;      // a send round is queued
+	uint32_t generation;    // config generation of the last duty event
+	uint32_t ticks;
+} sse;
+
+static void sse_pump(void *arg);
+
+/**
+ * @brief sse_schedule_pump queues a send round into the http server task,
+ * where the sockets are owned.
+ */
+static void sse_schedule_pump()
+{
+	xSemaphoreTake(sse.lock, portMAX_DELAY);
+	bool pending = sse.pump_pending;
+	sse.pump_pending = true;
+	xSemaphoreGive(sse.lock);
+	if (pending) {
+		return;
+	}
+	if (httpd_queue_work(sse.server, sse_pump, NULL) != ESP_OK) {
+		xSemaphoreTake(sse.lock, portMAX_DELAY);
+		sse.pump_pending = false;
+		xSemaphoreGive(sse.lock);
+	}
+}
+
+/**
+ * @brief sse_publish appends the event into the ring buffer.
+ */
+static void sse_publish(const char *event, const char *data)
+{
+	char buffer[SSE_EVENT_MAX_SIZE];
+	int n = snprintf(buffer, sizeof(buffer),
+		"event: %s\ndata: %s\n\n", event, data);
+	if (n < 0 || (size_t) n >= sizeof(buffer)) {
+		ESP_LOGE(TAG, "sse_publish: event [%s] too large", event);
+		return;
+	}
+	xSemaphoreTake(sse.lock, portMAX_DELAY);
+	for (int i = 0; i < n; i++) {
+		sse.ring[(sse.head + i) % SSE_RING_SIZE] = buffer[i];
+	}
+	sse.head += n;
+	xSemaphoreGive(sse.lock);
+	sse_schedule_pump();
+}
+
+static void sse_pump(void *arg)
+{
+	char buffer[SSE_CLIENT_BUDGET];
+	bool pending = false;
+	for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+		xSemaphoreTake(sse.lock, portMAX_DELAY);
+		struct sse_client *client = &sse.clients[i];
+		int fd = client->fd;
+		uint32_t cursor = client->cursor;
+		uint32_t behind = sse.head - cursor;
+		size_t n = behind < sizeof(buffer) ? behind : sizeof(buffer);
+		for (size_t j = 0; j < n; j++) {
+			buffer[j] = sse.ring[(cursor + j) % SSE_RING_SIZE];
+		}
+		xSemaphoreGive(sse.lock);
+		if (fd < 0 || n == 0) {
+			continue;
+		}
+		if (behind > SSE_RING_SIZE) {
+			// The events are overwritten, the client will reconnect
+			// and get a new snapshot.
+			ESP_LOGW(TAG, "client [%d] too slow, disconnect", fd);
+			httpd_sess_trigger_close(sse.server, fd);
+			continue;
+		}
+		// The pump runs on the server task, a full send window must not
+		// block it: the write is non-blocking and a short one counts
+		// as a stall.
+		int sent = httpd_socket_send(sse.server, fd, buffer, n,
+			MSG_DONTWAIT);
+		if (sent == HTTPD_SOCK_ERR_TIMEOUT) {
+			sent = 0;
+		}
+		if (sent < 0) {
+			ESP_LOGW(TAG, "send to client [%d] failed: %d", fd, sent);
+			httpd_sess_trigger_close(sse.server, fd);
+			continue;
+		}
+		bool stalled = false;
+		xSemaphoreTake(sse.lock, portMAX_DELAY);
+		if (client->fd == fd) {
+			client->cursor += sent;
+			client->stalls = (size_t) sent < n ? client->stalls + 1 : 0;
+			stalled = client->stalls > SSE_MAX_STALLS;
+			// A stalled client is retried by the next event, not
+			// by an immediate round.
+			pending |= (size_t) sent == n && client->cursor != sse.head;
+		}
+		xSemaphoreGive(sse.lock);
+		if (stalled) {
+			ESP_LOGW(TAG, "client [%d] stalled, disconnect", fd);
+			httpd_sess_trigger_close(sse.server, fd);
+		}
+	}
+
+	xSemaphoreTake(sse.lock, portMAX_DELAY);
+	sse.pump_pending = false;
+	xSemaphoreGive(sse.lock);
+	if (pending) {
+		sse_schedule_pump();
+	}
+}
+
+static int sse_format_duty(char *buffer, size_t size)
+{
+	return snprintf(buffer, size,
+		"{\"generation\": %u, \"pwm_fan_duty\": %u, "
+		"\"pwm_mos_duty\": %u}",
+		(unsigned int) global_controller_config_generation(),
+		(unsigned int) global_controller_get_duty(CONTROLLER_PWM_FAN),
+		(unsigned int) global_controller_get_duty(CONTROLLER_PWM_MOS));
+}
+
+static void sse_timer_callback(void *arg)
+{
+	if (sse.client_count == 0) {
+		return;
+	}
+	char data[SSE_EVENT_MAX_SIZE / 2];
+	uint32_t generation = global_controller_config_generation();
+	if (generation != sse.generation) {
+		sse.generation = generation;
+		sse_format_duty(data, sizeof(data));
+		sse_publish("duty", data);
+	}
+	if (++sse.ticks % (SSE_TELEMETRY_INTERVAL_MS /
+		SSE_POLL_INTERVAL_MS) != 0) {
+		return;
+	}
+	struct controller_tick_stats tick;
+	global_controller_get_tick_stats(&tick);
+	snprintf(data, sizeof(data),
+		"{\"heap_free\": %u, \"heap_min\": %u, \"uptime_ms\": %lld, "
+		"\"stations\": %d, \"subscribers\": %d, "
+		"\"duty_coalesced\": %u, \"tick_jitter_us\": %u, "
+		"\"tick_jitter_max_us\": %u}",
+		(unsigned int) esp_get_free_heap_size(),
+		(unsigned int) esp_get_minimum_free_heap_size(),
+		(long long) (esp_timer_get_time() / 1000),
+		controller_wifi_station_count(), sse.client_count,
+		(unsigned int) tick.coalesced, (unsigned int) tick.jitter_us,
+		(unsigned int) tick.jitter_max_us);
+	sse_publish("telemetry", data);
+}
+
+static esp_err_t handle_sse(httpd_req_t *req)
+{
+	int fd = httpd_req_to_sockfd(req);
+	xSemaphoreTake(sse.lock, portMAX_DELAY);
+	struct sse_client *client = NULL;
+	for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+		if (sse.clients[i].fd < 0) {
+			client = &sse.clients[i];
+			break;
+		}
+	}
+	xSemaphoreGive(sse.lock);
+	if (client == NULL) {
+		httpd_resp_set_status(req, "503 Service Unavailable");
+		return httpd_resp_sendstr(req, "too many subscribers");
+	}
+
+	// The stream has no length, the headers are sent directly and the
+	// events are written to the socket by the send rounds.
+	static const char header[] =
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type: text/event-stream\r\n"
+		"Cache-Control: no-store\r\n"
+		"Connection: keep-alive\r\n"
+		"\r\n"
+		"retry: 2000\n\n";
+	char event[SSE_EVENT_MAX_SIZE];
+	char data[SSE_EVENT_MAX_SIZE / 2];
+	sse_format_duty(data, sizeof(data));
+	int n = snprintf(event, sizeof(event), "event: duty\ndata: %s\n\n", data);
+	if (httpd_send(req, header, sizeof(header) - 1) < 0 ||
+		httpd_send(req, event, n) < 0) {
+		ESP_LOGE(TAG, "handle_sse: failed to send header");
+		return ESP_FAIL;
+	}
+
+	xSemaphoreTake(sse.lock, portMAX_DELAY);
+	client->fd = fd;
+	client->cursor = sse.head;
+	client->stalls = 0;
+	sse.client_count++;
+	xSemaphoreGive(sse.lock);
+	ESP_LOGI(TAG, "client [%d] subscribed", fd);
+	return ESP_OK;
+}
+
+void sse_close_client(int sockfd)
+{
+	if (sse.lock == NULL) {
+		return;
+	}
+	xSemaphoreTake(sse.lock, portMAX_DELAY);
+	for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+		if (sse.clients[i].fd == sockfd) {
+			sse.clients[i].fd = -1;
+			sse.client_count--;
+			ESP_LOGI(TAG, "client [%d] unsubscribed", sockfd);
+		}
+	}
+	xSemaphoreGive(sse.lock);
+}
+
+static const httpd_uri_t sse_handler = {
+	.uri = "/events",
+	.method = HTTP_GET,
+	.handler = handle_sse,
+};
+
+esp_err_t register_sse_handler(httpd_handle_t server)
+{
+	if (sse.lock == NULL) {
+		sse.lock = xSemaphoreCreateMutex();
+		if (sse.lock == NULL) {
+			ESP_LOGE(TAG, "register_sse_handler: "
+				"create mutex failed");
+			return ESP_FAIL;
+		}
+		for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+			sse.clients[i].fd = -1;
+		}
+	}
+	sse.server = server;
+	if (sse.timer == NULL) {
+		const esp_timer_create_args_t args = {
+			.callback = sse_timer_callback,
+			.name = "sse",
+		};
+		esp_err_t ret = esp_timer_create(&args, &sse.timer);
+		if (ret == ESP_OK) {
+			ret = esp_timer_start_periodic(sse.timer,
+				SSE_POLL_INTERVAL_MS * 1000);
+		}
+		if (ret != ESP_OK) {
+			ESP_LOGE(TAG, "register_sse_handler: "
+				"start timer failed: [%d]", ret);
+			return ret;
+		}
+	}
+	return traffic_register_uri_handler(
+		server, &sse_handler, TRAFFIC_STREAM);
+}
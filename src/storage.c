@@ -1,11 +1,14 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <esp_err.h>
 #include <esp_log.h>
 #include <nvs_flash.h>
 #include <esp_spiffs.h>
+#include <esp_vfs.h>
 
 #include "storage.h"
 
@@ -39,7 +42,7 @@ esp_err_t init_storage()
 		ESP_LOGE(TAG, "esp_spiffs_info failed %d", ret);
 		return ret;
 	}
-	ESP_LOGI(TAG, "spiff partition total: %d, used: %d", total, used);
+	ESP_LOGI(TAG, "spiff partition total: %zu, used: %zu", total, used);
 	ESP_LOGD(TAG, "storage init finished");
 	return ESP_OK;
 }
@@ -83,9 +86,65 @@ int write_file(char *filename, char *content)
 	return ret;
 }
 
+int write_file_atomic(const char *filename, const char *content)
+{
+	char tmp[ESP_VFS_PATH_MAX + CONFIG_SPIFFS_OBJ_NAME_LEN];
+	int n = snprintf(tmp, sizeof(tmp), "%s"STORAGE_TMP_SUFFIX, filename);
+	if (n < 0 || (size_t) n >= sizeof(tmp)) {
+		ESP_LOGE(TAG, "write_file_atomic: filename too long");
+		return 0;
+	}
+	FILE *fd = fopen(tmp, "w");
+	if (fd == NULL) {
+		ESP_LOGE(TAG, "failed to open: %s", tmp);
+		return 0;
+	}
+	int ret = fprintf(fd, "%s", content);
+	if (ret < 0 || fflush(fd) != 0) {
+		ESP_LOGE(TAG, "failed to write: %s", tmp);
+		fclose(fd);
+		unlink(tmp);
+		return 0;
+	}
+	// Best effort, not all VFS drivers implement fsync.
+	fsync(fileno(fd));
+	if (fclose(fd) != 0) {
+		ESP_LOGE(TAG, "failed to close: %s", tmp);
+		unlink(tmp);
+		return 0;
+	}
+
+	if (rename(tmp, filename) != 0) {
+		// SPIFFS does not allow to rename over an existing file.
+		unlink(filename);
+		if (rename(tmp, filename) != 0) {
+			ESP_LOGE(TAG, "failed to rename %s: %d", tmp, errno);
+			return 0;
+		}
+	}
+	return ret;
+}
+
+int open_file_atomic(const char *filename)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd >= 0) {
+		return fd;
+	}
+	char tmp[ESP_VFS_PATH_MAX + CONFIG_SPIFFS_OBJ_NAME_LEN];
+	int n = snprintf(tmp, sizeof(tmp), "%s"STORAGE_TMP_SUFFIX, filename);
+	if (n < 0 || (size_t) n >= sizeof(tmp)) {
+		return -1;
+	}
+	if (rename(tmp, filename) != 0) {
+		return -1;
+	}
+	ESP_LOGW(TAG, "recovered %s from the temporary file", filename);
+	return open(filename, O_RDONLY);
+}
+
 bool is_regular_file(const char *filename)
 {
 	struct stat s;
-	stat(filename, &s);
-	return S_ISREG(s.st_mode);
+	return stat(filename, &s) == 0 && S_ISREG(s.st_mode);
 }
@@ -0,0 +1,320 @@
+#include <string.h>
+#include <stdbool.h>
+
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <esp_http_server.h>
+
+#include "traffic.h"
+
+#define TAG "TRAFFIC"
+
+// Max number of the URI handlers registered with a class.
+#define TRAFFIC_MAX_URI_HANDLERS 12
+
+/**
+ * @brief traffic_uri is a registered URI handler with its class, it is the
+ * user context of the registered handler.
+ */
+struct traffic_uri {
+	httpd_uri_t uri;
+	enum traffic_class class;
+};
+
+/**
+ * @brief traffic_sock is an open socket of the http server.
+ */
+struct traffic_sock {
+	int fd;
+	bool used;                // false if the slot is free
+	bool classified;          // false if no request received yet
+	enum traffic_class class; // class of the last request
+	int active;               // requests being handled
+	int64_t last_us;          // time of the last request
+};
+
+static struct {
+	portMUX_TYPE lock;
+	struct traffic_uri uris[TRAFFIC_MAX_URI_HANDLERS];
+	int uri_count;
+	struct traffic_sock socks[TRAFFIC_MAX_OPEN_SOCKETS];
+	struct traffic_stats stats[TRAFFIC_CLASS_MAX];
+	// The request being handled by the server task.
+	struct traffic_req current;
+	bool deferred;
+} traffic = {
+	.lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static const char *traffic_class_names[TRAFFIC_CLASS_MAX] = {
+	[TRAFFIC_CONTROL] = "control",
+	[TRAFFIC_ASSET] = "asset",
+	[TRAFFIC_STREAM] = "stream",
+};
+
+static struct traffic_sock *traffic_find_sock(int fd)
+{
+	for (int i = 0; i < TRAFFIC_MAX_OPEN_SOCKETS; i++) {
+		if (traffic.socks[i].used && traffic.socks[i].fd == fd) {
+			return &traffic.socks[i];
+		}
+	}
+	return NULL;
+}
+
+static void traffic_begin(struct traffic_req *req)
+{
+	portENTER_CRITICAL(&traffic.lock);
+	struct traffic_stats *stats = &traffic.stats[req->class];
+	if (++stats->active > stats->active_max) {
+		stats->active_max = stats->active;
+	}
+	struct traffic_sock *sock = traffic_find_sock(req->fd);
+	if (sock != NULL) {
+		sock->class = req->class;
+		sock->classified = true;
+		sock->active++;
+		sock->last_us = req->start;
+	}
+	portEXIT_CRITICAL(&traffic.lock);
+}
+
+void traffic_end(const struct traffic_req *req)
+{
+	if (req == NULL || req->class >= TRAFFIC_CLASS_MAX) {
+		return;
+	}
+	uint32_t latency = esp_timer_get_time() - req->start;
+	portENTER_CRITICAL(&traffic.lock);
+	struct traffic_stats *stats = &traffic.stats[req->class];
+	stats->active--;
+	stats->requests++;
+	stats->latency_us += latency;
+	if (latency > stats->latency_max_us) {
+		stats->latency_max_us = latency;
+	}
+	struct traffic_sock *sock = traffic_find_sock(req->fd);
+	if (sock != NULL && sock->active > 0) {
+		sock->active--;
+	}
+	portEXIT_CRITICAL(&traffic.lock);
+}
+
+void traffic_defer(struct traffic_req *req)
+{
+	if (req != NULL) {
+		*req = traffic.current;
+	}
+	traffic.deferred = true;
+}
+
+/**
+ * @brief traffic_evict_asset closes the least recently used idle asset
+ * connection, it returns false if there is none.
+ */
+static bool traffic_evict_asset(httpd_handle_t server, int new_fd)
+{
+	int fd = -1;
+	portENTER_CRITICAL(&traffic.lock);
+	struct traffic_sock *victim = NULL;
+	for (int i = 0; i < TRAFFIC_MAX_OPEN_SOCKETS; i++) {
+		struct traffic_sock *sock = &traffic.socks[i];
+		if (!sock->used || sock->fd == new_fd ||
+			!sock->classified || sock->class != TRAFFIC_ASSET ||
+			sock->active > 0) {
+			continue;
+		}
+		if (victim == NULL || sock->last_us < victim->last_us) {
+			victim = sock;
+		}
+	}
+	if (victim != NULL) {
+		fd = victim->fd;
+		// Not picked again before it is closed.
+		victim->classified = false;
+		traffic.stats[TRAFFIC_ASSET].evicted++;
+	}
+	portEXIT_CRITICAL(&traffic.lock);
+	if (fd >= 0) {
+		ESP_LOGD(TAG, "close idle asset connection [%d]", fd);
+		httpd_sess_trigger_close(server, fd);
+	}
+	return fd >= 0;
+}
+
+/**
+ * @brief traffic_admit checks the connection limit of the request class.
+ * At most TRAFFIC_MAX_OPEN_SOCKETS - TRAFFIC_CONTROL_RESERVED_SOCKETS
+ * connections serve the other classes, a connection over the limit takes
+ * the place of an idle asset connection, or is refused.
+ */
+static bool traffic_admit(
+	httpd_handle_t server, int fd, enum traffic_class class
+) {
+	if (class == TRAFFIC_CONTROL) {
+		return true;
+	}
+	int used = 0;
+	bool admitted = false;
+	portENTER_CRITICAL(&traffic.lock);
+	for (int i = 0; i < TRAFFIC_MAX_OPEN_SOCKETS; i++) {
+		struct traffic_sock *sock = &traffic.socks[i];
+		if (!sock->used || !sock->classified ||
+			sock->class == TRAFFIC_CONTROL) {
+			continue;
+		}
+		if (sock->fd == fd) {
+			admitted = true;
+		}
+		used++;
+	}
+	portEXIT_CRITICAL(&traffic.lock);
+	if (admitted || used < TRAFFIC_MAX_OPEN_SOCKETS -
+		TRAFFIC_CONTROL_RESERVED_SOCKETS) {
+		return true;
+	}
+	return traffic_evict_asset(server, fd);
+}
+
+/**
+ * @brief traffic_refuse answers the request refused by the connection limit
+ * and closes the connection.
+ */
+static esp_err_t traffic_refuse(httpd_req_t *req, enum traffic_class class)
+{
+	portENTER_CRITICAL(&traffic.lock);
+	traffic.stats[class].refused++;
+	portEXIT_CRITICAL(&traffic.lock);
+	ESP_LOGD(TAG, "refuse %s connection [%d]", traffic_class_name(class),
+		httpd_req_to_sockfd(req));
+	httpd_resp_set_status(req, "503 Service Unavailable");
+	httpd_resp_set_hdr(req, "Retry-After", "1");
+	httpd_resp_set_hdr(req, "Connection", "close");
+	httpd_resp_sendstr(req, "too many connections");
+	// The session is closed by the server.
+	return ESP_FAIL;
+}
+
+/**
+ * @brief traffic_handler calls the registered handler and accounts the
+ * request by its class, it runs on the server task.
+ */
+static esp_err_t traffic_handler(httpd_req_t *req)
+{
+	const struct traffic_uri *entry = req->user_ctx;
+	req->user_ctx = entry->uri.user_ctx;
+	if (!traffic_admit(req->handle, httpd_req_to_sockfd(req),
+		entry->class)) {
+		return traffic_refuse(req, entry->class);
+	}
+	traffic.current.fd = httpd_req_to_sockfd(req);
+	traffic.current.class = entry->class;
+	traffic.current.start = esp_timer_get_time();
+	traffic.deferred = false;
+	traffic_begin(&traffic.current);
+
+	esp_err_t ret = entry->uri.handler(req);
+	if (!traffic.deferred) {
+		traffic_end(&traffic.current);
+	}
+	return ret;
+}
+
+esp_err_t traffic_register_uri_handler(
+	httpd_handle_t server, const httpd_uri_t *uri, enum traffic_class class
+) {
+	if (server == NULL || uri == NULL || class >= TRAFFIC_CLASS_MAX) {
+		ESP_LOGE(TAG, "traffic_register_uri_handler: invalid param");
+		return ESP_ERR_INVALID_ARG;
+	}
+	struct traffic_uri *entry = NULL;
+	for (int i = 0; i < traffic.uri_count; i++) {
+		if (strcmp(traffic.uris[i].uri.uri, uri->uri) == 0 &&
+			traffic.uris[i].uri.method == uri->method) {
+			// Registered again after the server restarted.
+			entry = &traffic.uris[i];
+			break;
+		}
+	}
+	if (entry == NULL) {
+		if (traffic.uri_count >= TRAFFIC_MAX_URI_HANDLERS) {
+			ESP_LOGE(TAG, "traffic_register_uri_handler: "
+				"too many handlers");
+			return ESP_ERR_NO_MEM;
+		}
+		entry = &traffic.uris[traffic.uri_count++];
+	}
+	entry->uri = *uri;
+	entry->class = class;
+
+	httpd_uri_t wrapped = *uri;
+	wrapped.handler = traffic_handler;
+	wrapped.user_ctx = entry;
+	return httpd_register_uri_handler(server, &wrapped);
+}
+
+esp_err_t traffic_open_fn(httpd_handle_t server, int sockfd)
+{
+	int open = 0;
+	bool tracked = false;
+	portENTER_CRITICAL(&traffic.lock);
+	for (int i = 0; i < TRAFFIC_MAX_OPEN_SOCKETS; i++) {
+		struct traffic_sock *sock = &traffic.socks[i];
+		if (!sock->used && !tracked) {
+			memset(sock, 0, sizeof(*sock));
+			sock->fd = sockfd;
+			sock->used = true;
+			tracked = true;
+		}
+		if (sock->used) {
+			open++;
+		}
+	}
+	portEXIT_CRITICAL(&traffic.lock);
+	if (open > TRAFFIC_MAX_OPEN_SOCKETS -
+		TRAFFIC_CONTROL_RESERVED_SOCKETS) {
+		traffic_evict_asset(server, sockfd);
+	}
+	if (open >= TRAFFIC_MAX_OPEN_SOCKETS) {
+		// The evicted connections are closed later by the server
+		// task. A socket is kept free, so the server LRU purge of
+		// the next connection does not close a control connection.
+		ESP_LOGD(TAG, "no free socket, refuse connection [%d]", sockfd);
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+void traffic_close_fn(int sockfd)
+{
+	portENTER_CRITICAL(&traffic.lock);
+	struct traffic_sock *sock = traffic_find_sock(sockfd);
+	if (sock != NULL) {
+		sock->used = false;
+	}
+	portEXIT_CRITICAL(&traffic.lock);
+}
+
+const char *traffic_class_name(enum traffic_class class)
+{
+	if (class >= TRAFFIC_CLASS_MAX) {
+		return "unknown";
+	}
+	return traffic_class_names[class];
+}
+
+void traffic_get_stats(enum traffic_class class, struct traffic_stats *stats)
+{
+	if (stats == NULL) {
+		return;
+	}
+	if (class >= TRAFFIC_CLASS_MAX) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+	portENTER_CRITICAL(&traffic.lock);
+	memcpy(stats, &traffic.stats[class], sizeof(*stats));
+	portEXIT_CRITICAL(&traffic.lock);
+}
@@ -0,0 +1,222 @@
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+
+#include "udp.h"
+#include "udp_proto.h"
+#include "controller.h"
+
+#define TAG "UDP"
+
+#define UDP_TASK_STACK_SIZE 4096
+#define UDP_TASK_PRIORITY (tskIDLE_PRIORITY + 2)
+
+/**
+ * @brief udp_peer is the session of a peer, identified by its address
+ * and port.
+ */
+struct udp_peer {
+	uint32_t addr;
+	uint16_t port;
+	bool used;
+	uint32_t seq;      // last accepted sequence number
+	int64_t last_seen; // esp_timer time in us
+};
+
+static struct {
+	int sock;
+	TaskHandle_t task;
+	struct udp_peer peers[UDP_MAX_PEERS];
+	struct udp_stats stats;
+} udp = {
+	.sock = -1,
+};
+
+/**
+ * @brief udp_find_peer finds the peer session, a new session replaces the
+ * least recently seen one if not found.
+ *
+ * @return the peer session, `used` is false if it is a new session.
+ */
+static struct udp_peer *udp_find_peer(const struct sockaddr_in *from)
+{
+	struct udp_peer *oldest = &udp.peers[0];
+	for (int i = 0; i < UDP_MAX_PEERS; i++) {
+		struct udp_peer *peer = &udp.peers[i];
+		if (peer->used && peer->addr == from->sin_addr.s_addr &&
+			peer->port == from->sin_port) {
+			return peer;
+		}
+		if (!peer->used) {
+			oldest = peer;
+		} else if (oldest->used && peer->last_seen < oldest->last_seen) {
+			oldest = peer;
+		}
+	}
+	memset(oldest, 0, sizeof(*oldest));
+	oldest->addr = from->sin_addr.s_addr;
+	oldest->port = from->sin_port;
+	return oldest;
+}
+
+static esp_err_t stage_udp_duties(struct config *staged, void *ctx)
+{
+	const struct udp_proto_packet *packet = ctx;
+	for (int i = 0; i < packet->count; i++) {
+		const struct udp_proto_duty *d = &packet->duties[i];
+		enum config_key_id id = controller_pwm_duty_id(d->pwm);
+		if (id == CONFIG_ID_MAX) {
+			return ESP_ERR_INVALID_ARG;
+		}
+		if (config_set_uint(staged, id, d->duty) != ESP_OK) {
+			return ESP_ERR_INVALID_ARG;
+		}
+	}
+	return ESP_OK;
+}
+
+static uint8_t udp_apply_duties(const struct udp_proto_packet *packet)
+{
+	int64_t start = esp_timer_get_time();
+	esp_err_t ret = global_controller_update_config_batch(
+		stage_udp_duties, (void *) packet);
+	if (ret == ESP_ERR_INVALID_ARG) {
+		udp.stats.invalid++;
+		return UDP_PROTO_STATUS_INVALID;
+	} else if (ret != ESP_OK) {
+		return UDP_PROTO_STATUS_FAILED;
+	}
+	uint32_t elapsed = esp_timer_get_time() - start;
+	udp.stats.applied++;
+	udp.stats.apply_us = elapsed;
+	if (elapsed > udp.stats.apply_max_us) {
+		udp.stats.apply_max_us = elapsed;
+	}
+	return UDP_PROTO_STATUS_OK;
+}
+
+static void udp_send_ack(
+	const struct sockaddr_in *to, uint32_t seq, uint8_t status
+) {
+	struct udp_proto_packet ack = {
+		.type = UDP_PROTO_ACK,
+		.status = status,
+		.seq = seq,
+		.count = CONTROLLER_PWM_MAX,
+	};
+	for (int pwm = 0; pwm < CONTROLLER_PWM_MAX; pwm++) {
+		ack.duties[pwm].pwm = pwm;
+		ack.duties[pwm].duty = global_controller_get_duty(pwm);
+	}
+	uint8_t buffer[UDP_PROTO_MAX_PACKET_SIZE];
+	size_t length = udp_proto_encode(&ack, buffer, sizeof(buffer));
+	if (sendto(udp.sock, buffer, length, 0,
+		(const struct sockaddr *) to, sizeof(*to)) < 0) {
+		ESP_LOGW(TAG, "sendto failed: errno %d", errno);
+	}
+}
+
+static void udp_handle_packet(
+	const uint8_t *buffer, size_t length, const struct sockaddr_in *from
+) {
+	struct udp_proto_packet packet;
+	udp.stats.received++;
+	if (udp_proto_decode(buffer, length, &packet) != ESP_OK ||
+		packet.type == UDP_PROTO_ACK) {
+		udp.stats.invalid++;
+		return;
+	}
+
+	struct udp_peer *peer = udp_find_peer(from);
+	bool repeated = false;
+	if (peer->used && packet.seq != 0) {
+		if (packet.seq == peer->seq) {
+			// The ack was lost, ack again without applying.
+			repeated = true;
+		} else if (!udp_proto_seq_newer(packet.seq, peer->seq)) {
+			udp.stats.stale++;
+			return;
+		}
+	}
+	peer->used = true;
+	peer->seq = packet.seq;
+	peer->last_seen = esp_timer_get_time();
+
+	uint8_t status = UDP_PROTO_STATUS_OK;
+	if (packet.type == UDP_PROTO_SET_DUTY && !repeated) {
+		status = udp_apply_duties(&packet);
+	}
+	udp_send_ack(from, packet.seq, status);
+}
+
+static void udp_task(void *arg)
+{
+	uint8_t buffer[UDP_PROTO_MAX_PACKET_SIZE + 1];
+	struct sockaddr_in from;
+	while (true) {
+		socklen_t from_len = sizeof(from);
+		int n = recvfrom(udp.sock, buffer, sizeof(buffer), 0,
+			(struct sockaddr *) &from, &from_len);
+		if (n < 0) {
+			ESP_LOGE(TAG, "recvfrom failed: errno %d", errno);
+			vTaskDelay(pdMS_TO_TICKS(100));
+			continue;
+		}
+		udp_handle_packet(buffer, n, &from);
+	}
+}
+
+esp_err_t start_udp_control(const struct config *config)
+{
+	if (config == NULL) {
+		ESP_LOGE(TAG, "start_udp_control: invalid param");
+		return ESP_FAIL;
+	}
+	if (udp.task != NULL) {
+		return ESP_OK;
+	}
+
+	udp.sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (udp.sock < 0) {
+		ESP_LOGE(TAG, "socket failed: errno %d", errno);
+		return ESP_FAIL;
+	}
+	// Listen on the soft AP interface only.
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(UDP_CONTROL_PORT),
+		.sin_addr.s_addr = config->dhcps.ip.addr,
+	};
+	if (bind(udp.sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		ESP_LOGE(TAG, "bind failed: errno %d", errno);
+		close(udp.sock);
+		udp.sock = -1;
+		return ESP_FAIL;
+	}
+
+	BaseType_t ret = xTaskCreate(udp_task, "udp_control",
+		UDP_TASK_STACK_SIZE, NULL, UDP_TASK_PRIORITY, &udp.task);
+	if (ret != pdPASS) {
+		ESP_LOGE(TAG, "start_udp_control: xTaskCreate failed");
+		close(udp.sock);
+		udp.sock = -1;
+		udp.task = NULL;
+		return ESP_FAIL;
+	}
+	ESP_LOGI(TAG, "UDP control listening on port %d", UDP_CONTROL_PORT);
+	return ESP_OK;
+}
+
+void udp_get_stats(struct udp_stats *stats)
+{
+	if (stats != NULL) {
+		memcpy(stats, &udp.stats, sizeof(*stats));
+	}
+}
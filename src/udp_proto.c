@@ -0,0 +1,99 @@
+#include <string.h>
+
+#include "udp_proto.h"
+
+static uint16_t get_u16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+	put_u16(p, v & 0xffff);
+	put_u16(p + 2, (v >> 16) & 0xffff);
+}
+
+esp_err_t udp_proto_decode(
+	const uint8_t *buffer, size_t length, struct udp_proto_packet *packet
+) {
+	if (buffer == NULL || packet == NULL ||
+		length < UDP_PROTO_HEADER_SIZE ||
+		length > UDP_PROTO_MAX_PACKET_SIZE ||
+		(length - UDP_PROTO_HEADER_SIZE) % UDP_PROTO_RECORD_SIZE) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	if (buffer[0] != UDP_PROTO_MAGIC || buffer[1] != UDP_PROTO_VERSION) {
+		return ESP_ERR_INVALID_VERSION;
+	}
+	memset(packet, 0, sizeof(*packet));
+	packet->type = buffer[2];
+	packet->status = buffer[3];
+	packet->seq = get_u32(buffer + 4);
+	packet->count = (length - UDP_PROTO_HEADER_SIZE) /
+		UDP_PROTO_RECORD_SIZE;
+	switch (packet->type) {
+	case UDP_PROTO_SET_DUTY:
+		if (packet->count == 0) {
+			return ESP_ERR_INVALID_SIZE;
+		}
+		break;
+	case UDP_PROTO_GET_DUTY:
+		if (packet->count != 0) {
+			return ESP_ERR_INVALID_SIZE;
+		}
+		break;
+	case UDP_PROTO_ACK:
+		break;
+	default:
+		return ESP_ERR_INVALID_ARG;
+	}
+	const uint8_t *p = buffer + UDP_PROTO_HEADER_SIZE;
+	for (int i = 0; i < packet->count; i++) {
+		packet->duties[i].pwm = p[0];
+		packet->duties[i].duty = get_u16(p + 1);
+		p += UDP_PROTO_RECORD_SIZE;
+	}
+	return ESP_OK;
+}
+
+size_t udp_proto_encode(
+	const struct udp_proto_packet *packet, uint8_t *buffer, size_t size
+) {
+	if (packet == NULL || buffer == NULL ||
+		packet->count > UDP_PROTO_MAX_RECORDS) {
+		return 0;
+	}
+	size_t length = UDP_PROTO_HEADER_SIZE +
+		packet->count * UDP_PROTO_RECORD_SIZE;
+	if (size < length) {
+		return 0;
+	}
+	buffer[0] = UDP_PROTO_MAGIC;
+	buffer[1] = UDP_PROTO_VERSION;
+	buffer[2] = packet->type;
+	buffer[3] = packet->status;
+	put_u32(buffer + 4, packet->seq);
+	uint8_t *p = buffer + UDP_PROTO_HEADER_SIZE;
+	for (int i = 0; i < packet->count; i++) {
+		p[0] = packet->duties[i].pwm;
+		put_u16(p + 1, packet->duties[i].duty);
+		p += UDP_PROTO_RECORD_SIZE;
+	}
+	return length;
+}
+
+bool udp_proto_seq_newer(uint32_t seq, uint32_t last)
+{
+	return (int32_t) (seq - last) > 0;
+}
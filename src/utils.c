@@ -90,3 +90,16 @@ esp_ip4_addr_t str2ipv4(const char *const value)
 
 	return ip;
 }
+
+uint32_t crc32(const void *data, size_t length)
+{
+	const uint8_t *p = data;
+	uint32_t crc = 0xffffffff;
+	for (size_t i = 0; i < length; i++) {
+		crc ^= p[i];
+		for (int j = 0; j < 8; j++) {
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		}
+	}
+	return ~crc;
+}
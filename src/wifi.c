@@ -11,6 +11,8 @@
 #define TAG "WIFI"
 #define DEFAULT_WIFI_MAX_CONNECTION 4
 
+static volatile int wifi_station_count;
+
 static void wifi_event_handler(
 	void* arg,
 	esp_event_base_t event_base,
@@ -24,6 +26,7 @@ static void wifi_event_handler(
 			(wifi_event_ap_staconnected_t*) event_data;
 		ESP_LOGD(TAG, "station "MACSTR" join, AID=%d",
 			MAC2STR(event->mac), event->aid);
+		wifi_station_count++;
 		break;
 	}
 	case WIFI_EVENT_AP_STADISCONNECTED:
@@ -32,6 +35,9 @@ static void wifi_event_handler(
 			(wifi_event_ap_stadisconnected_t*) event_data;
 		ESP_LOGD(TAG, "station "MACSTR" leave, AID=%d",
 			MAC2STR(event->mac), event->aid);
+		if (wifi_station_count > 0) {
+			wifi_station_count--;
+		}
 		break;
 	}
 	}
@@ -62,8 +68,8 @@ esp_err_t init_controller_wifi_softap(struct config *c)
 
 	wifi_config_t config = {
 		.ap = {
-			.ssid_len = strlen(c->wifi->ssid),
-			.channel = c->wifi->channel,
+			.ssid_len = strlen(c->wifi.ssid),
+			.channel = c->wifi.channel,
 			.max_connection = DEFAULT_WIFI_MAX_CONNECTION,
 			.authmode = WIFI_AUTH_WPA2_PSK,
 			.pmf_cfg = {
@@ -73,10 +79,10 @@ esp_err_t init_controller_wifi_softap(struct config *c)
 	};
 	memset(config.ap.ssid, 0, sizeof(config.ap.ssid));
 	memset(config.ap.password, 0, sizeof(config.ap.password));
-	memcpy(config.ap.ssid, c->wifi->ssid, strlen(c->wifi->ssid));
+	memcpy(config.ap.ssid, c->wifi.ssid, strlen(c->wifi.ssid));
 	memcpy(config.ap.password,
-		c->wifi->password, strlen(c->wifi->password));
-	if (strlen(c->wifi->password) == 0) {
+		c->wifi.password, strlen(c->wifi.password));
+	if (strlen(c->wifi.password) == 0) {
 		config.ap.authmode = WIFI_AUTH_OPEN;
 		config.ap.pmf_cfg.required = false;
 	}
@@ -104,8 +110,8 @@ esp_err_t init_controller_wifi_softap(struct config *c)
 		wifi_ap,
 		ESP_NETIF_OP_SET,
 		ESP_NETIF_ROUTER_SOLICITATION_ADDRESS,
-		&c->dhcps->as_router,
-		sizeof(c->dhcps->as_router)
+		&c->dhcps.as_router,
+		sizeof(c->dhcps.as_router)
 	);
 	if (ret != ESP_OK) {
 		ESP_LOGE(TAG, "esp_netif_dhcps_option [%d]", ret);
@@ -114,9 +120,9 @@ esp_err_t init_controller_wifi_softap(struct config *c)
 
         // Set IP address.
         esp_netif_ip_info_t info = {
-		.ip = c->dhcps->ip,
-		.gw = c->dhcps->ip,
-		.netmask = c->dhcps->netmask
+		.ip = c->dhcps.ip,
+		.gw = c->dhcps.ip,
+		.netmask = c->dhcps.netmask
 	};
 	if ((ret = esp_netif_set_ip_info(wifi_ap, &info)) != ESP_OK) {
 		ESP_LOGE(TAG, "esp_netif_set_ip_info [%d]", ret);
@@ -134,7 +140,12 @@ esp_err_t init_controller_wifi_softap(struct config *c)
 		return ret;
 	}
 	ESP_LOGI(TAG, "init WIFI: SSID [%s] channel [%u]",
-		c->wifi->ssid, c->wifi->channel);
+		c->wifi.ssid, c->wifi.channel);
 
 	return ESP_OK;
 }
+
+int controller_wifi_station_count()
+{
+	return wifi_station_count;
+}
@@ -0,0 +1,144 @@
+#include <string.h>
+#include <stdbool.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <esp_http_server.h>
+
+#include "ws.h"
+#include "controller.h"
+#include "traffic.h"
+
+#define TAG "WS"
+
+#if CONFIG_HTTPD_WS_SUPPORT
+
+#define WS_MAX_FRAME_SIZE (WS_DUTY_RECORD_SIZE * 8)
+
+static esp_timer_handle_t ws_persist_timer;
+
+static void ws_persist_timer_callback(void *arg)
+{
+	if (global_controller_save_config() != ESP_OK) {
+		ESP_LOGW(TAG, "failed to schedule saving config");
+	}
+}
+
+/**
+ * @brief ws_schedule_persist restarts the idle timer to save the config,
+ * so the flash is not written while the sliders are moving.
+ */
+static void ws_schedule_persist()
+{
+	if (esp_timer_is_active(ws_persist_timer)) {
+		esp_timer_stop(ws_persist_timer);
+	}
+	esp_timer_start_once(ws_persist_timer, WS_PERSIST_IDLE_MS * 1000);
+}
+
+static void ws_encode_duty(uint8_t *p, enum controller_pwm pwm)
+{
+	uint32_t duty = global_controller_get_duty(pwm);
+	p[0] = pwm;
+	p[1] = duty & 0xff;
+	p[2] = (duty >> 8) & 0xff;
+}
+
+static esp_err_t handle_ws(httpd_req_t *req)
+{
+	if (req->method == HTTP_GET) {
+		ESP_LOGI(TAG, "websocket session opened: [%d]",
+			httpd_req_to_sockfd(req));
+		return ESP_OK;
+	}
+
+	uint8_t payload[WS_MAX_FRAME_SIZE];
+	httpd_ws_frame_t frame = { 0 };
+	esp_err_t ret = httpd_ws_recv_frame(req, &frame, 0);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "httpd_ws_recv_frame failed: %d", ret);
+		return ret;
+	}
+	if (frame.len > sizeof(payload)) {
+		// Returning error closes the session.
+		ESP_LOGE(TAG, "handle_ws: frame too large: %u",
+			(unsigned int) frame.len);
+		return ESP_FAIL;
+	}
+	frame.payload = payload;
+	if (frame.len > 0 &&
+		(ret = httpd_ws_recv_frame(req, &frame, frame.len)) != ESP_OK) {
+		ESP_LOGE(TAG, "httpd_ws_recv_frame failed: %d", ret);
+		return ret;
+	}
+	if (frame.type != HTTPD_WS_TYPE_BINARY) {
+		return ESP_OK;
+	}
+	if (frame.len % WS_DUTY_RECORD_SIZE != 0) {
+		ESP_LOGW(TAG, "handle_ws: invalid frame length: %u",
+			(unsigned int) frame.len);
+		return ESP_OK;
+	}
+
+	bool changed = false;
+	for (size_t i = 0; i < frame.len; i += WS_DUTY_RECORD_SIZE) {
+		enum controller_pwm pwm = payload[i];
+		uint32_t duty = payload[i+1] | (payload[i+2] << 8);
+		if (pwm >= CONTROLLER_PWM_MAX) {
+			continue;
+		}
+		if (global_controller_set_duty(pwm, duty) == ESP_OK) {
+			changed = true;
+		}
+	}
+	if (changed) {
+		ws_schedule_persist();
+	}
+
+	// Reply the applied duty of all outputs.
+	for (int pwm = 0; pwm < CONTROLLER_PWM_MAX; pwm++) {
+		ws_encode_duty(payload + pwm * WS_DUTY_RECORD_SIZE, pwm);
+	}
+	httpd_ws_frame_t reply = {
+		.final = true,
+		.type = HTTPD_WS_TYPE_BINARY,
+		.payload = payload,
+		.len = CONTROLLER_PWM_MAX * WS_DUTY_RECORD_SIZE,
+	};
+	return httpd_ws_send_frame(req, &reply);
+}
+
+static const httpd_uri_t ws_handler = {
+	.uri = "/ws",
+	.method = HTTP_GET,
+	.handler = handle_ws,
+	.is_websocket = true,
+};
+
+esp_err_t register_ws_handler(httpd_handle_t server)
+{
+	if (ws_persist_timer == NULL) {
+		const esp_timer_create_args_t args = {
+			.callback = ws_persist_timer_callback,
+			.name = "ws_persist",
+		};
+		esp_err_t ret = esp_timer_create(&args, &ws_persist_timer);
+		if (ret != ESP_OK) {
+			ESP_LOGE(TAG, "esp_timer_create failed: [%d]", ret);
+			return ret;
+		}
+	}
+	return traffic_register_uri_handler(
+		server, &ws_handler, TRAFFIC_CONTROL);
+}
+
+#else
+
+esp_err_t register_ws_handler(httpd_handle_t server)
+{
+	ESP_LOGW(TAG, "CONFIG_HTTPD_WS_SUPPORT is disabled, /ws not available");
+	return ESP_OK;
+}
+
+#endif // CONFIG_HTTPD_WS_SUPPORT
@@ -0,0 +1,433 @@
+#!/usr/bin/env python3
+"""
+Build the SPIFFS image directory from the data directory.
+
+Usage: build_assets.py <data dir> <output dir>
+
+- The HTML pages are minified and the local CSS, JS and SVG icon they
+  reference are minified and inlined, so a page loads in one request.
+- An HTML page with '{{key}}' placeholders is a template, it is compiled
+  to '<page>.tpl' and '<page>.tpl.gz', and rendered by the server in the
+  locale of the client from the string tables in LOCALES_DIR, which are
+  compiled to I18N_FILE. See compile_templates.
+- A template with the STATE_SLOT comment gets the settings JSON filled in
+  by the server when it is sent, so the first view does not need to
+  request the state.
+- The remaining CSS, JS and icon references in the HTML pages get a
+  '?v=<hash>' version query, so the browser can cache them for a long time.
+- A gzip compressed '<file>.gz' is added next to each compressible web
+  asset, the server sends it with 'Content-Encoding: gzip' when the client
+  accepts it, the original file is kept for the other clients.
+- The content hash (ETag) of every file is written to the manifest file
+  ASSET_MANIFEST, so the server can answer conditional requests without
+  opening the files. Keep the format in sync with src/asset.c.
+"""
+
+import gzip
+import json
+import os
+import re
+import shutil
+import struct
+import sys
+import urllib.parse
+import zlib
+
+# File extensions of the assets to compress.
+COMPRESS_EXTENSIONS = (".html", ".css", ".js", ".json", ".svg", ".ico")
+
+# Max SPIFFS object name length, CONFIG_SPIFFS_OBJ_NAME_LEN - 1.
+SPIFFS_OBJ_NAME_MAX_LEN = 31
+
+# Manifest of the file ETags, lines of '<crc32 hex> <path>'.
+ASSET_MANIFEST = "assets.manifest"
+
+# Directories of the files changed at runtime, not listed in the manifest.
+RUNTIME_DIRS = ("/config/",)
+
+# Local asset references in the HTML pages to be versioned.
+ASSET_REF_RE = re.compile(
+    r'((?:href|src)=")(/[^"?#]+\.(?:css|js|svg|ico))(")')
+
+# Server filled slot of the settings JSON in the templates.
+STATE_SLOT = "<!--#state-->"
+
+# Max size of the template content after the state slot, keep in sync with
+# include/page.h.
+SLOT_TAIL_MAX_SIZE = 256
+
+# Placeholder of a locale string in the templates.
+TEMPLATE_KEY_RE = re.compile(r"\{\{([a-z0-9_]+)\}\}")
+
+# Source string tables, '<locale>.json' objects of the keys and the HTML
+# strings. Missing strings fall back to the default locale, which is also
+# sent to the clients accepting none of the locales.
+LOCALES_DIR = "locales"
+DEFAULT_LOCALE = "zh"
+
+# Compiled files, keep the formats in sync with include/i18n.h and
+# include/page.h.
+I18N_FILE = "i18n.bin"
+TEMPLATE_SUFFIX = ".tpl"
+TEMPLATE_FLAG_GZIP = 0x01
+TEMPLATE_FLAG_SLOT = 0x02
+STRING_NONE = 0xFFFF
+STRING_STATE = 0xFFFE
+I18N_CODE_MAX_LEN = 8
+
+# Local asset references in the HTML pages to be inlined.
+STYLE_REF_RE = re.compile(r'<link rel="stylesheet" href="(/[^"?#]+\.css)">')
+SCRIPT_REF_RE = re.compile(r'<script src="(/[^"?#]+\.js)"></script>')
+ICON_REF_RE = re.compile(r'(<link rel="icon" type="image/svg\+xml" href=")'
+                         r'(/[^"?#]+\.svg)(">)')
+
+# Max size of an icon to be inlined as a data URI.
+INLINE_ICON_MAX_SIZE = 2048
+
+# Elements whose content is kept as is by the HTML minifier.
+RAW_ELEMENT_RE = re.compile(r"(<(script|style|pre|textarea)\b.*?</\2>)",
+                            re.S | re.I)
+
+
+def etag(data):
+    return zlib.crc32(data) & 0xFFFFFFFF
+
+
+def compress(data):
+    # mtime is fixed so the image is reproducible.
+    return gzip.compress(data, compresslevel=9, mtime=0)
+
+
+def uri_path(root, path):
+    return "/" + os.path.relpath(path, root).replace(os.sep, "/")
+
+
+def list_files(root):
+    for base, _, files in os.walk(root):
+        for name in sorted(files):
+            yield os.path.join(base, name)
+
+
+def minify_css(css):
+    css = re.sub(r"/\*.*?\*/", "", css, flags=re.S)
+    css = re.sub(r"\s+", " ", css)
+    css = re.sub(r"\s*([{};,>])\s*", r"\1", css)
+    # Only the space after ':' is removed, ' :' may be a descendant
+    # pseudo-class selector.
+    css = re.sub(r":\s+", ":", css)
+    return css.replace(";}", "}").strip()
+
+
+def minify_js(js):
+    """Strip the indentation, blank lines and line comments.
+
+    The line breaks are kept, so the automatic semicolon insertion and
+    the strings are not affected.
+    """
+    lines = []
+    for line in js.splitlines():
+        line = line.strip()
+        if line and not line.startswith("//"):
+            lines.append(line)
+    return "\n".join(lines)
+
+
+def minify_html(html):
+    """Remove the comments and collapse the whitespace outside the raw
+    elements, the server filled slots are kept."""
+    parts = RAW_ELEMENT_RE.split(html)
+    out = []
+    # re.split returns the text, the raw element and its tag name.
+    for i in range(0, len(parts), 3):
+        text = re.sub(r"<!--(?!#).*?-->", "", parts[i], flags=re.S)
+        out.append(re.sub(r"\s+", " ", text))
+        if i + 1 < len(parts):
+            out.append(parts[i + 1])
+    return "".join(out).strip()
+
+
+def read_text(root, uri):
+    path = os.path.join(root, uri.lstrip("/"))
+    if not os.path.isfile(path):
+        return None
+    with open(path, "r", encoding="utf-8") as f:
+        return f.read()
+
+
+def bundle_pages(root):
+    """Minify the HTML pages and inline the assets they reference."""
+    def inline_style(match):
+        css = read_text(root, match.group(1))
+        if css is None:
+            return match.group(0)
+        return f"<style>{minify_css(css)}</style>"
+
+    def inline_script(match):
+        js = read_text(root, match.group(1))
+        if js is None or "</script" in js.lower():
+            return match.group(0)
+        return f"<script>{minify_js(js)}</script>"
+
+    def inline_icon(match):
+        svg = read_text(root, match.group(2))
+        if svg is None or len(svg) > INLINE_ICON_MAX_SIZE:
+            return match.group(0)
+        data = urllib.parse.quote(re.sub(r"\s+", " ", svg).strip(),
+                                  safe=" :/=;,'")
+        return f"{match.group(1)}data:image/svg+xml,{data}{match.group(3)}"
+
+    for path in list_files(root):
+        if not path.endswith(".html"):
+            continue
+        with open(path, "r", encoding="utf-8") as f:
+            html = f.read()
+        size = len(html.encode("utf-8"))
+        html = minify_html(html)
+        html = STYLE_REF_RE.sub(inline_style, html)
+        html = SCRIPT_REF_RE.sub(inline_script, html)
+        html = ICON_REF_RE.sub(inline_icon, html)
+        with open(path, "w", encoding="utf-8") as f:
+            f.write(html)
+        print(f"{uri_path(root, path)}: bundled {size} -> "
+              f"{len(html.encode('utf-8'))} bytes")
+
+
+def stored_block(length, final=False):
+    """Header of a deflate stored block at a byte boundary."""
+    return struct.pack("<BHH", 1 if final else 0, length, length ^ 0xFFFF)
+
+
+def deflate_segment(data):
+    """Raw deflate blocks of the data ending at a byte boundary, so other
+    blocks can be appended. The blocks don't refer to the previous data.
+    The smallest of the dynamic, fixed Huffman and stored blocks is used,
+    the table of a dynamic block costs more than a short segment."""
+    if not data:
+        return b""
+    candidates = [stored_block(len(data)) + data] if len(data) <= 0xFFFF \
+        else []
+    for strategy in (zlib.Z_DEFAULT_STRATEGY, zlib.Z_FIXED):
+        compressor = zlib.compressobj(9, zlib.DEFLATED, -zlib.MAX_WBITS,
+                                      9, strategy)
+        candidates.append(compressor.compress(data) +
+                          compressor.flush(zlib.Z_SYNC_FLUSH))
+    return min(candidates, key=len)
+
+
+def load_locales(root):
+    """Load the string tables, the default locale goes first."""
+    path = os.path.join(root, LOCALES_DIR)
+    tables = {}
+    for name in sorted(os.listdir(path)):
+        code, ext = os.path.splitext(name)
+        if ext != ".json":
+            continue
+        if len(code) >= I18N_CODE_MAX_LEN:
+            raise ValueError(f"locale code too long: {code}")
+        with open(os.path.join(path, name), "r", encoding="utf-8") as f:
+            tables[code] = json.load(f)
+    if DEFAULT_LOCALE not in tables:
+        raise ValueError(f"default locale {DEFAULT_LOCALE} not found")
+    codes = [DEFAULT_LOCALE] + [c for c in tables if c != DEFAULT_LOCALE]
+    keys = sorted(set().union(*tables.values()))
+    strings = []
+    for code in codes:
+        table = tables[code]
+        for key in keys:
+            if key not in table:
+                print(f"{code}: missing string {key}, fall back to "
+                      f"{DEFAULT_LOCALE}", file=sys.stderr)
+        strings.append([table.get(key, tables[DEFAULT_LOCALE].get(key, ""))
+                        .encode("utf-8") for key in keys])
+    return codes, keys, strings
+
+
+def write_i18n(root, codes, strings):
+    """Write the string tables of all the locales.
+
+    Header '<4s B x H': 'I18N', locale count, string count. The locale
+    codes, 8 bytes each. The index of each locale, '<H H' offset and length
+    of each string in the blob. The blob, each string is preceded by the
+    header of a deflate stored block of it.
+    """
+    count = len(strings[0])
+    data = struct.pack("<4sBxH", b"I18N", len(codes), count)
+    for code in codes:
+        data += struct.pack(f"<{I18N_CODE_MAX_LEN}s", code.encode())
+    index, blob = b"", b""
+    for table in strings:
+        for value in table:
+            if len(blob) > 0xFFFF or len(value) > 0xFFFF:
+                raise ValueError("string tables too large")
+            index += struct.pack("<HH", len(blob), len(value))
+            blob += stored_block(len(value)) + value
+    data += index + blob
+    with open(os.path.join(root, I18N_FILE), "wb") as f:
+        f.write(data)
+    return len(data)
+
+
+def compile_template(html, keys, strings, gzip_variant):
+    """Compile the template page.
+
+    Header '<3s B H H B 3x': 'TPL', flags, op count, tail length, locale
+    count. The crc32 and size '<I I' of the page of each locale before the
+    state slot, the whole page if no slot. The ops '<H H': length of the
+    literal content, then the ID of the string to send after it, or
+    STRING_NONE, or STRING_STATE for the state slot of the last op.
+    The literal contents follow, then the tail content after the slot.
+    The literal contents of the gzip variant are deflate segments, the
+    server sends the strings as stored blocks, ends the deflate stream and
+    appends the gzip trailer.
+    """
+    head, slot, tail = html.partition(STATE_SLOT)
+    if TEMPLATE_KEY_RE.search(tail) or len(tail) > SLOT_TAIL_MAX_SIZE:
+        raise ValueError("too much content after the state slot")
+    parts = TEMPLATE_KEY_RE.split(head)
+    ops = []
+    for i in range(0, len(parts), 2):
+        literal = parts[i].encode("utf-8")
+        string = STRING_NONE
+        if i + 1 < len(parts):
+            if parts[i + 1] not in keys:
+                raise ValueError(f"unknown string {parts[i + 1]}")
+            string = keys.index(parts[i + 1])
+        elif slot:
+            string = STRING_STATE
+        ops.append((literal, string))
+
+    sums = b""
+    for table in strings:
+        page = b"".join(literal + (table[string] if string < len(table)
+                                   else b"") for literal, string in ops)
+        sums += struct.pack("<II", etag(page), len(page))
+    literals = [deflate_segment(literal) if gzip_variant else literal
+                for literal, _ in ops]
+    flags = (TEMPLATE_FLAG_GZIP if gzip_variant else 0) | \
+        (TEMPLATE_FLAG_SLOT if slot else 0)
+    tail = tail.encode("utf-8")
+    data = struct.pack("<3sBHHB3x", b"TPL", flags, len(ops), len(tail),
+                       len(strings))
+    data += sums
+    for literal, (_, string) in zip(literals, ops):
+        if len(literal) > 0xFFFF:
+            raise ValueError("template literal too large")
+        data += struct.pack("<HH", len(literal), string)
+    return data + b"".join(literals) + tail
+
+
+def render_page(html, keys, table):
+    """Render the page of a locale as the server does."""
+    return TEMPLATE_KEY_RE.sub(
+        lambda m: table[keys.index(m.group(1))].decode("utf-8"), html)
+
+
+def compile_templates(root):
+    """Compile the template pages and the string tables, the footprint is
+    compared with a copy of the pages per locale."""
+    if not os.path.isdir(os.path.join(root, LOCALES_DIR)):
+        return
+    codes, keys, strings = load_locales(root)
+    shutil.rmtree(os.path.join(root, LOCALES_DIR))
+    size = write_i18n(root, codes, strings)
+    size_locales = 0
+    for path in list_files(root):
+        if not path.endswith(".html"):
+            continue
+        with open(path, "r", encoding="utf-8") as f:
+            html = f.read()
+        if not TEMPLATE_KEY_RE.search(html):
+            continue
+        for table in strings:
+            page = render_page(html, keys, table).encode("utf-8")
+            size_locales += len(page) + len(compress(page))
+        for gzip_variant in (False, True):
+            data = compile_template(html, keys, strings, gzip_variant)
+            name = path + TEMPLATE_SUFFIX + (".gz" if gzip_variant else "")
+            if len(uri_path(root, name)) > SPIFFS_OBJ_NAME_MAX_LEN:
+                raise ValueError(f"{uri_path(root, name)}: name too long")
+            with open(name, "wb") as f:
+                f.write(data)
+            size += len(data)
+            print(f"{uri_path(root, name)}: {len(data)} bytes")
+        os.remove(path)
+    print(f"templates: {len(codes)} locales {size_locales} -> {size} bytes")
+
+
+def version_references(root):
+    """Append the content hash of the referenced assets to the HTML pages."""
+    def replace(match):
+        path = os.path.join(root, match.group(2).lstrip("/"))
+        if not os.path.isfile(path):
+            return match.group(0)
+        with open(path, "rb") as f:
+            version = etag(f.read())
+        return f"{match.group(1)}{match.group(2)}?v={version:08x}" \
+            f"{match.group(3)}"
+
+    for path in list_files(root):
+        if not path.endswith(".html"):
+            continue
+        with open(path, "r", encoding="utf-8") as f:
+            html = f.read()
+        versioned = ASSET_REF_RE.sub(replace, html)
+        if versioned != html:
+            with open(path, "w", encoding="utf-8") as f:
+                f.write(versioned)
+
+
+def compress_assets(root):
+    total, total_gz = 0, 0
+    for path in list_files(root):
+        if not path.lower().endswith(COMPRESS_EXTENSIONS):
+            continue
+        rel = uri_path(root, path)
+        if len(rel) + len(".gz") > SPIFFS_OBJ_NAME_MAX_LEN:
+            print(f"skip {rel}: name too long", file=sys.stderr)
+            continue
+        with open(path, "rb") as f:
+            data = f.read()
+        data_gz = compress(data)
+        if len(data_gz) >= len(data):
+            continue
+        with open(path + ".gz", "wb") as f:
+            f.write(data_gz)
+        total += len(data)
+        total_gz += len(data_gz)
+        print(f"{rel}: {len(data)} -> {len(data_gz)} bytes")
+    if total > 0:
+        print(f"total: {total} -> {total_gz} bytes ({total / total_gz:.1f}x)")
+
+
+def write_manifest(root):
+    lines = []
+    for path in list_files(root):
+        rel = uri_path(root, path)
+        if rel.startswith(RUNTIME_DIRS):
+            continue
+        with open(path, "rb") as f:
+            value = etag(f.read())
+        lines.append(f"{value:08x} {rel}\n")
+    with open(os.path.join(root, ASSET_MANIFEST), "w") as f:
+        f.writelines(lines)
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(f"usage: {sys.argv[0]} <data dir> <output dir>", file=sys.stderr)
+        return 1
+    src, dst = sys.argv[1], sys.argv[2]
+    if os.path.exists(dst):
+        shutil.rmtree(dst)
+    shutil.copytree(src, dst)
+
+    bundle_pages(dst)
+    version_references(dst)
+    compile_templates(dst)
+    compress_assets(dst)
+    write_manifest(dst)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""
+Build the binary config snapshot from a config.cfg file, and write the
+NVS partition CSV used by `nvs_create_partition_image`.
+
+Usage: config_nvs_image.py <config.cfg> <output.csv>
+
+The config file must set every CONFIG_KEY_* key of include/config.h.
+
+The snapshot layout must be kept in sync with `struct config_image`
+in src/config_nvs.c.
+"""
+
+import os
+import re
+import socket
+import struct
+import sys
+import zlib
+
+CONFIG_NVS_NAMESPACE = "controller"
+CONFIG_NVS_KEY = "config"
+CONFIG_IMAGE_MAGIC = 0x434D5750
+CONFIG_IMAGE_VERSION = 2
+
+# The config keys are read from the CONFIG_KEY_* definitions, the values
+# all come from the config file, so nothing here can drift from the
+# defaults of the schema in src/config.c.
+CONFIG_HEADER = os.path.join(
+    os.path.dirname(os.path.abspath(__file__)), "..", "include", "config.h")
+CONFIG_KEY_RE = re.compile(r'^#define\s+CONFIG_KEY_\w+\s+"(\w+)"', re.M)
+
+
+def config_keys():
+    with open(CONFIG_HEADER, "r", encoding="utf-8") as f:
+        keys = CONFIG_KEY_RE.findall(f.read())
+    if not keys:
+        sys.exit(f"no config keys found in {CONFIG_HEADER}")
+    return keys
+
+
+def parse_config(path):
+    keys = config_keys()
+    config = {}
+    with open(path, "r", encoding="utf-8") as f:
+        for line in f:
+            line = line.rstrip("\r\n \t")
+            if not line or line.startswith("#") or "=" not in line:
+                continue
+            key, value = line.split("=", 1)
+            if key not in keys:
+                sys.exit(f"unrecognized config key: {key}")
+            config[key] = value
+    # The snapshot replaces the whole config, every key must be set.
+    missing = [key for key in keys if key not in config]
+    if missing:
+        sys.exit(f"{path}: missing config keys: {', '.join(missing)}")
+    return config
+
+
+def pack_pwm(config, prefix):
+    return struct.pack(
+        "<5B3xI",
+        int(config[prefix + "_channel"]),
+        int(config[prefix + "_gpio"]),
+        int(config[prefix + "_duty"]),
+        int(config[prefix + "_duty_min"]),
+        int(config[prefix + "_duty_max"]),
+        int(config[prefix + "_frequency"]),
+    )
+
+
+def pack_ipv4(value):
+    # esp_ip4_addr_t stores the address in network byte order.
+    return struct.unpack("<I", socket.inet_aton(value))[0]
+
+
+def pack_image(config):
+    payload = pack_pwm(config, "pwm_fan") + pack_pwm(config, "pwm_mos")
+    payload += struct.pack(
+        "<33s64sB2xIIB3xI",
+        config["wifi_ssid"].encode(),
+        config["wifi_password"].encode(),
+        int(config["wifi_channel"]),
+        pack_ipv4(config["dhcps_ip"]),
+        pack_ipv4(config["dhcps_netmask"]),
+        int(config["dhcps_as_router"]),
+        0,  # journal epoch
+    )
+    assert len(payload) == 140
+    header = struct.pack(
+        "<IHHI",
+        CONFIG_IMAGE_MAGIC,
+        CONFIG_IMAGE_VERSION,
+        len(payload),
+        zlib.crc32(payload),
+    )
+    return header + payload
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    config_path, csv_path = sys.argv[1:]
+    bin_path = os.path.splitext(csv_path)[0] + ".bin"
+    with open(bin_path, "wb") as f:
+        f.write(pack_image(parse_config(config_path)))
+    with open(csv_path, "w", encoding="utf-8") as f:
+        f.write("key,type,encoding,value\n")
+        f.write(f"{CONFIG_NVS_NAMESPACE},namespace,,\n")
+        f.write(f"{CONFIG_NVS_KEY},file,binary,{os.path.abspath(bin_path)}\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""
+Build the config_schema_slots perfect hash table of src/config.c from the
+CONFIG_KEY_* keys and the CONFIG_ID_* indexes of include/config.h.
+
+Usage: config_schema_slots.py          print the table
+       config_schema_slots.py --check  check the table in src/config.c
+
+The hash must be kept in sync with `config_key_hash` in src/config.c.
+"""
+
+import os
+import re
+import sys
+
+CONFIG_SCHEMA_SLOTS = 32
+# config_schema_lookup rejects the shorter keys before hashing key[5].
+CONFIG_KEY_MIN_LEN = 6
+
+REPO_DIR = os.path.normpath(
+    os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+CONFIG_HEADER = os.path.join(REPO_DIR, "include", "config.h")
+CONFIG_SOURCE = os.path.join(REPO_DIR, "src", "config.c")
+CONFIG_KEY_RE = re.compile(r'^#define\s+CONFIG_KEY_(\w+)\s+"(\w+)"', re.M)
+CONFIG_ID_RE = re.compile(r"enum config_key_id \{(.*?)\};", re.S)
+CONFIG_SLOTS_RE = re.compile(
+    r"config_schema_slots\[CONFIG_SCHEMA_SLOTS\] = \{(.*?)\};", re.S)
+
+
+def config_key_hash(key):
+    return (len(key) * 2 + ord(key[5]) * 8 + ord(key[-1])) \
+        & (CONFIG_SCHEMA_SLOTS - 1)
+
+
+def config_keys():
+    """Return the keys indexed by their CONFIG_ID_* value."""
+    with open(CONFIG_HEADER, "r", encoding="utf-8") as f:
+        header = f.read()
+    keys = dict(CONFIG_KEY_RE.findall(header))
+    match = CONFIG_ID_RE.search(header)
+    if not keys or match is None:
+        sys.exit(f"no config keys found in {CONFIG_HEADER}")
+    ids = re.findall(r"CONFIG_ID_(\w+)", match.group(1))
+    ids.remove("MAX")
+    missing = ["CONFIG_ID_" + name for name in ids if name not in keys]
+    if missing:
+        sys.exit(f"no CONFIG_KEY_* of {', '.join(missing)}")
+    return [keys[name] for name in ids]
+
+
+def build_slots(keys):
+    slots = [-1] * CONFIG_SCHEMA_SLOTS
+    for i, key in enumerate(keys):
+        if len(key) < CONFIG_KEY_MIN_LEN:
+            sys.exit(f"config key too short to hash: {key}")
+        h = config_key_hash(key)
+        if slots[h] >= 0:
+            sys.exit(f"config key hash collision: {keys[slots[h]]}, {key}, "
+                     "change config_key_hash")
+        slots[h] = i
+    return slots
+
+
+def format_slots(slots):
+    lines = []
+    for i in range(0, len(slots), 8):
+        lines.append("\t" + " ".join(f"{v:2d}," for v in slots[i:i + 8]))
+    return "\n".join(lines)
+
+
+def source_slots():
+    with open(CONFIG_SOURCE, "r", encoding="utf-8") as f:
+        match = CONFIG_SLOTS_RE.search(f.read())
+    if match is None:
+        sys.exit(f"no config_schema_slots found in {CONFIG_SOURCE}")
+    return [int(v) for v in match.group(1).replace(",", " ").split()]
+
+
+def main(argv):
+    if len(argv) > 2 or (len(argv) == 2 and argv[1] != "--check"):
+        sys.exit(__doc__.strip())
+    slots = build_slots(config_keys())
+    if len(argv) == 1:
+        print(format_slots(slots))
+        return
+    if source_slots() != slots:
+        sys.exit(f"config_schema_slots in {CONFIG_SOURCE} is out of date, "
+                 f"regenerate it with {argv[0]}:\n{format_slots(slots)}")
+    print("config_schema_slots is up to date")
+
+
+if __name__ == "__main__":
+    main(sys.argv)
@@ -0,0 +1,526 @@
+/*
+ * loadgen is a closed loop HTTP/1.1 load generator for the host build.
+ *
+ * Each connection is a thread sending the routes in turn on a keep-alive
+ * socket and waiting for each response, it reconnects when the server
+ * closes the connection. The throughput and the latency percentiles are
+ * reported per route.
+ *
+ * Usage: loadgen [-c connections] [-d seconds] [-H host] [-p port] [-i]
+ *                [route ...]
+ *
+ * A route is "METHOD PATH [BODY]", e.g. "GET /api/state" or
+ * "PATCH /api/settings {\"pwm_fan_duty\":60}".
+ */
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define LOADGEN_MAX_ROUTES 16
+#define LOADGEN_RECV_BUF_SIZE 16384
+#define LOADGEN_REQUEST_SIZE 2048
+
+static const char *default_routes[] = {
+	"GET /",
+	"GET /settings",
+	"GET /api/state",
+	"PATCH /api/settings {\"pwm_fan_duty\":60}",
+};
+
+struct route {
+	char method[16];
+	char path[512];
+	const char *body;
+	char request[LOADGEN_REQUEST_SIZE];
+	size_t request_length;
+};
+
+/**
+ * @brief route_stats are the results of a route on a connection, merged
+ * when the connections finish.
+ */
+struct route_stats {
+	uint64_t *latencies; // ns
+	size_t count;
+	size_t capacity;
+	uint64_t errors;
+	uint64_t bytes;
+	uint64_t status_errors; // responses other than 2xx and 3xx
+};
+
+struct conn {
+	pthread_t thread;
+	int fd;
+	size_t route;
+	uint64_t reconnects;
+	struct route_stats stats[LOADGEN_MAX_ROUTES];
+	char buffer[LOADGEN_RECV_BUF_SIZE];
+	size_t length;       // bytes in the buffer
+};
+
+static struct {
+	struct addrinfo *addr;
+	struct route routes[LOADGEN_MAX_ROUTES];
+	size_t route_count;
+	atomic_bool stop;
+} loadgen;
+
+static uint64_t now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static bool parse_route(
+	struct route *route, const char *spec, const char *host, bool gzip
+) {
+	const char *space = strchr(spec, ' ');
+	if (space == NULL ||
+		(size_t) (space - spec) >= sizeof(route->method)) {
+		return false;
+	}
+	memcpy(route->method, spec, space - spec);
+	route->method[space - spec] = '\0';
+	const char *path = space + 1;
+	size_t path_length = strcspn(path, " ");
+	if (path_length == 0 || path_length >= sizeof(route->path)) {
+		return false;
+	}
+	memcpy(route->path, path, path_length);
+	route->path[path_length] = '\0';
+	route->body = path[path_length] == ' ' ? path + path_length + 1 : NULL;
+
+	size_t body_length = route->body != NULL ? strlen(route->body) : 0;
+	size_t n = snprintf(route->request, sizeof(route->request),
+		"%s %s HTTP/1.1\r\nHost: %s\r\nAccept-Encoding: %s\r\n",
+		route->method, route->path, host, gzip ? "gzip" : "identity");
+	if (route->body != NULL) {
+		n += snprintf(route->request + n, n < sizeof(route->request) ?
+			sizeof(route->request) - n : 0,
+			"Content-Type: application/json\r\n"
+			"Content-Length: %zu\r\n\r\n%s", body_length, route->body);
+	} else {
+		n += snprintf(route->request + n, n < sizeof(route->request) ?
+			sizeof(route->request) - n : 0, "\r\n");
+	}
+	if (n >= sizeof(route->request)) {
+		return false;
+	}
+	route->request_length = n;
+	return true;
+}
+
+static int conn_connect(struct conn *c)
+{
+	c->fd = socket(loadgen.addr->ai_family, SOCK_STREAM, 0);
+	if (c->fd < 0) {
+		return -1;
+	}
+	int nodelay = 1;
+	struct timeval timeout = { .tv_sec = 10 };
+	setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+	setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	if (connect(c->fd, loadgen.addr->ai_addr, loadgen.addr->ai_addrlen)
+		!= 0) {
+		close(c->fd);
+		c->fd = -1;
+		return -1;
+	}
+	c->length = 0;
+	return 0;
+}
+
+static void conn_close(struct conn *c)
+{
+	if (c->fd >= 0) {
+		close(c->fd);
+		c->fd = -1;
+	}
+	c->length = 0;
+}
+
+/**
+ * @brief conn_fill receives more bytes into the buffer.
+ *
+ * @return -1 if the connection is closed or failed.
+ */
+static int conn_fill(struct conn *c)
+{
+	if (c->length == sizeof(c->buffer)) {
+		return -1;
+	}
+	ssize_t n;
+	do {
+		n = recv(c->fd, c->buffer + c->length,
+			sizeof(c->buffer) - c->length, 0);
+	} while (n < 0 && errno == EINTR);
+	if (n <= 0) {
+		return -1;
+	}
+	c->length += n;
+	return 0;
+}
+
+static void conn_consume(struct conn *c, size_t n)
+{
+	memmove(c->buffer, c->buffer + n, c->length - n);
+	c->length -= n;
+}
+
+/**
+ * @brief conn_skip discards n bytes of the body, received or not.
+ */
+static int conn_skip(struct conn *c, size_t n)
+{
+	while (n > 0) {
+		if (c->length == 0 && conn_fill(c) != 0) {
+			return -1;
+		}
+		size_t m = n < c->length ? n : c->length;
+		conn_consume(c, m);
+		n -= m;
+	}
+	return 0;
+}
+
+/**
+ * @brief conn_read_line reads a CRLF terminated line of the chunked body.
+ *
+ * @return the line length without CRLF, -1 if failed.
+ */
+static ssize_t conn_read_line(struct conn *c, char *line, size_t size)
+{
+	char *end;
+	while ((end = memmem(c->buffer, c->length, "\r\n", 2)) == NULL) {
+		if (conn_fill(c) != 0) {
+			return -1;
+		}
+	}
+	size_t n = end - c->buffer;
+	if (n >= size) {
+		return -1;
+	}
+	memcpy(line, c->buffer, n);
+	line[n] = '\0';
+	conn_consume(c, n + 2);
+	return n;
+}
+
+/**
+ * @brief conn_read_response reads a response with a Content-Length or a
+ * chunked body.
+ *
+ * @param status [out]
+ * @param bytes [out] body length
+ * @return 0 if succeed, -1 if the connection failed.
+ */
+static int conn_read_response(struct conn *c, int *status, uint64_t *bytes)
+{
+	char *end;
+	while ((end = memmem(c->buffer, c->length, "\r\n\r\n", 4)) == NULL) {
+		if (conn_fill(c) != 0) {
+			return -1;
+		}
+	}
+	size_t header_length = end + 4 - c->buffer;
+	*end = '\0';
+	if (sscanf(c->buffer, "HTTP/1.%*d %d", status) != 1) {
+		return -1;
+	}
+	long long content_length = -1;
+	bool chunked = false;
+	bool close_conn = false;
+	for (char *line = strstr(c->buffer, "\r\n"); line != NULL;
+		line = strstr(line, "\r\n")) {
+		line += 2;
+		if (strncasecmp(line, "Content-Length:", 15) == 0) {
+			content_length = strtoll(line + 15, NULL, 10);
+		} else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+			chunked = strstr(line, "chunked") != NULL;
+		} else if (strncasecmp(line, "Connection:", 11) == 0) {
+			close_conn = strstr(line, "close") != NULL;
+		}
+	}
+	conn_consume(c, header_length);
+
+	*bytes = 0;
+	if (chunked) {
+		char line[64];
+		while (true) {
+			if (conn_read_line(c, line, sizeof(line)) < 0) {
+				return -1;
+			}
+			size_t size = strtoul(line, NULL, 16);
+			if (size == 0) {
+				// The trailer is empty.
+				return conn_read_line(c, line, sizeof(line)) < 0 ? -1 : 0;
+			}
+			if (conn_skip(c, size + 2) != 0) {
+				return -1;
+			}
+			*bytes += size;
+		}
+	}
+	if (content_length < 0) {
+		return -1;
+	}
+	*bytes = content_length;
+	if (conn_skip(c, content_length) != 0) {
+		return -1;
+	}
+	if (close_conn) {
+		conn_close(c);
+	}
+	return 0;
+}
+
+static void stats_add(struct route_stats *stats, uint64_t latency)
+{
+	if (stats->count == stats->capacity) {
+		stats->capacity = stats->capacity > 0 ? stats->capacity * 2 : 4096;
+		stats->latencies = realloc(stats->latencies,
+			stats->capacity * sizeof(uint64_t));
+		if (stats->latencies == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	stats->latencies[stats->count++] = latency;
+}
+
+/**
+ * @brief conn_request sends the request and reads the response, the
+ * request is sent again on a new connection once if the server closed the
+ * idle connection.
+ */
+static int conn_request(struct conn *c, const struct route *route,
+	int *status, uint64_t *bytes)
+{
+	for (int attempt = 0; attempt < 2; attempt++) {
+		if (c->fd < 0) {
+			if (conn_connect(c) != 0) {
+				return -1;
+			}
+			c->reconnects++;
+		}
+		ssize_t n = send(c->fd, route->request, route->request_length,
+			MSG_NOSIGNAL);
+		if (n == (ssize_t) route->request_length &&
+			conn_read_response(c, status, bytes) == 0) {
+			return 0;
+		}
+		conn_close(c);
+	}
+	return -1;
+}
+
+static void *conn_task(void *arg)
+{
+	struct conn *c = arg;
+	while (!atomic_load(&loadgen.stop)) {
+		size_t i = c->route;
+		c->route = (c->route + 1) % loadgen.route_count;
+		int status = 0;
+		uint64_t bytes = 0;
+		uint64_t start = now_ns();
+		int ret = conn_request(c, &loadgen.routes[i], &status, &bytes);
+		uint64_t latency = now_ns() - start;
+		struct route_stats *stats = &c->stats[i];
+		if (ret != 0) {
+			stats->errors++;
+			// Do not spin on a server that is down.
+			usleep(10000);
+			continue;
+		}
+		if (status < 200 || status >= 400) {
+			stats->status_errors++;
+		}
+		stats->bytes += bytes;
+		stats_add(stats, latency);
+	}
+	conn_close(c);
+	return NULL;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+	return x < y ? -1 : x > y;
+}
+
+static double percentile_ms(const uint64_t *sorted, size_t count, double p)
+{
+	if (count == 0) {
+		return 0;
+	}
+	size_t i = (size_t) (p * (count - 1) + 0.5);
+	return sorted[i] / 1e6;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-c connections] [-d seconds] [-H host] [-p port] [-i]"
+		" [route ...]\n"
+		"  -c connections  keep-alive connections (default 4)\n"
+		"  -d seconds      duration (default 10)\n"
+		"  -H host         server host (default 127.0.0.1)\n"
+		"  -p port         server port (default 8080)\n"
+		"  -i              request identity instead of gzip encoding\n"
+		"  route           \"METHOD PATH [BODY]\", default:\n", name);
+	for (size_t i = 0; i < sizeof(default_routes) /
+		sizeof(default_routes[0]); i++) {
+		fprintf(stderr, "                  '%s'\n", default_routes[i]);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int connections = 4;
+	int duration = 10;
+	const char *host = "127.0.0.1";
+	const char *port = "8080";
+	bool gzip = true;
+	int opt;
+	while ((opt = getopt(argc, argv, "c:d:H:p:ih")) != -1) {
+		switch (opt) {
+		case 'c':
+			connections = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'H':
+			host = optarg;
+			break;
+		case 'p':
+			port = optarg;
+			break;
+		case 'i':
+			gzip = false;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (connections <= 0 || duration <= 0) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const char **specs = (const char **) argv + optind;
+	size_t spec_count = argc - optind;
+	if (spec_count == 0) {
+		specs = default_routes;
+		spec_count = sizeof(default_routes) / sizeof(default_routes[0]);
+	}
+	if (spec_count > LOADGEN_MAX_ROUTES) {
+		fprintf(stderr, "too many routes, max %d\n", LOADGEN_MAX_ROUTES);
+		return EXIT_FAILURE;
+	}
+	for (size_t i = 0; i < spec_count; i++) {
+		if (!parse_route(&loadgen.routes[i], specs[i], host, gzip)) {
+			fprintf(stderr, "invalid route: %s\n", specs[i]);
+			return EXIT_FAILURE;
+		}
+	}
+	loadgen.route_count = spec_count;
+
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+	};
+	int ret = getaddrinfo(host, port, &hints, &loadgen.addr);
+	if (ret != 0) {
+		fprintf(stderr, "resolve %s:%s failed: %s\n", host, port,
+			gai_strerror(ret));
+		return EXIT_FAILURE;
+	}
+
+	struct conn *conns = calloc(connections, sizeof(struct conn));
+	if (conns == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	printf("%d connections, %d s, %zu routes, %s:%s\n", connections,
+		duration, loadgen.route_count, host, port);
+	uint64_t start = now_ns();
+	for (int i = 0; i < connections; i++) {
+		conns[i].fd = -1;
+		// Start the connections on different routes.
+		conns[i].route = i % loadgen.route_count;
+		if (pthread_create(&conns[i].thread, NULL, conn_task,
+			&conns[i]) != 0) {
+			fprintf(stderr, "start connection %d failed\n", i);
+			return EXIT_FAILURE;
+		}
+	}
+	sleep(duration);
+	atomic_store(&loadgen.stop, true);
+	uint64_t reconnects = 0;
+	for (int i = 0; i < connections; i++) {
+		pthread_join(conns[i].thread, NULL);
+		// The first connection of each thread is not a reconnect.
+		reconnects += conns[i].reconnects > 0 ?
+			conns[i].reconnects - 1 : 0;
+	}
+	double elapsed = (now_ns() - start) / 1e9;
+
+	printf("%-40s %10s %9s %9s %9s %9s %7s\n", "route", "req/s",
+		"p50 ms", "p99 ms", "max ms", "KB/s", "errors");
+	uint64_t total = 0;
+	uint64_t total_errors = 0;
+	for (size_t r = 0; r < loadgen.route_count; r++) {
+		struct route_stats merged = { 0 };
+		for (int i = 0; i < connections; i++) {
+			struct route_stats *stats = &conns[i].stats[r];
+			for (size_t j = 0; j < stats->count; j++) {
+				stats_add(&merged, stats->latencies[j]);
+			}
+			merged.errors += stats->errors;
+			merged.status_errors += stats->status_errors;
+			merged.bytes += stats->bytes;
+			free(stats->latencies);
+		}
+		if (merged.count > 0) {
+			qsort(merged.latencies, merged.count, sizeof(uint64_t),
+				compare_latency);
+		}
+		char name[64];
+		snprintf(name, sizeof(name), "%s %s", loadgen.routes[r].method,
+			loadgen.routes[r].path);
+		printf("%-40s %10.1f %9.3f %9.3f %9.3f %9.1f %7llu\n", name,
+			merged.count / elapsed,
+			percentile_ms(merged.latencies, merged.count, 0.50),
+			percentile_ms(merged.latencies, merged.count, 0.99),
+			merged.count > 0 ?
+				merged.latencies[merged.count - 1] / 1e6 : 0,
+			merged.bytes / 1024.0 / elapsed,
+			(unsigned long long) (merged.errors + merged.status_errors));
+		total += merged.count;
+		total_errors += merged.errors + merged.status_errors;
+		free(merged.latencies);
+	}
+	printf("total %.1f req/s, %llu errors, %llu reconnects\n",
+		total / elapsed, (unsigned long long) total_errors,
+		(unsigned long long) reconnects);
+	freeaddrinfo(loadgen.addr);
+	free(conns);
+	return total_errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <esp_log.h>
+
+#include "host.h"
+
+#ifndef HOST_DEFAULT_SPIFFS_DIR
+#define HOST_DEFAULT_SPIFFS_DIR "spiffs_data"
+#endif
+
+void app_main();
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-p port] [-u port] [-d spiffs dir] [-n nvs dir] [-s us]"
+		" [-t divisor] [-q]\n"
+		"  -p port        http port instead of 80 (default 8080)\n"
+		"  -u port        UDP control port instead of 4210 (default the"
+		" http port)\n"
+		"  -d spiffs dir  directory of the SPIFFS partition (default %s)\n"
+		"  -n nvs dir     directory of the NVS partition (default nvs)\n"
+		"  -s us          delay of opening a SPIFFS file (default 0)\n"
+		"  -t divisor     divisor of the periodic timer periods (default 1)\n"
+		"  -q             only log warnings and errors\n",
+		name, HOST_DEFAULT_SPIFFS_DIR);
+}
+
+/**
+ * @brief main runs the firmware on the host, app_main of src/main.c runs
+ * on the main thread like on the device.
+ */
+int main(int argc, char **argv)
+{
+	int port = 8080;
+	int udp_port = 0;
+	int opt;
+	host_set_spiffs_dir(HOST_DEFAULT_SPIFFS_DIR);
+	while ((opt = getopt(argc, argv, "p:u:d:n:s:t:qh")) != -1) {
+		switch (opt) {
+		case 'p':
+			port = atoi(optarg);
+			if (port <= 0 || port > 65535) {
+				fprintf(stderr, "invalid port: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'u':
+			udp_port = atoi(optarg);
+			if (udp_port <= 0 || udp_port > 65535) {
+				fprintf(stderr, "invalid port: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'd':
+			host_set_spiffs_dir(optarg);
+			break;
+		case 'n':
+			host_set_nvs_dir(optarg);
+			break;
+		case 's':
+			host_set_spiffs_open_delay(strtoul(optarg, NULL, 10));
+			break;
+		case 't':
+			host_set_timer_period_divisor(strtoul(optarg, NULL, 10));
+			break;
+		case 'q':
+			esp_log_level_set("*", ESP_LOG_WARN);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	// Closed connections are reported by send.
+	signal(SIGPIPE, SIG_IGN);
+	host_set_http_port(port);
+	// The TCP and UDP ports are separate, the same port number is free.
+	host_set_udp_port(udp_port != 0 ? udp_port : port);
+
+	app_main();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,1611 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+#include "host.h"
+
+#define TAG "httpd"
+
+#ifndef MIN
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#endif
+
+// The request headers are kept in the scratch buffer like the IDF server.
+#define HTTPD_SCRATCH_BUF MAX(CONFIG_HTTPD_MAX_REQ_HDR_LEN, \
+	CONFIG_HTTPD_MAX_URI_LEN)
+// Request line and headers of a request.
+#define HTTPD_RECV_BUF_SIZE (CONFIG_HTTPD_MAX_URI_LEN + HTTPD_SCRATCH_BUF + 64)
+#define HTTPD_MAX_RESP_HEADERS 32
+#define HTTPD_RESP_BUF_SIZE 2048
+#define HTTPD_MAX_WORKS 16
+
+/**
+ * @brief sock_db is a session of the server.
+ */
+struct sock_db {
+	int fd;              // -1 if the slot is free
+	bool for_async_req;  // served by an async handler, not polled
+	bool close_pending;  // close when the async handler completes
+	uint64_t lru_counter;
+	size_t recv_start;   // offset of the data not consumed yet
+	size_t recv_length;  // bytes received into the buffer
+	// Handler of the websocket session, NULL before the handshake.
+	const httpd_uri_t *ws_handler;
+	char recv_buffer[HTTPD_RECV_BUF_SIZE];
+};
+
+struct httpd_resp_hdr {
+	const char *field;
+	const char *value;
+};
+
+/**
+ * @brief httpd_req_aux is the private part of a request.
+ */
+struct httpd_req_aux {
+	struct sock_db *sd;
+	char scratch[HTTPD_SCRATCH_BUF]; // 'field: value' strings
+	size_t req_hdrs_count;
+	size_t remaining_len;   // body bytes not received yet
+	bool handed_over;       // copied by httpd_req_async_handler_begin
+	bool first_chunk_sent;
+	const char *status;
+	const char *content_type;
+	size_t resp_hdrs_count;
+	struct httpd_resp_hdr resp_hdrs[HTTPD_MAX_RESP_HEADERS];
+	// The websocket frame being received.
+	httpd_ws_type_t ws_type;
+	bool ws_final;
+	uint8_t ws_mask[4];
+	size_t ws_length;       // payload length
+};
+
+struct httpd_work {
+	httpd_work_fn_t fn;
+	void *arg;
+};
+
+/**
+ * @brief httpd_data is the server instance, the handle of the API.
+ */
+struct httpd_data {
+	httpd_config_t config;
+	int listen_fd;
+	int ctrl_fd[2];        // pipe waking the server task
+	pthread_t task;
+	volatile bool running;
+	pthread_mutex_t lock;  // protects the sessions & the work queue
+	struct sock_db *sessions;
+	uint64_t lru_counter;
+	httpd_uri_t *handlers;
+	size_t handler_count;
+	httpd_err_handler_func_t err_handlers[HTTPD_ERR_CODE_MAX];
+	struct httpd_work works[HTTPD_MAX_WORKS];
+	size_t work_head;
+	size_t work_count;
+	struct httpd_req req;  // request served by the server task
+	struct httpd_req_aux aux;
+};
+
+static uint16_t http_port_override;
+
+void host_set_http_port(uint16_t port)
+{
+	http_port_override = port;
+}
+
+uint16_t host_http_port(void)
+{
+	return http_port_override;
+}
+
+static const struct {
+	const char *status;
+	const char *message;
+} httpd_errors[HTTPD_ERR_CODE_MAX] = {
+	[HTTPD_500_INTERNAL_SERVER_ERROR] = { "500 Internal Server Error",
+		"Server has encountered an unexpected error" },
+	[HTTPD_501_METHOD_NOT_IMPLEMENTED] = { "501 Method Not Implemented",
+		"Server does not support this method" },
+	[HTTPD_505_VERSION_NOT_SUPPORTED] = { "505 Version Not Supported",
+		"HTTP version not supported by server" },
+	[HTTPD_400_BAD_REQUEST] = { "400 Bad Request",
+		"Bad request syntax" },
+	[HTTPD_401_UNAUTHORIZED] = { "401 Unauthorized",
+		"No permission -- see authorization schemes" },
+	[HTTPD_403_FORBIDDEN] = { "403 Forbidden",
+		"Request forbidden -- authorization will not help" },
+	[HTTPD_404_NOT_FOUND] = { "404 Not Found",
+		"This URI does not exist" },
+	[HTTPD_405_METHOD_NOT_ALLOWED] = { "405 Method Not Allowed",
+		"Specified method is invalid for this resource" },
+	[HTTPD_408_REQ_TIMEOUT] = { "408 Request Timeout",
+		"Server closed this connection" },
+	[HTTPD_411_LENGTH_REQUIRED] = { "411 Length Required",
+		"Client must specify Content-Length" },
+	[HTTPD_414_URI_TOO_LONG] = { "414 URI Too Long",
+		"URI is too long" },
+	[HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE] = {
+		"431 Request Header Fields Too Large",
+		"Header fields are too long" },
+};
+
+static const struct {
+	const char *name;
+	httpd_method_t method;
+} httpd_methods[] = {
+	{ "DELETE", HTTP_DELETE },
+	{ "GET", HTTP_GET },
+	{ "HEAD", HTTP_HEAD },
+	{ "POST", HTTP_POST },
+	{ "PUT", HTTP_PUT },
+	{ "OPTIONS", HTTP_OPTIONS },
+	{ "PATCH", HTTP_PATCH },
+};
+
+static void httpd_wake(struct httpd_data *hd)
+{
+	char c = 0;
+	if (write(hd->ctrl_fd[1], &c, 1) < 0 && errno != EAGAIN) {
+		ESP_LOGW(TAG, "httpd_wake: write failed: %d", errno);
+	}
+}
+
+/**
+ * @brief httpd_send_all sends the whole buffer on the socket.
+ */
+static esp_err_t httpd_send_all(int fd, const char *buf, size_t len, int flags)
+{
+	while (len > 0) {
+		ssize_t n = send(fd, buf, len, flags | MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ESP_LOGD(TAG, "send [%d] failed: %d", fd, errno);
+			return ESP_ERR_HTTPD_RESP_SEND;
+		}
+		buf += n;
+		len -= n;
+	}
+	return ESP_OK;
+}
+
+static struct sock_db *httpd_sess_get(struct httpd_data *hd, int fd)
+{
+	for (int i = 0; i < hd->config.max_open_sockets; i++) {
+		if (hd->sessions[i].fd == fd) {
+			return &hd->sessions[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief httpd_sess_delete closes the session, the close_fn closes the
+ * socket if configured.
+ */
+static void httpd_sess_delete(struct httpd_data *hd, struct sock_db *sd)
+{
+	int fd = sd->fd;
+	if (fd < 0) {
+		return;
+	}
+	ESP_LOGD(TAG, "close session [%d]", fd);
+	if (hd->config.close_fn != NULL) {
+		hd->config.close_fn(hd, fd);
+	} else {
+		close(fd);
+	}
+	pthread_mutex_lock(&hd->lock);
+	sd->fd = -1;
+	sd->for_async_req = false;
+	sd->close_pending = false;
+	sd->ws_handler = NULL;
+	pthread_mutex_unlock(&hd->lock);
+}
+
+static void httpd_sess_close_work(void *arg)
+{
+	struct httpd_data *hd = ((void **) arg)[0];
+	int fd = (int) (intptr_t) ((void **) arg)[1];
+	free(arg);
+	pthread_mutex_lock(&hd->lock);
+	struct sock_db *sd = httpd_sess_get(hd, fd);
+	if (sd != NULL && sd->for_async_req) {
+		// Closed when the async handler completes.
+		sd->close_pending = true;
+		sd = NULL;
+	}
+	pthread_mutex_unlock(&hd->lock);
+	if (sd != NULL) {
+		httpd_sess_delete(hd, sd);
+	}
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work,
+	void *arg)
+{
+	struct httpd_data *hd = handle;
+	if (hd == NULL || work == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	pthread_mutex_lock(&hd->lock);
+	if (hd->work_count == HTTPD_MAX_WORKS) {
+		pthread_mutex_unlock(&hd->lock);
+		ESP_LOGW(TAG, "httpd_queue_work: queue full");
+		return ESP_FAIL;
+	}
+	struct httpd_work *w = &hd->works[
+		(hd->work_head + hd->work_count) % HTTPD_MAX_WORKS];
+	w->fn = work;
+	w->arg = arg;
+	hd->work_count++;
+	pthread_mutex_unlock(&hd->lock);
+	httpd_wake(hd);
+	return ESP_OK;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd)
+{
+	struct httpd_data *hd = handle;
+	if (hd == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	pthread_mutex_lock(&hd->lock);
+	struct sock_db *sd = httpd_sess_get(hd, sockfd);
+	pthread_mutex_unlock(&hd->lock);
+	if (sd == NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	void **arg = malloc(2 * sizeof(void *));
+	if (arg == NULL) {
+		return ESP_ERR_NO_MEM;
+	}
+	arg[0] = hd;
+	arg[1] = (void *) (intptr_t) sockfd;
+	esp_err_t ret = httpd_queue_work(hd, httpd_sess_close_work, arg);
+	if (ret != ESP_OK) {
+		free(arg);
+	}
+	return ret;
+}
+
+static void httpd_run_works(struct httpd_data *hd)
+{
+	while (true) {
+		pthread_mutex_lock(&hd->lock);
+		if (hd->work_count == 0) {
+			pthread_mutex_unlock(&hd->lock);
+			return;
+		}
+		struct httpd_work w = hd->works[hd->work_head];
+		hd->work_head = (hd->work_head + 1) % HTTPD_MAX_WORKS;
+		hd->work_count--;
+		pthread_mutex_unlock(&hd->lock);
+		w.fn(w.arg);
+	}
+}
+
+/**
+ * @brief httpd_recv_header receives the request line and the headers into
+ * the session buffer.
+ *
+ * @param sd
+ * @param length [out] length of the request line and the headers
+ * @param error [out] error to reply if failed
+ * @return ESP_OK if succeed.
+ * @return ESP_FAIL if the connection is closed or failed, the error is
+ * HTTPD_ERR_CODE_MAX if no reply should be sent.
+ */
+static esp_err_t httpd_recv_header(
+	struct sock_db *sd, size_t *length, httpd_err_code_t *error
+) {
+	*error = HTTPD_ERR_CODE_MAX;
+	while (true) {
+		char *end = memmem(sd->recv_buffer, sd->recv_length, "\r\n\r\n", 4);
+		if (end != NULL) {
+			*length = end + 4 - sd->recv_buffer;
+			return ESP_OK;
+		}
+		if (sd->recv_length == sizeof(sd->recv_buffer)) {
+			bool line = memchr(sd->recv_buffer, '\n',
+				sd->recv_length) != NULL;
+			*error = line ? HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE :
+				HTTPD_414_URI_TOO_LONG;
+			return ESP_FAIL;
+		}
+		ssize_t n = recv(sd->fd, sd->recv_buffer + sd->recv_length,
+			sizeof(sd->recv_buffer) - sd->recv_length, 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			*error = sd->recv_length > 0 ?
+				HTTPD_408_REQ_TIMEOUT : HTTPD_ERR_CODE_MAX;
+			return ESP_FAIL;
+		}
+		if (n <= 0) {
+			return ESP_FAIL;
+		}
+		sd->recv_length += n;
+	}
+}
+
+/**
+ * @brief httpd_parse_req parses the request line and the headers, the
+ * headers are copied into the scratch buffer.
+ */
+static httpd_err_code_t httpd_parse_req(
+	struct httpd_req *r, char *header, size_t length
+) {
+	struct httpd_req_aux *ra = r->aux;
+	// Terminate the lines.
+	header[length - 2] = '\0';
+	char *line = header;
+	char *next = strstr(line, "\r\n");
+	if (next == NULL) {
+		return HTTPD_400_BAD_REQUEST;
+	}
+	*next = '\0';
+	next += 2;
+
+	char *uri = strchr(line, ' ');
+	char *version = uri != NULL ? strchr(uri + 1, ' ') : NULL;
+	if (version == NULL) {
+		return HTTPD_400_BAD_REQUEST;
+	}
+	*uri++ = '\0';
+	*version++ = '\0';
+	r->method = -1;
+	for (size_t i = 0; i < sizeof(httpd_methods) /
+		sizeof(httpd_methods[0]); i++) {
+		if (strcmp(line, httpd_methods[i].name) == 0) {
+			r->method = httpd_methods[i].method;
+		}
+	}
+	if (r->method < 0) {
+		return HTTPD_501_METHOD_NOT_IMPLEMENTED;
+	}
+	if (strlen(uri) > CONFIG_HTTPD_MAX_URI_LEN) {
+		return HTTPD_414_URI_TOO_LONG;
+	}
+	strcpy((char *) r->uri, uri);
+	if (strcmp(version, "HTTP/1.1") != 0 &&
+		strcmp(version, "HTTP/1.0") != 0) {
+		return HTTPD_505_VERSION_NOT_SUPPORTED;
+	}
+
+	size_t used = 0;
+	for (line = next; *line != '\0'; line = next) {
+		next = strstr(line, "\r\n");
+		if (next != NULL) {
+			*next = '\0';
+			next += 2;
+		} else {
+			next = line + strlen(line);
+		}
+		char *colon = strchr(line, ':');
+		if (colon == NULL || colon == line) {
+			return HTTPD_400_BAD_REQUEST;
+		}
+		// Trim the trailing spaces of the value.
+		char *end = line + strlen(line);
+		while (end > colon + 1 && (end[-1] == ' ' || end[-1] == '\t')) {
+			*--end = '\0';
+		}
+		size_t n = end - line + 1;
+		if (used + n > sizeof(ra->scratch)) {
+			return HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE;
+		}
+		memcpy(ra->scratch + used, line, n);
+		used += n;
+		ra->req_hdrs_count++;
+
+		const char *value = colon + 1;
+		while (*value == ' ') {
+			value++;
+		}
+		size_t name_length = colon - line;
+		if (name_length == 14 &&
+			strncasecmp(line, "Content-Length", 14) == 0) {
+			char *p = NULL;
+			unsigned long long content_len = strtoull(value, &p, 10);
+			if (p == value || *p != '\0') {
+				return HTTPD_400_BAD_REQUEST;
+			}
+			r->content_len = content_len;
+		} else if (name_length == 17 &&
+			strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+			// Chunked request bodies are not supported.
+			return HTTPD_411_LENGTH_REQUIRED;
+		}
+	}
+	ra->remaining_len = r->content_len;
+	return HTTPD_ERR_CODE_MAX;
+}
+
+/**
+ * @brief httpd_req_init resets the request of the server task.
+ */
+static void httpd_req_init(struct httpd_data *hd, struct sock_db *sd)
+{
+	struct httpd_req *r = &hd->req;
+	struct httpd_req_aux *ra = &hd->aux;
+	memset(r, 0, sizeof(*r));
+	ra->sd = sd;
+	ra->req_hdrs_count = 0;
+	ra->remaining_len = 0;
+	ra->handed_over = false;
+	ra->first_chunk_sent = false;
+	ra->status = HTTPD_200;
+	ra->content_type = HTTPD_TYPE_TEXT;
+	ra->resp_hdrs_count = 0;
+	r->handle = hd;
+	r->aux = ra;
+}
+
+/**
+ * @brief httpd_req_finish discards the body not received and moves the
+ * pipelined data to the front of the session buffer.
+ */
+static esp_err_t httpd_req_finish(struct httpd_req *r)
+{
+	struct httpd_req_aux *ra = r->aux;
+	struct sock_db *sd = ra->sd;
+	esp_err_t ret = ESP_OK;
+	char purge[CONFIG_HTTPD_PURGE_BUF_LEN];
+	while (ra->remaining_len > 0) {
+		int n = httpd_req_recv(r, purge, sizeof(purge));
+		if (n <= 0) {
+			ret = ESP_FAIL;
+			break;
+		}
+	}
+	memmove(sd->recv_buffer, sd->recv_buffer + sd->recv_start,
+		sd->recv_length - sd->recv_start);
+	sd->recv_length -= sd->recv_start;
+	sd->recv_start = 0;
+	return ret;
+}
+
+static esp_err_t httpd_req_handle_err(
+	struct httpd_data *hd, httpd_req_t *r, httpd_err_code_t error
+) {
+	if (hd->err_handlers[error] != NULL) {
+		esp_err_t ret = hd->err_handlers[error](r, error);
+		// The connection is closed after 500 anyway.
+		return error == HTTPD_500_INTERNAL_SERVER_ERROR ? ESP_FAIL : ret;
+	}
+	httpd_resp_send_err(r, error, NULL);
+	return ESP_FAIL;
+}
+
+static bool httpd_uri_match(
+	struct httpd_data *hd, const httpd_uri_t *uri,
+	const char *uri_to_match, size_t length
+) {
+	if (hd->config.uri_match_fn != NULL) {
+		return hd->config.uri_match_fn(uri->uri, uri_to_match, length);
+	}
+	return strlen(uri->uri) == length &&
+		strncmp(uri->uri, uri_to_match, length) == 0;
+}
+
+static const char *httpd_find_hdr(httpd_req_t *r, const char *field);
+
+/**
+ * @brief httpd_sha1 computes the SHA-1 digest of the websocket handshake.
+ */
+static void httpd_sha1(const uint8_t *data, size_t length, uint8_t digest[20])
+{
+	uint32_t h[5] = {
+		0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0,
+	};
+	// The message is padded with 0x80, zeros and the bit length.
+	size_t total = (length + 8) / 64 * 64 + 64;
+	for (size_t block = 0; block < total; block += 64) {
+		uint32_t w[80];
+		for (int i = 0; i < 64; i++) {
+			size_t pos = block + i;
+			uint8_t byte = pos < length ? data[pos] :
+				pos == length ? 0x80 : 0;
+			if (pos >= total - 8) {
+				byte = (uint64_t) length * 8 >> (8 * (total - 1 - pos));
+			}
+			if (i % 4 == 0) {
+				w[i / 4] = 0;
+			}
+			w[i / 4] |= (uint32_t) byte << (8 * (3 - i % 4));
+		}
+		for (int i = 16; i < 80; i++) {
+			uint32_t x = w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16];
+			w[i] = x << 1 | x >> 31;
+		}
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for (int i = 0; i < 80; i++) {
+			uint32_t f, k;
+			if (i < 20) {
+				f = (b & c) | (~b & d);
+				k = 0x5A827999;
+			} else if (i < 40) {
+				f = b ^ c ^ d;
+				k = 0x6ED9EBA1;
+			} else if (i < 60) {
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8F1BBCDC;
+			} else {
+				f = b ^ c ^ d;
+				k = 0xCA62C1D6;
+			}
+			uint32_t t = (a << 5 | a >> 27) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = b << 30 | b >> 2;
+			b = a;
+			a = t;
+		}
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+	}
+	for (int i = 0; i < 20; i++) {
+		digest[i] = h[i / 4] >> (8 * (3 - i % 4));
+	}
+}
+
+static void httpd_base64(const uint8_t *data, size_t length, char *out)
+{
+	static const char table[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	for (size_t i = 0; i < length; i += 3) {
+		uint32_t v = data[i] << 16;
+		if (i + 1 < length) {
+			v |= data[i+1] << 8;
+		}
+		if (i + 2 < length) {
+			v |= data[i+2];
+		}
+		*out++ = table[v >> 18 & 0x3f];
+		*out++ = table[v >> 12 & 0x3f];
+		*out++ = i + 1 < length ? table[v >> 6 & 0x3f] : '=';
+		*out++ = i + 2 < length ? table[v & 0x3f] : '=';
+	}
+	*out = '\0';
+}
+
+/**
+ * @brief httpd_ws_handshake answers the upgrade request of the websocket
+ * URI, the session serves the frames of the handler afterwards.
+ */
+static esp_err_t httpd_ws_handshake(httpd_req_t *r, const httpd_uri_t *uri)
+{
+	static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	const char *upgrade = httpd_find_hdr(r, "Upgrade");
+	const char *key = httpd_find_hdr(r, "Sec-WebSocket-Key");
+	if (r->method != HTTP_GET || upgrade == NULL ||
+		strcasecmp(upgrade, "websocket") != 0 || key == NULL ||
+		strlen(key) > 64) {
+		ESP_LOGW(TAG, "invalid websocket handshake of %s", r->uri);
+		return ESP_FAIL;
+	}
+	char accept_key[64 + sizeof(guid)];
+	uint8_t digest[20];
+	char accept[32];
+	int n = snprintf(accept_key, sizeof(accept_key), "%s%s", key, guid);
+	httpd_sha1((const uint8_t *) accept_key, n, digest);
+	httpd_base64(digest, sizeof(digest), accept);
+
+	char response[160];
+	n = snprintf(response, sizeof(response),
+		"HTTP/1.1 101 Switching Protocols\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+	struct httpd_req_aux *ra = r->aux;
+	if (httpd_send_all(ra->sd->fd, response, n, 0) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	ra->sd->ws_handler = uri;
+	return ESP_OK;
+}
+
+/**
+ * @brief httpd_ws_recv_all receives the bytes of the frame, buffered or
+ * not.
+ */
+static esp_err_t httpd_ws_recv_all(httpd_req_t *r, uint8_t *buf, size_t len)
+{
+	struct httpd_req_aux *ra = r->aux;
+	ra->remaining_len = len;
+	while (ra->remaining_len > 0) {
+		int n = httpd_req_recv(r, (char *) buf, ra->remaining_len);
+		if (n <= 0) {
+			return ESP_FAIL;
+		}
+		buf += n;
+	}
+	return ESP_OK;
+}
+
+static esp_err_t httpd_ws_send(
+	int fd, httpd_ws_type_t type, bool final, const uint8_t *payload,
+	size_t len
+) {
+	uint8_t header[10];
+	size_t n = 2;
+	header[0] = (final ? 0x80 : 0) | type;
+	if (len < 126) {
+		header[1] = len;
+	} else if (len <= 0xffff) {
+		header[1] = 126;
+		header[n++] = len >> 8;
+		header[n++] = len;
+	} else {
+		header[1] = 127;
+		for (int i = 7; i >= 0; i--) {
+			header[n++] = (uint64_t) len >> (8 * i);
+		}
+	}
+	esp_err_t ret = httpd_send_all(fd, (const char *) header, n, 0);
+	if (ret == ESP_OK && len > 0) {
+		ret = httpd_send_all(fd, (const char *) payload, len, 0);
+	}
+	return ret;
+}
+
+/**
+ * @brief httpd_ws_process receives the header of a frame of the websocket
+ * session, answers the control frames and passes the data frames to the
+ * handler.
+ *
+ * @return ESP_FAIL if the session should be closed.
+ */
+static esp_err_t httpd_ws_process(httpd_req_t *r, const httpd_uri_t *uri)
+{
+	struct httpd_req_aux *ra = r->aux;
+	uint8_t header[8];
+	if (httpd_ws_recv_all(r, header, 2) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	ra->ws_final = header[0] & 0x80;
+	ra->ws_type = header[0] & 0x0f;
+	size_t length = header[1] & 0x7f;
+	// The client frames are masked.
+	if (!(header[1] & 0x80)) {
+		ESP_LOGW(TAG, "unmasked websocket frame [%d]", ra->sd->fd);
+		return ESP_FAIL;
+	}
+	if (length >= 126) {
+		size_t n = length == 126 ? 2 : 8;
+		if (httpd_ws_recv_all(r, header, n) != ESP_OK) {
+			return ESP_FAIL;
+		}
+		length = 0;
+		for (size_t i = 0; i < n; i++) {
+			length = length << 8 | header[i];
+		}
+	}
+	if (httpd_ws_recv_all(r, ra->ws_mask, sizeof(ra->ws_mask)) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	ra->ws_length = length;
+	ra->remaining_len = length;
+	strcpy((char *) r->uri, uri->uri);
+
+	bool control = ra->ws_type >= HTTPD_WS_TYPE_CLOSE;
+	if (control && !uri->handle_ws_control_frames) {
+		uint8_t payload[125];
+		httpd_ws_frame_t frame = { .payload = payload };
+		if (length > sizeof(payload) ||
+			httpd_ws_recv_frame(r, &frame, sizeof(payload)) != ESP_OK) {
+			return ESP_FAIL;
+		}
+		if (ra->ws_type == HTTPD_WS_TYPE_PING) {
+			return httpd_ws_send(ra->sd->fd, HTTPD_WS_TYPE_PONG, true,
+				payload, frame.len);
+		}
+		if (ra->ws_type == HTTPD_WS_TYPE_CLOSE) {
+			// Echo the status code and close the session.
+			httpd_ws_send(ra->sd->fd, HTTPD_WS_TYPE_CLOSE, true,
+				payload, MIN(frame.len, 2));
+			return ESP_FAIL;
+		}
+		return ESP_OK;
+	}
+	r->user_ctx = uri->user_ctx;
+	return uri->handler(r);
+}
+
+/**
+ * @brief httpd_dispatch calls the first handler matching the URI and the
+ * method, the handlers are matched in the registration order.
+ */
+static esp_err_t httpd_dispatch(struct httpd_data *hd, httpd_req_t *r)
+{
+	size_t length = strcspn(r->uri, "?#");
+	httpd_err_code_t error = HTTPD_404_NOT_FOUND;
+	const httpd_uri_t *found = NULL;
+	for (size_t i = 0; i < hd->handler_count && found == NULL; i++) {
+		const httpd_uri_t *uri = &hd->handlers[i];
+		if (!httpd_uri_match(hd, uri, r->uri, length)) {
+			continue;
+		}
+		if ((int) uri->method == r->method ||
+			(int) uri->method == HTTP_ANY) {
+			found = uri;
+		} else {
+			error = HTTPD_405_METHOD_NOT_ALLOWED;
+		}
+	}
+	if (found == NULL) {
+		ESP_LOGW(TAG, "no handler for %s: %d", r->uri, error);
+		return httpd_req_handle_err(hd, r, error);
+	}
+	if (found->is_websocket && httpd_ws_handshake(r, found) != ESP_OK) {
+		return httpd_req_handle_err(hd, r, HTTPD_400_BAD_REQUEST);
+	}
+	r->user_ctx = found->user_ctx;
+	if (found->handler(r) != ESP_OK) {
+		ESP_LOGW(TAG, "uri handler of %s failed", r->uri);
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+/**
+ * @brief httpd_sess_process serves a request of the session.
+ *
+ * @return ESP_FAIL if the session should be closed.
+ */
+static esp_err_t httpd_sess_process(struct httpd_data *hd, struct sock_db *sd)
+{
+	httpd_req_init(hd, sd);
+	httpd_req_t *r = &hd->req;
+	if (sd->ws_handler != NULL) {
+		esp_err_t ret = httpd_ws_process(r, sd->ws_handler);
+		if (httpd_req_finish(r) != ESP_OK) {
+			ret = ESP_FAIL;
+		}
+		return ret;
+	}
+	size_t length = 0;
+	httpd_err_code_t error = HTTPD_ERR_CODE_MAX;
+	esp_err_t ret = httpd_recv_header(sd, &length, &error);
+	if (ret == ESP_OK) {
+		sd->recv_start = length;
+		error = httpd_parse_req(r, sd->recv_buffer, length);
+	}
+	if (error != HTTPD_ERR_CODE_MAX) {
+		// The request can not be parsed, the session is closed.
+		sd->recv_start = sd->recv_length;
+		httpd_req_handle_err(hd, r, error);
+		return ESP_FAIL;
+	}
+	if (ret != ESP_OK) {
+		return ret;
+	}
+
+	ret = httpd_dispatch(hd, r);
+	if (hd->aux.handed_over) {
+		// The async handler owns the session now.
+		return ESP_OK;
+	}
+	if (httpd_req_finish(r) != ESP_OK) {
+		ret = ESP_FAIL;
+	}
+	return ret;
+}
+
+static void httpd_accept_conn(struct httpd_data *hd)
+{
+	int fd = accept(hd->listen_fd, NULL, NULL);
+	if (fd < 0) {
+		ESP_LOGW(TAG, "accept failed: %d", errno);
+		return;
+	}
+	struct sock_db *sd = httpd_sess_get(hd, -1);
+	if (sd == NULL && hd->config.lru_purge_enable) {
+		struct sock_db *lru = NULL;
+		pthread_mutex_lock(&hd->lock);
+		for (int i = 0; i < hd->config.max_open_sockets; i++) {
+			struct sock_db *s = &hd->sessions[i];
+			if (s->fd >= 0 && !s->for_async_req && (lru == NULL ||
+				s->lru_counter < lru->lru_counter)) {
+				lru = s;
+			}
+		}
+		pthread_mutex_unlock(&hd->lock);
+		if (lru != NULL) {
+			ESP_LOGD(TAG, "purge LRU session [%d]", lru->fd);
+			httpd_sess_delete(hd, lru);
+			sd = lru;
+		}
+	}
+	if (sd == NULL) {
+		ESP_LOGW(TAG, "no free session, close [%d]", fd);
+		close(fd);
+		return;
+	}
+
+	struct timeval recv_timeout = { .tv_sec = hd->config.recv_wait_timeout };
+	struct timeval send_timeout = { .tv_sec = hd->config.send_wait_timeout };
+	int nodelay = 1;
+	// The loopback send buffer grows to megabytes, a blocking send of
+	// the handler would not stall the server task as on the device.
+	int send_buffer = CONFIG_LWIP_TCP_SND_BUF_DEFAULT;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO,
+		&recv_timeout, sizeof(recv_timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO,
+		&send_timeout, sizeof(send_timeout));
+	// Loopback delayed ACKs would dominate the latency of the split sends.
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &send_buffer,
+		sizeof(send_buffer));
+
+	pthread_mutex_lock(&hd->lock);
+	sd->fd = fd;
+	sd->for_async_req = false;
+	sd->close_pending = false;
+	sd->lru_counter = ++hd->lru_counter;
+	sd->recv_start = 0;
+	sd->recv_length = 0;
+	sd->ws_handler = NULL;
+	pthread_mutex_unlock(&hd->lock);
+	ESP_LOGD(TAG, "new session [%d]", fd);
+	if (hd->config.open_fn != NULL && hd->config.open_fn(hd, fd) != ESP_OK) {
+		httpd_sess_delete(hd, sd);
+	}
+}
+
+static void *httpd_server_task(void *arg)
+{
+	struct httpd_data *hd = arg;
+	pthread_setname_np(pthread_self(), "httpd");
+	size_t count = hd->config.max_open_sockets + 2;
+	struct pollfd *fds = calloc(count, sizeof(struct pollfd));
+	struct sock_db **polled = calloc(count, sizeof(struct sock_db *));
+	if (fds == NULL || polled == NULL) {
+		ESP_LOGE(TAG, "httpd_server_task: out of memory");
+		abort();
+	}
+
+	while (hd->running) {
+		size_t n = 0;
+		int timeout = -1;
+		fds[n++] = (struct pollfd) { .fd = hd->ctrl_fd[0], .events = POLLIN };
+		fds[n++] = (struct pollfd) { .fd = hd->listen_fd, .events = POLLIN };
+		pthread_mutex_lock(&hd->lock);
+		for (int i = 0; i < hd->config.max_open_sockets; i++) {
+			struct sock_db *sd = &hd->sessions[i];
+			if (sd->fd < 0 || sd->for_async_req) {
+				continue;
+			}
+			// Pipelined requests are already in the buffer.
+			if (sd->recv_length > 0) {
+				timeout = 0;
+			}
+			polled[n] = sd;
+			fds[n++] = (struct pollfd) { .fd = sd->fd, .events = POLLIN };
+		}
+		pthread_mutex_unlock(&hd->lock);
+
+		if (poll(fds, n, timeout) < 0 && errno != EINTR) {
+			ESP_LOGE(TAG, "poll failed: %d", errno);
+			break;
+		}
+		if (fds[0].revents & POLLIN) {
+			char drain[64];
+			while (read(hd->ctrl_fd[0], drain, sizeof(drain)) > 0) {
+				continue;
+			}
+		}
+		httpd_run_works(hd);
+		for (size_t i = 2; i < n && hd->running; i++) {
+			struct sock_db *sd = polled[i];
+			// The session may be closed by a work or a purge.
+			if (sd->fd != fds[i].fd || (fds[i].revents == 0 &&
+				sd->recv_length == 0)) {
+				continue;
+			}
+			if (httpd_sess_process(hd, sd) != ESP_OK) {
+				httpd_sess_delete(hd, sd);
+				continue;
+			}
+			pthread_mutex_lock(&hd->lock);
+			sd->lru_counter = ++hd->lru_counter;
+			pthread_mutex_unlock(&hd->lock);
+		}
+		if (hd->running && (fds[1].revents & POLLIN)) {
+			httpd_accept_conn(hd);
+		}
+	}
+	free(polled);
+	free(fds);
+	return NULL;
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+	if (handle == NULL || config == NULL || config->max_open_sockets == 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	struct httpd_data *hd = calloc(1, sizeof(struct httpd_data));
+	if (hd == NULL) {
+		return ESP_ERR_HTTPD_ALLOC_MEM;
+	}
+	hd->config = *config;
+	if (http_port_override != 0) {
+		hd->config.server_port = http_port_override;
+	}
+	hd->config.max_resp_headers = MIN(config->max_resp_headers,
+		HTTPD_MAX_RESP_HEADERS);
+	pthread_mutex_init(&hd->lock, NULL);
+	hd->sessions = calloc(config->max_open_sockets, sizeof(struct sock_db));
+	hd->handlers = calloc(config->max_uri_handlers, sizeof(httpd_uri_t));
+	hd->listen_fd = -1;
+	hd->ctrl_fd[0] = hd->ctrl_fd[1] = -1;
+	if (hd->sessions == NULL || hd->handlers == NULL ||
+		pipe(hd->ctrl_fd) != 0) {
+		ESP_LOGE(TAG, "httpd_start: out of resources");
+		goto error;
+	}
+	for (int i = 0; i < config->max_open_sockets; i++) {
+		hd->sessions[i].fd = -1;
+	}
+	fcntl(hd->ctrl_fd[0], F_SETFL, O_NONBLOCK);
+	fcntl(hd->ctrl_fd[1], F_SETFL, O_NONBLOCK);
+
+	hd->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	int enable = 1;
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(hd->config.server_port),
+		.sin_addr.s_addr = htonl(INADDR_ANY),
+	};
+	if (hd->listen_fd < 0 ||
+		setsockopt(hd->listen_fd, SOL_SOCKET, SO_REUSEADDR,
+			&enable, sizeof(enable)) != 0 ||
+		bind(hd->listen_fd, (struct sockaddr *) &addr,
+			sizeof(addr)) != 0 ||
+		listen(hd->listen_fd, hd->config.backlog_conn) != 0) {
+		ESP_LOGE(TAG, "httpd_start: listen on port %u failed: %d",
+			(unsigned int) hd->config.server_port, errno);
+		goto error;
+	}
+
+	hd->running = true;
+	if (pthread_create(&hd->task, NULL, httpd_server_task, hd) != 0) {
+		ESP_LOGE(TAG, "httpd_start: start server task failed");
+		goto error;
+	}
+	ESP_LOGI(TAG, "started on port %u", (unsigned int) hd->config.server_port);
+	*handle = hd;
+	return ESP_OK;
+
+error:
+	if (hd->listen_fd >= 0) {
+		close(hd->listen_fd);
+	}
+	if (hd->ctrl_fd[0] >= 0) {
+		close(hd->ctrl_fd[0]);
+		close(hd->ctrl_fd[1]);
+	}
+	free(hd->handlers);
+	free(hd->sessions);
+	free(hd);
+	return ESP_ERR_HTTPD_TASK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+	struct httpd_data *hd = handle;
+	if (hd == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	hd->running = false;
+	httpd_wake(hd);
+	pthread_join(hd->task, NULL);
+	for (int i = 0; i < hd->config.max_open_sockets; i++) {
+		httpd_sess_delete(hd, &hd->sessions[i]);
+	}
+	close(hd->listen_fd);
+	close(hd->ctrl_fd[0]);
+	close(hd->ctrl_fd[1]);
+	for (size_t i = 0; i < hd->handler_count; i++) {
+		free((char *) hd->handlers[i].uri);
+	}
+	free(hd->handlers);
+	free(hd->sessions);
+	free(hd);
+	return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(
+	httpd_handle_t handle, const httpd_uri_t *uri_handler
+) {
+	struct httpd_data *hd = handle;
+	if (hd == NULL || uri_handler == NULL || uri_handler->uri == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	for (size_t i = 0; i < hd->handler_count; i++) {
+		if (hd->handlers[i].method == uri_handler->method &&
+			strcmp(hd->handlers[i].uri, uri_handler->uri) == 0) {
+			ESP_LOGW(TAG, "handler %s already registered",
+				uri_handler->uri);
+			return ESP_ERR_HTTPD_HANDLER_EXISTS;
+		}
+	}
+	if (hd->handler_count == hd->config.max_uri_handlers) {
+		ESP_LOGW(TAG, "no slot left for handler %s", uri_handler->uri);
+		return ESP_ERR_HTTPD_HANDLERS_FULL;
+	}
+	httpd_uri_t *uri = &hd->handlers[hd->handler_count];
+	*uri = *uri_handler;
+	uri->uri = strdup(uri_handler->uri);
+	if (uri->uri == NULL) {
+		return ESP_ERR_HTTPD_ALLOC_MEM;
+	}
+	hd->handler_count++;
+	ESP_LOGD(TAG, "registered handler %s", uri->uri);
+	return ESP_OK;
+}
+
+esp_err_t httpd_register_err_handler(
+	httpd_handle_t handle, httpd_err_code_t error,
+	httpd_err_handler_func_t handler_fn
+) {
+	struct httpd_data *hd = handle;
+	if (hd == NULL || error >= HTTPD_ERR_CODE_MAX) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	hd->err_handlers[error] = handler_fn;
+	return ESP_OK;
+}
+
+bool httpd_uri_match_wildcard(
+	const char *uri_template, const char *uri_to_match, size_t match_upto
+) {
+	const size_t tpl_len = strlen(uri_template);
+	size_t exact_match_chars = tpl_len;
+
+	// Check for the trailing question mark and asterisk.
+	const char last = tpl_len > 0 ? uri_template[tpl_len - 1] : 0;
+	const char prevlast = tpl_len > 1 ? uri_template[tpl_len - 2] : 0;
+	const bool asterisk = last == '*' || (prevlast == '*' && last == '?');
+	const bool quest = last == '?' || (prevlast == '?' && last == '*');
+
+	if (exact_match_chars < (size_t) (asterisk + quest * 2)) {
+		return false;
+	}
+	exact_match_chars -= asterisk + quest * 2;
+	if (match_upto < exact_match_chars) {
+		return false;
+	}
+	if (!quest) {
+		if (!asterisk && match_upto != exact_match_chars) {
+			return false;
+		}
+		return strncmp(uri_template, uri_to_match,
+			exact_match_chars) == 0;
+	}
+	// The character before '?' is optional.
+	if (match_upto > exact_match_chars &&
+		uri_template[exact_match_chars] !=
+		uri_to_match[exact_match_chars]) {
+		return false;
+	}
+	if (strncmp(uri_template, uri_to_match, exact_match_chars) != 0) {
+		return false;
+	}
+	return asterisk || match_upto <= exact_match_chars + 1;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+	if (r == NULL || r->aux == NULL) {
+		return -1;
+	}
+	return ((struct httpd_req_aux *) r->aux)->sd->fd;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+	if (r == NULL || buf == NULL) {
+		return HTTPD_SOCK_ERR_INVALID;
+	}
+	struct httpd_req_aux *ra = r->aux;
+	struct sock_db *sd = ra->sd;
+	buf_len = MIN(buf_len, ra->remaining_len);
+	if (buf_len == 0) {
+		return 0;
+	}
+	// The body received with the headers goes first.
+	size_t pending = sd->recv_length - sd->recv_start;
+	if (pending > 0) {
+		size_t n = MIN(pending, buf_len);
+		memcpy(buf, sd->recv_buffer + sd->recv_start, n);
+		sd->recv_start += n;
+		ra->remaining_len -= n;
+		return n;
+	}
+	ssize_t n;
+	do {
+		n = recv(sd->fd, buf, buf_len, 0);
+	} while (n < 0 && errno == EINTR);
+	if (n < 0) {
+		return errno == EAGAIN || errno == EWOULDBLOCK ?
+			HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+	}
+	ra->remaining_len -= n;
+	return n;
+}
+
+/**
+ * @brief httpd_find_hdr finds the value of the request header.
+ *
+ * @return the value without the preceding spaces, NULL if not found.
+ */
+static const char *httpd_find_hdr(httpd_req_t *r, const char *field)
+{
+	if (r == NULL || r->aux == NULL || field == NULL) {
+		return NULL;
+	}
+	struct httpd_req_aux *ra = r->aux;
+	size_t length = strlen(field);
+	const char *hdr = ra->scratch;
+	for (size_t i = 0; i < ra->req_hdrs_count; i++) {
+		const char *colon = strchr(hdr, ':');
+		if ((size_t) (colon - hdr) == length &&
+			strncasecmp(hdr, field, length) == 0) {
+			const char *value = colon + 1;
+			while (*value == ' ') {
+				value++;
+			}
+			return value;
+		}
+		hdr += strlen(hdr) + 1;
+	}
+	return NULL;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+	const char *value = httpd_find_hdr(r, field);
+	return value != NULL ? strlen(value) : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(
+	httpd_req_t *r, const char *field, char *val, size_t val_size
+) {
+	if (val == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	const char *value = httpd_find_hdr(r, field);
+	if (value == NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	strlcpy(val, value, val_size);
+	return strlen(value) + 1 > val_size ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_req_get_cookie_val(
+	httpd_req_t *req, const char *cookie_name, char *val, size_t *val_size
+) {
+	if (cookie_name == NULL || val == NULL || val_size == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	const char *cookie = httpd_find_hdr(req, "Cookie");
+	if (cookie == NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	size_t length = strlen(cookie_name);
+	const size_t buf_len = *val_size;
+	while (*cookie != '\0') {
+		const char *value = strchr(cookie, '=');
+		if (value == NULL) {
+			break;
+		}
+		// The pairs are separated by '; '.
+		if ((size_t) (value - cookie) != length ||
+			strncasecmp(cookie, cookie_name, length) != 0) {
+			cookie = strchr(value, ' ');
+			if (cookie == NULL) {
+				break;
+			}
+			cookie++;
+			continue;
+		}
+		value++;
+		size_t size = strcspn(value, ";") + 1;
+		strlcpy(val, value, MIN(size, buf_len));
+		if (buf_len < size) {
+			*val_size = size;
+			return ESP_ERR_HTTPD_RESULT_TRUNC;
+		}
+		*val_size = size;
+		return ESP_OK;
+	}
+	return ESP_ERR_NOT_FOUND;
+}
+
+/**
+ * @brief httpd_find_query finds the query of the URI.
+ *
+ * @return the query after '?', NULL if no query.
+ */
+static const char *httpd_find_query(httpd_req_t *r, size_t *length)
+{
+	const char *query = strchr(r->uri, '?');
+	if (query == NULL) {
+		return NULL;
+	}
+	query++;
+	*length = strcspn(query, "#");
+	return query;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r)
+{
+	size_t length = 0;
+	if (r == NULL || httpd_find_query(r, &length) == NULL) {
+		return 0;
+	}
+	return length;
+}
+
+esp_err_t httpd_req_get_url_query_str(
+	httpd_req_t *r, char *buf, size_t buf_len
+) {
+	if (r == NULL || buf == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	size_t length = 0;
+	const char *query = httpd_find_query(r, &length);
+	if (query == NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	strlcpy(buf, query, MIN(buf_len, length + 1));
+	return buf_len < length + 1 ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(
+	const char *qry, const char *key, char *val, size_t val_size
+) {
+	if (qry == NULL || key == NULL || val == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	size_t length = strlen(key);
+	while (*qry != '\0') {
+		const char *value = strchr(qry, '=');
+		if (value == NULL) {
+			break;
+		}
+		if ((size_t) (value - qry) != length ||
+			strncasecmp(qry, key, length) != 0) {
+			qry = strchr(value, '&');
+			if (qry == NULL) {
+				break;
+			}
+			qry++;
+			continue;
+		}
+		value++;
+		size_t size = strcspn(value, "&") + 1;
+		strlcpy(val, value, MIN(size, val_size));
+		return val_size < size ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+	}
+	return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out)
+{
+	if (r == NULL || out == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	struct httpd_req *copy = malloc(sizeof(struct httpd_req));
+	struct httpd_req_aux *aux = malloc(sizeof(struct httpd_req_aux));
+	if (copy == NULL || aux == NULL) {
+		free(copy);
+		free(aux);
+		return ESP_ERR_NO_MEM;
+	}
+	struct httpd_req_aux *ra = r->aux;
+	memcpy(copy, r, sizeof(struct httpd_req));
+	memcpy(aux, ra, sizeof(struct httpd_req_aux));
+	copy->aux = aux;
+
+	struct httpd_data *hd = r->handle;
+	pthread_mutex_lock(&hd->lock);
+	ra->sd->for_async_req = true;
+	pthread_mutex_unlock(&hd->lock);
+	ra->handed_over = true;
+	*out = copy;
+	return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r)
+{
+	if (r == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	struct httpd_data *hd = r->handle;
+	struct httpd_req_aux *ra = r->aux;
+	struct sock_db *sd = ra->sd;
+	bool failed = httpd_req_finish(r) != ESP_OK;
+
+	pthread_mutex_lock(&hd->lock);
+	int fd = sd->fd;
+	bool close_pending = failed || sd->close_pending;
+	sd->for_async_req = false;
+	sd->close_pending = false;
+	sd->lru_counter = ++hd->lru_counter;
+	pthread_mutex_unlock(&hd->lock);
+	free(ra);
+	free(r);
+	if (close_pending) {
+		httpd_sess_trigger_close(hd, fd);
+	} else {
+		// The session is polled again, or its pipelined request served.
+		httpd_wake(hd);
+	}
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+	if (r == NULL || status == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	((struct httpd_req_aux *) r->aux)->status = status;
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+	if (r == NULL || type == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	((struct httpd_req_aux *) r->aux)->content_type = type;
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(
+	httpd_req_t *r, const char *field, const char *value
+) {
+	if (r == NULL || field == NULL || value == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	struct httpd_data *hd = r->handle;
+	struct httpd_req_aux *ra = r->aux;
+	if (ra->resp_hdrs_count >= hd->config.max_resp_headers) {
+		ESP_LOGW(TAG, "too many response headers, %s dropped", field);
+		return ESP_ERR_HTTPD_RESP_HDR;
+	}
+	ra->resp_hdrs[ra->resp_hdrs_count].field = field;
+	ra->resp_hdrs[ra->resp_hdrs_count].value = value;
+	ra->resp_hdrs_count++;
+	return ESP_OK;
+}
+
+/**
+ * @brief httpd_format_header formats the status line and the headers.
+ *
+ * @param content_length -1 for the chunked response
+ * @return the header length, 0 if the buffer is too small.
+ */
+static size_t httpd_format_header(
+	httpd_req_t *r, ssize_t content_length, char *buf, size_t size
+) {
+	struct httpd_req_aux *ra = r->aux;
+	size_t n = snprintf(buf, size, "HTTP/1.1 %s\r\nContent-Type: %s\r\n",
+		ra->status, ra->content_type);
+	if (content_length >= 0) {
+		n += snprintf(buf + n, n < size ? size - n : 0,
+			"Content-Length: %zd\r\n", content_length);
+	} else {
+		n += snprintf(buf + n, n < size ? size - n : 0,
+			"Transfer-Encoding: chunked\r\n");
+	}
+	for (size_t i = 0; i < ra->resp_hdrs_count; i++) {
+		n += snprintf(buf + n, n < size ? size - n : 0, "%s: %s\r\n",
+			ra->resp_hdrs[i].field, ra->resp_hdrs[i].value);
+	}
+	n += snprintf(buf + n, n < size ? size - n : 0, "\r\n");
+	return n < size ? n : 0;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+	if (r == NULL || r->aux == NULL) {
+		return ESP_ERR_HTTPD_INVALID_REQ;
+	}
+	if (buf == NULL) {
+		buf_len = 0;
+	} else if (buf_len == HTTPD_RESP_USE_STRLEN) {
+		buf_len = strlen(buf);
+	}
+	int fd = httpd_req_to_sockfd(r);
+	char header[HTTPD_RESP_BUF_SIZE];
+	size_t n = httpd_format_header(r, buf_len, header, sizeof(header));
+	if (n == 0) {
+		ESP_LOGE(TAG, "httpd_resp_send: headers too long");
+		return ESP_ERR_HTTPD_RESP_HDR;
+	}
+	// Small responses go out in one segment.
+	if (n + buf_len <= sizeof(header)) {
+		if (buf_len > 0) {
+			memcpy(header + n, buf, buf_len);
+		}
+		return httpd_send_all(fd, header, n + buf_len, 0);
+	}
+	esp_err_t ret = httpd_send_all(fd, header, n, MSG_MORE);
+	if (ret == ESP_OK) {
+		ret = httpd_send_all(fd, buf, buf_len, 0);
+	}
+	return ret;
+}
+
+esp_err_t httpd_resp_send_chunk(
+	httpd_req_t *r, const char *buf, ssize_t buf_len
+) {
+	if (r == NULL || r->aux == NULL) {
+		return ESP_ERR_HTTPD_INVALID_REQ;
+	}
+	struct httpd_req_aux *ra = r->aux;
+	if (buf == NULL) {
+		buf_len = 0;
+	} else if (buf_len == HTTPD_RESP_USE_STRLEN) {
+		buf_len = strlen(buf);
+	}
+	int fd = httpd_req_to_sockfd(r);
+	char chunk[HTTPD_RESP_BUF_SIZE];
+	size_t n = 0;
+	if (!ra->first_chunk_sent) {
+		n = httpd_format_header(r, -1, chunk, sizeof(chunk));
+		if (n == 0) {
+			ESP_LOGE(TAG, "httpd_resp_send_chunk: headers too long");
+			return ESP_ERR_HTTPD_RESP_HDR;
+		}
+		ra->first_chunk_sent = true;
+	}
+	// The chunk size line, the data and the terminator.
+	if (sizeof(chunk) - n < 16) {
+		esp_err_t ret = httpd_send_all(fd, chunk, n, MSG_MORE);
+		if (ret != ESP_OK) {
+			return ret;
+		}
+		n = 0;
+	}
+	n += snprintf(chunk + n, sizeof(chunk) - n, "%zx\r\n", buf_len);
+	if (buf_len == 0) {
+		n += snprintf(chunk + n, sizeof(chunk) - n, "\r\n");
+		return httpd_send_all(fd, chunk, n, 0);
+	}
+	if (n + buf_len + 2 <= sizeof(chunk)) {
+		memcpy(chunk + n, buf, buf_len);
+		memcpy(chunk + n + buf_len, "\r\n", 2);
+		return httpd_send_all(fd, chunk, n + buf_len + 2, 0);
+	}
+	esp_err_t ret = httpd_send_all(fd, chunk, n, MSG_MORE);
+	if (ret == ESP_OK) {
+		ret = httpd_send_all(fd, buf, buf_len, MSG_MORE);
+	}
+	if (ret == ESP_OK) {
+		ret = httpd_send_all(fd, "\r\n", 2, 0);
+	}
+	return ret;
+}
+
+esp_err_t httpd_resp_send_err(
+	httpd_req_t *req, httpd_err_code_t error, const char *msg
+) {
+	if (req == NULL || error >= HTTPD_ERR_CODE_MAX) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	httpd_resp_set_status(req, httpd_errors[error].status);
+	httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+	return httpd_resp_send(req, msg != NULL ? msg :
+		httpd_errors[error].message, HTTPD_RESP_USE_STRLEN);
+}
+
+int httpd_send(httpd_req_t *r, const char *buf, size_t buf_len)
+{
+	if (r == NULL || buf == NULL) {
+		return HTTPD_SOCK_ERR_INVALID;
+	}
+	ssize_t n;
+	do {
+		n = send(httpd_req_to_sockfd(r), buf, buf_len, MSG_NOSIGNAL);
+	} while (n < 0 && errno == EINTR);
+	if (n < 0) {
+		return errno == EAGAIN || errno == EWOULDBLOCK ?
+			HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+	}
+	return n;
+}
+
+int httpd_socket_send(
+	httpd_handle_t handle, int sockfd, const char *buf, size_t buf_len,
+	int flags
+) {
+	struct httpd_data *hd = handle;
+	if (hd == NULL || buf == NULL) {
+		return HTTPD_SOCK_ERR_INVALID;
+	}
+	pthread_mutex_lock(&hd->lock);
+	bool found = httpd_sess_get(hd, sockfd) != NULL;
+	pthread_mutex_unlock(&hd->lock);
+	if (!found) {
+		return HTTPD_SOCK_ERR_INVALID;
+	}
+	ssize_t n;
+	do {
+		n = send(sockfd, buf, buf_len, flags | MSG_NOSIGNAL);
+	} while (n < 0 && errno == EINTR);
+	if (n < 0) {
+		return errno == EAGAIN || errno == EWOULDBLOCK ?
+			HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+	}
+	return n;
+}
+
+esp_err_t httpd_ws_recv_frame(
+	httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len
+) {
+	if (req == NULL || req->aux == NULL || pkt == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	struct httpd_req_aux *ra = req->aux;
+	pkt->type = ra->ws_type;
+	pkt->final = ra->ws_final;
+	pkt->fragmented = false;
+	if (max_len == 0) {
+		pkt->len = ra->ws_length;
+		return ESP_OK;
+	}
+	if (pkt->payload == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	size_t offset = ra->ws_length - ra->remaining_len;
+	size_t len = MIN(max_len, ra->remaining_len);
+	size_t remaining = ra->remaining_len - len;
+	if (httpd_ws_recv_all(req, pkt->payload, len) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	ra->remaining_len = remaining;
+	for (size_t i = 0; i < len; i++) {
+		pkt->payload[i] ^= ra->ws_mask[(offset + i) % 4];
+	}
+	pkt->len = len;
+	return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt)
+{
+	if (req == NULL || pkt == NULL || (pkt->len > 0 && pkt->payload == NULL)) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	return httpd_ws_send(httpd_req_to_sockfd(req), pkt->type, pkt->final,
+		pkt->payload, pkt->len);
+}
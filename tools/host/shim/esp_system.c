@@ -0,0 +1,172 @@
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <esp_rom_crc.h>
+#include <esp_http_server.h>
+#include <nvs.h>
+
+static _Atomic esp_log_level_t log_level = CONFIG_LOG_DEFAULT_LEVEL;
+static _Atomic uint32_t heap_min = UINT32_MAX;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+	atomic_store(&log_level, level);
+}
+
+uint32_t esp_log_timestamp(void)
+{
+	return (uint32_t) (esp_timer_get_time() / 1000);
+}
+
+void esp_log_write(
+	esp_log_level_t level, const char *tag, const char *format, ...
+) {
+	if (level > atomic_load(&log_level)) {
+		return;
+	}
+	va_list args;
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+}
+
+/**
+ * @brief esp_err_names are the names of the error codes used by the
+ * sources and the shims.
+ */
+static const struct {
+	esp_err_t code;
+	const char *name;
+} esp_err_names[] = {
+	{ ESP_OK, "ESP_OK" },
+	{ ESP_FAIL, "ESP_FAIL" },
+	{ ESP_ERR_NO_MEM, "ESP_ERR_NO_MEM" },
+	{ ESP_ERR_INVALID_ARG, "ESP_ERR_INVALID_ARG" },
+	{ ESP_ERR_INVALID_STATE, "ESP_ERR_INVALID_STATE" },
+	{ ESP_ERR_INVALID_SIZE, "ESP_ERR_INVALID_SIZE" },
+	{ ESP_ERR_NOT_FOUND, "ESP_ERR_NOT_FOUND" },
+	{ ESP_ERR_NOT_SUPPORTED, "ESP_ERR_NOT_SUPPORTED" },
+	{ ESP_ERR_TIMEOUT, "ESP_ERR_TIMEOUT" },
+	{ ESP_ERR_INVALID_RESPONSE, "ESP_ERR_INVALID_RESPONSE" },
+	{ ESP_ERR_INVALID_CRC, "ESP_ERR_INVALID_CRC" },
+	{ ESP_ERR_INVALID_VERSION, "ESP_ERR_INVALID_VERSION" },
+	{ ESP_ERR_NOT_FINISHED, "ESP_ERR_NOT_FINISHED" },
+	{ ESP_ERR_NOT_ALLOWED, "ESP_ERR_NOT_ALLOWED" },
+	{ ESP_ERR_NVS_NOT_INITIALIZED, "ESP_ERR_NVS_NOT_INITIALIZED" },
+	{ ESP_ERR_NVS_NOT_FOUND, "ESP_ERR_NVS_NOT_FOUND" },
+	{ ESP_ERR_NVS_READ_ONLY, "ESP_ERR_NVS_READ_ONLY" },
+	{ ESP_ERR_NVS_INVALID_NAME, "ESP_ERR_NVS_INVALID_NAME" },
+	{ ESP_ERR_NVS_INVALID_HANDLE, "ESP_ERR_NVS_INVALID_HANDLE" },
+	{ ESP_ERR_NVS_KEY_TOO_LONG, "ESP_ERR_NVS_KEY_TOO_LONG" },
+	{ ESP_ERR_NVS_INVALID_LENGTH, "ESP_ERR_NVS_INVALID_LENGTH" },
+	{ ESP_ERR_NVS_VALUE_TOO_LONG, "ESP_ERR_NVS_VALUE_TOO_LONG" },
+	{ ESP_ERR_HTTPD_HANDLERS_FULL, "ESP_ERR_HTTPD_HANDLERS_FULL" },
+	{ ESP_ERR_HTTPD_HANDLER_EXISTS, "ESP_ERR_HTTPD_HANDLER_EXISTS" },
+	{ ESP_ERR_HTTPD_INVALID_REQ, "ESP_ERR_HTTPD_INVALID_REQ" },
+	{ ESP_ERR_HTTPD_RESULT_TRUNC, "ESP_ERR_HTTPD_RESULT_TRUNC" },
+	{ ESP_ERR_HTTPD_RESP_HDR, "ESP_ERR_HTTPD_RESP_HDR" },
+	{ ESP_ERR_HTTPD_RESP_SEND, "ESP_ERR_HTTPD_RESP_SEND" },
+	{ ESP_ERR_HTTPD_ALLOC_MEM, "ESP_ERR_HTTPD_ALLOC_MEM" },
+	{ ESP_ERR_HTTPD_TASK, "ESP_ERR_HTTPD_TASK" },
+};
+
+const char *esp_err_to_name(esp_err_t code)
+{
+	for (size_t i = 0; i < sizeof(esp_err_names) /
+		sizeof(esp_err_names[0]); i++) {
+		if (esp_err_names[i].code == code) {
+			return esp_err_names[i].name;
+		}
+	}
+	return "UNKNOWN ERROR";
+}
+
+void _esp_error_check_failed_without_abort(
+	esp_err_t rc, const char *file, int line,
+	const char *function, const char *expression
+) {
+	printf("ESP_ERROR_CHECK_WITHOUT_ABORT failed: esp_err_t 0x%x (%s) "
+		"at %s:%d\nfunc: %s\nexpression: %s\n", rc,
+		esp_err_to_name(rc), file, line, function, expression);
+}
+
+void _esp_error_check_failed(
+	esp_err_t rc, const char *file, int line,
+	const char *function, const char *expression
+) {
+	printf("ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) at %s:%d\n"
+		"func: %s\nexpression: %s\n", rc,
+		esp_err_to_name(rc), file, line, function, expression);
+	fflush(stdout);
+	abort();
+}
+
+void esp_restart(void)
+{
+	printf("restart requested, exit\n");
+	fflush(stdout);
+	exit(EXIT_SUCCESS);
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+	struct mallinfo2 info = mallinfo2();
+	uint32_t size = info.fordblks > UINT32_MAX ?
+		UINT32_MAX : (uint32_t) info.fordblks;
+	uint32_t min = atomic_load(&heap_min);
+	while (size < min &&
+		!atomic_compare_exchange_weak(&heap_min, &min, size)) {
+		continue;
+	}
+	return size;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+	uint32_t min = atomic_load(&heap_min);
+	return min == UINT32_MAX ? esp_get_free_heap_size() : min;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+	crc = ~crc;
+	for (uint32_t i = 0; i < len; i++) {
+		crc ^= buf[i];
+		for (int j = 0; j < 8; j++) {
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		}
+	}
+	return ~crc;
+}
+
+#if HOST_NEED_STRLCPY
+
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t length = strlen(src);
+	if (size > 0) {
+		size_t n = length < size - 1 ? length : size - 1;
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+	return length;
+}
+
+size_t strlcat(char *dst, const char *src, size_t size)
+{
+	size_t length = strnlen(dst, size);
+	if (length == size) {
+		return size + strlen(src);
+	}
+	return length + strlcpy(dst + length, src, size - length);
+}
+
+#endif // HOST_NEED_STRLCPY
@@ -0,0 +1,236 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+
+#define TAG "ESP_TIMER"
+
+struct esp_timer {
+	esp_timer_cb_t callback;
+	void *arg;
+	const char *name;
+	bool active;
+	int64_t alarm;          // esp_timer time of the next run
+	uint64_t period;        // 0 for the one shot timers
+	struct esp_timer *next; // next active timer by the alarm
+};
+
+/**
+ * @brief private timer task state, the active timers are kept in a list
+ * sorted by the alarm, the callbacks run on the timer task.
+ */
+static struct {
+	pthread_once_t once;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	pthread_t task;
+	bool started;
+	struct esp_timer *active;
+	struct timespec start; // time 0 of esp_timer_get_time
+} timers = {
+	.once = PTHREAD_ONCE_INIT,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void init_timers()
+{
+	clock_gettime(CLOCK_MONOTONIC, &timers.start);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&timers.changed, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+int64_t esp_timer_get_time(void)
+{
+	pthread_once(&timers.once, init_timers);
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t) (now.tv_sec - timers.start.tv_sec) * 1000000 +
+		(now.tv_nsec - timers.start.tv_nsec) / 1000;
+}
+
+/**
+ * @brief timer_insert inserts the timer into the active list by its alarm,
+ * the timers with the same alarm run in the start order.
+ */
+static void timer_insert(struct esp_timer *timer)
+{
+	struct esp_timer **p = &timers.active;
+	while (*p != NULL && (*p)->alarm <= timer->alarm) {
+		p = &(*p)->next;
+	}
+	timer->next = *p;
+	*p = timer;
+	timer->active = true;
+}
+
+static void timer_remove(struct esp_timer *timer)
+{
+	for (struct esp_timer **p = &timers.active; *p != NULL;
+		p = &(*p)->next) {
+		if (*p == timer) {
+			*p = timer->next;
+			break;
+		}
+	}
+	timer->next = NULL;
+	timer->active = false;
+}
+
+static void *timer_task(void *arg)
+{
+	pthread_setname_np(pthread_self(), "esp_timer");
+	pthread_mutex_lock(&timers.lock);
+	while (true) {
+		struct esp_timer *timer = timers.active;
+		if (timer == NULL) {
+			pthread_cond_wait(&timers.changed, &timers.lock);
+			continue;
+		}
+		int64_t now = esp_timer_get_time();
+		if (timer->alarm > now) {
+			struct timespec until = timers.start;
+			int64_t ns = timer->alarm * 1000 + until.tv_nsec;
+			until.tv_sec += ns / 1000000000;
+			until.tv_nsec = ns % 1000000000;
+			pthread_cond_timedwait(
+				&timers.changed, &timers.lock, &until);
+			continue;
+		}
+		timer_remove(timer);
+		if (timer->period > 0) {
+			// Skip the missed periods like skip_unhandled_events.
+			timer->alarm += timer->period;
+			if (timer->alarm <= now) {
+				timer->alarm = now + timer->period;
+			}
+			timer_insert(timer);
+		}
+		esp_timer_cb_t callback = timer->callback;
+		void *callback_arg = timer->arg;
+		pthread_mutex_unlock(&timers.lock);
+		callback(callback_arg);
+		pthread_mutex_lock(&timers.lock);
+	}
+	return NULL;
+}
+
+esp_err_t esp_timer_create(
+	const esp_timer_create_args_t *create_args,
+	esp_timer_handle_t *out_handle
+) {
+	if (create_args == NULL || create_args->callback == NULL ||
+		out_handle == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	pthread_once(&timers.once, init_timers);
+	pthread_mutex_lock(&timers.lock);
+	if (!timers.started) {
+		if (pthread_create(&timers.task, NULL, timer_task, NULL) != 0) {
+			pthread_mutex_unlock(&timers.lock);
+			ESP_LOGE(TAG, "esp_timer_create: start timer task failed");
+			return ESP_ERR_NO_MEM;
+		}
+		pthread_detach(timers.task);
+		timers.started = true;
+	}
+	pthread_mutex_unlock(&timers.lock);
+
+	struct esp_timer *timer = calloc(1, sizeof(struct esp_timer));
+	if (timer == NULL) {
+		return ESP_ERR_NO_MEM;
+	}
+	timer->callback = create_args->callback;
+	timer->arg = create_args->arg;
+	timer->name = create_args->name;
+	*out_handle = timer;
+	return ESP_OK;
+}
+
+static esp_err_t timer_start(
+	esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period
+) {
+	if (timer == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	pthread_mutex_lock(&timers.lock);
+	if (timer->active) {
+		pthread_mutex_unlock(&timers.lock);
+		return ESP_ERR_INVALID_STATE;
+	}
+	timer->alarm = esp_timer_get_time() + timeout_us;
+	timer->period = period;
+	timer_insert(timer);
+	pthread_cond_signal(&timers.changed);
+	pthread_mutex_unlock(&timers.lock);
+	return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+	return timer_start(timer, timeout_us, 0);
+}
+
+static uint32_t period_divisor = 1;
+
+void host_set_timer_period_divisor(uint32_t divisor)
+{
+	period_divisor = divisor > 0 ? divisor : 1;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+	if (period == 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	period = period / period_divisor > 0 ? period / period_divisor : 1;
+	return timer_start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+	if (timer == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	esp_err_t ret = ESP_OK;
+	pthread_mutex_lock(&timers.lock);
+	if (timer->active) {
+		timer_remove(timer);
+		pthread_cond_signal(&timers.changed);
+	} else {
+		ret = ESP_ERR_INVALID_STATE;
+	}
+	pthread_mutex_unlock(&timers.lock);
+	return ret;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+	if (timer == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (esp_timer_is_active(timer)) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	free(timer);
+	return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+	if (timer == NULL) {
+		return false;
+	}
+	pthread_mutex_lock(&timers.lock);
+	bool active = timer->active;
+	pthread_mutex_unlock(&timers.lock);
+	return active;
+}
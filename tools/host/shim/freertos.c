@@ -0,0 +1,402 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <freertos/queue.h>
+
+#define TAG "FREERTOS"
+
+#define TICK_PERIOD_NS (1000000000ULL / configTICK_RATE_HZ)
+
+/**
+ * @brief host_task is a task running on a thread, the main thread gets its
+ * task when it first asks for it.
+ */
+struct host_task {
+	pthread_t thread;
+	char name[16];
+	TaskFunction_t code;
+	void *parameters;
+	pthread_mutex_t lock;
+	pthread_cond_t notified;
+	uint32_t notify_count;
+};
+
+struct host_semaphore {
+	pthread_mutex_t lock;
+	pthread_cond_t available;
+	UBaseType_t count;
+	UBaseType_t max_count;
+};
+
+struct host_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	UBaseType_t length;
+	UBaseType_t item_size;
+	UBaseType_t head;  // index of the oldest item
+	UBaseType_t count;
+	uint8_t *items;
+};
+
+static __thread struct host_task *current_task;
+
+static struct timespec start_time;
+static pthread_once_t start_once = PTHREAD_ONCE_INIT;
+
+static void init_start_time()
+{
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+}
+
+static uint64_t elapsed_ns()
+{
+	pthread_once(&start_once, init_start_time);
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) (now.tv_sec - start_time.tv_sec) * 1000000000ULL +
+		now.tv_nsec - start_time.tv_nsec;
+}
+
+/**
+ * @brief deadline gets the absolute CLOCK_MONOTONIC time after the ticks,
+ * the conditions wait on CLOCK_MONOTONIC too.
+ */
+static struct timespec deadline(TickType_t ticks)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	uint64_t ns = (uint64_t) ticks * TICK_PERIOD_NS + t.tv_nsec;
+	t.tv_sec += ns / 1000000000ULL;
+	t.tv_nsec = ns % 1000000000ULL;
+	return t;
+}
+
+static void init_cond(pthread_cond_t *cond)
+{
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/**
+ * @brief wait_cond waits for the condition until the ticks pass,
+ * portMAX_DELAY waits forever.
+ *
+ * @return false if timed out.
+ */
+static bool wait_cond(
+	pthread_cond_t *cond, pthread_mutex_t *lock,
+	const struct timespec *until, TickType_t ticks
+) {
+	if (ticks == 0) {
+		return false;
+	}
+	if (ticks == portMAX_DELAY) {
+		pthread_cond_wait(cond, lock);
+		return true;
+	}
+	return pthread_cond_timedwait(cond, lock, until) != ETIMEDOUT;
+}
+
+static struct host_task *new_task(const char *name)
+{
+	struct host_task *task = calloc(1, sizeof(struct host_task));
+	if (task == NULL) {
+		return NULL;
+	}
+	strncpy(task->name, name, sizeof(task->name) - 1);
+	pthread_mutex_init(&task->lock, NULL);
+	init_cond(&task->notified);
+	return task;
+}
+
+static void *task_thread(void *arg)
+{
+	struct host_task *task = arg;
+	current_task = task;
+	pthread_setname_np(pthread_self(), task->name);
+	task->code(task->parameters);
+	// FreeRTOS tasks must not return.
+	ESP_LOGE(TAG, "task [%s] returned", task->name);
+	abort();
+	return NULL;
+}
+
+BaseType_t xTaskCreate(
+	TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+	void *parameters, UBaseType_t priority, TaskHandle_t *created_task
+) {
+	struct host_task *task = new_task(name != NULL ? name : "");
+	if (task == NULL) {
+		return pdFAIL;
+	}
+	task->code = task_code;
+	task->parameters = parameters;
+	if (created_task != NULL) {
+		*created_task = task;
+	}
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	int ret = pthread_create(&task->thread, &attr, task_thread, task);
+	pthread_attr_destroy(&attr);
+	if (ret != 0) {
+		ESP_LOGE(TAG, "xTaskCreate: pthread_create failed: %d", ret);
+		if (created_task != NULL) {
+			*created_task = NULL;
+		}
+		free(task);
+		return pdFAIL;
+	}
+	return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+	if (task != NULL && task != xTaskGetCurrentTaskHandle()) {
+		ESP_LOGE(TAG, "vTaskDelete: only the calling task is supported");
+		abort();
+	}
+	pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+	struct timespec until = deadline(ticks);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL)
+		== EINTR) {
+		continue;
+	}
+}
+
+void vTaskDelayUntil(
+	TickType_t *previous_wake_time, TickType_t time_increment
+) {
+	*previous_wake_time += time_increment;
+	uint64_t wake_ns = (uint64_t) *previous_wake_time * TICK_PERIOD_NS;
+	uint64_t now_ns = elapsed_ns();
+	if (wake_ns <= now_ns) {
+		// Already late, the wake time is kept for the next period.
+		return;
+	}
+	struct timespec until;
+	clock_gettime(CLOCK_MONOTONIC, &until);
+	uint64_t ns = wake_ns - now_ns + until.tv_nsec;
+	until.tv_sec += ns / 1000000000ULL;
+	until.tv_nsec = ns % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL)
+		== EINTR) {
+		continue;
+	}
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+	return (TickType_t) (elapsed_ns() / TICK_PERIOD_NS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+	if (current_task == NULL) {
+		current_task = new_task("main");
+		if (current_task != NULL) {
+			current_task->thread = pthread_self();
+		}
+	}
+	return current_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+	pthread_mutex_lock(&task->lock);
+	task->notify_count++;
+	pthread_cond_signal(&task->notified);
+	pthread_mutex_unlock(&task->lock);
+	return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks)
+{
+	struct host_task *task = xTaskGetCurrentTaskHandle();
+	struct timespec until = deadline(ticks);
+	pthread_mutex_lock(&task->lock);
+	while (task->notify_count == 0) {
+		if (!wait_cond(&task->notified, &task->lock, &until, ticks)) {
+			break;
+		}
+	}
+	uint32_t count = task->notify_count;
+	if (count > 0) {
+		task->notify_count = clear_count_on_exit ? 0 : count - 1;
+	}
+	pthread_mutex_unlock(&task->lock);
+	return count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(
+	UBaseType_t max_count, UBaseType_t initial_count
+) {
+	if (max_count == 0 || initial_count > max_count) {
+		return NULL;
+	}
+	struct host_semaphore *semaphore = calloc(
+		1, sizeof(struct host_semaphore));
+	if (semaphore == NULL) {
+		return NULL;
+	}
+	pthread_mutex_init(&semaphore->lock, NULL);
+	init_cond(&semaphore->available);
+	semaphore->count = initial_count;
+	semaphore->max_count = max_count;
+	return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+	return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+	return xSemaphoreCreateCounting(1, 0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+	if (semaphore == NULL) {
+		return;
+	}
+	pthread_cond_destroy(&semaphore->available);
+	pthread_mutex_destroy(&semaphore->lock);
+	free(semaphore);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+	struct timespec until = deadline(ticks);
+	BaseType_t ret = pdTRUE;
+	pthread_mutex_lock(&semaphore->lock);
+	while (semaphore->count == 0) {
+		if (!wait_cond(&semaphore->available, &semaphore->lock,
+			&until, ticks)) {
+			ret = pdFALSE;
+			break;
+		}
+	}
+	if (ret == pdTRUE) {
+		semaphore->count--;
+	}
+	pthread_mutex_unlock(&semaphore->lock);
+	return ret;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+	BaseType_t ret = pdFALSE;
+	pthread_mutex_lock(&semaphore->lock);
+	if (semaphore->count < semaphore->max_count) {
+		semaphore->count++;
+		pthread_cond_signal(&semaphore->available);
+		ret = pdTRUE;
+	}
+	pthread_mutex_unlock(&semaphore->lock);
+	return ret;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore)
+{
+	pthread_mutex_lock(&semaphore->lock);
+	UBaseType_t count = semaphore->count;
+	pthread_mutex_unlock(&semaphore->lock);
+	return count;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+	if (length == 0) {
+		return NULL;
+	}
+	struct host_queue *queue = calloc(1, sizeof(struct host_queue));
+	if (queue == NULL) {
+		return NULL;
+	}
+	queue->items = calloc(length, item_size > 0 ? item_size : 1);
+	if (queue->items == NULL) {
+		free(queue);
+		return NULL;
+	}
+	pthread_mutex_init(&queue->lock, NULL);
+	init_cond(&queue->not_empty);
+	init_cond(&queue->not_full);
+	queue->length = length;
+	queue->item_size = item_size;
+	return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+	if (queue == NULL) {
+		return;
+	}
+	pthread_cond_destroy(&queue->not_full);
+	pthread_cond_destroy(&queue->not_empty);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue->items);
+	free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+	struct timespec until = deadline(ticks);
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count == queue->length) {
+		if (!wait_cond(&queue->not_full, &queue->lock, &until, ticks)) {
+			pthread_mutex_unlock(&queue->lock);
+			return errQUEUE_FULL;
+		}
+	}
+	UBaseType_t tail = (queue->head + queue->count) % queue->length;
+	memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+	queue->count++;
+	pthread_cond_signal(&queue->not_empty);
+	pthread_mutex_unlock(&queue->lock);
+	return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks)
+{
+	struct timespec until = deadline(ticks);
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count == 0) {
+		if (!wait_cond(&queue->not_empty, &queue->lock, &until, ticks)) {
+			pthread_mutex_unlock(&queue->lock);
+			return pdFALSE;
+		}
+	}
+	memcpy(buffer, queue->items + queue->head * queue->item_size,
+		queue->item_size);
+	queue->head = (queue->head + 1) % queue->length;
+	queue->count--;
+	pthread_cond_signal(&queue->not_full);
+	pthread_mutex_unlock(&queue->lock);
+	return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+	pthread_mutex_lock(&queue->lock);
+	UBaseType_t count = queue->count;
+	pthread_mutex_unlock(&queue->lock);
+	return count;
+}
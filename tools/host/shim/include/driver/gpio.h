@@ -0,0 +1,8 @@
+#ifndef DRIVER_GPIO_H
+#define DRIVER_GPIO_H
+
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+
+#endif // DRIVER_GPIO_H
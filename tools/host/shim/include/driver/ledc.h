@@ -0,0 +1,94 @@
+#ifndef DRIVER_LEDC_H
+#define DRIVER_LEDC_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+/*
+ * LEDC without the hardware: the configs are validated like the ESP32-C3
+ * driver and the duty is kept per channel.
+ */
+
+typedef enum {
+	LEDC_LOW_SPEED_MODE,
+	LEDC_SPEED_MODE_MAX,
+} ledc_mode_t;
+
+typedef enum {
+	LEDC_TIMER_0 = 0,
+	LEDC_TIMER_1,
+	LEDC_TIMER_2,
+	LEDC_TIMER_3,
+	LEDC_TIMER_MAX,
+} ledc_timer_t;
+
+typedef enum {
+	LEDC_CHANNEL_0 = 0,
+	LEDC_CHANNEL_1,
+	LEDC_CHANNEL_2,
+	LEDC_CHANNEL_3,
+	LEDC_CHANNEL_4,
+	LEDC_CHANNEL_5,
+	LEDC_CHANNEL_MAX,
+} ledc_channel_t;
+
+typedef enum {
+	LEDC_TIMER_1_BIT = 1,
+	LEDC_TIMER_8_BIT = 8,
+	LEDC_TIMER_10_BIT = 10,
+	LEDC_TIMER_13_BIT = 13,
+	LEDC_TIMER_14_BIT = 14,
+	LEDC_TIMER_BIT_MAX,
+} ledc_timer_bit_t;
+
+typedef enum {
+	LEDC_AUTO_CLK = 0,
+} ledc_clk_cfg_t;
+
+typedef enum {
+	LEDC_INTR_DISABLE = 0,
+	LEDC_INTR_FADE_END,
+} ledc_intr_type_t;
+
+typedef struct {
+	ledc_mode_t speed_mode;
+	ledc_timer_bit_t duty_resolution;
+	ledc_timer_t timer_num;
+	uint32_t freq_hz;
+	ledc_clk_cfg_t clk_cfg;
+} ledc_timer_config_t;
+
+typedef struct {
+	int gpio_num;
+	ledc_mode_t speed_mode;
+	ledc_channel_t channel;
+	ledc_intr_type_t intr_type;
+	ledc_timer_t timer_sel;
+	uint32_t duty;
+	int hpoint;
+} ledc_channel_config_t;
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf);
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *ledc_conf);
+
+/**
+ * @brief ledc_set_duty sets the duty, it takes effect after
+ * ledc_update_duty.
+ */
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel,
+	uint32_t duty);
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel);
+
+/**
+ * @brief ledc_get_duty gets the duty in effect.
+ *
+ * @return the duty, LEDC_ERR_DUTY if the channel is invalid.
+ */
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel);
+
+#define LEDC_ERR_DUTY (0xFFFFFFFF)
+
+#endif // DRIVER_LEDC_H
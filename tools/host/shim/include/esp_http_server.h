@@ -0,0 +1,315 @@
+#ifndef ESP_HTTP_SERVER_H
+#define ESP_HTTP_SERVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <sys/types.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+/*
+ * esp_http_server over POSIX sockets. One server task accepts and serves
+ * the sessions in turn like the IDF server, the sessions handed over by
+ * httpd_req_async_handler_begin are served by the other tasks.
+ */
+
+#define ESP_ERR_HTTPD_BASE              (0xb000)
+#define ESP_ERR_HTTPD_HANDLERS_FULL     (ESP_ERR_HTTPD_BASE +  1)
+#define ESP_ERR_HTTPD_HANDLER_EXISTS    (ESP_ERR_HTTPD_BASE +  2)
+#define ESP_ERR_HTTPD_INVALID_REQ       (ESP_ERR_HTTPD_BASE +  3)
+#define ESP_ERR_HTTPD_RESULT_TRUNC      (ESP_ERR_HTTPD_BASE +  4)
+#define ESP_ERR_HTTPD_RESP_HDR          (ESP_ERR_HTTPD_BASE +  5)
+#define ESP_ERR_HTTPD_RESP_SEND         (ESP_ERR_HTTPD_BASE +  6)
+#define ESP_ERR_HTTPD_ALLOC_MEM         (ESP_ERR_HTTPD_BASE +  7)
+#define ESP_ERR_HTTPD_TASK              (ESP_ERR_HTTPD_BASE +  8)
+
+#define HTTPD_RESP_USE_STRLEN -1
+
+#define HTTPD_SOCK_ERR_FAIL      -1
+#define HTTPD_SOCK_ERR_INVALID   -2
+#define HTTPD_SOCK_ERR_TIMEOUT   -3
+
+#define HTTPD_200      "200 OK"
+#define HTTPD_204      "204 No Content"
+#define HTTPD_207      "207 Multi-Status"
+#define HTTPD_400      "400 Bad Request"
+#define HTTPD_404      "404 Not Found"
+#define HTTPD_408      "408 Request Timeout"
+#define HTTPD_500      "500 Internal Server Error"
+
+#define HTTPD_TYPE_JSON   "application/json"
+#define HTTPD_TYPE_TEXT   "text/html"
+#define HTTPD_TYPE_OCTET  "application/octet-stream"
+
+typedef void *httpd_handle_t;
+
+/**
+ * @brief httpd_method_t follows the method numbers of http_parser.
+ */
+typedef enum {
+	HTTP_DELETE = 0,
+	HTTP_GET = 1,
+	HTTP_HEAD = 2,
+	HTTP_POST = 3,
+	HTTP_PUT = 4,
+	HTTP_OPTIONS = 6,
+	HTTP_PATCH = 28,
+} httpd_method_t;
+
+#define HTTP_ANY INT_MAX
+
+typedef enum {
+	HTTPD_500_INTERNAL_SERVER_ERROR = 0,
+	HTTPD_501_METHOD_NOT_IMPLEMENTED,
+	HTTPD_505_VERSION_NOT_SUPPORTED,
+	HTTPD_400_BAD_REQUEST,
+	HTTPD_401_UNAUTHORIZED,
+	HTTPD_403_FORBIDDEN,
+	HTTPD_404_NOT_FOUND,
+	HTTPD_405_METHOD_NOT_ALLOWED,
+	HTTPD_408_REQ_TIMEOUT,
+	HTTPD_411_LENGTH_REQUIRED,
+	HTTPD_414_URI_TOO_LONG,
+	HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE,
+	HTTPD_ERR_CODE_MAX,
+} httpd_err_code_t;
+
+typedef struct httpd_req {
+	httpd_handle_t handle;
+	int method;
+	const char uri[CONFIG_HTTPD_MAX_URI_LEN + 1];
+	size_t content_len;
+	void *aux;
+	void *user_ctx;
+	void *sess_ctx;
+	void (*free_ctx)(void *ctx);
+	bool ignore_sess_ctx_changes;
+} httpd_req_t;
+
+typedef struct httpd_uri {
+	const char *uri;
+	httpd_method_t method;
+	esp_err_t (*handler)(httpd_req_t *r);
+	void *user_ctx;
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+	bool is_websocket;
+	bool handle_ws_control_frames;
+	const char *supported_subprotocol;
+#endif
+} httpd_uri_t;
+
+typedef void (*httpd_free_ctx_fn_t)(void *ctx);
+typedef esp_err_t (*httpd_open_func_t)(httpd_handle_t hd, int sockfd);
+typedef void (*httpd_close_func_t)(httpd_handle_t hd, int sockfd);
+typedef bool (*httpd_uri_match_func_t)(
+	const char *reference_uri, const char *uri_to_match, size_t match_upto);
+typedef esp_err_t (*httpd_err_handler_func_t)(
+	httpd_req_t *req, httpd_err_code_t error);
+typedef void (*httpd_work_fn_t)(void *arg);
+
+/**
+ * @brief httpd_config_t is the IDF config, the task and core fields are
+ * accepted and ignored.
+ */
+typedef struct httpd_config {
+	unsigned task_priority;
+	size_t stack_size;
+	int core_id;
+	uint16_t server_port;
+	uint16_t ctrl_port;
+	uint16_t max_open_sockets;
+	uint16_t max_uri_handlers;
+	uint16_t max_resp_headers;
+	uint16_t backlog_conn;
+	bool lru_purge_enable;
+	uint16_t recv_wait_timeout;
+	uint16_t send_wait_timeout;
+	void *global_user_ctx;
+	httpd_free_ctx_fn_t global_user_ctx_free_fn;
+	void *global_transport_ctx;
+	httpd_free_ctx_fn_t global_transport_ctx_free_fn;
+	bool enable_so_linger;
+	int linger_timeout;
+	bool keep_alive_enable;
+	int keep_alive_idle;
+	int keep_alive_interval;
+	int keep_alive_count;
+	httpd_open_func_t open_fn;
+	httpd_close_func_t close_fn;
+	httpd_uri_match_func_t uri_match_fn;
+} httpd_config_t;
+
+#define HTTPD_DEFAULT_CONFIG() {                        \
+		.task_priority      = 5,                \
+		.stack_size         = 4096,             \
+		.core_id            = INT_MAX,          \
+		.server_port        = 80,               \
+		.ctrl_port          = 32768,            \
+		.max_open_sockets   = 7,                \
+		.max_uri_handlers   = 8,                \
+		.max_resp_headers   = 8,                \
+		.backlog_conn       = 5,                \
+		.lru_purge_enable   = false,            \
+		.recv_wait_timeout  = 5,                \
+		.send_wait_timeout  = 5,                \
+		.global_user_ctx = NULL,                \
+		.global_user_ctx_free_fn = NULL,        \
+		.global_transport_ctx = NULL,           \
+		.global_transport_ctx_free_fn = NULL,   \
+		.enable_so_linger = false,              \
+		.linger_timeout = 0,                    \
+		.keep_alive_enable = false,             \
+		.keep_alive_idle = 0,                   \
+		.keep_alive_interval = 0,               \
+		.keep_alive_count = 0,                  \
+		.open_fn = NULL,                        \
+		.close_fn = NULL,                       \
+		.uri_match_fn = NULL                    \
+	}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config);
+
+esp_err_t httpd_stop(httpd_handle_t handle);
+
+esp_err_t httpd_register_uri_handler(
+	httpd_handle_t handle, const httpd_uri_t *uri_handler);
+
+esp_err_t httpd_register_err_handler(httpd_handle_t handle,
+	httpd_err_code_t error, httpd_err_handler_func_t handler_fn);
+
+bool httpd_uri_match_wildcard(
+	const char *uri_template, const char *uri_to_match, size_t match_upto);
+
+/**
+ * @brief httpd_queue_work runs the work on the server task.
+ *
+ * @return ESP_OK if succeed.
+ * @return ESP_FAIL if the work queue is full.
+ */
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work,
+	void *arg);
+
+/**
+ * @brief httpd_sess_trigger_close closes the session on the server task.
+ *
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_NOT_FOUND if the socket has no session.
+ */
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd);
+
+int httpd_req_to_sockfd(httpd_req_t *r);
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len);
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field);
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field,
+	char *val, size_t val_size);
+
+esp_err_t httpd_req_get_cookie_val(httpd_req_t *req, const char *cookie_name,
+	char *val, size_t *val_size);
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r);
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf,
+	size_t buf_len);
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val,
+	size_t val_size);
+
+/**
+ * @brief httpd_req_async_handler_begin copies the request, the socket is
+ * not served by the server task until httpd_req_async_handler_complete.
+ */
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out);
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r);
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status);
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
+
+/**
+ * @brief httpd_resp_set_hdr adds a response header, the field and value
+ * are not copied and must be valid until the response is sent.
+ *
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_HTTPD_RESP_HDR if max_resp_headers is exceeded.
+ */
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field,
+	const char *value);
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len);
+
+/**
+ * @brief httpd_resp_send_chunk sends a chunk of the chunked response,
+ * a chunk of length 0 completes the response.
+ */
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf,
+	ssize_t buf_len);
+
+static inline esp_err_t httpd_resp_sendstr(httpd_req_t *r, const char *str)
+{
+	return httpd_resp_send(r, str,
+		str == NULL ? 0 : HTTPD_RESP_USE_STRLEN);
+}
+
+static inline esp_err_t httpd_resp_sendstr_chunk(
+	httpd_req_t *r, const char *str
+) {
+	return httpd_resp_send_chunk(r, str,
+		str == NULL ? 0 : HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error,
+	const char *msg);
+
+/**
+ * @brief httpd_send sends the raw bytes on the socket of the request.
+ *
+ * @return bytes sent, or HTTPD_SOCK_ERR_* if failed.
+ */
+int httpd_send(httpd_req_t *r, const char *buf, size_t buf_len);
+
+int httpd_socket_send(httpd_handle_t handle, int sockfd, const char *buf,
+	size_t buf_len, int flags);
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+
+/*
+ * Websocket frames like the IDF server: the handler of a websocket URI is
+ * called with HTTP_GET after the handshake, then with method 0 for each
+ * data frame. The close, ping and pong frames are answered by the server
+ * unless handle_ws_control_frames is set.
+ */
+
+typedef enum {
+	HTTPD_WS_TYPE_CONTINUE = 0x0,
+	HTTPD_WS_TYPE_TEXT = 0x1,
+	HTTPD_WS_TYPE_BINARY = 0x2,
+	HTTPD_WS_TYPE_CLOSE = 0x8,
+	HTTPD_WS_TYPE_PING = 0x9,
+	HTTPD_WS_TYPE_PONG = 0xA,
+} httpd_ws_type_t;
+
+typedef struct httpd_ws_frame {
+	bool final;
+	bool fragmented;
+	httpd_ws_type_t type;
+	uint8_t *payload;
+	size_t len;
+} httpd_ws_frame_t;
+
+/**
+ * @brief httpd_ws_recv_frame gets the length & type of the frame with
+ * max_len 0, or receives up to max_len bytes of the payload.
+ */
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt,
+	size_t max_len);
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt);
+
+#endif // CONFIG_HTTPD_WS_SUPPORT
+
+#endif // ESP_HTTP_SERVER_H
@@ -0,0 +1,34 @@
+#ifndef ESP_NETIF_H
+#define ESP_NETIF_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_event.h"
+
+typedef struct {
+	uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+	esp_ip4_addr_t ip;
+	esp_ip4_addr_t netmask;
+	esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+#define esp_ip4_addr_get_byte(ipaddr, idx) \
+	(((const uint8_t *) (&(ipaddr)->addr))[idx])
+#define esp_ip4_addr1(ipaddr) esp_ip4_addr_get_byte(ipaddr, 0)
+#define esp_ip4_addr2(ipaddr) esp_ip4_addr_get_byte(ipaddr, 1)
+#define esp_ip4_addr3(ipaddr) esp_ip4_addr_get_byte(ipaddr, 2)
+#define esp_ip4_addr4(ipaddr) esp_ip4_addr_get_byte(ipaddr, 3)
+
+#define IP2STR(ipaddr) esp_ip4_addr1(ipaddr), esp_ip4_addr2(ipaddr), \
+	esp_ip4_addr3(ipaddr), esp_ip4_addr4(ipaddr)
+#define IPSTR "%d.%d.%d.%d"
+
+/**
+ * @brief esp_netif_init does nothing, the host network is used as is.
+ */
+esp_err_t esp_netif_init(void);
+
+#endif // ESP_NETIF_H
@@ -0,0 +1,17 @@
+#ifndef ESP_ROM_CRC_H
+#define ESP_ROM_CRC_H
+
+#include <stdint.h>
+
+/**
+ * @brief esp_rom_crc32_le continues the little endian CRC32 (the zlib
+ * polynomial) over the buffer, starts with crc 0.
+ *
+ * @param crc
+ * @param buf
+ * @param len
+ * @return uint32_t
+ */
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
+
+#endif // ESP_ROM_CRC_H
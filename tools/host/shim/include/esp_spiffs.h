@@ -0,0 +1,32 @@
+#ifndef ESP_SPIFFS_H
+#define ESP_SPIFFS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/*
+ * SPIFFS on a host directory: esp_vfs_spiffs_register maps the base path
+ * to the directory set by host_set_spiffs_dir, the file calls of the
+ * sources are redirected by the linker (see tools/host/CMakeLists.txt).
+ */
+
+typedef struct {
+	const char *base_path;
+	const char *partition_label;
+	size_t max_files;
+	bool format_if_mount_failed;
+} esp_vfs_spiffs_conf_t;
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf);
+
+esp_err_t esp_vfs_spiffs_unregister(const char *partition_label);
+
+/**
+ * @brief esp_spiffs_info gets the partition size and the bytes used by
+ * the files in the directory.
+ */
+esp_err_t esp_spiffs_info(const char *partition_label,
+	size_t *total_bytes, size_t *used_bytes);
+
+#endif // ESP_SPIFFS_H
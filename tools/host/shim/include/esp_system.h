@@ -0,0 +1,28 @@
+#ifndef ESP_SYSTEM_H
+#define ESP_SYSTEM_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief esp_restart exits the host process, the supervisor (or the user)
+ * starts it again.
+ */
+void esp_restart(void) __attribute__((noreturn));
+
+/**
+ * @brief esp_get_free_heap_size gets the free bytes of the malloc arena.
+ *
+ * @return uint32_t
+ */
+uint32_t esp_get_free_heap_size(void);
+
+/**
+ * @brief esp_get_minimum_free_heap_size gets the lowest free heap size seen
+ * by esp_get_free_heap_size.
+ *
+ * @return uint32_t
+ */
+uint32_t esp_get_minimum_free_heap_size(void);
+
+#endif // ESP_SYSTEM_H
@@ -0,0 +1,60 @@
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef struct esp_timer *esp_timer_handle_t;
+
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum {
+	ESP_TIMER_TASK,
+	ESP_TIMER_MAX,
+} esp_timer_dispatch_t;
+
+typedef struct {
+	esp_timer_cb_t callback;
+	void *arg;
+	esp_timer_dispatch_t dispatch_method;
+	const char *name;
+	bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+/**
+ * @brief esp_timer_get_time gets the microseconds since the start.
+ *
+ * @return int64_t
+ */
+int64_t esp_timer_get_time(void);
+
+/**
+ * @brief esp_timer_create creates a timer, the callbacks of all timers run
+ * on one timer task.
+ *
+ * @param create_args
+ * @param out_handle [out]
+ * @return esp_err_t
+ */
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args,
+	esp_timer_handle_t *out_handle);
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+
+/**
+ * @brief esp_timer_stop stops the timer.
+ *
+ * @param timer
+ * @return ESP_OK if succeed.
+ * @return ESP_ERR_INVALID_STATE if the timer is not running.
+ */
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+
+bool esp_timer_is_active(esp_timer_handle_t timer);
+
+#endif // ESP_TIMER_H
@@ -0,0 +1,10 @@
+#ifndef ESP_VFS_H
+#define ESP_VFS_H
+
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+#define ESP_VFS_PATH_MAX 15
+
+#endif // ESP_VFS_H
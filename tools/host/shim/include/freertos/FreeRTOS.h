@@ -0,0 +1,44 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "sdkconfig.h"
+
+/*
+ * FreeRTOS on POSIX threads: the tasks are threads, the priorities are
+ * ignored and the ticks are counted from the monotonic clock.
+ */
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define configMAX_PRIORITIES 25
+#define portMAX_DELAY ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t) 1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) \
+	((TickType_t) (((uint64_t) (ms) * configTICK_RATE_HZ) / 1000U))
+#define tskIDLE_PRIORITY ((UBaseType_t) 0U)
+
+/**
+ * @brief portMUX_TYPE is a recursive mutex on the host, critical sections
+ * don't disable the scheduler.
+ */
+typedef struct {
+	pthread_mutex_t mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP }
+
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(&(mux)->mutex)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(&(mux)->mutex)
+
+#endif // FREERTOS_H
@@ -0,0 +1,26 @@
+#ifndef FREERTOS_QUEUE_H
+#define FREERTOS_QUEUE_H
+
+#include "FreeRTOS.h"
+
+typedef struct host_queue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+
+void vQueueDelete(QueueHandle_t queue);
+
+/**
+ * @brief xQueueSend copies the item to the back of the queue.
+ *
+ * @return pdTRUE if succeed, errQUEUE_FULL if the queue is still full
+ * after waiting.
+ */
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks);
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#define errQUEUE_FULL ((BaseType_t) 0)
+
+#endif // FREERTOS_QUEUE_H
@@ -0,0 +1,34 @@
+#ifndef FREERTOS_TASK_H
+#define FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+/**
+ * @brief xTaskCreate starts the task on a detached thread, the stack depth
+ * and the priority are ignored.
+ */
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char *name,
+	uint32_t stack_depth, void *parameters, UBaseType_t priority,
+	TaskHandle_t *created_task);
+
+/**
+ * @brief vTaskDelete ends the calling task, only NULL (self) is supported.
+ */
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+
+void vTaskDelayUntil(TickType_t *previous_wake_time, TickType_t time_increment);
+
+TickType_t xTaskGetTickCount(void);
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks);
+
+#endif // FREERTOS_TASK_H
@@ -0,0 +1,76 @@
+#ifndef HOST_H
+#define HOST_H
+
+/*
+ * host.h is included first into every source of the host build, it
+ * declares what newlib has and glibc may miss, and the host settings of
+ * the shims.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+#define HOST_NEED_STRLCPY 1
+size_t strlcpy(char *dst, const char *src, size_t size);
+size_t strlcat(char *dst, const char *src, size_t size);
+#endif
+
+/**
+ * @brief host_set_spiffs_dir sets the directory of the SPIFFS partition,
+ * it must be called before esp_vfs_spiffs_register.
+ *
+ * @param dir
+ */
+void host_set_spiffs_dir(const char *dir);
+
+/**
+ * @brief host_set_spiffs_open_delay sets the delay of opening a SPIFFS
+ * file, to model the object lookup of a full SPIFFS partition, 0 by default.
+ *
+ * @param us
+ */
+void host_set_spiffs_open_delay(uint32_t us);
+
+/**
+ * @brief host_set_timer_period_divisor divides the period of the periodic
+ * esp_timers started later, so the tests see minutes of the periodic work
+ * in seconds, 1 by default.
+ *
+ * @param divisor
+ */
+void host_set_timer_period_divisor(uint32_t divisor);
+
+/**
+ * @brief host_set_nvs_dir sets the directory of the NVS partition, it must
+ * be called before nvs_flash_init.
+ *
+ * @param dir
+ */
+void host_set_nvs_dir(const char *dir);
+
+/**
+ * @brief host_set_http_port overrides the server_port of the http servers
+ * started later, 0 keeps the configured port.
+ *
+ * @param port
+ */
+void host_set_http_port(uint16_t port);
+
+/**
+ * @brief host_set_udp_port overrides the port of the UDP sockets bound
+ * later, 0 keeps the configured port.
+ *
+ * @param port
+ */
+void host_set_udp_port(uint16_t port);
+
+/**
+ * @brief host_http_port gets the server port override, 0 if not set.
+ *
+ * @return uint16_t
+ */
+uint16_t host_http_port(void);
+
+#endif // HOST_H
@@ -0,0 +1,19 @@
+#ifndef LWIP_SOCKETS_H
+#define LWIP_SOCKETS_H
+
+// The host sockets have the same BSD API as lwip.
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+/**
+ * @brief host_lwip_bind binds the sockets of the sources to the loopback
+ * address, the soft AP address does not exist on the host. The port of the
+ * UDP sockets is replaced by the one set by host_set_udp_port.
+ */
+int host_lwip_bind(int fd, const struct sockaddr *addr, socklen_t length);
+#define bind host_lwip_bind
+
+#endif // LWIP_SOCKETS_H
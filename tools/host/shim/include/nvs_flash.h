@@ -0,0 +1,17 @@
+#ifndef NVS_FLASH_H
+#define NVS_FLASH_H
+
+#include "nvs.h"
+
+/**
+ * @brief nvs_flash_init creates the directory set by host_set_nvs_dir,
+ * every namespace is a sub directory and every key is a file.
+ */
+esp_err_t nvs_flash_init(void);
+
+/**
+ * @brief nvs_flash_erase removes all namespaces.
+ */
+esp_err_t nvs_flash_erase(void);
+
+#endif // NVS_FLASH_H
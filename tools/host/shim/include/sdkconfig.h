@@ -0,0 +1,21 @@
+/*
+ * Host build config, the values follow sdkconfig.esp32dev so the sources
+ * see the same limits as on the device.
+ */
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+#define CONFIG_IDF_TARGET "linux"
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_LOG_DEFAULT_LEVEL 3
+#define CONFIG_LOG_MAXIMUM_LEVEL 3
+#define CONFIG_HTTPD_MAX_REQ_HDR_LEN 512
+#define CONFIG_HTTPD_MAX_URI_LEN 512
+#define CONFIG_HTTPD_PURGE_BUF_LEN 32
+#define CONFIG_LWIP_MAX_SOCKETS 10
+#define CONFIG_LWIP_TCP_SND_BUF_DEFAULT 5744
+#define CONFIG_SPIFFS_OBJ_NAME_LEN 32
+
+#define CONFIG_HTTPD_WS_SUPPORT 1
+
+#endif // SDKCONFIG_H
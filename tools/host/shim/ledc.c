@@ -0,0 +1,96 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <driver/ledc.h>
+
+#define TAG "ledc"
+
+/**
+ * @brief private LEDC state, the duty is set by any task and read by the
+ * API handlers.
+ */
+static struct {
+	bool timer_configured[LEDC_TIMER_MAX];
+	uint32_t timer_bits[LEDC_TIMER_MAX];
+	bool channel_configured[LEDC_CHANNEL_MAX];
+	ledc_timer_t channel_timer[LEDC_CHANNEL_MAX];
+	_Atomic uint32_t duty[LEDC_CHANNEL_MAX];     // duty in effect
+	_Atomic uint32_t duty_set[LEDC_CHANNEL_MAX]; // duty set, not updated
+} ledc;
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf)
+{
+	if (timer_conf == NULL || timer_conf->speed_mode >= LEDC_SPEED_MODE_MAX ||
+		timer_conf->timer_num >= LEDC_TIMER_MAX ||
+		timer_conf->duty_resolution == 0 ||
+		timer_conf->duty_resolution >= LEDC_TIMER_BIT_MAX ||
+		timer_conf->freq_hz == 0) {
+		ESP_LOGE(TAG, "ledc_timer_config: invalid param");
+		return ESP_ERR_INVALID_ARG;
+	}
+	ledc.timer_configured[timer_conf->timer_num] = true;
+	ledc.timer_bits[timer_conf->timer_num] = timer_conf->duty_resolution;
+	return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *ledc_conf)
+{
+	if (ledc_conf == NULL || ledc_conf->speed_mode >= LEDC_SPEED_MODE_MAX ||
+		ledc_conf->channel >= LEDC_CHANNEL_MAX ||
+		ledc_conf->timer_sel >= LEDC_TIMER_MAX ||
+		ledc_conf->gpio_num < 0) {
+		ESP_LOGE(TAG, "ledc_channel_config: invalid param");
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (!ledc.timer_configured[ledc_conf->timer_sel]) {
+		ESP_LOGE(TAG, "ledc_channel_config: timer %d not configured",
+			ledc_conf->timer_sel);
+		return ESP_ERR_INVALID_STATE;
+	}
+	ledc.channel_configured[ledc_conf->channel] = true;
+	ledc.channel_timer[ledc_conf->channel] = ledc_conf->timer_sel;
+	atomic_store(&ledc.duty_set[ledc_conf->channel], ledc_conf->duty);
+	atomic_store(&ledc.duty[ledc_conf->channel], ledc_conf->duty);
+	return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(
+	ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty
+) {
+	if (speed_mode >= LEDC_SPEED_MODE_MAX || channel >= LEDC_CHANNEL_MAX ||
+		!ledc.channel_configured[channel]) {
+		ESP_LOGE(TAG, "ledc_set_duty: invalid channel %d", channel);
+		return ESP_ERR_INVALID_ARG;
+	}
+	uint32_t bits = ledc.timer_bits[ledc.channel_timer[channel]];
+	if (duty > (1U << bits)) {
+		ESP_LOGE(TAG, "ledc_set_duty: duty %u out of range",
+			(unsigned int) duty);
+		return ESP_ERR_INVALID_ARG;
+	}
+	atomic_store(&ledc.duty_set[channel], duty);
+	return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+	if (speed_mode >= LEDC_SPEED_MODE_MAX || channel >= LEDC_CHANNEL_MAX ||
+		!ledc.channel_configured[channel]) {
+		ESP_LOGE(TAG, "ledc_update_duty: invalid channel %d", channel);
+		return ESP_ERR_INVALID_ARG;
+	}
+	uint32_t duty = atomic_load(&ledc.duty_set[channel]);
+	atomic_store(&ledc.duty[channel], duty);
+	ESP_LOGD(TAG, "channel [%d] duty [%u]", channel, (unsigned int) duty);
+	return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+	if (speed_mode >= LEDC_SPEED_MODE_MAX || channel >= LEDC_CHANNEL_MAX) {
+		return LEDC_ERR_DUTY;
+	}
+	return atomic_load(&ledc.duty[channel]);
+}
@@ -0,0 +1,31 @@
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "host.h"
+
+int host_lwip_bind(int fd, const struct sockaddr *addr, socklen_t length);
+
+static uint16_t udp_port_override;
+
+void host_set_udp_port(uint16_t port)
+{
+	udp_port_override = port;
+}
+
+int host_lwip_bind(int fd, const struct sockaddr *addr, socklen_t length)
+{
+	if (addr == NULL || addr->sa_family != AF_INET ||
+		length < sizeof(struct sockaddr_in)) {
+		return bind(fd, addr, length);
+	}
+	struct sockaddr_in in = *(const struct sockaddr_in *) addr;
+	in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int type = 0;
+	socklen_t type_length = sizeof(type);
+	if (udp_port_override != 0 &&
+		getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &type_length) == 0 &&
+		type == SOCK_DGRAM) {
+		in.sin_port = htons(udp_port_override);
+	}
+	return bind(fd, (const struct sockaddr *) &in, sizeof(in));
+}
@@ -0,0 +1,301 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+
+#include "host.h"
+
+#define TAG "nvs"
+
+#define NVS_MAX_HANDLES 8
+// Size of the nvs partition in partitions.csv.
+#define NVS_MAX_BLOB_SIZE 0x6000
+
+struct nvs_entry {
+	bool used;
+	nvs_open_mode_t mode;
+	char namespace_name[NVS_KEY_NAME_MAX_SIZE];
+};
+
+/**
+ * @brief private NVS state, the partition is a directory with a sub
+ * directory per namespace and a file per key.
+ */
+static struct {
+	pthread_mutex_t lock;
+	char dir[256];
+	bool initialized;
+	struct nvs_entry handles[NVS_MAX_HANDLES];
+} nvs = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.dir = "nvs",
+};
+
+void host_set_nvs_dir(const char *dir)
+{
+	strlcpy(nvs.dir, dir, sizeof(nvs.dir));
+}
+
+static bool nvs_valid_name(const char *name)
+{
+	if (name == NULL || name[0] == '\0') {
+		return false;
+	}
+	// The names become file names.
+	return strchr(name, '/') == NULL && strcmp(name, ".") != 0 &&
+		strcmp(name, "..") != 0;
+}
+
+static esp_err_t nvs_path(
+	char *path, size_t size, const char *namespace_name, const char *key
+) {
+	int n = key == NULL ?
+		snprintf(path, size, "%s/%s", nvs.dir, namespace_name) :
+		snprintf(path, size, "%s/%s/%s", nvs.dir, namespace_name, key);
+	return n < 0 || (size_t) n >= size ? ESP_ERR_NVS_INVALID_NAME : ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+	if (mkdir(nvs.dir, 0755) != 0 && errno != EEXIST) {
+		ESP_LOGE(TAG, "nvs_flash_init: mkdir %s failed: %d",
+			nvs.dir, errno);
+		return ESP_FAIL;
+	}
+	nvs.initialized = true;
+	return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+	DIR *dir = opendir(nvs.dir);
+	if (dir == NULL) {
+		return errno == ENOENT ? ESP_OK : ESP_FAIL;
+	}
+	char path[512];
+	struct dirent *ns;
+	while ((ns = readdir(dir)) != NULL) {
+		if (!nvs_valid_name(ns->d_name) ||
+			nvs_path(path, sizeof(path), ns->d_name, NULL) != ESP_OK) {
+			continue;
+		}
+		DIR *keys = opendir(path);
+		struct dirent *key;
+		while (keys != NULL && (key = readdir(keys)) != NULL) {
+			char file[768];
+			if (nvs_valid_name(key->d_name) &&
+				(size_t) snprintf(file, sizeof(file), "%s/%s", path,
+					key->d_name) < sizeof(file)) {
+				unlink(file);
+			}
+		}
+		if (keys != NULL) {
+			closedir(keys);
+		}
+		rmdir(path);
+	}
+	closedir(dir);
+	return ESP_OK;
+}
+
+static struct nvs_entry *nvs_get_entry(nvs_handle_t handle)
+{
+	if (handle == 0 || handle > NVS_MAX_HANDLES ||
+		!nvs.handles[handle - 1].used) {
+		return NULL;
+	}
+	return &nvs.handles[handle - 1];
+}
+
+esp_err_t nvs_open(
+	const char *namespace_name, nvs_open_mode_t open_mode,
+	nvs_handle_t *out_handle
+) {
+	if (!nvs.initialized) {
+		return ESP_ERR_NVS_NOT_INITIALIZED;
+	}
+	if (!nvs_valid_name(namespace_name) || out_handle == NULL) {
+		return ESP_ERR_NVS_INVALID_NAME;
+	}
+	if (strlen(namespace_name) >= NVS_KEY_NAME_MAX_SIZE) {
+		return ESP_ERR_NVS_KEY_TOO_LONG;
+	}
+	char path[512];
+	esp_err_t ret = nvs_path(path, sizeof(path), namespace_name, NULL);
+	if (ret != ESP_OK) {
+		return ret;
+	}
+	struct stat s;
+	if (stat(path, &s) != 0) {
+		if (open_mode == NVS_READONLY) {
+			return ESP_ERR_NVS_NOT_FOUND;
+		}
+		if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+			ESP_LOGE(TAG, "nvs_open: mkdir %s failed: %d", path, errno);
+			return ESP_FAIL;
+		}
+	}
+
+	pthread_mutex_lock(&nvs.lock);
+	for (int i = 0; i < NVS_MAX_HANDLES; i++) {
+		struct nvs_entry *entry = &nvs.handles[i];
+		if (!entry->used) {
+			entry->used = true;
+			entry->mode = open_mode;
+			strlcpy(entry->namespace_name, namespace_name,
+				sizeof(entry->namespace_name));
+			*out_handle = i + 1;
+			pthread_mutex_unlock(&nvs.lock);
+			return ESP_OK;
+		}
+	}
+	pthread_mutex_unlock(&nvs.lock);
+	return ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+	pthread_mutex_lock(&nvs.lock);
+	struct nvs_entry *entry = nvs_get_entry(handle);
+	if (entry != NULL) {
+		entry->used = false;
+	}
+	pthread_mutex_unlock(&nvs.lock);
+}
+
+/**
+ * @brief nvs_key_path gets the file of the key.
+ */
+static esp_err_t nvs_key_path(
+	nvs_handle_t handle, const char *key, bool write,
+	char *path, size_t size
+) {
+	pthread_mutex_lock(&nvs.lock);
+	struct nvs_entry *entry = nvs_get_entry(handle);
+	if (entry == NULL) {
+		pthread_mutex_unlock(&nvs.lock);
+		return ESP_ERR_NVS_INVALID_HANDLE;
+	}
+	if (write && entry->mode == NVS_READONLY) {
+		pthread_mutex_unlock(&nvs.lock);
+		return ESP_ERR_NVS_READ_ONLY;
+	}
+	char namespace_name[NVS_KEY_NAME_MAX_SIZE];
+	strlcpy(namespace_name, entry->namespace_name, sizeof(namespace_name));
+	pthread_mutex_unlock(&nvs.lock);
+
+	if (!nvs_valid_name(key)) {
+		return ESP_ERR_NVS_INVALID_NAME;
+	}
+	if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+		return ESP_ERR_NVS_KEY_TOO_LONG;
+	}
+	return nvs_path(path, size, namespace_name, key);
+}
+
+esp_err_t nvs_get_blob(
+	nvs_handle_t handle, const char *key, void *out_value, size_t *length
+) {
+	if (length == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	char path[512];
+	esp_err_t ret = nvs_key_path(handle, key, false, path, sizeof(path));
+	if (ret != ESP_OK) {
+		return ret;
+	}
+	FILE *fd = fopen(path, "rb");
+	if (fd == NULL) {
+		return ESP_ERR_NVS_NOT_FOUND;
+	}
+	fseek(fd, 0, SEEK_END);
+	long size = ftell(fd);
+	fseek(fd, 0, SEEK_SET);
+	if (size < 0) {
+		fclose(fd);
+		return ESP_FAIL;
+	}
+	if (out_value == NULL) {
+		// Only the length is requested.
+		*length = size;
+		fclose(fd);
+		return ESP_OK;
+	}
+	if (*length < (size_t) size) {
+		*length = size;
+		fclose(fd);
+		return ESP_ERR_NVS_INVALID_LENGTH;
+	}
+	size_t n = fread(out_value, 1, size, fd);
+	fclose(fd);
+	if (n != (size_t) size) {
+		return ESP_FAIL;
+	}
+	*length = size;
+	return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(
+	nvs_handle_t handle, const char *key, const void *value, size_t length
+) {
+	if (value == NULL && length > 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (length > NVS_MAX_BLOB_SIZE) {
+		return ESP_ERR_NVS_VALUE_TOO_LONG;
+	}
+	char path[512];
+	esp_err_t ret = nvs_key_path(handle, key, true, path, sizeof(path));
+	if (ret != ESP_OK) {
+		return ret;
+	}
+	// The old value is kept if the write is interrupted, like NVS.
+	char tmp[520];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	FILE *fd = fopen(tmp, "wb");
+	if (fd == NULL) {
+		ESP_LOGE(TAG, "nvs_set_blob: open %s failed: %d", tmp, errno);
+		return ESP_FAIL;
+	}
+	bool ok = fwrite(value, 1, length, fd) == length;
+	ok = fflush(fd) == 0 && ok;
+	ok = fsync(fileno(fd)) == 0 && ok;
+	ok = fclose(fd) == 0 && ok;
+	if (!ok || rename(tmp, path) != 0) {
+		ESP_LOGE(TAG, "nvs_set_blob: write %s failed: %d", path, errno);
+		unlink(tmp);
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+	char path[512];
+	esp_err_t ret = nvs_key_path(handle, key, true, path, sizeof(path));
+	if (ret != ESP_OK) {
+		return ret;
+	}
+	if (unlink(path) != 0) {
+		return errno == ENOENT ? ESP_ERR_NVS_NOT_FOUND : ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+	pthread_mutex_lock(&nvs.lock);
+	struct nvs_entry *entry = nvs_get_entry(handle);
+	pthread_mutex_unlock(&nvs.lock);
+	return entry == NULL ? ESP_ERR_NVS_INVALID_HANDLE : ESP_OK;
+}
@@ -0,0 +1,193 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_spiffs.h>
+#include <esp_vfs.h>
+
+#include "host.h"
+
+#define TAG "SPIFFS"
+
+// Size of the storage partition in partitions.csv.
+#define SPIFFS_PARTITION_SIZE (2 * 1024 * 1024)
+
+/**
+ * @brief private VFS state, one SPIFFS partition is mounted at the base
+ * path and its files are in the host directory.
+ */
+static struct {
+	char dir[PATH_MAX];
+	char base_path[ESP_VFS_PATH_MAX + 1];
+	size_t base_length;
+	bool mounted;
+	uint32_t open_delay_us;
+} vfs = {
+	.dir = "spiffs",
+};
+
+void host_set_spiffs_dir(const char *dir)
+{
+	strlcpy(vfs.dir, dir, sizeof(vfs.dir));
+}
+
+void host_set_spiffs_open_delay(uint32_t us)
+{
+	vfs.open_delay_us = us;
+}
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf)
+{
+	if (conf == NULL || conf->base_path == NULL ||
+		strlen(conf->base_path) > ESP_VFS_PATH_MAX) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (vfs.mounted) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	struct stat s;
+	if (stat(vfs.dir, &s) != 0 || !S_ISDIR(s.st_mode)) {
+		ESP_LOGE(TAG, "spiffs directory %s not found", vfs.dir);
+		return ESP_ERR_NOT_FOUND;
+	}
+	strlcpy(vfs.base_path, conf->base_path, sizeof(vfs.base_path));
+	vfs.base_length = strlen(vfs.base_path);
+	vfs.mounted = true;
+	ESP_LOGI(TAG, "mounted %s at %s", vfs.dir, vfs.base_path);
+	return ESP_OK;
+}
+
+esp_err_t esp_vfs_spiffs_unregister(const char *partition_label)
+{
+	if (!vfs.mounted) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	vfs.mounted = false;
+	return ESP_OK;
+}
+
+static size_t spiffs_used;
+
+static int spiffs_count_file(
+	const char *path, const struct stat *s, int type, struct FTW *ftw
+) {
+	if (type == FTW_F) {
+		spiffs_used += s->st_size;
+	}
+	return 0;
+}
+
+esp_err_t esp_spiffs_info(
+	const char *partition_label, size_t *total_bytes, size_t *used_bytes
+) {
+	if (!vfs.mounted) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	// Only called by init_storage, the counter is not shared.
+	spiffs_used = 0;
+	if (nftw(vfs.dir, spiffs_count_file, 8, FTW_PHYS) != 0) {
+		return ESP_FAIL;
+	}
+	*total_bytes = SPIFFS_PARTITION_SIZE;
+	*used_bytes = spiffs_used;
+	return ESP_OK;
+}
+
+/**
+ * @brief vfs_map maps the path under the base path into the directory,
+ * other paths are not changed. The SPIFFS object name is the path after
+ * the base path, it must be shorter than CONFIG_SPIFFS_OBJ_NAME_LEN.
+ *
+ * @return the host path, NULL if the name is too long.
+ */
+static const char *vfs_map(const char *path, char *buffer, size_t size)
+{
+	if (!vfs.mounted || path == NULL ||
+		strncmp(path, vfs.base_path, vfs.base_length) != 0 ||
+		path[vfs.base_length] != '/') {
+		return path;
+	}
+	const char *name = path + vfs.base_length;
+	int n = snprintf(buffer, size, "%s%s", vfs.dir, name);
+	if (strlen(name) >= CONFIG_SPIFFS_OBJ_NAME_LEN || n < 0 ||
+		(size_t) n >= size) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	return buffer;
+}
+
+/**
+ * @brief vfs_open_delay sleeps the open delay if the path is mapped.
+ */
+static void vfs_open_delay(const char *path, const char *mapped)
+{
+	if (vfs.open_delay_us > 0 && mapped != NULL && mapped != path) {
+		usleep(vfs.open_delay_us);
+	}
+}
+
+/*
+ * The file calls of all objects are redirected here by the linker option
+ * --wrap, see tools/host/CMakeLists.txt.
+ */
+
+FILE *__real_fopen(const char *path, const char *mode);
+int __real_open(const char *path, int flags, ...);
+int __real_stat(const char *path, struct stat *s);
+int __real_rename(const char *from, const char *to);
+int __real_unlink(const char *path);
+
+FILE *__wrap_fopen(const char *path, const char *mode)
+{
+	char buffer[PATH_MAX];
+	const char *mapped = vfs_map(path, buffer, sizeof(buffer));
+	vfs_open_delay(path, mapped);
+	return mapped != NULL ? __real_fopen(mapped, mode) : NULL;
+}
+
+int __wrap_open(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	if (flags & (O_CREAT | O_TMPFILE)) {
+		va_list args;
+		va_start(args, flags);
+		mode = va_arg(args, mode_t);
+		va_end(args);
+	}
+	char buffer[PATH_MAX];
+	const char *mapped = vfs_map(path, buffer, sizeof(buffer));
+	vfs_open_delay(path, mapped);
+	return mapped != NULL ? __real_open(mapped, flags, mode) : -1;
+}
+
+int __wrap_stat(const char *path, struct stat *s)
+{
+	char buffer[PATH_MAX];
+	path = vfs_map(path, buffer, sizeof(buffer));
+	return path != NULL ? __real_stat(path, s) : -1;
+}
+
+int __wrap_rename(const char *from, const char *to)
+{
+	char from_buffer[PATH_MAX], to_buffer[PATH_MAX];
+	from = vfs_map(from, from_buffer, sizeof(from_buffer));
+	to = vfs_map(to, to_buffer, sizeof(to_buffer));
+	return from != NULL && to != NULL ? __real_rename(from, to) : -1;
+}
+
+int __wrap_unlink(const char *path)
+{
+	char buffer[PATH_MAX];
+	path = vfs_map(path, buffer, sizeof(buffer));
+	return path != NULL ? __real_unlink(path) : -1;
+}
@@ -0,0 +1,40 @@
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_event.h>
+#include <esp_netif.h>
+
+#include "wifi.h"
+
+#define TAG "WIFI"
+
+/*
+ * The host has no radio: src/wifi.c is replaced by this file, the soft AP
+ * is reported as started and the clients reach the server on the host
+ * network.
+ */
+
+esp_err_t esp_netif_init(void)
+{
+	return ESP_OK;
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+	return ESP_OK;
+}
+
+esp_err_t init_controller_wifi_softap(struct config *config)
+{
+	if (config == NULL) {
+		ESP_LOGE(TAG, "init_controller_wifi_softap: invalid param");
+		return ESP_FAIL;
+	}
+	ESP_LOGI(TAG, "host build, soft AP [%s] not started",
+		config->wifi.ssid);
+	return ESP_OK;
+}
+
+int controller_wifi_station_count()
+{
+	return 0;
+}
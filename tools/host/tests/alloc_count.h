@@ -0,0 +1,19 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+/*
+ * Heap allocation counter of the host tests and benchmarks. The malloc,
+ * calloc and realloc calls of the firmware and the shims are wrapped by the
+ * linker, see target_alloc_count in CMakeLists.txt. The allocations inside
+ * the C library are not counted.
+ */
+
+#include <stddef.h>
+
+/**
+ * @brief alloc_count gets the number of the heap allocations since the
+ * program started, a realloc is counted as an allocation.
+ */
+size_t alloc_count(void);
+
+#endif // ALLOC_COUNT_H
@@ -0,0 +1,91 @@
+/*
+ * Boot to config ready of the two paths of persist_load_config: the binary
+ * snapshot in NVS, and the fallback which parses the config file and
+ * rebuilds the snapshot. The snapshot is erased before each boot of the
+ * fallback path, outside of the measured time.
+ *
+ * The NVS and SPIFFS shims are files in directories, so the numbers
+ * compare the work of the two paths on the host, not the flash timings of
+ * a device.
+ *
+ * Usage: bench_config_boot [boots]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <esp_log.h>
+#include <nvs.h>
+
+#include "config.h"
+#include "persist.h"
+#include "test.h"
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static bool erase_snapshot(void)
+{
+	nvs_handle_t handle;
+	if (nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+		return false;
+	}
+	esp_err_t ret = nvs_erase_key(handle, CONFIG_NVS_KEY);
+	if (ret == ESP_OK || ret == ESP_ERR_NVS_NOT_FOUND) {
+		ret = nvs_commit(handle);
+	}
+	nvs_close(handle);
+	return ret == ESP_OK;
+}
+
+static bool run(const char *name, bool snapshot, long boots)
+{
+	double total = 0;
+	double max = 0;
+	for (long i = 0; i < boots; i++) {
+		if (!snapshot && !erase_snapshot()) {
+			fprintf(stderr, "erase snapshot failed\n");
+			return false;
+		}
+		double start = now_us();
+		struct config *config = persist_load_config();
+		double us = now_us() - start;
+		if (config == NULL) {
+			fprintf(stderr, "%s: load config failed\n", name);
+			return false;
+		}
+		release_config(&config);
+		total += us;
+		max = us > max ? us : max;
+	}
+	printf("%-20s %6ld boots %10.1f us/boot %10.1f us max\n",
+		name, boots, total / boots, max);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	long boots = argc > 1 ? atol(argv[1]) : 1000;
+	if (boots <= 0) {
+		fprintf(stderr, "Usage: %s [boots]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	test_init_storage();
+	// The fallback path warns about the missing snapshot on every boot.
+	esp_log_level_set("*", ESP_LOG_ERROR);
+	if (!test_copy_file(TEST_DATA_DIR "/config/config.cfg.default",
+			CONFIG_FILE)) {
+		fprintf(stderr, "copy config.cfg.default failed\n");
+		return EXIT_FAILURE;
+	}
+	// The first boot builds the snapshot.
+	if (!run("config file", false, boots) ||
+		!run("nvs snapshot", true, boots)) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
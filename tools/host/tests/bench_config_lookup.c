@@ -0,0 +1,110 @@
+/*
+ * Microbenchmark of the config key lookup: config_schema_lookup hashes the
+ * key into config_schema_slots and verifies it with a single strcmp, the
+ * linear scan (the lookup before the slots table) compares the key with
+ * every schema key in order.
+ *
+ * Usage: bench_config_lookup [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+
+// The keys of a config file, and a few keys which are not config keys.
+static const char *lookup_keys[] = {
+	CONFIG_KEY_PWM_FAN_CHANNEL,
+	CONFIG_KEY_PWM_FAN_FREQUENCY,
+	CONFIG_KEY_PWM_FAN_GPIO,
+	CONFIG_KEY_PWM_FAN_DUTY,
+	CONFIG_KEY_PWM_FAN_DUTY_MIN,
+	CONFIG_KEY_PWM_FAN_DUTY_MAX,
+	CONFIG_KEY_PWM_MOS_CHANNEL,
+	CONFIG_KEY_PWM_MOS_FREQUENCY,
+	CONFIG_KEY_PWM_MOS_GPIO,
+	CONFIG_KEY_PWM_MOS_DUTY,
+	CONFIG_KEY_PWM_MOS_DUTY_MIN,
+	CONFIG_KEY_PWM_MOS_DUTY_MAX,
+	CONFIG_KEY_WIFI_SSID,
+	CONFIG_KEY_WIFI_PASSWORD,
+	CONFIG_KEY_WIFI_CHANNEL,
+	CONFIG_KEY_DHCPS_IP,
+	CONFIG_KEY_DHCPS_NETMASK,
+	CONFIG_KEY_DHCPS_AS_ROUTER,
+	"pwm_fan_duty_mid",
+	"dhcps_gateway",
+};
+
+#define LOOKUP_KEYS (sizeof(lookup_keys) / sizeof(lookup_keys[0]))
+
+static volatile size_t sink;
+
+static const struct config_schema *linear_lookup(const char *key)
+{
+	for (int i = 0; i < CONFIG_ID_MAX; i++) {
+		const struct config_schema *schema = config_schema_get(i);
+		if (strcmp(schema->key, key) == 0) {
+			return schema;
+		}
+	}
+	return NULL;
+}
+
+static void bench_schema_lookup(void)
+{
+	for (size_t i = 0; i < LOOKUP_KEYS; i++) {
+		sink += config_schema_lookup(lookup_keys[i]) != NULL;
+	}
+}
+
+static void bench_linear_lookup(void)
+{
+	for (size_t i = 0; i < LOOKUP_KEYS; i++) {
+		sink += linear_lookup(lookup_keys[i]) != NULL;
+	}
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(const char *name, void (*fn)(void), long iterations)
+{
+	// Warm up the caches.
+	for (long i = 0; i < iterations / 10 + 1; i++) {
+		fn();
+	}
+	double start = now_ns();
+	for (long i = 0; i < iterations; i++) {
+		fn();
+	}
+	double ns = (now_ns() - start) / iterations;
+	printf("%-24s %10ld iterations %10.1f ns/key\n",
+		name, iterations, ns / LOOKUP_KEYS);
+}
+
+int main(int argc, char **argv)
+{
+	long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+	if (iterations <= 0) {
+		fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	// Both lookups must agree, or the numbers compare different work.
+	for (size_t i = 0; i < LOOKUP_KEYS; i++) {
+		if (config_schema_lookup(lookup_keys[i]) !=
+			linear_lookup(lookup_keys[i])) {
+			fprintf(stderr, "lookup mismatch [%s]\n", lookup_keys[i]);
+			return EXIT_FAILURE;
+		}
+	}
+	printf("%zu keys\n", LOOKUP_KEYS);
+	run("config_schema_lookup", bench_schema_lookup, iterations);
+	run("linear scan", bench_linear_lookup, iterations);
+	return EXIT_SUCCESS;
+}
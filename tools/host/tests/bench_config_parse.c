@@ -0,0 +1,93 @@
+/*
+ * Microbenchmark of the config file parsing at boot: new_config_by_load_file
+ * reads the file through a fixed stack buffer and parses the lines in
+ * place. The parse time and the heap allocations per parse are reported,
+ * for the default config file and for a long file of the same lines, which
+ * refills the read buffer many times.
+ *
+ * Usage: bench_config_parse [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "alloc_count.h"
+#include "config.h"
+#include "test.h"
+
+// The default config file repeated, the last value of a key wins.
+#define LONG_FILE_REPEAT 16
+
+static char config_data[64 * 1024];
+
+static volatile size_t sink;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static bool parse(void)
+{
+	struct config *config = new_config_by_load_file();
+	if (config == NULL) {
+		return false;
+	}
+	sink += config->pwm_fan.duty;
+	release_config(&config);
+	return true;
+}
+
+static bool run(const char *name, size_t size, long iterations)
+{
+	if (!test_write_file(CONFIG_FILE, config_data, size)) {
+		fprintf(stderr, "write %s failed\n", CONFIG_FILE);
+		return false;
+	}
+	// Warm up the caches.
+	for (long i = 0; i < iterations / 10 + 1; i++) {
+		if (!parse()) {
+			fprintf(stderr, "parse %s failed\n", CONFIG_FILE);
+			return false;
+		}
+	}
+	size_t allocs = alloc_count();
+	double start = now_ns();
+	for (long i = 0; i < iterations; i++) {
+		parse();
+	}
+	double ns = (now_ns() - start) / iterations;
+	allocs = alloc_count() - allocs;
+	printf("%-24s %6zu bytes %8ld iterations %10.1f ns/parse "
+		"%8.1f MB/s %5.1f allocs/parse\n",
+		name, size, iterations, ns, size / ns * 1e3,
+		(double) allocs / iterations);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	long iterations = argc > 1 ? atol(argv[1]) : 100000;
+	if (iterations <= 0) {
+		fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	test_init_storage();
+	long size = test_read_file(TEST_DATA_DIR "/config/config.cfg.default",
+		config_data, sizeof(config_data) / LONG_FILE_REPEAT);
+	if (size <= 0) {
+		fprintf(stderr, "read config.cfg.default failed\n");
+		return EXIT_FAILURE;
+	}
+	for (int i = 1; i < LONG_FILE_REPEAT; i++) {
+		memcpy(config_data + i * size, config_data, size);
+	}
+	if (!run("config.cfg.default", size, iterations) ||
+		!run("config.cfg.default x16", size * LONG_FILE_REPEAT,
+			iterations / LONG_FILE_REPEAT + 1)) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
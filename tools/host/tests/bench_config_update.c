@@ -0,0 +1,117 @@
+/*
+ * Heap churn of the settings updates: the config is one fixed-size block,
+ * an update is staged into the staged copy of the controller and a reset
+ * copies the default config into the same block. The heap allocations and
+ * the glibc heap state are reported before and after the updates, the
+ * number of the free chunks shows the fragmentation left by the updates.
+ *
+ * Usage: bench_config_update [updates]
+ */
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "alloc_count.h"
+#include "config.h"
+#include "controller.h"
+#include "persist.h"
+#include "test.h"
+
+// Every RESET_INTERVAL-th update is a reset to the default config.
+#define RESET_INTERVAL 100
+
+struct heap_state {
+	size_t allocs;
+	size_t in_use;     // bytes of the allocated chunks
+	size_t free;       // bytes of the free chunks
+	size_t free_chunks;
+};
+
+static void heap_state(struct heap_state *state)
+{
+	struct mallinfo2 info = mallinfo2();
+	state->allocs = alloc_count();
+	state->in_use = info.uordblks;
+	state->free = info.fordblks;
+	state->free_chunks = info.ordblks;
+}
+
+static void print_heap_state(const char *name, const struct heap_state *s)
+{
+	printf("%-8s allocs %8zu in use %8zu bytes free %8zu bytes "
+		"in %5zu chunks\n",
+		name, s->allocs, s->in_use, s->free, s->free_chunks);
+}
+
+static esp_err_t stage_update(struct config *staged, void *ctx)
+{
+	long i = *(long *) ctx;
+	char value[CONFIG_WIFI_SSID_MAX_LEN + 1];
+	snprintf(value, sizeof(value), "%ld", i % 256);
+	if (config_parse_value(staged, CONFIG_KEY_PWM_FAN_DUTY, value) !=
+		ESP_OK) {
+		return ESP_FAIL;
+	}
+	// Strings of different lengths, a heap cloned string would move.
+	snprintf(value, sizeof(value), "fan%.*s", (int) (i % 24),
+		"_controller_controller_controller");
+	return config_parse_value(staged, CONFIG_KEY_WIFI_SSID, value);
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int main(int argc, char **argv)
+{
+	long updates = argc > 1 ? atol(argv[1]) : 10000;
+	if (updates <= 0) {
+		fprintf(stderr, "Usage: %s [updates]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	test_init_storage();
+	if (!test_copy_file(TEST_DATA_DIR "/config/config.cfg.default",
+			CONFIG_FILE_DEFAULT) ||
+		!test_copy_file(TEST_DATA_DIR "/config/config.cfg.default",
+			CONFIG_FILE) ||
+		init_global_controller() != ESP_OK) {
+		fprintf(stderr, "init controller failed\n");
+		return EXIT_FAILURE;
+	}
+
+	struct heap_state before, after;
+	heap_state(&before);
+	long resets = 0;
+	double start = now_us();
+	for (long i = 1; i <= updates; i++) {
+		esp_err_t ret;
+		if (i % RESET_INTERVAL == 0) {
+			ret = global_controller_reset_default();
+			resets++;
+		} else {
+			ret = global_controller_update_config_batch(
+				stage_update, &i);
+		}
+		if (ret != ESP_OK) {
+			fprintf(stderr, "update %ld failed: [%d]\n", i, ret);
+			return EXIT_FAILURE;
+		}
+	}
+	double elapsed = now_us() - start;
+	// The coalesced save of the updates.
+	persist_flush();
+	heap_state(&after);
+
+	printf("%ld updates, %ld resets, %.3f us/update\n",
+		updates, resets, elapsed / updates);
+	print_heap_state("before", &before);
+	print_heap_state("after", &after);
+	printf("%.3f allocs/update, %+ld bytes in use\n",
+		(double) (after.allocs - before.allocs) / updates,
+		(long) after.in_use - (long) before.in_use);
+	return EXIT_SUCCESS;
+}
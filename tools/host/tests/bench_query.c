@@ -0,0 +1,91 @@
+/*
+ * Microbenchmark of the settings query parsing: query_parse walks the
+ * query once, the per key lookup with httpd_query_key_value (the parsing
+ * before query_parse) scans the query once per settings key.
+ *
+ * Usage: bench_query [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <esp_http_server.h>
+
+#include "config.h"
+#include "query.h"
+
+// The query of the settings form with all the query keys.
+static const char settings_query[] =
+	"pwm_fan_channel=0&pwm_fan_frequency=25000&pwm_fan_gpio=4"
+	"&pwm_fan_duty=100&pwm_mos_channel=1&pwm_mos_frequency=25000"
+	"&pwm_mos_gpio=8&pwm_mos_duty=255&wifi_ssid=PWM+FAN+CONTROLLER"
+	"&wifi_password=test%21password%23123&wifi_channel=1"
+	"&dhcps_ip=10.10.10.1&dhcps_netmask=255.255.255.0&dhcps_as_router=0";
+
+static volatile size_t sink;
+
+static esp_err_t count_pair(const char *key, const char *value, void *ctx)
+{
+	const struct config_schema *schema = config_schema_lookup(key);
+	if (schema != NULL && (schema->flags & CONFIG_FLAG_QUERY)) {
+		sink += strlen(value);
+	}
+	return ESP_OK;
+}
+
+static void bench_query_parse(void)
+{
+	char buffer[sizeof(settings_query)];
+	memcpy(buffer, settings_query, sizeof(buffer));
+	query_parse(buffer, count_pair, NULL);
+}
+
+static void bench_key_value(void)
+{
+	char value[64];
+	for (int i = 0; i < CONFIG_ID_MAX; i++) {
+		const struct config_schema *schema = config_schema_get(i);
+		if (!(schema->flags & CONFIG_FLAG_QUERY)) {
+			continue;
+		}
+		if (httpd_query_key_value(settings_query, schema->key,
+			value, sizeof(value)) == ESP_OK) {
+			sink += strlen(value);
+		}
+	}
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(const char *name, void (*fn)(void), long iterations)
+{
+	// Warm up the caches.
+	for (long i = 0; i < iterations / 10 + 1; i++) {
+		fn();
+	}
+	double start = now_ns();
+	for (long i = 0; i < iterations; i++) {
+		fn();
+	}
+	double ns = (now_ns() - start) / iterations;
+	printf("%-24s %10ld iterations %10.1f ns/query %8.1f MB/s\n",
+		name, iterations, ns, sizeof(settings_query) / ns * 1e3);
+}
+
+int main(int argc, char **argv)
+{
+	long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+	if (iterations <= 0) {
+		fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	printf("query length %zu bytes\n", sizeof(settings_query) - 1);
+	run("query_parse", bench_query_parse, iterations);
+	run("httpd_query_key_value", bench_key_value, iterations);
+	return EXIT_SUCCESS;
+}
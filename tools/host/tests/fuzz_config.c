@@ -0,0 +1,150 @@
+/*
+ * Fuzz target of the streaming config file parser, the config loaded by
+ * new_config_by_load_file is checked against a plain reference parser,
+ * which splits the whole file by '\n' and sets the values with
+ * config_set_value.
+ *
+ * Built with clang and HOST_FUZZ=ON, it is a libFuzzer target:
+ *   fuzz_config [libFuzzer options] [corpus dir]
+ * Otherwise it is a standalone driver with the sanitizers of gcc, it runs
+ * random config files of the config lines:
+ *   fuzz_config [iterations] [seed]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <esp_log.h>
+
+#include "config.h"
+#include "test.h"
+
+// CONFIG_LINE_SIZE in src/config.c, the longer lines are discarded.
+#define FUZZ_LINE_SIZE 128
+#define FUZZ_MAX_SIZE 4096
+
+#ifndef MIN
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#endif
+
+/**
+ * @brief fuzz_parse_line trims the trailing '\r', spaces and tabs of the
+ * line, skips the empty and the comment lines, then sets the value after
+ * the first '='.
+ */
+static void fuzz_parse_line(struct config *config, char *line, size_t length)
+{
+	while (length > 0 && (line[length - 1] == '\r' ||
+		line[length - 1] == ' ' || line[length - 1] == '\t')) {
+		line[--length] = '\0';
+	}
+	if (length == 0 || line[0] == '#') {
+		return;
+	}
+	char *eq = memchr(line, '=', length);
+	if (eq != NULL) {
+		*eq = '\0';
+		config_set_value(config, line, eq + 1);
+	}
+}
+
+static void fuzz_reference(
+	const uint8_t *data, size_t size, struct config *config
+) {
+	char line[FUZZ_LINE_SIZE];
+	size_t start = 0;
+	while (start < size) {
+		const uint8_t *end = memchr(data + start, '\n', size - start);
+		size_t length = end != NULL ?
+			(size_t) (end - data) - start : size - start;
+		if (length < FUZZ_LINE_SIZE) {
+			memcpy(line, data + start, length);
+			line[length] = '\0';
+			fuzz_parse_line(config, line, length);
+		}
+		start += length + 1;
+	}
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	test_init_storage();
+	esp_log_level_set("*", ESP_LOG_NONE);
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	if (size > FUZZ_MAX_SIZE) {
+		return 0;
+	}
+	if (!test_write_file(CONFIG_FILE, data, size)) {
+		fprintf(stderr, "write %s failed\n", CONFIG_FILE);
+		abort();
+	}
+	struct config *actual = new_config_by_load_file();
+	struct config *expected = new_config_default_value();
+	if (actual == NULL || expected == NULL) {
+		fprintf(stderr, "new config failed\n");
+		abort();
+	}
+	fuzz_reference(data, size, expected);
+	if (!config_equal(actual, expected)) {
+		fprintf(stderr, "config file of %zu bytes: config mismatch\n",
+			size);
+		fwrite(data, 1, size, stderr);
+		abort();
+	}
+	release_config(&actual);
+	release_config(&expected);
+	return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+
+// The pieces of the config lines, the bytes the parser handles specially
+// are more likely.
+static const char *fuzz_tokens[] = {
+	CONFIG_KEY_PWM_FAN_DUTY, CONFIG_KEY_PWM_MOS_FREQUENCY,
+	CONFIG_KEY_WIFI_SSID, CONFIG_KEY_WIFI_PASSWORD, CONFIG_KEY_DHCPS_IP,
+	"=", "=", "\n", "\n", "\r\n", "\r", " ", "\t", "#", "1", "255", "256",
+	"10.10.10.1", "pass word", "\x00", "\xff",
+};
+
+#define FUZZ_TOKENS (sizeof(fuzz_tokens) / sizeof(fuzz_tokens[0]))
+
+int main(int argc, char **argv)
+{
+	long iterations = argc > 1 ? atol(argv[1]) : 20000;
+	unsigned int seed = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+	LLVMFuzzerInitialize(&argc, &argv);
+	srand(seed);
+	uint8_t data[FUZZ_MAX_SIZE];
+	for (long i = 0; i < iterations; i++) {
+		size_t size = 0;
+		size_t limit = rand() % sizeof(data);
+		while (size < limit) {
+			size_t n = 1;
+			if (rand() % 16 == 0) {
+				// A run of a byte, long enough to be discarded.
+				n = rand() % (2 * FUZZ_LINE_SIZE) + 1;
+				n = MIN(n, limit - size);
+				memset(data + size, 'a' + rand() % 26, n);
+			} else if (rand() % 8 == 0) {
+				data[size] = rand() % 256;
+			} else {
+				const char *token = fuzz_tokens[rand() % FUZZ_TOKENS];
+				// The "\x00" token is a single NUL byte.
+				n = MIN(token[0] == '\0' ? 1 : strlen(token),
+					limit - size);
+				memcpy(data + size, token, n);
+			}
+			size += n;
+		}
+		LLVMFuzzerTestOneInput(data, size);
+	}
+	printf("%ld config files, seed %u\n", iterations, seed);
+	return EXIT_SUCCESS;
+}
+
+#endif // FUZZ_LIBFUZZER
@@ -0,0 +1,179 @@
+/*
+ * Fuzz target of query_parse, the pairs are checked against a plain
+ * reference decoder.
+ *
+ * Built with clang and HOST_FUZZ=ON, it is a libFuzzer target:
+ *   fuzz_query [libFuzzer options] [corpus dir]
+ * Otherwise it is a standalone driver with the sanitizers of gcc, it runs
+ * random queries of the query alphabet:
+ *   fuzz_query [iterations] [seed]
+ */
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <esp_log.h>
+
+#include "query.h"
+
+#define FUZZ_MAX_SIZE 512
+#define FUZZ_MAX_PAIRS (FUZZ_MAX_SIZE / 2 + 1)
+
+struct fuzz_pair {
+	char key[FUZZ_MAX_SIZE + 1];
+	char value[FUZZ_MAX_SIZE + 1];
+};
+
+struct fuzz_result {
+	esp_err_t ret;
+	int count;
+	struct fuzz_pair pairs[FUZZ_MAX_PAIRS];
+};
+
+static struct fuzz_result expected, actual;
+static const char *fuzz_buffer_start, *fuzz_buffer_end;
+
+static int fuzz_hex(char c)
+{
+	if (!isxdigit((unsigned char) c)) {
+		return -1;
+	}
+	return isdigit((unsigned char) c) ? c - '0' : tolower(c) - 'a' + 10;
+}
+
+/**
+ * @brief fuzz_decode decodes length bytes of s into out.
+ *
+ * @return false if the percent-encoding is invalid.
+ */
+static bool fuzz_decode(const char *s, size_t length, char *out)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < length; i++) {
+		if (s[i] == '+') {
+			out[n++] = ' ';
+		} else if (s[i] != '%') {
+			out[n++] = s[i];
+		} else {
+			int h = i + 1 < length ? fuzz_hex(s[i + 1]) : -1;
+			int l = i + 2 < length ? fuzz_hex(s[i + 2]) : -1;
+			if (h < 0 || l < 0 || (h == 0 && l == 0)) {
+				return false;
+			}
+			out[n++] = h << 4 | l;
+			i += 2;
+		}
+	}
+	out[n] = '\0';
+	return true;
+}
+
+/**
+ * @brief fuzz_reference splits the query by '&' and the first '=' of each
+ * pair, then decodes the key and the value.
+ */
+static void fuzz_reference(const char *query, struct fuzz_result *result)
+{
+	result->ret = ESP_OK;
+	result->count = 0;
+	while (*query != '\0') {
+		size_t length = strcspn(query, "&");
+		const char *eq = memchr(query, '=', length);
+		size_t key_length = eq != NULL ? (size_t) (eq - query) : length;
+		struct fuzz_pair *pair = &result->pairs[result->count];
+		if (!fuzz_decode(query, key_length, pair->key) ||
+			!fuzz_decode(eq != NULL ? eq + 1 : query + length,
+				eq != NULL ? length - key_length - 1 : 0,
+				pair->value)) {
+			result->ret = ESP_ERR_INVALID_ARG;
+			return;
+		}
+		if (pair->key[0] != '\0') {
+			result->count++;
+		}
+		query += length + (query[length] == '&');
+	}
+}
+
+static esp_err_t fuzz_collect(const char *key, const char *value, void *ctx)
+{
+	struct fuzz_result *result = ctx;
+	// The pairs are decoded in place.
+	if (key < fuzz_buffer_start || key >= fuzz_buffer_end ||
+		value < fuzz_buffer_start || value >= fuzz_buffer_end ||
+		key[0] == '\0' || result->count >= FUZZ_MAX_PAIRS) {
+		abort();
+	}
+	struct fuzz_pair *pair = &result->pairs[result->count++];
+	strcpy(pair->key, key);
+	strcpy(pair->value, value);
+	return ESP_OK;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	static char query[FUZZ_MAX_SIZE + 1];
+	if (size > FUZZ_MAX_SIZE) {
+		return 0;
+	}
+	// Exactly sized copy, so the sanitizers catch reads past the end.
+	char *buffer = malloc(size + 1);
+	memcpy(buffer, data, size);
+	buffer[size] = '\0';
+	strcpy(query, buffer);
+	fuzz_buffer_start = buffer;
+	fuzz_buffer_end = buffer + size + 1;
+
+	actual.count = 0;
+	actual.ret = query_parse(buffer, fuzz_collect, &actual);
+	fuzz_reference(query, &expected);
+	if (actual.ret != expected.ret) {
+		fprintf(stderr, "query [%s]: ret %d, expected %d\n",
+			query, actual.ret, expected.ret);
+		abort();
+	}
+	// On errors the pairs before the invalid one are passed.
+	if (actual.count != expected.count) {
+		fprintf(stderr, "query [%s]: %d pairs, expected %d\n",
+			query, actual.count, expected.count);
+		abort();
+	}
+	for (int i = 0; i < actual.count; i++) {
+		if (strcmp(actual.pairs[i].key, expected.pairs[i].key) != 0 ||
+			strcmp(actual.pairs[i].value,
+				expected.pairs[i].value) != 0) {
+			fprintf(stderr, "query [%s]: pair %d mismatch\n",
+				query, i);
+			abort();
+		}
+	}
+	free(buffer);
+	return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+
+// The bytes the parser handles specially are more likely.
+static const char fuzz_alphabet[] = "&&&===%%%++0aF9gG \xff";
+
+int main(int argc, char **argv)
+{
+	long iterations = argc > 1 ? atol(argv[1]) : 200000;
+	unsigned int seed = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+	esp_log_level_set("*", ESP_LOG_NONE);
+	srand(seed);
+	uint8_t data[64];
+	for (long i = 0; i < iterations; i++) {
+		size_t size = rand() % sizeof(data);
+		for (size_t j = 0; j < size; j++) {
+			data[j] = rand() % 4 == 0 ? rand() % 256 :
+				fuzz_alphabet[rand() % (sizeof(fuzz_alphabet) - 1)];
+		}
+		LLVMFuzzerTestOneInput(data, size);
+	}
+	printf("%ld queries, seed %u\n", iterations, seed);
+	return EXIT_SUCCESS;
+}
+
+#endif // FUZZ_LIBFUZZER
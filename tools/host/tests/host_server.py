@@ -0,0 +1,122 @@
+"""
+Harness of the HTTP tests of the host build: HostServer runs pwm_host on
+a copy of the SPIFFS image and an empty NVS directory, on a free port.
+
+The paths of the programs come from the environment set by ctest, see
+CMakeLists.txt: PWM_HOST, LOADGEN, UDPGEN, SPIFFS_DATA and DATA_DIR.
+"""
+
+import http.client
+import os
+import shutil
+import socket
+import subprocess
+import tempfile
+import time
+import unittest
+import zlib
+
+# Seconds to wait for the server to accept connections.
+START_TIMEOUT = 10
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+class HostServer:
+    """Run pwm_host, files maps the extra SPIFFS file paths like
+    '/big.bin' to their contents, args are the extra pwm_host options."""
+
+    def __init__(self, files=None, args=None):
+        self.dir = tempfile.mkdtemp(prefix="pwm_host.")
+        self.spiffs = os.path.join(self.dir, "spiffs")
+        self.nvs = os.path.join(self.dir, "nvs")
+        shutil.copytree(os.environ["SPIFFS_DATA"], self.spiffs)
+        # The config files of the image may be changed by a manual run of
+        # pwm_host, start from the ones in the data directory.
+        config = os.path.join(self.spiffs, "config")
+        shutil.rmtree(config)
+        shutil.copytree(os.path.join(os.environ["DATA_DIR"], "config"),
+                        config)
+        # The server only finds the files listed in the asset manifest,
+        # see tools/build_assets.py.
+        for path, data in (files or {}).items():
+            with open(self.spiffs + path, "wb") as f:
+                f.write(data)
+            with open(os.path.join(self.spiffs, "assets.manifest"), "a",
+                      encoding="utf-8") as f:
+                f.write(f"{zlib.crc32(data):08x} {path}\n")
+        self.port = free_port()
+        self.log = open(os.path.join(self.dir, "server.log"), "w+")
+        self.process = subprocess.Popen(
+            [os.environ["PWM_HOST"], "-q", "-p", str(self.port),
+             "-d", self.spiffs, "-n", self.nvs] + (args or []),
+            stdout=self.log, stderr=subprocess.STDOUT)
+        deadline = time.monotonic() + START_TIMEOUT
+        while True:
+            if self.process.poll() is not None:
+                self.stop()
+                raise RuntimeError("pwm_host exited: " + self.output())
+            try:
+                socket.create_connection(("127.0.0.1", self.port), 1).close()
+                return
+            except OSError:
+                if time.monotonic() > deadline:
+                    self.stop()
+                    raise
+                time.sleep(0.05)
+
+    def output(self):
+        self.log.seek(0)
+        return self.log.read()
+
+    def connection(self, timeout=5):
+        return http.client.HTTPConnection("127.0.0.1", self.port,
+                                          timeout=timeout)
+
+    def request(self, method, path, body=None, headers=None):
+        """Send one request on a new connection.
+
+        Returns the response with the body read into 'data'.
+        """
+        conn = self.connection()
+        try:
+            conn.request(method, path, body=body, headers=headers or {})
+            response = conn.getresponse()
+            response.data = response.read()
+            return response
+        finally:
+            conn.close()
+
+    def stop(self):
+        if self.process.poll() is None:
+            self.process.terminate()
+            try:
+                self.process.wait(5)
+            except subprocess.TimeoutExpired:
+                self.process.kill()
+                self.process.wait()
+        self.log.close()
+        shutil.rmtree(self.dir, ignore_errors=True)
+
+
+class HostTestCase(unittest.TestCase):
+    """Test case with a server shared by the tests of the class."""
+
+    # Extra SPIFFS files and pwm_host options of the server.
+    files = {}
+    args = []
+
+    @classmethod
+    def setUpClass(cls):
+        cls.server = HostServer(cls.files, cls.args)
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.server.stop()
+
+    def request(self, method, path, body=None, headers=None):
+        return self.server.request(method, path, body, headers)
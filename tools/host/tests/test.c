@@ -0,0 +1,154 @@
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <esp_log.h>
+
+#include "host.h"
+#include "storage.h"
+#include "test.h"
+
+int test_failures;
+
+static struct {
+	char dir[PATH_MAX];
+	const char *name;
+	bool failed;
+} test = {
+	.dir = "",
+};
+
+void test_fail(const char *file, int line, const char *message)
+{
+	fprintf(stderr, "%s:%d: %s: assertion failed: %s\n",
+		file, line, test.name ? test.name : "-", message);
+	test.failed = true;
+}
+
+static void test_quiet_log(void)
+{
+	// Only the warnings and errors, like pwm_host -q.
+	esp_log_level_set("*", ESP_LOG_WARN);
+}
+
+void test_run(const char *name, void (*fn)(void))
+{
+	test_quiet_log();
+	test.name = name;
+	test.failed = false;
+	fn();
+	if (test.failed) {
+		test_failures++;
+	}
+	printf("%s %s\n", test.failed ? "FAIL" : "ok  ", name);
+	test.name = NULL;
+}
+
+static int test_remove_file(
+	const char *path, const struct stat *s, int type, struct FTW *ftw
+) {
+	return remove(path);
+}
+
+static void test_remove_dir(void)
+{
+	if (test.dir[0] != '\0') {
+		nftw(test.dir, test_remove_file, 8, FTW_DEPTH | FTW_PHYS);
+	}
+}
+
+const char *test_init_storage(void)
+{
+	if (test.dir[0] != '\0') {
+		return test.dir;
+	}
+	const char *tmp = getenv("TMPDIR");
+	snprintf(test.dir, sizeof(test.dir), "%s/pwm_test.XXXXXX",
+		tmp != NULL && tmp[0] != '\0' ? tmp : "/tmp");
+	if (mkdtemp(test.dir) == NULL) {
+		perror("mkdtemp");
+		exit(EXIT_FAILURE);
+	}
+	atexit(test_remove_dir);
+	test_quiet_log();
+
+	char spiffs[PATH_MAX + 8], nvs[PATH_MAX + 8];
+	snprintf(spiffs, sizeof(spiffs), "%s/spiffs", test.dir);
+	snprintf(nvs, sizeof(nvs), "%s/nvs", test.dir);
+	char config[PATH_MAX + 16];
+	snprintf(config, sizeof(config), "%s/config", spiffs);
+	if (mkdir(spiffs, 0755) != 0 || mkdir(config, 0755) != 0) {
+		perror("mkdir");
+		exit(EXIT_FAILURE);
+	}
+	host_set_spiffs_dir(spiffs);
+	host_set_nvs_dir(nvs);
+	if (init_storage() != ESP_OK) {
+		fprintf(stderr, "init_storage failed\n");
+		exit(EXIT_FAILURE);
+	}
+	return test.dir;
+}
+
+bool test_write_file(const char *path, const void *content, size_t length)
+{
+	FILE *f = fopen(path, "wb");
+	if (f == NULL) {
+		return false;
+	}
+	bool ok = fwrite(content, 1, length, f) == length;
+	return fclose(f) == 0 && ok;
+}
+
+long test_read_file(const char *path, void *content, size_t size)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		return -1;
+	}
+	size_t n = fread(content, 1, size, f);
+	bool ok = !ferror(f);
+	fclose(f);
+	return ok ? (long) n : -1;
+}
+
+bool test_copy_file(const char *from, const char *to)
+{
+	static char buffer[64 * 1024];
+	long n = test_read_file(from, buffer, sizeof(buffer));
+	return n >= 0 && (size_t) n < sizeof(buffer) &&
+		test_write_file(to, buffer, n);
+}
+
+uint16_t test_free_port(void)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t length = sizeof(addr);
+	uint16_t port = 0;
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0 &&
+		getsockname(fd, (struct sockaddr *) &addr, &length) == 0) {
+		port = ntohs(addr.sin_port);
+	}
+	close(fd);
+	return port;
+}
+
+int test_exit_code(void)
+{
+	if (test_failures > 0) {
+		printf("%d test(s) failed\n", test_failures);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
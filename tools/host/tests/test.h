@@ -0,0 +1,102 @@
+#ifndef TEST_H
+#define TEST_H
+
+/*
+ * Minimal unit test harness of the host build. A test is a void function,
+ * a failed assertion reports the expression and returns from the test.
+ * The program exits with EXIT_FAILURE if a test failed.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+extern int test_failures;
+
+void test_fail(const char *file, int line, const char *message);
+
+#define TEST_ASSERT(cond) do { \
+	if (!(cond)) { \
+		test_fail(__FILE__, __LINE__, #cond); \
+		return; \
+	} \
+} while (0)
+
+#define TEST_ASSERT_EQUAL(expected, actual) do { \
+	long long test_e = (long long) (expected); \
+	long long test_a = (long long) (actual); \
+	if (test_e != test_a) { \
+		char test_msg[256]; \
+		snprintf(test_msg, sizeof(test_msg), "%s == %s: %lld != %lld", \
+			#expected, #actual, test_e, test_a); \
+		test_fail(__FILE__, __LINE__, test_msg); \
+		return; \
+	} \
+} while (0)
+
+#define TEST_ASSERT_EQUAL_STRING(expected, actual) do { \
+	const char *test_e = (expected); \
+	const char *test_a = (actual); \
+	if (test_a == NULL || strcmp(test_e, test_a) != 0) { \
+		char test_msg[256]; \
+		snprintf(test_msg, sizeof(test_msg), "%s == %s: [%s] != [%s]", \
+			#expected, #actual, test_e, test_a ? test_a : "(null)"); \
+		test_fail(__FILE__, __LINE__, test_msg); \
+		return; \
+	} \
+} while (0)
+
+/**
+ * @brief TEST_RUN runs the test and reports the result.
+ */
+#define TEST_RUN(fn) test_run(#fn, fn)
+
+void test_run(const char *name, void (*fn)(void));
+
+/**
+ * @brief test_init_storage mounts an empty temporary SPIFFS directory at
+ * /spiffs, with the 'config' directory of the config files, and
+ * initializes NVS in an empty temporary directory. The directories are
+ * removed at exit.
+ *
+ * @return the temporary directory holding 'spiffs' and 'nvs'.
+ */
+const char *test_init_storage(void);
+
+/**
+ * @brief test_write_file writes the content into the file, the /spiffs
+ * paths are mapped into the SPIFFS directory.
+ *
+ * @return true if succeed.
+ */
+bool test_write_file(const char *path, const void *content, size_t length);
+
+/**
+ * @brief test_read_file reads at most size bytes of the file.
+ *
+ * @return the length read, -1 if failed.
+ */
+long test_read_file(const char *path, void *content, size_t size);
+
+/**
+ * @brief test_copy_file copies the file, up to 64KB.
+ *
+ * @return true if succeed.
+ */
+bool test_copy_file(const char *from, const char *to);
+
+/**
+ * @brief test_free_port gets a free TCP port of the loopback interface,
+ * for the tests starting the server.
+ *
+ * @return the port, 0 if failed.
+ */
+uint16_t test_free_port(void);
+
+/**
+ * @brief test_exit_code gets the exit code of the test program.
+ */
+int test_exit_code(void);
+
+#endif // TEST_H
@@ -0,0 +1,165 @@
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "alloc_count.h"
+#include "api.h"
+#include "config.h"
+#include "controller.h"
+#include "host.h"
+#include "server.h"
+#include "test.h"
+
+// Requests before counting, the first ones fill the lazily allocated
+// state, such as the settings JSON cache lock.
+#define WARMUP_REQUESTS 3
+#define COUNTED_REQUESTS 20
+
+static uint16_t port;
+
+static int connect_server(void)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	struct timeval timeout = { .tv_sec = 5 };
+	if (fd < 0 ||
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+			sizeof(timeout)) != 0 ||
+		connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		return -1;
+	}
+	return fd;
+}
+
+static bool send_all(int fd, const char *data, size_t length)
+{
+	while (length > 0) {
+		ssize_t n = send(fd, data, length, 0);
+		if (n <= 0) {
+			return false;
+		}
+		data += n;
+		length -= n;
+	}
+	return true;
+}
+
+/**
+ * @brief patch_settings sends PATCH /api/settings on the keep-alive
+ * connection and reads the chunked response.
+ *
+ * @return the status code, -1 if failed.
+ */
+static int patch_settings(int fd, const char *body, size_t length)
+{
+	char header[128];
+	int n = snprintf(header, sizeof(header),
+		"PATCH /api/settings HTTP/1.1\r\nHost: localhost\r\n"
+		"Content-Length: %u\r\n\r\n", (unsigned int) length);
+	if (!send_all(fd, header, n) || !send_all(fd, body, length)) {
+		return -1;
+	}
+	static char response[8192];
+	size_t received = 0;
+	while (received < sizeof(response) - 1) {
+		ssize_t r = recv(fd, response + received,
+			sizeof(response) - 1 - received, 0);
+		if (r <= 0) {
+			return -1;
+		}
+		received += r;
+		response[received] = '\0';
+		if (strstr(response, "\r\n0\r\n\r\n") != NULL) {
+			int status = -1;
+			sscanf(response, "HTTP/1.1 %d", &status);
+			return status;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief max_settings_body formats a body of API_BODY_MAX_SIZE bytes with
+ * the max length SSID and password, all their characters are escaped in
+ * JSON. The variant changes the fan duty, so each request updates the
+ * config.
+ */
+static size_t max_settings_body(char *body, int variant)
+{
+	char ssid[CONFIG_WIFI_SSID_MAX_LEN * 2 + 1];
+	char password[CONFIG_WIFI_PASSWORD_MAX_LEN * 2 + 1];
+	for (int i = 0; i < CONFIG_WIFI_SSID_MAX_LEN; i++) {
+		memcpy(ssid + i * 2, "\\\"", 2);
+	}
+	ssid[CONFIG_WIFI_SSID_MAX_LEN * 2] = '\0';
+	for (int i = 0; i < CONFIG_WIFI_PASSWORD_MAX_LEN; i++) {
+		memcpy(password + i * 2, "\\\\", 2);
+	}
+	password[CONFIG_WIFI_PASSWORD_MAX_LEN * 2] = '\0';
+	char members[512];
+	int n = snprintf(members, sizeof(members),
+		"\"%s\": \"%s\", \"%s\": \"%s\", \"%s\": \"%d\"}",
+		CONFIG_KEY_WIFI_SSID, ssid, CONFIG_KEY_WIFI_PASSWORD, password,
+		CONFIG_KEY_PWM_FAN_DUTY, 100 + variant % 100);
+	// Padded by the whitespace before the members.
+	body[0] = '{';
+	memset(body + 1, ' ', API_BODY_MAX_SIZE - 1 - n);
+	memcpy(body + API_BODY_MAX_SIZE - n, members, n);
+	return API_BODY_MAX_SIZE;
+}
+
+static void test_patch_max_body(void)
+{
+	static char body[API_BODY_MAX_SIZE];
+	int fd = connect_server();
+	TEST_ASSERT(fd >= 0);
+	for (int i = 0; i < WARMUP_REQUESTS; i++) {
+		size_t length = max_settings_body(body, i);
+		TEST_ASSERT_EQUAL(200, patch_settings(fd, body, length));
+	}
+	// The request path uses the request arena, not the heap.
+	size_t before = alloc_count();
+	for (int i = 0; i < COUNTED_REQUESTS; i++) {
+		size_t length = max_settings_body(body, WARMUP_REQUESTS + i);
+		TEST_ASSERT_EQUAL(200, patch_settings(fd, body, length));
+	}
+	size_t allocs = alloc_count() - before;
+	close(fd);
+	printf("%d max size PATCH /api/settings: %u allocations\n",
+		COUNTED_REQUESTS, (unsigned int) allocs);
+	TEST_ASSERT_EQUAL(0, allocs);
+
+	struct arena_stats stats;
+	http_arena_get_stats(&stats);
+	TEST_ASSERT_EQUAL(0, stats.failures);
+	TEST_ASSERT(stats.high_water <= stats.size);
+}
+
+int main(void)
+{
+	test_init_storage();
+	if (!test_copy_file(TEST_DATA_DIR "/config/config.cfg.default",
+			CONFIG_FILE_DEFAULT) ||
+		!test_copy_file(TEST_DATA_DIR "/config/config.cfg.default",
+			CONFIG_FILE)) {
+		fprintf(stderr, "copy config files failed\n");
+		return 1;
+	}
+	port = test_free_port();
+	host_set_http_port(port);
+	if (init_global_controller() != ESP_OK ||
+		global_controller_start() != ESP_OK) {
+		fprintf(stderr, "start controller failed\n");
+		return 1;
+	}
+	TEST_RUN(test_patch_max_body);
+	return test_exit_code();
+}
@@ -0,0 +1,181 @@
+"""The file system reads are handed over to the async workers, the control
+requests are answered while large assets are downloaded."""
+
+import json
+import os
+import socket
+import threading
+import time
+import unittest
+
+from host_server import HostTestCase
+
+# Larger than ASSET_CACHE_MAX_FILE_SIZE in include/asset.h, streamed by a
+# worker.
+BIG_FILE = os.urandom(200 * 1024)
+
+# Concurrent downloads, HTTP_ASYNC_WORKERS in include/server.h is 2.
+DOWNLOADS = 2
+
+# The downloads are read slowly through a small receive buffer, a handler
+# sending the file on the server task would stall it for the whole download.
+READ_SIZE = 2048
+READ_INTERVAL = 0.005
+
+# Bounds of the control latency in seconds, far above the latency of an
+# idle server, the max is below the time of a download.
+CONTROL_P99_BOUND = 0.05
+CONTROL_MAX_BOUND = 0.25
+
+# Cached assets loaded once each, with a SPIFFS open delay in seconds above
+# CONTROL_MAX_BOUND.
+COLD_FILES = {f"/cold{i}.txt": os.urandom(1024) for i in range(4)}
+RACE_FILE = os.urandom(1024)
+COLD_OPEN_DELAY = 0.4
+
+
+def percentile(sorted_values, p):
+    return sorted_values[int(p * (len(sorted_values) - 1) + 0.5)]
+
+
+def dechunk(body):
+    data = b""
+    while True:
+        size, _, body = body.partition(b"\r\n")
+        size = int(size, 16)
+        if size == 0:
+            return data
+        data += body[:size]
+        body = body[size + 2:]
+
+
+class AsyncTest(HostTestCase):
+    files = {"/big.bin": BIG_FILE}
+
+    def download(self, results):
+        start = time.monotonic()
+        data = b""
+        with socket.socket() as sock:
+            sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+            sock.settimeout(10)
+            sock.connect(("127.0.0.1", self.server.port))
+            sock.sendall(b"GET /big.bin HTTP/1.1\r\nHost: localhost\r\n"
+                         b"Accept-Encoding: identity\r\n\r\n")
+            # Read until the last chunk, the connection is kept alive.
+            while not data.endswith(b"\r\n0\r\n\r\n"):
+                chunk = sock.recv(READ_SIZE)
+                if not chunk:
+                    break
+                data += chunk
+                time.sleep(READ_INTERVAL)
+        results.append((data, time.monotonic() - start))
+
+    def test_control_latency(self):
+        downloads = []
+        threads = [threading.Thread(target=self.download, args=(downloads,))
+                   for _ in range(DOWNLOADS)]
+        for thread in threads:
+            thread.start()
+        latencies = []
+        conn = self.server.connection()
+        try:
+            while any(thread.is_alive() for thread in threads):
+                start = time.monotonic()
+                conn.request("GET", "/api/state")
+                response = conn.getresponse()
+                data = response.read()
+                latencies.append(time.monotonic() - start)
+                self.assertEqual(response.status, 200)
+                json.loads(data)
+        finally:
+            conn.close()
+            for thread in threads:
+                thread.join()
+
+        self.assertEqual(len(downloads), DOWNLOADS)
+        for data, duration in downloads:
+            header, _, body = data.partition(b"\r\n\r\n")
+            self.assertTrue(header.startswith(b"HTTP/1.1 200"), header)
+            self.assertIn(b"Transfer-Encoding: chunked", header)
+            self.assertEqual(dechunk(body), BIG_FILE)
+            # Otherwise the bound does not show the server task is free.
+            self.assertGreater(duration, CONTROL_MAX_BOUND)
+        latencies.sort()
+        p50 = percentile(latencies, 0.50)
+        p99 = percentile(latencies, 0.99)
+        print(f"\ncontrol p50 {p50 * 1e3:.3f} ms, p99 {p99 * 1e3:.3f} ms, "
+              f"max {latencies[-1] * 1e3:.3f} ms, "
+              f"{len(latencies)} requests")
+        self.assertLess(p99, CONTROL_P99_BOUND)
+        self.assertLess(latencies[-1], CONTROL_MAX_BOUND)
+
+        state = json.loads(self.request("GET", "/api/state").data)
+        traffic = state["traffic"]
+        self.assertEqual(traffic["control"]["evicted"], 0)
+        self.assertEqual(traffic["control"]["refused"], 0)
+        self.assertEqual(traffic["asset"]["refused"], 0)
+        self.assertEqual(state["arena"]["failures"], 0)
+
+
+class ColdLoadTest(HostTestCase):
+    """The asset cache is not locked while an asset is loaded, the lookups
+    of the cached assets on the server task don't wait for the load."""
+    files = dict(COLD_FILES, **{"/race.txt": RACE_FILE})
+    args = ["-s", str(int(COLD_OPEN_DELAY * 1e6))]
+
+    def get(self, conn, path):
+        start = time.monotonic()
+        conn.request("GET", path, headers={"Accept-Encoding": "identity"})
+        response = conn.getresponse()
+        data = response.read()
+        self.assertEqual(response.status, 200)
+        return data, time.monotonic() - start
+
+    def load_cold(self, results):
+        conn = self.server.connection(timeout=10)
+        try:
+            for path, content in COLD_FILES.items():
+                data, _ = self.get(conn, path)
+                results.append(data == content)
+        finally:
+            conn.close()
+
+    def test_cached_lookup(self):
+        conn = self.server.connection(timeout=10)
+        try:
+            styles, _ = self.get(conn, "/css/styles.css")
+            results = []
+            thread = threading.Thread(target=self.load_cold, args=(results,))
+            thread.start()
+            latencies = []
+            while thread.is_alive():
+                data, latency = self.get(conn, "/css/styles.css")
+                self.assertEqual(data, styles)
+                latencies.append(latency)
+            thread.join()
+        finally:
+            conn.close()
+        self.assertEqual(results, [True] * len(COLD_FILES))
+        print(f"\ncached asset max {max(latencies) * 1e3:.3f} ms, "
+              f"{len(latencies)} requests")
+        self.assertLess(max(latencies), CONTROL_MAX_BOUND)
+
+    def test_concurrent_miss(self):
+        # Both workers load the file, the second one to finish gets the
+        # entry cached by the first.
+        results = []
+
+        def get():
+            results.append(self.request("GET", "/race.txt").data)
+
+        threads = [threading.Thread(target=get) for _ in range(2)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(results, [RACE_FILE] * 2)
+        self.assertEqual(self.request("GET", "/race.txt").data, RACE_FILE)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,113 @@
+"""The pages are bundled into one request, and the settings are filled into
+the state slot of the controller and setting pages."""
+
+import gzip
+import json
+import re
+import time
+import unittest
+
+from host_server import HostTestCase
+
+PAGES = ["/", "/controller/", "/setting/", "/about.html"]
+SLOT_PAGES = ["/controller/", "/setting/"]
+
+# The same origin resources a browser would request to show the page.
+RESOURCE = re.compile(
+    r'<(?:link|script|img)\b[^>]*\b(?:href|src)="(/[^"]*)"')
+STATE_SLOT = re.compile(
+    r'<script id="state" type="application/json">(.*?)</script>', re.S)
+
+
+class BundleTest(HostTestCase):
+    def get_page(self, path, gzip_encoding):
+        encoding = "gzip" if gzip_encoding else "identity"
+        response = self.request("GET", path,
+                                headers={"Accept-Encoding": encoding})
+        self.assertEqual(response.status, 200)
+        self.assertEqual(response.getheader("Content-Type"), "text/html")
+        data = response.data
+        if gzip_encoding:
+            self.assertEqual(response.getheader("Content-Encoding"), "gzip")
+            # Checks the crc32 and the size of the spliced slot pages.
+            data = gzip.decompress(data)
+        return data.decode()
+
+    def get_settings(self):
+        return json.loads(self.request("GET", "/api/state").data)["settings"]
+
+    def test_bundled(self):
+        for path in PAGES:
+            for gzip_encoding in (False, True):
+                with self.subTest(path=path, gzip=gzip_encoding):
+                    html = self.get_page(path, gzip_encoding)
+                    self.assertEqual(RESOURCE.findall(html), [])
+                    self.assertNotIn("<!--#state-->", html)
+
+    def test_state_slot(self):
+        response = self.request("PATCH", "/api/settings",
+                                body=json.dumps({"pwm_fan_duty": "61"}))
+        self.assertEqual(response.status, 200)
+        settings = self.get_settings()
+        self.assertEqual(settings["pwm_fan_duty"], "61")
+        for path in SLOT_PAGES:
+            for gzip_encoding in (False, True):
+                with self.subTest(path=path, gzip=gzip_encoding):
+                    html = self.get_page(path, gzip_encoding)
+                    slots = STATE_SLOT.findall(html)
+                    self.assertEqual(len(slots), 1)
+                    self.assertEqual(json.loads(slots[0]), settings)
+
+    def test_state_slot_max_settings(self):
+        # The longest settings JSON, every character of the max length SSID
+        # and password is escaped. It must fit into the state slot buffer
+        # allocated from the request arena.
+        response = self.request("PATCH", "/api/settings", body=json.dumps({
+            "wifi_ssid": '"' * 32, "wifi_password": "\\" * 63}))
+        self.assertEqual(response.status, 200)
+        settings = self.get_settings()
+        self.assertEqual(settings["wifi_ssid"], '"' * 32)
+        for path in SLOT_PAGES:
+            for gzip_encoding in (False, True):
+                with self.subTest(path=path, gzip=gzip_encoding):
+                    html = self.get_page(path, gzip_encoding)
+                    slots = STATE_SLOT.findall(html)
+                    self.assertEqual(len(slots), 1)
+                    self.assertEqual(json.loads(slots[0]), settings)
+        arena = json.loads(self.request("GET", "/api/state").data)["arena"]
+        self.assertEqual(arena["failures"], 0)
+        self.assertLessEqual(arena["high_water"], arena["size"])
+
+    def test_load_time(self):
+        """Fetch the pages the way js/state.js loads the first view, the
+        requests and the time until the settings are known are reported."""
+        for path in SLOT_PAGES:
+            with self.subTest(path=path):
+                start = time.monotonic()
+                conn = self.server.connection()
+                requests = 0
+                try:
+                    conn.request("GET", path,
+                                 headers={"Accept-Encoding": "gzip"})
+                    response = conn.getresponse()
+                    html = gzip.decompress(response.read()).decode()
+                    requests += 1
+                    for resource in RESOURCE.findall(html):
+                        conn.request("GET", resource)
+                        conn.getresponse().read()
+                        requests += 1
+                    slots = STATE_SLOT.findall(html)
+                    if not slots:
+                        conn.request("GET", "/api/state")
+                        conn.getresponse().read()
+                        requests += 1
+                finally:
+                    conn.close()
+                elapsed = time.monotonic() - start
+                print(f"\n{path}: requests {requests}, "
+                      f"{elapsed * 1e3:.3f} ms")
+                self.assertEqual(requests, 1)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,84 @@
+#include <stdlib.h>
+
+#include "config.h"
+#include "test.h"
+
+static void test_copy_equal(void)
+{
+	struct config *a = new_config_default_value();
+	struct config *b = new_config_default_value();
+	TEST_ASSERT(a != NULL && b != NULL);
+	TEST_ASSERT(config_equal(a, b));
+	TEST_ASSERT_EQUAL(0, config_diff(a, b));
+
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(a,
+		CONFIG_KEY_WIFI_SSID, "my fan"));
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(a,
+		CONFIG_KEY_PWM_MOS_DUTY, "30"));
+	TEST_ASSERT(!config_equal(a, b));
+	TEST_ASSERT_EQUAL(CONFIG_ID_BIT(CONFIG_ID_WIFI_SSID) |
+		CONFIG_ID_BIT(CONFIG_ID_PWM_MOS_DUTY), config_diff(a, b));
+
+	// The config has no pointers, the copy is independent.
+	config_copy(b, a);
+	TEST_ASSERT(config_equal(a, b));
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(a,
+		CONFIG_KEY_WIFI_SSID, "other"));
+	TEST_ASSERT_EQUAL_STRING("my fan", b->wifi.ssid);
+	release_config(&a);
+	release_config(&b);
+}
+
+static void test_string_tail(void)
+{
+	// Setting a shorter string clears the old tail, so the configs with
+	// the same values compare equal byte by byte.
+	struct config *a = new_config_default_value();
+	struct config *b = new_config_default_value();
+	TEST_ASSERT(a != NULL && b != NULL);
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(a,
+		CONFIG_KEY_WIFI_PASSWORD, "a long password value"));
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(a,
+		CONFIG_KEY_WIFI_PASSWORD, "password"));
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(b,
+		CONFIG_KEY_WIFI_PASSWORD, "password"));
+	TEST_ASSERT(config_equal(a, b));
+	TEST_ASSERT_EQUAL(0, config_diff(a, b));
+
+	// The max length strings fill the inline arrays.
+	char ssid[CONFIG_WIFI_SSID_MAX_LEN + 1];
+	memset(ssid, 's', CONFIG_WIFI_SSID_MAX_LEN);
+	ssid[CONFIG_WIFI_SSID_MAX_LEN] = '\0';
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(a,
+		CONFIG_KEY_WIFI_SSID, ssid));
+	TEST_ASSERT_EQUAL_STRING(ssid, a->wifi.ssid);
+	TEST_ASSERT(is_valid_config(a));
+	TEST_ASSERT_EQUAL(CONFIG_ID_BIT(CONFIG_ID_WIFI_SSID),
+		config_diff(a, b));
+
+	// A string without the terminator is invalid.
+	memset(a->wifi.ssid, 's', sizeof(a->wifi.ssid));
+	TEST_ASSERT(!is_valid_config(a));
+	release_config(&a);
+	release_config(&b);
+}
+
+static void test_reset_default(void)
+{
+	struct config *a = new_config_default_value();
+	TEST_ASSERT(a != NULL);
+	struct config b;
+	// Garbage in the padding bytes is cleared by the reset.
+	memset(&b, 0x5a, sizeof(b));
+	config_reset_default(&b);
+	TEST_ASSERT(config_equal(a, &b));
+	release_config(&a);
+}
+
+int main(void)
+{
+	TEST_RUN(test_copy_equal);
+	TEST_RUN(test_string_tail);
+	TEST_RUN(test_reset_default);
+	return test_exit_code();
+}
@@ -0,0 +1,123 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "test.h"
+
+static char nvs_file[PATH_MAX];
+
+static void test_missing(void)
+{
+	uint32_t epoch = 1;
+	TEST_ASSERT(new_config_by_load_nvs(&epoch) == NULL);
+	TEST_ASSERT_EQUAL(1, epoch);
+}
+
+static void test_round_trip(void)
+{
+	struct config *config = new_config_default_value();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(config,
+		CONFIG_KEY_PWM_FAN_DUTY, "42"));
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(config,
+		CONFIG_KEY_PWM_MOS_FREQUENCY, "30000"));
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(config,
+		CONFIG_KEY_WIFI_SSID, "my fan"));
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(config,
+		CONFIG_KEY_WIFI_PASSWORD, "123456789012345678901234567890"
+		"123456789012345678901234567890123"));
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(config,
+		CONFIG_KEY_DHCPS_IP, "192.168.4.1"));
+	TEST_ASSERT_EQUAL(ESP_OK, save_config_nvs(config, 7));
+
+	uint32_t epoch = 0;
+	struct config *loaded = new_config_by_load_nvs(&epoch);
+	TEST_ASSERT(loaded != NULL);
+	TEST_ASSERT_EQUAL(7, epoch);
+	TEST_ASSERT(config_equal(config, loaded));
+	release_config(&loaded);
+	release_config(&config);
+
+	struct config invalid;
+	config_reset_default(&invalid);
+	invalid.wifi.channel = 0;
+	TEST_ASSERT_EQUAL(ESP_FAIL, save_config_nvs(&invalid, 8));
+	loaded = new_config_by_load_nvs(&epoch);
+	TEST_ASSERT(loaded != NULL);
+	TEST_ASSERT_EQUAL(7, epoch);
+	release_config(&loaded);
+}
+
+/**
+ * @brief corrupt saves the default config and changes a byte of the blob.
+ */
+static bool corrupt(long offset, unsigned char value)
+{
+	struct config config;
+	config_reset_default(&config);
+	unsigned char image[512];
+	if (save_config_nvs(&config, 0) != ESP_OK) {
+		return false;
+	}
+	long n = test_read_file(nvs_file, image, sizeof(image));
+	if (n <= offset) {
+		return false;
+	}
+	image[offset] = value;
+	return test_write_file(nvs_file, image, n);
+}
+
+static void test_corrupted(void)
+{
+	// Magic, version and the payload covered by the crc.
+	TEST_ASSERT(corrupt(0, 'X'));
+	TEST_ASSERT(new_config_by_load_nvs(NULL) == NULL);
+	TEST_ASSERT(corrupt(4, 1));
+	TEST_ASSERT(new_config_by_load_nvs(NULL) == NULL);
+	TEST_ASSERT(corrupt(20, 0xAA));
+	TEST_ASSERT(new_config_by_load_nvs(NULL) == NULL);
+
+	struct config *loaded = NULL;
+	TEST_ASSERT(corrupt(0, 'P'));
+	TEST_ASSERT((loaded = new_config_by_load_nvs(NULL)) != NULL);
+	release_config(&loaded);
+
+	// Truncated.
+	unsigned char image[512];
+	long n = test_read_file(nvs_file, image, sizeof(image));
+	TEST_ASSERT(n > 0);
+	TEST_ASSERT(test_write_file(nvs_file, image, n - 1));
+	TEST_ASSERT(new_config_by_load_nvs(NULL) == NULL);
+}
+
+static void test_build_image(void)
+{
+	// The image built by tools/config_nvs_image.py from the default
+	// config file, it is flashed into the NVS partition.
+	TEST_ASSERT(test_copy_file(TEST_NVS_IMAGE, nvs_file));
+	TEST_ASSERT(test_copy_file(TEST_DATA_DIR "/config/config.cfg.default",
+		CONFIG_FILE_DEFAULT));
+	uint32_t epoch = 1;
+	struct config *loaded = new_config_by_load_nvs(&epoch);
+	TEST_ASSERT(loaded != NULL);
+	TEST_ASSERT_EQUAL(0, epoch);
+	struct config *config = new_config_by_load_default_file();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT_EQUAL(0, config_diff(config, loaded));
+	TEST_ASSERT(config_equal(config, loaded));
+	release_config(&config);
+	release_config(&loaded);
+}
+
+int main(void)
+{
+	const char *dir = test_init_storage();
+	snprintf(nvs_file, sizeof(nvs_file), "%s/nvs/%s/%s",
+		dir, CONFIG_NVS_NAMESPACE, CONFIG_NVS_KEY);
+	TEST_RUN(test_missing);
+	TEST_RUN(test_round_trip);
+	TEST_RUN(test_corrupted);
+	TEST_RUN(test_build_image);
+	return test_exit_code();
+}
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "storage.h"
+#include "test.h"
+
+static struct config *load(const char *content)
+{
+	if (!test_write_file(CONFIG_FILE, content, strlen(content))) {
+		return NULL;
+	}
+	return new_config_by_load_file();
+}
+
+static void test_parse(void)
+{
+	struct config *config = load(
+		"# comment line\n"
+		"pwm_fan_duty=120\r\n"
+		"\n"
+		"\r\n"
+		"wifi_ssid=my fan  \t\r\n"
+		"unknown_key=1\n"
+		"invalid line\n"
+		"#pwm_mos_duty=1\n"
+		"dhcps_ip=192.168.4.1\n"
+		"pwm_fan_frequency=20000");
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT_EQUAL(120, config->pwm_fan.duty);
+	TEST_ASSERT_EQUAL_STRING("my fan", config->wifi.ssid);
+	TEST_ASSERT_EQUAL(0x0104A8C0, config->dhcps.ip.addr);
+	// The last line does not end with '\n'.
+	TEST_ASSERT_EQUAL(20000, config->pwm_fan.frequency);
+	// Other keys have the default values.
+	TEST_ASSERT_EQUAL(255, config->pwm_mos.duty);
+	TEST_ASSERT(is_valid_config(config));
+	release_config(&config);
+}
+
+static void test_long_line(void)
+{
+	char content[1024];
+	char value[301];
+	memset(value, 'a', sizeof(value) - 1);
+	value[sizeof(value) - 1] = '\0';
+	// The over-long line is discarded, also when it starts in the middle
+	// of the read buffer, the next line is parsed.
+	snprintf(content, sizeof(content),
+		"pwm_fan_duty=10\n"
+		"wifi_password=%s\n"
+		"pwm_mos_duty=20\n"
+		"wifi_ssid=%s\n"
+		"pwm_mos_duty_max=40",
+		value, value);
+	struct config *config = load(content);
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT_EQUAL(10, config->pwm_fan.duty);
+	TEST_ASSERT_EQUAL_STRING("testpassword123", config->wifi.password);
+	TEST_ASSERT_EQUAL(20, config->pwm_mos.duty);
+	TEST_ASSERT_EQUAL_STRING("PWM_FAN_CONTROLLER", config->wifi.ssid);
+	TEST_ASSERT_EQUAL(40, config->pwm_mos.duty_max);
+	release_config(&config);
+
+	// The over-long last line without '\n' is discarded too.
+	snprintf(content, sizeof(content), "pwm_fan_duty=10\nwifi_ssid=%s",
+		value);
+	config = load(content);
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT_EQUAL(10, config->pwm_fan.duty);
+	TEST_ASSERT_EQUAL_STRING("PWM_FAN_CONTROLLER", config->wifi.ssid);
+	release_config(&config);
+}
+
+static void test_many_lines(void)
+{
+	// Lines cross the boundaries of the read buffer, the last value wins.
+	char content[8192];
+	size_t pos = 0;
+	for (int i = 0; i <= 255; i++) {
+		pos += snprintf(content + pos, sizeof(content) - pos,
+			"pwm_fan_duty=%d\n", i);
+	}
+	struct config *config = load(content);
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT_EQUAL(255, config->pwm_fan.duty);
+	release_config(&config);
+}
+
+static void test_save(void)
+{
+	struct config *config = new_config_default_value();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(config,
+		CONFIG_KEY_WIFI_PASSWORD, "pass word=#1"));
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(config,
+		CONFIG_KEY_DHCPS_NETMASK, "255.255.0.0"));
+	TEST_ASSERT_EQUAL(ESP_OK, save_config_file(config));
+	struct config *loaded = new_config_by_load_file();
+	TEST_ASSERT(loaded != NULL);
+	TEST_ASSERT(config_equal(config, loaded));
+	release_config(&loaded);
+	release_config(&config);
+}
+
+static void test_recover_tmp(void)
+{
+	const char *content = "pwm_fan_duty=77\n";
+	TEST_ASSERT_EQUAL(0, unlink(CONFIG_FILE));
+	TEST_ASSERT(new_config_by_load_file() == NULL);
+	// Power lost after the old file was removed by write_file_atomic.
+	TEST_ASSERT(test_write_file(CONFIG_FILE STORAGE_TMP_SUFFIX,
+		content, strlen(content)));
+	struct config *config = new_config_by_load_file();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT_EQUAL(77, config->pwm_fan.duty);
+	release_config(&config);
+	TEST_ASSERT(is_regular_file(CONFIG_FILE));
+}
+
+int main(void)
+{
+	test_init_storage();
+	TEST_RUN(test_parse);
+	TEST_RUN(test_long_line);
+	TEST_RUN(test_many_lines);
+	TEST_RUN(test_save);
+	TEST_RUN(test_recover_tmp);
+	return test_exit_code();
+}
@@ -0,0 +1,237 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "test.h"
+
+static const char *config_keys[CONFIG_ID_MAX] = {
+	CONFIG_KEY_PWM_FAN_CHANNEL,
+	CONFIG_KEY_PWM_FAN_FREQUENCY,
+	CONFIG_KEY_PWM_FAN_GPIO,
+	CONFIG_KEY_PWM_FAN_DUTY,
+	CONFIG_KEY_PWM_FAN_DUTY_MIN,
+	CONFIG_KEY_PWM_FAN_DUTY_MAX,
+	CONFIG_KEY_PWM_MOS_CHANNEL,
+	CONFIG_KEY_PWM_MOS_FREQUENCY,
+	CONFIG_KEY_PWM_MOS_GPIO,
+	CONFIG_KEY_PWM_MOS_DUTY,
+	CONFIG_KEY_PWM_MOS_DUTY_MIN,
+	CONFIG_KEY_PWM_MOS_DUTY_MAX,
+	CONFIG_KEY_WIFI_SSID,
+	CONFIG_KEY_WIFI_PASSWORD,
+	CONFIG_KEY_WIFI_CHANNEL,
+	CONFIG_KEY_DHCPS_IP,
+	CONFIG_KEY_DHCPS_NETMASK,
+	CONFIG_KEY_DHCPS_AS_ROUTER,
+};
+
+static void test_lookup(void)
+{
+	for (int i = 0; i < CONFIG_ID_MAX; i++) {
+		const struct config_schema *schema =
+			config_schema_lookup(config_keys[i]);
+		TEST_ASSERT(schema != NULL);
+		TEST_ASSERT_EQUAL(i, schema->id);
+		TEST_ASSERT_EQUAL_STRING(config_keys[i], schema->key);
+		TEST_ASSERT(config_schema_get(i) == schema);
+	}
+}
+
+static void test_lookup_unknown(void)
+{
+	TEST_ASSERT(config_schema_lookup(NULL) == NULL);
+	TEST_ASSERT(config_schema_lookup("") == NULL);
+	TEST_ASSERT(config_schema_lookup("pwm") == NULL);
+	TEST_ASSERT(config_schema_lookup("pwm_fan_dut") == NULL);
+	TEST_ASSERT(config_schema_lookup("pwm_fan_duty ") == NULL);
+	TEST_ASSERT(config_schema_lookup("PWM_FAN_DUTY") == NULL);
+	TEST_ASSERT(config_schema_lookup("wifi_ssie") == NULL);
+	TEST_ASSERT(config_schema_get(CONFIG_ID_MAX) == NULL);
+	TEST_ASSERT(config_schema_get(-1) == NULL);
+}
+
+static void test_default_value(void)
+{
+	struct config *config = new_config_default_value();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT(is_valid_config(config));
+	uint32_t v = 0;
+	TEST_ASSERT_EQUAL(ESP_OK, config_get_value(config,
+		CONFIG_KEY_PWM_FAN_FREQUENCY, &v, sizeof(v)));
+	TEST_ASSERT_EQUAL(25000, v);
+	TEST_ASSERT_EQUAL(ESP_OK, config_get_value(config,
+		CONFIG_KEY_DHCPS_IP, &v, sizeof(v)));
+	TEST_ASSERT_EQUAL(0x010A0A0A, v);
+	char ssid[CONFIG_WIFI_SSID_MAX_LEN + 1];
+	TEST_ASSERT_EQUAL(ESP_OK, config_get_value(config,
+		CONFIG_KEY_WIFI_SSID, ssid, sizeof(ssid)));
+	TEST_ASSERT_EQUAL_STRING("PWM_FAN_CONTROLLER", ssid);
+	// The string does not fit.
+	TEST_ASSERT_EQUAL(ESP_FAIL, config_get_value(config,
+		CONFIG_KEY_WIFI_SSID, ssid, 8));
+	TEST_ASSERT_EQUAL(ESP_FAIL, config_get_value(config,
+		"unknown_key", &v, sizeof(v)));
+	release_config(&config);
+	TEST_ASSERT(config == NULL);
+}
+
+static void test_set_value(void)
+{
+	struct config *config = new_config_default_value();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT_EQUAL(ESP_OK, config_set_value(config,
+		CONFIG_KEY_PWM_FAN_DUTY, "200"));
+	TEST_ASSERT_EQUAL(200, config->pwm_fan.duty);
+	TEST_ASSERT_EQUAL(ESP_OK, config_set_value(config,
+		CONFIG_KEY_DHCPS_IP, "192.168.4.1"));
+	TEST_ASSERT_EQUAL(0x0104A8C0, config->dhcps.ip.addr);
+	TEST_ASSERT_EQUAL(ESP_OK, config_set_value(config,
+		CONFIG_KEY_WIFI_SSID, "my fan"));
+	TEST_ASSERT_EQUAL_STRING("my fan", config->wifi.ssid);
+	TEST_ASSERT_EQUAL(ESP_FAIL, config_set_value(config,
+		"unknown_key", "1"));
+
+	// The config file is loaded leniently, out of range numbers and
+	// addresses are reset to the default value.
+	TEST_ASSERT_EQUAL(ESP_OK, config_set_value(config,
+		CONFIG_KEY_PWM_FAN_DUTY, "256"));
+	TEST_ASSERT_EQUAL(100, config->pwm_fan.duty);
+	TEST_ASSERT_EQUAL(ESP_OK, config_set_value(config,
+		CONFIG_KEY_WIFI_CHANNEL, "12"));
+	TEST_ASSERT_EQUAL(1, config->wifi.channel);
+	TEST_ASSERT_EQUAL(ESP_OK, config_set_value(config,
+		CONFIG_KEY_DHCPS_NETMASK, "255.0.255.0"));
+	TEST_ASSERT_EQUAL(0x00ffffff, config->dhcps.netmask.addr);
+	// Invalid strings are rejected.
+	TEST_ASSERT_EQUAL(ESP_FAIL, config_set_value(config,
+		CONFIG_KEY_WIFI_SSID, ""));
+	TEST_ASSERT_EQUAL(ESP_FAIL, config_set_value(config,
+		CONFIG_KEY_WIFI_SSID, "123456789012345678901234567890123"));
+	TEST_ASSERT_EQUAL_STRING("my fan", config->wifi.ssid);
+	TEST_ASSERT(is_valid_config(config));
+	release_config(&config);
+}
+
+static void test_parse_value(void)
+{
+	struct config *config = new_config_default_value();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(config,
+		CONFIG_KEY_PWM_FAN_DUTY, "0"));
+	TEST_ASSERT_EQUAL(0, config->pwm_fan.duty);
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(config,
+		CONFIG_KEY_PWM_FAN_DUTY, "255"));
+	TEST_ASSERT_EQUAL(255, config->pwm_fan.duty);
+
+	// The client values are rejected, the config is not changed.
+	const char *invalid[] = { "", "256", "-1", "+1", " 1", "1 ", "0x10",
+		"99999999999" };
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+		TEST_ASSERT_EQUAL(ESP_FAIL, config_parse_value(config,
+			CONFIG_KEY_PWM_FAN_DUTY, invalid[i]));
+	}
+	TEST_ASSERT_EQUAL(255, config->pwm_fan.duty);
+	TEST_ASSERT_EQUAL(ESP_FAIL, config_parse_value(config,
+		CONFIG_KEY_PWM_FAN_FREQUENCY, "999"));
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(config,
+		CONFIG_KEY_PWM_FAN_FREQUENCY, "100000"));
+	TEST_ASSERT_EQUAL(100000, config->pwm_fan.frequency);
+
+	const char *invalid_ip[] = { "10.10.10", "10.10.10.1.", "10.10.10.256",
+		"10..10.1", "0.10.10.1", "10.10.10.0", "10.10.10.0001" };
+	for (size_t i = 0; i < sizeof(invalid_ip) / sizeof(invalid_ip[0]);
+		i++) {
+		TEST_ASSERT_EQUAL(ESP_FAIL, config_parse_value(config,
+			CONFIG_KEY_DHCPS_IP, invalid_ip[i]));
+	}
+	TEST_ASSERT_EQUAL(0x010A0A0A, config->dhcps.ip.addr);
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(config,
+		CONFIG_KEY_DHCPS_NETMASK, "255.255.0.0"));
+	TEST_ASSERT_EQUAL(0x0000ffff, config->dhcps.netmask.addr);
+	TEST_ASSERT_EQUAL(ESP_FAIL, config_parse_value(config,
+		CONFIG_KEY_DHCPS_NETMASK, "255.0.255.0"));
+	TEST_ASSERT_EQUAL(ESP_FAIL, config_parse_value(config,
+		"unknown_key", "1"));
+	release_config(&config);
+}
+
+static void test_parse_password(void)
+{
+	struct config *config = new_config_default_value();
+	TEST_ASSERT(config != NULL);
+	// 1-7 characters are neither an open AP nor a WPA2 passphrase.
+	const char *invalid[] = { "1", "1234567" };
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+		TEST_ASSERT_EQUAL(ESP_FAIL, config_parse_value(config,
+			CONFIG_KEY_WIFI_PASSWORD, invalid[i]));
+	}
+	TEST_ASSERT_EQUAL_STRING("testpassword123", config->wifi.password);
+
+	char max[CONFIG_WIFI_PASSWORD_MAX_LEN + 2];
+	memset(max, 'p', CONFIG_WIFI_PASSWORD_MAX_LEN + 1);
+	max[CONFIG_WIFI_PASSWORD_MAX_LEN + 1] = '\0';
+	TEST_ASSERT_EQUAL(ESP_FAIL, config_parse_value(config,
+		CONFIG_KEY_WIFI_PASSWORD, max));
+	max[CONFIG_WIFI_PASSWORD_MAX_LEN] = '\0';
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(config,
+		CONFIG_KEY_WIFI_PASSWORD, max));
+	TEST_ASSERT_EQUAL_STRING(max, config->wifi.password);
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(config,
+		CONFIG_KEY_WIFI_PASSWORD, "12345678"));
+	TEST_ASSERT_EQUAL_STRING("12345678", config->wifi.password);
+	// An empty password starts an open AP.
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(config,
+		CONFIG_KEY_WIFI_PASSWORD, ""));
+	TEST_ASSERT_EQUAL_STRING("", config->wifi.password);
+	release_config(&config);
+}
+
+static void test_uint(void)
+{
+	struct config *config = new_config_default_value();
+	TEST_ASSERT(config != NULL);
+	uint32_t v = 0;
+	TEST_ASSERT_EQUAL(ESP_OK, config_set_uint(config,
+		CONFIG_ID_PWM_MOS_DUTY, 30));
+	TEST_ASSERT_EQUAL(ESP_OK, config_get_uint(config,
+		CONFIG_ID_PWM_MOS_DUTY, &v));
+	TEST_ASSERT_EQUAL(30, v);
+	TEST_ASSERT_EQUAL(ESP_FAIL, config_set_uint(config,
+		CONFIG_ID_PWM_MOS_DUTY, 256));
+	TEST_ASSERT_EQUAL(ESP_FAIL, config_set_uint(config,
+		CONFIG_ID_DHCPS_AS_ROUTER, 2));
+	TEST_ASSERT_EQUAL(ESP_FAIL, config_set_uint(config,
+		CONFIG_ID_WIFI_SSID, 1));
+	TEST_ASSERT_EQUAL(ESP_FAIL, config_get_uint(config,
+		CONFIG_ID_WIFI_SSID, &v));
+	TEST_ASSERT_EQUAL(30, config->pwm_mos.duty);
+	release_config(&config);
+}
+
+static void test_valid_config(void)
+{
+	struct config *config = new_config_default_value();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT(!is_valid_config(NULL));
+	config->pwm_fan.duty_min = config->pwm_fan.duty_max;
+	TEST_ASSERT(!is_valid_config(config));
+	config_reset_default(config);
+	config->wifi.channel = 0;
+	TEST_ASSERT(!is_valid_config(config));
+	config_reset_default(config);
+	TEST_ASSERT(is_valid_config(config));
+	release_config(&config);
+}
+
+int main(void)
+{
+	TEST_RUN(test_lookup);
+	TEST_RUN(test_lookup_unknown);
+	TEST_RUN(test_default_value);
+	TEST_RUN(test_set_value);
+	TEST_RUN(test_parse_value);
+	TEST_RUN(test_parse_password);
+	TEST_RUN(test_uint);
+	TEST_RUN(test_valid_config);
+	return test_exit_code();
+}
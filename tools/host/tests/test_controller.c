@@ -0,0 +1,68 @@
+#include <driver/ledc.h>
+
+#include "config.h"
+#include "controller.h"
+#include "host.h"
+#include "test.h"
+
+/**
+ * @brief tick runs the controller ticks, the posted duties are applied by
+ * the first one.
+ */
+static void tick(void)
+{
+	for (int i = 0; i < 2; i++) {
+		global_controller_main_loop();
+	}
+}
+
+static void test_reset_applies_duty(void)
+{
+	struct config *defaults = new_config_by_load_default_file();
+	TEST_ASSERT(defaults != NULL);
+	int fan = defaults->pwm_fan.channel;
+	int mos = defaults->pwm_mos.channel;
+	uint32_t fan_duty = defaults->pwm_fan.duty;
+	uint32_t mos_duty = defaults->pwm_mos.duty;
+	release_config(&defaults);
+
+	TEST_ASSERT_EQUAL(ESP_OK, global_controller_set_duty(
+		CONTROLLER_PWM_FAN, fan_duty + 10));
+	TEST_ASSERT_EQUAL(ESP_OK, global_controller_set_duty(
+		CONTROLLER_PWM_MOS, 30));
+	tick();
+	TEST_ASSERT_EQUAL(fan_duty + 10, ledc_get_duty(LEDC_LOW_SPEED_MODE, fan));
+	TEST_ASSERT_EQUAL(30, ledc_get_duty(LEDC_LOW_SPEED_MODE, mos));
+
+	// The reset applies the default duties, not only the config.
+	TEST_ASSERT_EQUAL(ESP_OK, global_controller_reset_default());
+	TEST_ASSERT_EQUAL(fan_duty,
+		global_controller_get_duty(CONTROLLER_PWM_FAN));
+	TEST_ASSERT_EQUAL(mos_duty,
+		global_controller_get_duty(CONTROLLER_PWM_MOS));
+	tick();
+	TEST_ASSERT_EQUAL(fan_duty, ledc_get_duty(LEDC_LOW_SPEED_MODE, fan));
+	TEST_ASSERT_EQUAL(mos_duty, ledc_get_duty(LEDC_LOW_SPEED_MODE, mos));
+}
+
+int main(void)
+{
+	test_init_storage();
+	if (!test_copy_file(TEST_DATA_DIR "/config/config.cfg.default",
+			CONFIG_FILE_DEFAULT) ||
+		!test_copy_file(TEST_DATA_DIR "/config/config.cfg.default",
+			CONFIG_FILE)) {
+		fprintf(stderr, "copy config files failed\n");
+		return 1;
+	}
+	// The tick only runs while the server is running.
+	host_set_http_port(test_free_port());
+	if (init_global_controller() != ESP_OK ||
+		global_controller_apply_pwm_duty() != ESP_OK ||
+		global_controller_start() != ESP_OK) {
+		fprintf(stderr, "start controller failed\n");
+		return 1;
+	}
+	TEST_RUN(test_reset_applies_duty);
+	return test_exit_code();
+}
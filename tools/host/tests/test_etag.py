@@ -0,0 +1,102 @@
+"""The assets and the pages are validated by the ETag, the versioned
+assets are cached for a long time."""
+
+import os
+import unittest
+
+from host_server import HostTestCase
+
+
+def manifest():
+    etags = {}
+    path = os.path.join(os.environ["SPIFFS_DATA"], "assets.manifest")
+    with open(path, "r", encoding="utf-8") as f:
+        for line in f:
+            etag, name = line.split()
+            etags[name] = f'"{etag}"'
+    return etags
+
+
+class EtagTest(HostTestCase):
+    @classmethod
+    def setUpClass(cls):
+        super().setUpClass()
+        cls.etags = manifest()
+
+    def test_etag(self):
+        for path, headers, name in (
+                ("/css/styles.css", {}, "/css/styles.css"),
+                ("/css/styles.css", {"Accept-Encoding": "gzip"},
+                 "/css/styles.css.gz"),
+                ("/favicon.svg", {}, "/favicon.svg")):
+            with self.subTest(path=path, headers=headers):
+                etag = self.etags[name]
+                response = self.request("GET", path, headers=headers)
+                self.assertEqual(response.status, 200)
+                self.assertEqual(response.getheader("ETag"), etag)
+                self.assertEqual(response.getheader("Cache-Control"),
+                                 "no-cache")
+
+                for value in (etag, f'"0", {etag}', "*"):
+                    response = self.request(
+                        "GET", path,
+                        headers=dict(headers, **{"If-None-Match": value}))
+                    self.assertEqual(response.status, 304)
+                    self.assertEqual(response.data, b"")
+                    self.assertEqual(response.getheader("ETag"), etag)
+
+                response = self.request(
+                    "GET", path,
+                    headers=dict(headers, **{"If-None-Match": '"0"'}))
+                self.assertEqual(response.status, 200)
+                self.assertNotEqual(response.data, b"")
+
+    def test_encoding_etag(self):
+        # The gzip body has another ETag, it does not validate the
+        # identity body.
+        etag = self.etags["/css/styles.css.gz"]
+        response = self.request("GET", "/css/styles.css",
+                                headers={"If-None-Match": etag})
+        self.assertEqual(response.status, 200)
+
+    def test_versioned(self):
+        response = self.request("GET", "/css/styles.css?v=0123abcd")
+        self.assertEqual(response.status, 200)
+        self.assertEqual(response.getheader("Cache-Control"),
+                         "public, max-age=31536000, immutable")
+        self.assertEqual(response.getheader("ETag"),
+                         self.etags["/css/styles.css"])
+
+    def test_page(self):
+        for language in ("en", "zh"):
+            with self.subTest(language=language):
+                headers = {"Accept-Language": language}
+                response = self.request("GET", "/", headers=headers)
+                self.assertEqual(response.status, 200)
+                etag = response.getheader("ETag")
+                self.assertTrue(etag.endswith(f'-{language}"'))
+                self.assertEqual(response.getheader("Cache-Control"),
+                                 "no-cache")
+                response = self.request(
+                    "GET", "/",
+                    headers=dict(headers, **{"If-None-Match": etag}))
+                self.assertEqual(response.status, 304)
+                self.assertEqual(response.data, b"")
+
+        # The ETag of another locale does not match.
+        etag = self.request("GET", "/", headers={
+            "Accept-Language": "en"}).getheader("ETag")
+        response = self.request("GET", "/", headers={
+            "Accept-Language": "zh", "If-None-Match": etag})
+        self.assertEqual(response.status, 200)
+
+    def test_state_page(self):
+        # The pages with the settings filled in are never cached.
+        response = self.request("GET", "/setting/")
+        self.assertEqual(response.status, 200)
+        self.assertIsNone(response.getheader("ETag"))
+        self.assertEqual(response.getheader("Cache-Control"), "no-store")
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,60 @@
+"""The precompressed assets are sent to the clients accepting gzip."""
+
+import gzip
+import unittest
+
+from host_server import HostTestCase
+
+ASSETS = ("/css/styles.css", "/js/controller.js", "/js/setting.js",
+          "/favicon.svg", "/404.html")
+
+
+class GzipTest(HostTestCase):
+    def test_gzip(self):
+        for path in ASSETS:
+            with self.subTest(path=path):
+                identity = self.request("GET", path)
+                self.assertEqual(identity.status, 200)
+                self.assertIsNone(identity.getheader("Content-Encoding"))
+                self.assertEqual(identity.getheader("Vary"),
+                                 "Accept-Encoding")
+
+                response = self.request(
+                    "GET", path, headers={"Accept-Encoding": "gzip"})
+                self.assertEqual(response.status, 200)
+                self.assertEqual(response.getheader("Content-Encoding"),
+                                 "gzip")
+                self.assertEqual(response.getheader("Content-Type"),
+                                 identity.getheader("Content-Type"))
+                self.assertLess(len(response.data), len(identity.data))
+                self.assertEqual(gzip.decompress(response.data),
+                                 identity.data)
+
+    def test_accept_encoding(self):
+        path = "/css/styles.css"
+        for value, encoded in (
+                ("gzip, deflate, br", True),
+                ("deflate, GZIP", True),
+                ("br;q=1.0, gzip;q=0.8", True),
+                ("*", True),
+                ("gzip;q=0", False),
+                ("deflate, br", False),
+                ("identity", False),
+                ("xgzip", False)):
+            with self.subTest(value=value):
+                response = self.request(
+                    "GET", path, headers={"Accept-Encoding": value})
+                self.assertEqual(response.status, 200)
+                self.assertEqual(
+                    response.getheader("Content-Encoding"),
+                    "gzip" if encoded else None)
+
+    def test_not_found(self):
+        response = self.request("GET", "/missing.css",
+                                headers={"Accept-Encoding": "gzip"})
+        self.assertEqual(response.status, 404)
+        self.assertIn(b"404", gzip.decompress(response.data))
+
+
+if __name__ == "__main__":
+    unittest.main()
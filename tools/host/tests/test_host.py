@@ -0,0 +1,43 @@
+"""Smoke test of the host build: the pages, the state API and the
+settings API."""
+
+import json
+import unittest
+
+from host_server import HostTestCase
+
+
+class HostTest(HostTestCase):
+    def test_index(self):
+        response = self.request("GET", "/")
+        self.assertEqual(response.status, 200)
+        self.assertIn("text/html", response.getheader("Content-Type"))
+        self.assertIn(b"<!DOCTYPE html>", response.data)
+
+    def test_not_found(self):
+        response = self.request("GET", "/missing.html")
+        self.assertEqual(response.status, 404)
+
+    def test_state(self):
+        response = self.request("GET", "/api/state")
+        self.assertEqual(response.status, 200)
+        state = json.loads(response.data)
+        self.assertEqual(state["settings"]["wifi_ssid"],
+                         "PWM_FAN_CONTROLLER")
+
+    def test_settings(self):
+        response = self.request("PATCH", "/api/settings",
+                                body='{"pwm_fan_duty": "61"}')
+        self.assertEqual(response.status, 200)
+        state = json.loads(response.data)
+        self.assertEqual(state["settings"]["pwm_fan_duty"], "61")
+
+        response = self.request("PATCH", "/api/settings",
+                                body='{"pwm_fan_duty": "999"}')
+        self.assertEqual(response.status, 400)
+        state = json.loads(self.request("GET", "/api/state").data)
+        self.assertEqual(state["settings"]["pwm_fan_duty"], "61")
+
+
+if __name__ == "__main__":
+    unittest.main()
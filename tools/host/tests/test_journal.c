@@ -0,0 +1,265 @@
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "journal.h"
+#include "persist.h"
+#include "storage.h"
+#include "test.h"
+
+// Sizes of the journal header and records in src/journal.c.
+#define JOURNAL_HEADER_SIZE 8
+#define JOURNAL_RECORD_SIZE 6
+
+// Delay window of the persistence task in the retry test, in ms.
+#define RETRY_DELAY_MS 20
+
+static void test_append_replay(void)
+{
+	struct config *config = new_config_default_value();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT_EQUAL(ESP_OK, config_journal_reset(3));
+	TEST_ASSERT_EQUAL(JOURNAL_HEADER_SIZE, config_journal_size());
+	config->pwm_fan.duty = 10;
+	config->pwm_mos.duty = 30;
+	TEST_ASSERT_EQUAL(ESP_OK, config_journal_append(config,
+		CONFIG_ID_BIT(CONFIG_ID_PWM_FAN_DUTY) |
+		CONFIG_ID_BIT(CONFIG_ID_PWM_MOS_DUTY)));
+	config->pwm_fan.duty = 20;
+	TEST_ASSERT_EQUAL(ESP_OK, config_journal_append(config,
+		CONFIG_ID_BIT(CONFIG_ID_PWM_FAN_DUTY)));
+	// Nothing to append.
+	TEST_ASSERT_EQUAL(ESP_OK, config_journal_append(config, 0));
+	TEST_ASSERT_EQUAL(JOURNAL_HEADER_SIZE + 3 * JOURNAL_RECORD_SIZE,
+		config_journal_size());
+	// Strings are never journaled.
+	TEST_ASSERT_EQUAL(ESP_FAIL, config_journal_append(config,
+		CONFIG_ID_BIT(CONFIG_ID_WIFI_SSID)));
+	TEST_ASSERT_EQUAL(JOURNAL_HEADER_SIZE + 3 * JOURNAL_RECORD_SIZE,
+		config_journal_size());
+
+	struct config *replayed = new_config_default_value();
+	TEST_ASSERT(replayed != NULL);
+	TEST_ASSERT_EQUAL(ESP_OK, config_journal_replay(replayed, 3));
+	TEST_ASSERT(config_equal(config, replayed));
+	release_config(&replayed);
+	release_config(&config);
+}
+
+static void test_ignored(void)
+{
+	struct config *config = new_config_default_value();
+	struct config *def = new_config_default_value();
+	TEST_ASSERT(config != NULL && def != NULL);
+	TEST_ASSERT_EQUAL(ESP_OK, config_journal_reset(4));
+	config->pwm_fan.duty = 10;
+	TEST_ASSERT_EQUAL(ESP_OK, config_journal_append(config,
+		CONFIG_ID_BIT(CONFIG_ID_PWM_FAN_DUTY)));
+	config_reset_default(config);
+	// The journal of another snapshot.
+	TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, config_journal_replay(config, 5));
+	TEST_ASSERT(config_equal(config, def));
+
+	TEST_ASSERT_EQUAL(0, unlink(CONFIG_JOURNAL_FILE));
+	TEST_ASSERT_EQUAL(0, config_journal_size());
+	TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, config_journal_replay(config, 4));
+	// Torn header.
+	TEST_ASSERT(test_write_file(CONFIG_JOURNAL_FILE, "PWMJ", 4));
+	TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, config_journal_replay(config, 4));
+	TEST_ASSERT(config_equal(config, def));
+	release_config(&config);
+	release_config(&def);
+}
+
+static void test_torn_record(void)
+{
+	struct config *config = new_config_default_value();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT_EQUAL(ESP_OK, config_journal_reset(6));
+	config->pwm_fan.duty = 10;
+	TEST_ASSERT_EQUAL(ESP_OK, config_journal_append(config,
+		CONFIG_ID_BIT(CONFIG_ID_PWM_FAN_DUTY)));
+	config->pwm_fan.duty = 20;
+	TEST_ASSERT_EQUAL(ESP_OK, config_journal_append(config,
+		CONFIG_ID_BIT(CONFIG_ID_PWM_FAN_DUTY)));
+	unsigned char journal[64];
+	long n = test_read_file(CONFIG_JOURNAL_FILE, journal, sizeof(journal));
+	TEST_ASSERT_EQUAL(JOURNAL_HEADER_SIZE + 2 * JOURNAL_RECORD_SIZE, n);
+
+	// Incomplete last record, the records before it are applied.
+	TEST_ASSERT(test_write_file(CONFIG_JOURNAL_FILE, journal, n - 1));
+	config_reset_default(config);
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE,
+		config_journal_replay(config, 6));
+	TEST_ASSERT_EQUAL(10, config->pwm_fan.duty);
+
+	// Corrupted record.
+	journal[n - 2] ^= 0x01;
+	TEST_ASSERT(test_write_file(CONFIG_JOURNAL_FILE, journal, n));
+	config_reset_default(config);
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE,
+		config_journal_replay(config, 6));
+	TEST_ASSERT_EQUAL(10, config->pwm_fan.duty);
+	release_config(&config);
+}
+
+static struct config current;
+
+static void snapshot(struct config *config)
+{
+	config_copy(config, &current);
+}
+
+static void flush(void)
+{
+	persist_request();
+	persist_flush();
+}
+
+/**
+ * @brief wait_stats waits for the persistence task until the field of the
+ * stats reaches the count, for at most 100 delay windows.
+ */
+static bool wait_stats(size_t offset, uint32_t count)
+{
+	for (int i = 0; i < 100; i++) {
+		struct persist_stats stats;
+		persist_get_stats(&stats);
+		uint32_t value;
+		memcpy(&value, (const char *) &stats + offset, sizeof(value));
+		if (value >= count) {
+			return true;
+		}
+		usleep(RETRY_DELAY_MS * 1000);
+	}
+	return false;
+}
+
+static void test_persist_retry(void)
+{
+	const char *file = "pwm_fan_duty=60\n";
+	TEST_ASSERT(test_write_file(CONFIG_FILE, file, strlen(file)));
+	struct config *config = persist_load_config();
+	TEST_ASSERT(config != NULL);
+	config_copy(&current, config);
+	release_config(&config);
+	TEST_ASSERT_EQUAL(ESP_OK, init_persist_task(snapshot, RETRY_DELAY_MS));
+	struct persist_stats stats;
+	persist_get_stats(&stats);
+
+	// The temporary file of the config file can not be created while a
+	// directory takes its name.
+	char tmp[PATH_MAX];
+	snprintf(tmp, sizeof(tmp), "%s/spiffs/config/config.cfg"
+		STORAGE_TMP_SUFFIX, test_init_storage());
+	TEST_ASSERT(mkdir(tmp, 0755) == 0);
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(&current,
+		CONFIG_KEY_WIFI_SSID, "retry"));
+	persist_request();
+	// The failed flush is retried without another request.
+	bool failed = wait_stats(offsetof(struct persist_stats, failures),
+		stats.failures + 2);
+	rmdir(tmp);
+	TEST_ASSERT(failed);
+	TEST_ASSERT(wait_stats(offsetof(struct persist_stats, writes),
+		stats.writes + 1));
+	config = new_config_by_load_file();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT_EQUAL_STRING("retry", config->wifi.ssid);
+	release_config(&config);
+}
+
+static void test_persist(void)
+{
+	// Without the NVS snapshot, the config file is loaded and compacted
+	// into a new snapshot.
+	TEST_ASSERT(unlink(CONFIG_JOURNAL_FILE) == 0 ||
+		config_journal_size() == 0);
+	const char *file = "pwm_fan_duty=60\n";
+	TEST_ASSERT(test_write_file(CONFIG_FILE, file, strlen(file)));
+	struct config *config = persist_load_config();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT_EQUAL(60, config->pwm_fan.duty);
+	config_copy(&current, config);
+	release_config(&config);
+	TEST_ASSERT_EQUAL(JOURNAL_HEADER_SIZE, config_journal_size());
+
+	// The task only flushes after the delay, the test flushes directly.
+	TEST_ASSERT_EQUAL(ESP_OK, init_persist_task(snapshot, 60 * 1000));
+	struct persist_stats stats;
+	persist_get_stats(&stats);
+	uint32_t compactions = stats.compactions;
+	uint32_t failures = stats.failures;
+
+	// Duty changes are appended to the journal.
+	current.pwm_fan.duty = 61;
+	flush();
+	current.pwm_mos.duty = 31;
+	flush();
+	persist_get_stats(&stats);
+	TEST_ASSERT_EQUAL(2, stats.journal_writes);
+	TEST_ASSERT_EQUAL(compactions, stats.compactions);
+	TEST_ASSERT_EQUAL(JOURNAL_HEADER_SIZE + 2 * JOURNAL_RECORD_SIZE,
+		config_journal_size());
+	config = persist_load_config();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT(config_equal(&current, config));
+	release_config(&config);
+
+	// Other keys rewrite the snapshot and start a new journal.
+	TEST_ASSERT_EQUAL(ESP_OK, config_parse_value(&current,
+		CONFIG_KEY_WIFI_SSID, "my fan"));
+	flush();
+	persist_get_stats(&stats);
+	TEST_ASSERT_EQUAL(compactions + 1, stats.compactions);
+	TEST_ASSERT_EQUAL(JOURNAL_HEADER_SIZE, config_journal_size());
+	config = persist_load_config();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT(config_equal(&current, config));
+	release_config(&config);
+	config = new_config_by_load_file();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT(config_equal(&current, config));
+	release_config(&config);
+
+	// The journal is compacted when it is full.
+	for (int i = 0; config_journal_size() < CONFIG_JOURNAL_MAX_SIZE; i++) {
+		current.pwm_fan.duty = i % 2 ? 100 : 101;
+		flush();
+	}
+	persist_get_stats(&stats);
+	TEST_ASSERT_EQUAL(compactions + 1, stats.compactions);
+	current.pwm_fan.duty = 102;
+	flush();
+	persist_get_stats(&stats);
+	TEST_ASSERT_EQUAL(compactions + 2, stats.compactions);
+	TEST_ASSERT_EQUAL(JOURNAL_HEADER_SIZE, config_journal_size());
+	TEST_ASSERT_EQUAL(failures, stats.failures);
+
+	// A torn append is replayed up to the torn record and compacted.
+	current.pwm_fan.duty = 103;
+	flush();
+	unsigned char journal[64];
+	long n = test_read_file(CONFIG_JOURNAL_FILE, journal, sizeof(journal));
+	TEST_ASSERT_EQUAL(JOURNAL_HEADER_SIZE + JOURNAL_RECORD_SIZE, n);
+	TEST_ASSERT(test_write_file(CONFIG_JOURNAL_FILE, journal, n - 1));
+	config = persist_load_config();
+	TEST_ASSERT(config != NULL);
+	TEST_ASSERT_EQUAL(102, config->pwm_fan.duty);
+	release_config(&config);
+	TEST_ASSERT_EQUAL(JOURNAL_HEADER_SIZE, config_journal_size());
+}
+
+int main(void)
+{
+	test_init_storage();
+	TEST_RUN(test_append_replay);
+	TEST_RUN(test_ignored);
+	TEST_RUN(test_torn_record);
+	TEST_RUN(test_persist_retry);
+	TEST_RUN(test_persist);
+	return test_exit_code();
+}
@@ -0,0 +1,110 @@
+#include <stdlib.h>
+
+#include "query.h"
+#include "test.h"
+
+#define MAX_PAIRS 8
+
+struct pairs {
+	int count;
+	char keys[MAX_PAIRS][64];
+	char values[MAX_PAIRS][64];
+	int stop; // pair index which returns an error, -1 for none
+};
+
+static esp_err_t collect(const char *key, const char *value, void *ctx)
+{
+	struct pairs *pairs = ctx;
+	if (pairs->count == pairs->stop) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	if (pairs->count >= MAX_PAIRS) {
+		return ESP_FAIL;
+	}
+	strlcpy(pairs->keys[pairs->count], key, sizeof(pairs->keys[0]));
+	strlcpy(pairs->values[pairs->count], value, sizeof(pairs->values[0]));
+	pairs->count++;
+	return ESP_OK;
+}
+
+static esp_err_t parse(const char *query, struct pairs *pairs)
+{
+	static char buffer[256];
+	strlcpy(buffer, query, sizeof(buffer));
+	int stop = pairs->stop;
+	memset(pairs, 0, sizeof(*pairs));
+	pairs->stop = stop;
+	return query_parse(buffer, collect, pairs);
+}
+
+static void test_pairs(void)
+{
+	struct pairs p = { .stop = -1 };
+	TEST_ASSERT_EQUAL(ESP_OK, parse(
+		"pwm_fan_duty=100&wifi_ssid=my+fan&flag&=ignored&&x=", &p));
+	TEST_ASSERT_EQUAL(4, p.count);
+	TEST_ASSERT_EQUAL_STRING("pwm_fan_duty", p.keys[0]);
+	TEST_ASSERT_EQUAL_STRING("100", p.values[0]);
+	TEST_ASSERT_EQUAL_STRING("wifi_ssid", p.keys[1]);
+	TEST_ASSERT_EQUAL_STRING("my fan", p.values[1]);
+	// No '=' gives an empty value, empty keys are skipped.
+	TEST_ASSERT_EQUAL_STRING("flag", p.keys[2]);
+	TEST_ASSERT_EQUAL_STRING("", p.values[2]);
+	TEST_ASSERT_EQUAL_STRING("x", p.keys[3]);
+	TEST_ASSERT_EQUAL_STRING("", p.values[3]);
+
+	TEST_ASSERT_EQUAL(ESP_OK, parse("", &p));
+	TEST_ASSERT_EQUAL(0, p.count);
+	TEST_ASSERT_EQUAL(ESP_OK, parse("&&&", &p));
+	TEST_ASSERT_EQUAL(0, p.count);
+}
+
+static void test_decode(void)
+{
+	struct pairs p = { .stop = -1 };
+	// Only the first '=' splits the pair, encoded separators are data.
+	TEST_ASSERT_EQUAL(ESP_OK, parse(
+		"wifi_password=a%3Db%26c%2Bd+e=f&k%65y=%e4%b8%ad&%41=%7e", &p));
+	TEST_ASSERT_EQUAL(3, p.count);
+	TEST_ASSERT_EQUAL_STRING("wifi_password", p.keys[0]);
+	TEST_ASSERT_EQUAL_STRING("a=b&c+d e=f", p.values[0]);
+	TEST_ASSERT_EQUAL_STRING("key", p.keys[1]);
+	TEST_ASSERT_EQUAL_STRING("\xe4\xb8\xad", p.values[1]);
+	TEST_ASSERT_EQUAL_STRING("A", p.keys[2]);
+	TEST_ASSERT_EQUAL_STRING("~", p.values[2]);
+}
+
+static void test_invalid(void)
+{
+	const char *invalid[] = { "a=%", "a=%4", "a=%4g", "a=%g4", "a=%00",
+		"%zz=1", "a=%&b=1", "a=%%41" };
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+		struct pairs p = { .stop = -1 };
+		TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, parse(invalid[i], &p));
+		TEST_ASSERT_EQUAL(0, p.count);
+	}
+	// The pairs before the invalid one are already passed.
+	struct pairs p = { .stop = -1 };
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, parse("a=1&b=%zz&c=3", &p));
+	TEST_ASSERT_EQUAL(1, p.count);
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, query_parse(NULL, collect, &p));
+	char query[] = "a=1";
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, query_parse(query, NULL, &p));
+}
+
+static void test_stop(void)
+{
+	struct pairs p = { .stop = 1 };
+	TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, parse("a=1&b=2&c=3", &p));
+	TEST_ASSERT_EQUAL(1, p.count);
+	TEST_ASSERT_EQUAL_STRING("a", p.keys[0]);
+}
+
+int main(void)
+{
+	TEST_RUN(test_pairs);
+	TEST_RUN(test_decode);
+	TEST_RUN(test_invalid);
+	TEST_RUN(test_stop);
+	return test_exit_code();
+}
@@ -0,0 +1,100 @@
+"""Range requests, and the files too large for the asset cache are
+streamed in chunks."""
+
+import json
+import os
+import unittest
+
+from host_server import HostTestCase
+
+# Larger than ASSET_CACHE_MAX_FILE_SIZE in include/asset.h.
+BIG_FILE = os.urandom(100 * 1024 + 7)
+
+
+class RangeTest(HostTestCase):
+    files = {"/big.bin": BIG_FILE}
+
+    @classmethod
+    def setUpClass(cls):
+        super().setUpClass()
+        cls.styles = cls.server.request("GET", "/css/styles.css").data
+
+    def test_stream(self):
+        response = self.request("GET", "/big.bin")
+        self.assertEqual(response.status, 200)
+        self.assertEqual(response.getheader("Transfer-Encoding"), "chunked")
+        self.assertEqual(response.data, BIG_FILE)
+        # The file is sent from a fixed size buffer.
+        arena = json.loads(self.request("GET", "/api/state").data)["arena"]
+        self.assertEqual(arena["failures"], 0)
+        self.assertLess(arena["high_water"], arena["size"])
+
+    def test_range(self):
+        for path, data in (("/big.bin", BIG_FILE),
+                           ("/css/styles.css", self.styles)):
+            length = len(data)
+            for value, start, end in (
+                    ("bytes=0-0", 0, 0),
+                    ("bytes=100-199", 100, 199),
+                    ("bytes=1000-", 1000, length - 1),
+                    ("bytes=-100", length - 100, length - 1),
+                    ("bytes=-999999", 0, length - 1),
+                    ("bytes=10-999999", 10, length - 1)):
+                with self.subTest(path=path, range=value):
+                    response = self.request("GET", path,
+                                            headers={"Range": value})
+                    self.assertEqual(response.status, 206)
+                    self.assertEqual(response.getheader("Content-Range"),
+                                     f"bytes {start}-{end}/{length}")
+                    self.assertEqual(response.data, data[start:end + 1])
+
+    def test_not_satisfiable(self):
+        length = len(self.styles)
+        for value in (f"bytes={length}-", f"bytes={length + 10}-", "bytes=-0"):
+            with self.subTest(range=value):
+                response = self.request("GET", "/css/styles.css",
+                                        headers={"Range": value})
+                self.assertEqual(response.status, 416)
+                self.assertEqual(response.getheader("Content-Range"),
+                                 f"bytes */{length}")
+                self.assertEqual(response.data, b"")
+
+    def test_ignored(self):
+        # Multiple or malformed ranges get the whole content.
+        for value in ("bytes=0-1,5-6", "bytes=5-1", "items=0-1", "bytes=x-1",
+                      "bytes=1"):
+            with self.subTest(range=value):
+                response = self.request("GET", "/css/styles.css",
+                                        headers={"Range": value})
+                self.assertEqual(response.status, 200)
+                self.assertEqual(response.data, self.styles)
+
+    def test_if_range(self):
+        etag = self.request("GET", "/css/styles.css").getheader("ETag")
+        response = self.request("GET", "/css/styles.css", headers={
+            "Range": "bytes=0-9", "If-Range": etag})
+        self.assertEqual(response.status, 206)
+        self.assertEqual(response.data, self.styles[:10])
+        # The content changed since the client got the first part.
+        response = self.request("GET", "/css/styles.css", headers={
+            "Range": "bytes=0-9", "If-Range": '"00000000"'})
+        self.assertEqual(response.status, 200)
+        self.assertEqual(response.data, self.styles)
+
+    def test_not_found(self):
+        # The error page is sent whole, it is not the requested resource.
+        for headers in ({"Range": "bytes=0-9"},
+                        {"Range": "bytes=0-9", "If-Range": '"00000000"'}):
+            with self.subTest(headers=headers):
+                response = self.request("GET", "/missing.css",
+                                        headers=headers)
+                self.assertEqual(response.status, 404)
+                self.assertIn(b"404", response.data)
+                self.assertGreater(len(response.data), 10)
+                for name in ("Content-Range", "Accept-Ranges", "ETag",
+                             "Cache-Control"):
+                    self.assertIsNone(response.getheader(name), name)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,159 @@
+"""The event stream of '/events': the events cross the end of the ring
+buffer intact, and a subscriber which stops reading is disconnected while
+the others keep receiving."""
+
+import json
+import socket
+import threading
+import time
+import unittest
+
+from host_server import HostTestCase
+
+# SSE_RING_SIZE in include/sse.h.
+SSE_RING_SIZE = 2048
+
+# The periodic timers run 50 times faster: an event poll every 4 ms and a
+# telemetry event every 20 ms.
+TIMER_DIVISOR = 50
+
+# Seconds to wait for the events.
+EVENT_TIMEOUT = 20
+
+EVENT_NAMES = ("duty", "telemetry")
+
+
+def subscribe(port, receive_buffer=None):
+    sock = socket.socket()
+    if receive_buffer is not None:
+        # Before connecting, so the TCP window stays small.
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, receive_buffer)
+    sock.settimeout(EVENT_TIMEOUT)
+    sock.connect(("127.0.0.1", port))
+    sock.sendall(b"GET /events HTTP/1.1\r\nHost: localhost\r\n\r\n")
+    return sock
+
+
+class EventReader:
+    """Read the events of a subscribed socket."""
+
+    def __init__(self, sock):
+        self.sock = sock
+        self.buffer = b""
+        self.header = None
+        self.bytes = 0
+
+    def next(self):
+        """Return the next event as (name, data), None if closed."""
+        while True:
+            if self.header is None and b"\r\n\r\n" in self.buffer:
+                self.header, _, self.buffer = self.buffer.partition(
+                    b"\r\n\r\n")
+                continue
+            if self.header is not None and b"\n\n" in self.buffer:
+                event, _, self.buffer = self.buffer.partition(b"\n\n")
+                self.bytes += len(event) + 2
+                return event.decode()
+            data = self.sock.recv(4096)
+            if not data:
+                return None
+            self.buffer += data
+
+
+def parse_event(event):
+    """Parse an event into (name, data), the 'retry' field is None."""
+    if event.startswith("retry: "):
+        return None
+    lines = event.split("\n")
+    if (len(lines) != 2 or not lines[0].startswith("event: ") or
+            not lines[1].startswith("data: ")):
+        raise AssertionError("malformed event: " + repr(event))
+    return lines[0][len("event: "):], json.loads(lines[1][len("data: "):])
+
+
+class SseTest(HostTestCase):
+    args = ["-t", str(TIMER_DIVISOR)]
+
+    def change_duty(self, stop):
+        """Change the duty until stopped, each event poll sends a duty
+        event."""
+        conn = self.server.connection()
+        try:
+            duty = 100
+            while not stop.is_set():
+                duty = 100 + (duty + 1) % 100
+                conn.request("PATCH", "/api/settings",
+                             body=json.dumps({"pwm_fan_duty": str(duty)}))
+                conn.getresponse().read()
+        finally:
+            conn.close()
+
+    def test_ring_wraparound(self):
+        stop = threading.Event()
+        changer = threading.Thread(target=self.change_duty, args=(stop,))
+        changer.start()
+        sock = subscribe(self.server.port)
+        try:
+            reader = EventReader(sock)
+            names = set()
+            generation = 0
+            # Several laps of the ring, sent in rounds of at most
+            # SSE_CLIENT_BUDGET bytes, an event may span two rounds.
+            while reader.bytes < 4 * SSE_RING_SIZE:
+                event = reader.next()
+                self.assertIsNotNone(event, "stream closed")
+                parsed = parse_event(event)
+                if parsed is None:
+                    continue
+                name, data = parsed
+                self.assertIn(name, EVENT_NAMES)
+                names.add(name)
+                if name == "duty":
+                    self.assertGreaterEqual(data["generation"], generation)
+                    generation = data["generation"]
+                    self.assertIn(data["pwm_fan_duty"], range(100, 200))
+            self.assertTrue(reader.header.startswith(b"HTTP/1.1 200"))
+            self.assertEqual(names, set(EVENT_NAMES))
+        finally:
+            stop.set()
+            changer.join()
+            sock.close()
+
+    def test_slow_client_evicted(self):
+        slow = subscribe(self.server.port, receive_buffer=1024)
+        fast = subscribe(self.server.port)
+        stop = threading.Event()
+        changer = threading.Thread(target=self.change_duty, args=(stop,))
+        changer.start()
+        try:
+            reader = EventReader(fast)
+            deadline = time.monotonic() + EVENT_TIMEOUT
+            # The slow subscriber never reads, once its socket buffers
+            # are full the send rounds stall and it is disconnected.
+            while True:
+                event = reader.next()
+                self.assertIsNotNone(event, "fast subscriber closed")
+                parsed = parse_event(event)
+                if (parsed is not None and parsed[0] == "telemetry" and
+                        parsed[1]["subscribers"] == 1):
+                    break
+                self.assertLess(time.monotonic(), deadline,
+                                "slow subscriber not disconnected")
+            self.assertIn("stalled, disconnect", self.server.output())
+            # The fast subscriber keeps receiving.
+            for _ in range(10):
+                event = reader.next()
+                self.assertIsNotNone(event, "fast subscriber closed")
+                parse_event(event)
+            # The slow one reads what was sent before the close.
+            while slow.recv(65536):
+                pass
+        finally:
+            stop.set()
+            changer.join()
+            slow.close()
+            fast.close()
+
+
+if __name__ == "__main__":
+    unittest.main()
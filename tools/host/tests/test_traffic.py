@@ -0,0 +1,127 @@
+"""The control requests keep their reserved sockets while loadgen floods
+the server with asset downloads."""
+
+import json
+import os
+import subprocess
+import time
+import unittest
+
+from host_server import HostTestCase
+
+# Streamed by the async workers, see test_async.py.
+BIG_FILE = os.urandom(100 * 1024)
+
+# TRAFFIC_MAX_OPEN_SOCKETS in include/traffic.h.
+TRAFFIC_MAX_OPEN_SOCKETS = 7
+
+# Asset connections, more than the sockets left for the asset requests by
+# TRAFFIC_CONTROL_RESERVED_SOCKETS in include/traffic.h.
+FLOOD_CONNECTIONS = 16
+
+FLOOD_ROUTES = ["GET /", "GET /css/styles.css", "GET /favicon.svg",
+                "GET /big.bin"]
+
+CONTROL_ROUTES = ["GET /api/state",
+                  'PATCH /api/settings {"pwm_fan_duty":"60"}']
+
+# Seconds of the runs. The control connection is opened before the flood
+# and kept alive: a connection opened during the flood waits behind the
+# flood reconnects in the listen backlog, which no socket reservation helps.
+FLOOD_DELAY = 0.5
+FLOOD_DURATION = 2
+CONTROL_DURATION = 4
+
+# Bound of the control p99 latency in milliseconds.
+CONTROL_P99_BOUND = 100
+
+
+def loadgen(port, connections, duration, routes):
+    return [os.environ["LOADGEN"], "-p", str(port), "-c", str(connections),
+            "-d", str(duration)] + routes
+
+
+def parse_report(output):
+    """Parse the loadgen report into the p99 latency of the routes, the
+    errors and the reconnects."""
+    routes = {}
+    errors = reconnects = None
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 8 and fields[0] in ("GET", "PATCH"):
+            routes[fields[0] + " " + fields[1]] = float(fields[4])
+        elif line.startswith("total "):
+            errors = int(fields[3])
+            reconnects = int(fields[5])
+    return routes, errors, reconnects
+
+
+class TrafficTest(HostTestCase):
+    files = {"/big.bin": BIG_FILE}
+
+    def test_control_under_flood(self):
+        control = subprocess.Popen(
+            loadgen(self.server.port, 1, CONTROL_DURATION, CONTROL_ROUTES),
+            stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+        try:
+            time.sleep(FLOOD_DELAY)
+            # The flood may report errors for the refused connections.
+            flood = subprocess.run(
+                loadgen(self.server.port, FLOOD_CONNECTIONS, FLOOD_DURATION,
+                        FLOOD_ROUTES),
+                stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True,
+                timeout=FLOOD_DURATION + 30)
+        finally:
+            control_output, _ = control.communicate(
+                timeout=CONTROL_DURATION + 30)
+        print("\n" + flood.stdout + control_output)
+
+        self.assertEqual(control.returncode, 0, control_output)
+        routes, errors, reconnects = parse_report(control_output)
+        self.assertEqual(errors, 0)
+        self.assertEqual(reconnects, 0)
+        self.assertEqual(len(routes), len(CONTROL_ROUTES))
+        for route, p99 in routes.items():
+            with self.subTest(route=route):
+                self.assertLess(p99, CONTROL_P99_BOUND)
+        self.assertIn("total", flood.stdout)
+
+        state = json.loads(self.request("GET", "/api/state").data)
+        traffic = state["traffic"]
+        self.assertEqual(traffic["control"]["evicted"], 0)
+        self.assertEqual(traffic["control"]["refused"], 0)
+        # The flood took every socket left for the assets.
+        self.assertGreater(traffic["asset"]["evicted"] +
+                           traffic["asset"]["refused"], 0)
+        self.assertEqual(state["settings"]["pwm_fan_duty"], "60")
+
+
+class ReservedSocketsTest(HostTestCase):
+    def test_new_control_connection(self):
+        # Idle keep-alive asset connections on every socket but the one
+        # kept free, the server closes the least recently used ones to keep
+        # the reserved sockets.
+        assets = []
+        try:
+            for _ in range(TRAFFIC_MAX_OPEN_SOCKETS - 1):
+                conn = self.server.connection()
+                conn.request("GET", "/favicon.svg")
+                response = conn.getresponse()
+                response.read()
+                self.assertEqual(response.status, 200)
+                assets.append(conn)
+            before = json.loads(self.request("GET", "/api/state").data)
+            self.assertGreater(before["traffic"]["asset"]["evicted"], 0)
+            # A new control connection gets a reserved socket.
+            for _ in range(3):
+                response = self.request("GET", "/api/state")
+                self.assertEqual(response.status, 200)
+            traffic = json.loads(response.data)["traffic"]
+            self.assertEqual(traffic["control"]["refused"], 0)
+        finally:
+            for conn in assets:
+                conn.close()
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,86 @@
+"""The UDP control listens on the loopback address of the host, udpgen
+reports the packet rate and the round trip latency of the duty packets."""
+
+import json
+import os
+import socket
+import struct
+import subprocess
+import time
+import unittest
+
+from host_server import HostTestCase, START_TIMEOUT
+
+# include/udp_proto.h
+UDP_PROTO_MAGIC = 0xD7
+UDP_PROTO_VERSION = 1
+UDP_PROTO_GET_DUTY = 2
+UDP_PROTO_ACK = 3
+
+PEERS = 2
+DURATION = 1
+
+# Bound of the p99 round trip latency in milliseconds.
+P99_BOUND = 50
+
+
+def udpgen(port, peers, duration, args=None):
+    return [os.environ["UDPGEN"], "-p", str(port), "-c", str(peers),
+            "-d", str(duration)] + (args or [])
+
+
+def parse_report(output):
+    """Parse the udpgen report into the packets per second, the p99
+    latency, the lost and the rejected packets."""
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 7 and fields[0] in ("SET_DUTY", "GET_DUTY"):
+            return (float(fields[1]), float(fields[3]), int(fields[5]),
+                    int(fields[6]))
+    raise AssertionError("no report: " + output)
+
+
+class UdpTest(HostTestCase):
+    def setUp(self):
+        # The UDP control starts after the web server, wait for an ack.
+        query = struct.pack("<BBBBI", UDP_PROTO_MAGIC, UDP_PROTO_VERSION,
+                            UDP_PROTO_GET_DUTY, 0, 0)
+        deadline = time.monotonic() + START_TIMEOUT
+        with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+            sock.settimeout(0.1)
+            while True:
+                sock.sendto(query, ("127.0.0.1", self.server.port))
+                try:
+                    ack = sock.recv(64)
+                    break
+                except OSError:
+                    if time.monotonic() > deadline:
+                        raise
+        self.assertEqual(ack[2], UDP_PROTO_ACK)
+
+    def run_udpgen(self, args=None):
+        result = subprocess.run(
+            udpgen(self.server.port, PEERS, DURATION, args),
+            stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True,
+            timeout=DURATION + 30)
+        print("\n" + result.stdout)
+        self.assertEqual(result.returncode, 0, result.stdout)
+        rate, p99, lost, rejected = parse_report(result.stdout)
+        self.assertGreater(rate, 0)
+        self.assertLess(p99, P99_BOUND)
+        self.assertEqual(lost, 0)
+        self.assertEqual(rejected, 0)
+
+    def test_set_duty(self):
+        self.run_udpgen()
+        # udpgen sets the fan duty between 100 and 199.
+        settings = json.loads(self.request("GET", "/api/state").data)[
+            "settings"]
+        self.assertIn(int(settings["pwm_fan_duty"]), range(100, 200))
+
+    def test_get_duty(self):
+        self.run_udpgen(["-g"])
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+
+#include "udp_proto.h"
+#include "test.h"
+
+static void test_round_trip(void)
+{
+	struct udp_proto_packet packet = {
+		.type = UDP_PROTO_SET_DUTY,
+		.seq = 0x12345678,
+		.count = 2,
+		.duties = { { 0, 100 }, { 1, 0x1ff } },
+	};
+	uint8_t buffer[UDP_PROTO_MAX_PACKET_SIZE];
+	size_t length = udp_proto_encode(&packet, buffer, sizeof(buffer));
+	TEST_ASSERT_EQUAL(UDP_PROTO_HEADER_SIZE + 2 * UDP_PROTO_RECORD_SIZE,
+		length);
+	// Little endian wire format.
+	const uint8_t expected[] = { UDP_PROTO_MAGIC, UDP_PROTO_VERSION,
+		UDP_PROTO_SET_DUTY, 0, 0x78, 0x56, 0x34, 0x12,
+		0, 100, 0, 1, 0xff, 0x01 };
+	TEST_ASSERT_EQUAL(sizeof(expected), length);
+	TEST_ASSERT(memcmp(expected, buffer, length) == 0);
+
+	struct udp_proto_packet decoded;
+	TEST_ASSERT_EQUAL(ESP_OK, udp_proto_decode(buffer, length, &decoded));
+	TEST_ASSERT_EQUAL(UDP_PROTO_SET_DUTY, decoded.type);
+	TEST_ASSERT_EQUAL(0, decoded.status);
+	TEST_ASSERT_EQUAL(0x12345678, decoded.seq);
+	TEST_ASSERT_EQUAL(2, decoded.count);
+	TEST_ASSERT_EQUAL(1, decoded.duties[1].pwm);
+	TEST_ASSERT_EQUAL(0x1ff, decoded.duties[1].duty);
+
+	// The ack with the max records.
+	packet.type = UDP_PROTO_ACK;
+	packet.status = UDP_PROTO_STATUS_INVALID;
+	packet.count = UDP_PROTO_MAX_RECORDS;
+	for (int i = 0; i < UDP_PROTO_MAX_RECORDS; i++) {
+		packet.duties[i].pwm = i;
+		packet.duties[i].duty = 1000 + i;
+	}
+	length = udp_proto_encode(&packet, buffer, sizeof(buffer));
+	TEST_ASSERT_EQUAL(UDP_PROTO_MAX_PACKET_SIZE, length);
+	TEST_ASSERT_EQUAL(ESP_OK, udp_proto_decode(buffer, length, &decoded));
+	TEST_ASSERT_EQUAL(UDP_PROTO_STATUS_INVALID, decoded.status);
+	TEST_ASSERT_EQUAL(UDP_PROTO_MAX_RECORDS, decoded.count);
+	TEST_ASSERT_EQUAL(1007, decoded.duties[7].duty);
+}
+
+static void test_encode_invalid(void)
+{
+	struct udp_proto_packet packet = {
+		.type = UDP_PROTO_SET_DUTY,
+		.count = 1,
+	};
+	uint8_t buffer[UDP_PROTO_MAX_PACKET_SIZE];
+	TEST_ASSERT_EQUAL(0, udp_proto_encode(&packet, buffer,
+		UDP_PROTO_HEADER_SIZE + UDP_PROTO_RECORD_SIZE - 1));
+	TEST_ASSERT_EQUAL(0, udp_proto_encode(NULL, buffer, sizeof(buffer)));
+	packet.count = UDP_PROTO_MAX_RECORDS + 1;
+	TEST_ASSERT_EQUAL(0, udp_proto_encode(&packet, buffer,
+		sizeof(buffer)));
+}
+
+static void test_decode_invalid(void)
+{
+	uint8_t buffer[UDP_PROTO_MAX_PACKET_SIZE + UDP_PROTO_RECORD_SIZE] = {
+		UDP_PROTO_MAGIC, UDP_PROTO_VERSION, UDP_PROTO_SET_DUTY,
+	};
+	struct udp_proto_packet packet;
+	size_t one = UDP_PROTO_HEADER_SIZE + UDP_PROTO_RECORD_SIZE;
+	TEST_ASSERT_EQUAL(ESP_OK, udp_proto_decode(buffer, one, &packet));
+
+	// Lengths of partial records, too short or too long.
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE,
+		udp_proto_decode(buffer, one - 1, &packet));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE,
+		udp_proto_decode(buffer, UDP_PROTO_HEADER_SIZE - 1, &packet));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, udp_proto_decode(buffer,
+		UDP_PROTO_MAX_PACKET_SIZE + UDP_PROTO_RECORD_SIZE, &packet));
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE,
+		udp_proto_decode(NULL, one, &packet));
+	// SET without records, GET with records.
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE,
+		udp_proto_decode(buffer, UDP_PROTO_HEADER_SIZE, &packet));
+	buffer[2] = UDP_PROTO_GET_DUTY;
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE,
+		udp_proto_decode(buffer, one, &packet));
+	TEST_ASSERT_EQUAL(ESP_OK,
+		udp_proto_decode(buffer, UDP_PROTO_HEADER_SIZE, &packet));
+	TEST_ASSERT_EQUAL(0, packet.count);
+
+	buffer[2] = 0;
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+		udp_proto_decode(buffer, UDP_PROTO_HEADER_SIZE, &packet));
+	buffer[2] = UDP_PROTO_ACK + 1;
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+		udp_proto_decode(buffer, UDP_PROTO_HEADER_SIZE, &packet));
+
+	buffer[2] = UDP_PROTO_GET_DUTY;
+	buffer[1] = UDP_PROTO_VERSION + 1;
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_VERSION,
+		udp_proto_decode(buffer, UDP_PROTO_HEADER_SIZE, &packet));
+	buffer[1] = UDP_PROTO_VERSION;
+	buffer[0] = 'G';
+	TEST_ASSERT_EQUAL(ESP_ERR_INVALID_VERSION,
+		udp_proto_decode(buffer, UDP_PROTO_HEADER_SIZE, &packet));
+}
+
+static void test_seq_newer(void)
+{
+	TEST_ASSERT(udp_proto_seq_newer(2, 1));
+	TEST_ASSERT(!udp_proto_seq_newer(1, 1));
+	TEST_ASSERT(!udp_proto_seq_newer(1, 2));
+	// Wrap around.
+	TEST_ASSERT(udp_proto_seq_newer(0, UINT32_MAX));
+	TEST_ASSERT(udp_proto_seq_newer(5, UINT32_MAX - 5));
+	TEST_ASSERT(!udp_proto_seq_newer(UINT32_MAX, 0));
+	TEST_ASSERT(udp_proto_seq_newer(0x7fffffff, 0));
+	TEST_ASSERT(!udp_proto_seq_newer(0x80000000, 0));
+}
+
+int main(void)
+{
+	TEST_RUN(test_round_trip);
+	TEST_RUN(test_encode_invalid);
+	TEST_RUN(test_decode_invalid);
+	TEST_RUN(test_seq_newer);
+	return test_exit_code();
+}
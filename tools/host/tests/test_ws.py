@@ -0,0 +1,162 @@
+"""The /ws live control channel: the handshake, the binary duty frames
+and the control frames."""
+
+import base64
+import hashlib
+import json
+import os
+import socket
+import struct
+import time
+import unittest
+
+from host_server import HostTestCase
+
+WS_GUID = b"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+OP_TEXT, OP_BINARY, OP_CLOSE, OP_PING, OP_PONG = 0x1, 0x2, 0x8, 0x9, 0xA
+PWM_FAN, PWM_MOS = 0, 1
+# WS_PERSIST_IDLE_MS in include/ws.h.
+PERSIST_IDLE = 3.0
+
+
+class WebSocket:
+    def __init__(self, port):
+        self.sock = socket.create_connection(("127.0.0.1", port), 5)
+        key = base64.b64encode(os.urandom(16))
+        self.sock.sendall(
+            b"GET /ws HTTP/1.1\r\nHost: localhost\r\n"
+            b"Upgrade: websocket\r\nConnection: Upgrade\r\n"
+            b"Sec-WebSocket-Key: " + key + b"\r\n"
+            b"Sec-WebSocket-Version: 13\r\n\r\n")
+        response = b""
+        while b"\r\n\r\n" not in response:
+            data = self.sock.recv(1024)
+            if not data:
+                raise ConnectionError("handshake closed")
+            response += data
+        head, self.buffer = response.split(b"\r\n\r\n", 1)
+        lines = head.decode().split("\r\n")
+        self.status = lines[0]
+        self.headers = {}
+        for line in lines[1:]:
+            name, value = line.split(":", 1)
+            self.headers[name.strip().lower()] = value.strip()
+        self.accept = base64.b64encode(
+            hashlib.sha1(key + WS_GUID).digest()).decode()
+
+    def send(self, opcode, payload=b""):
+        # Client frames are masked.
+        mask = os.urandom(4)
+        header = bytes([0x80 | opcode])
+        if len(payload) < 126:
+            header += bytes([0x80 | len(payload)])
+        else:
+            header += bytes([0x80 | 126]) + struct.pack(">H", len(payload))
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        self.sock.sendall(header + mask + masked)
+
+    def read(self, n):
+        while len(self.buffer) < n:
+            data = self.sock.recv(4096)
+            if not data:
+                raise ConnectionError("closed")
+            self.buffer += data
+        data, self.buffer = self.buffer[:n], self.buffer[n:]
+        return data
+
+    def recv(self):
+        b0, b1 = self.read(2)
+        length = b1 & 0x7F
+        if length == 126:
+            length = struct.unpack(">H", self.read(2))[0]
+        elif length == 127:
+            length = struct.unpack(">Q", self.read(8))[0]
+        # Server frames are not masked.
+        return b0 & 0x0F, self.read(length)
+
+    def close(self):
+        self.sock.close()
+
+
+def duties(payload):
+    return {payload[i]: payload[i + 1] | payload[i + 2] << 8
+            for i in range(0, len(payload), 3)}
+
+
+class WebSocketTest(HostTestCase):
+    def setUp(self):
+        self.ws = WebSocket(self.server.port)
+
+    def tearDown(self):
+        self.ws.close()
+
+    def state(self):
+        return json.loads(self.request("GET", "/api/state").data)["settings"]
+
+    def test_handshake(self):
+        self.assertIn(" 101 ", self.ws.status)
+        self.assertEqual(self.ws.headers["upgrade"].lower(), "websocket")
+        self.assertEqual(self.ws.headers["sec-websocket-accept"],
+                         self.ws.accept)
+
+    def test_duty(self):
+        self.ws.send(OP_BINARY, bytes([PWM_FAN, 77, 0]))
+        opcode, payload = self.ws.recv()
+        self.assertEqual(opcode, OP_BINARY)
+        self.assertEqual(duties(payload)[PWM_FAN], 77)
+        self.assertEqual(self.state()["pwm_fan_duty"], "77")
+
+        # Both outputs in one frame, the invalid record is skipped.
+        self.ws.send(OP_BINARY, bytes([PWM_FAN, 78, 0, PWM_MOS, 30, 0,
+                                       9, 1, 0]))
+        opcode, payload = self.ws.recv()
+        self.assertEqual(duties(payload), {PWM_FAN: 78, PWM_MOS: 30})
+        # Out of range duty is rejected, the reply has the current duty.
+        self.ws.send(OP_BINARY, bytes([PWM_FAN, 0, 1]))
+        opcode, payload = self.ws.recv()
+        self.assertEqual(duties(payload)[PWM_FAN], 78)
+        state = self.state()
+        self.assertEqual(state["pwm_fan_duty"], "78")
+        self.assertEqual(state["pwm_mos_duty"], "30")
+
+    def test_persist(self):
+        self.ws.send(OP_BINARY, bytes([PWM_FAN, 91, 0]))
+        self.ws.recv()
+        # The config is saved after the sliders are idle.
+        journal = os.path.join(self.server.spiffs, "config",
+                               "config.journal")
+        deadline = time.monotonic() + PERSIST_IDLE + 5
+        record = struct.pack("<BI", 3, 91)  # CONFIG_ID_PWM_FAN_DUTY
+        while time.monotonic() < deadline:
+            with open(journal, "rb") as f:
+                if record in f.read():
+                    return
+            time.sleep(0.2)
+        self.fail("duty not saved to the journal")
+
+    def test_control_frames(self):
+        self.ws.send(OP_PING, b"hello")
+        self.assertEqual(self.ws.recv(), (OP_PONG, b"hello"))
+        # Text frames are ignored.
+        self.ws.send(OP_TEXT, b"text")
+        self.ws.send(OP_PING, b"")
+        self.assertEqual(self.ws.recv(), (OP_PONG, b""))
+        # A frame of a partial record is ignored.
+        self.ws.send(OP_BINARY, bytes([PWM_FAN, 1]))
+        self.ws.send(OP_PING, b"x")
+        self.assertEqual(self.ws.recv(), (OP_PONG, b"x"))
+
+        close = struct.pack(">H", 1000)
+        self.ws.send(OP_CLOSE, close)
+        opcode, payload = self.ws.recv()
+        self.assertEqual(opcode, OP_CLOSE)
+        self.assertEqual(self.ws.sock.recv(1), b"")
+
+    def test_too_large(self):
+        # Frames larger than a few records close the session.
+        self.ws.send(OP_BINARY, bytes(300))
+        self.assertEqual(self.ws.sock.recv(1024), b"")
+
+
+if __name__ == "__main__":
+    unittest.main()
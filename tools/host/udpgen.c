@@ -0,0 +1,275 @@
+/*
+ * udpgen is a closed loop load generator of the UDP control protocol for
+ * the host build, see include/udp_proto.h.
+ *
+ * Each peer is a thread with its own socket, so the server tracks a
+ * session per peer. A peer sends a packet with the next sequence number
+ * and waits for its ack before sending the next one, a packet without an
+ * ack in time is counted as lost. The throughput and the round trip
+ * latency percentiles are reported, for the duty packets the round trip
+ * includes applying the duty.
+ *
+ * Usage: udpgen [-c peers] [-d seconds] [-H host] [-p port] [-g]
+ */
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "controller.h"
+#include "udp_proto.h"
+
+// Milliseconds to wait for the ack of a packet.
+#define UDPGEN_ACK_TIMEOUT_MS 200
+
+struct peer {
+	pthread_t thread;
+	int fd;
+	uint32_t seq;
+	uint64_t *latencies; // ns
+	size_t count;
+	size_t capacity;
+	uint64_t lost;     // packets without an ack in time
+	uint64_t rejected; // acks with a status other than OK
+};
+
+static struct {
+	struct addrinfo *addr;
+	uint8_t type;
+	atomic_bool stop;
+} udpgen;
+
+static uint64_t now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void peer_add_latency(struct peer *p, uint64_t latency)
+{
+	if (p->count == p->capacity) {
+		p->capacity = p->capacity > 0 ? p->capacity * 2 : 4096;
+		p->latencies = realloc(p->latencies,
+			p->capacity * sizeof(uint64_t));
+		if (p->latencies == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	p->latencies[p->count++] = latency;
+}
+
+/**
+ * @brief peer_wait_ack receives until the ack of the sequence number, the
+ * late acks of the lost packets are skipped.
+ *
+ * @return the status of the ack, -1 if no ack in time.
+ */
+static int peer_wait_ack(struct peer *p, uint32_t seq)
+{
+	uint8_t buffer[UDP_PROTO_MAX_PACKET_SIZE];
+	struct udp_proto_packet ack;
+	while (true) {
+		ssize_t n = recv(p->fd, buffer, sizeof(buffer), 0);
+		if (n < 0) {
+			return -1;
+		}
+		if (udp_proto_decode(buffer, n, &ack) == ESP_OK &&
+			ack.type == UDP_PROTO_ACK && ack.seq == seq) {
+			return ack.status;
+		}
+	}
+}
+
+static void *peer_task(void *arg)
+{
+	struct peer *p = arg;
+	uint8_t buffer[UDP_PROTO_MAX_PACKET_SIZE];
+	while (!atomic_load(&udpgen.stop)) {
+		// 0 restarts the session, the sequence numbers start at 1.
+		p->seq++;
+		struct udp_proto_packet packet = {
+			.type = udpgen.type,
+			.seq = p->seq,
+		};
+		if (udpgen.type == UDP_PROTO_SET_DUTY) {
+			packet.count = 1;
+			packet.duties[0].pwm = CONTROLLER_PWM_FAN;
+			packet.duties[0].duty = 100 + p->seq % 100;
+		}
+		size_t length = udp_proto_encode(&packet, buffer,
+			sizeof(buffer));
+		uint64_t start = now_ns();
+		if (send(p->fd, buffer, length, 0) != (ssize_t) length) {
+			p->lost++;
+			// Do not spin on a server that is down.
+			usleep(10000);
+			continue;
+		}
+		int status = peer_wait_ack(p, p->seq);
+		uint64_t latency = now_ns() - start;
+		if (status < 0) {
+			p->lost++;
+			continue;
+		}
+		if (status != UDP_PROTO_STATUS_OK) {
+			p->rejected++;
+		}
+		peer_add_latency(p, latency);
+	}
+	close(p->fd);
+	return NULL;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+	return x < y ? -1 : x > y;
+}
+
+static double percentile_ms(const uint64_t *sorted, size_t count, double p)
+{
+	if (count == 0) {
+		return 0;
+	}
+	size_t i = (size_t) (p * (count - 1) + 0.5);
+	return sorted[i] / 1e6;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-c peers] [-d seconds] [-H host] [-p port] [-g]\n"
+		"  -c peers    peers with their own socket (default 1)\n"
+		"  -d seconds  duration (default 10)\n"
+		"  -H host     server host (default 127.0.0.1)\n"
+		"  -p port     server port (default 4210)\n"
+		"  -g          query the duties instead of setting the fan duty\n",
+		name);
+}
+
+int main(int argc, char **argv)
+{
+	int peers = 1;
+	int duration = 10;
+	const char *host = "127.0.0.1";
+	const char *port = "4210";
+	int opt;
+	udpgen.type = UDP_PROTO_SET_DUTY;
+	while ((opt = getopt(argc, argv, "c:d:H:p:gh")) != -1) {
+		switch (opt) {
+		case 'c':
+			peers = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'H':
+			host = optarg;
+			break;
+		case 'p':
+			port = optarg;
+			break;
+		case 'g':
+			udpgen.type = UDP_PROTO_GET_DUTY;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (peers <= 0 || duration <= 0 || optind != argc) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_DGRAM,
+	};
+	int ret = getaddrinfo(host, port, &hints, &udpgen.addr);
+	if (ret != 0) {
+		fprintf(stderr, "resolve %s:%s failed: %s\n", host, port,
+			gai_strerror(ret));
+		return EXIT_FAILURE;
+	}
+
+	struct peer *ps = calloc(peers, sizeof(struct peer));
+	if (ps == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	const char *type = udpgen.type == UDP_PROTO_SET_DUTY ?
+		"SET_DUTY" : "GET_DUTY";
+	printf("%d peers, %d s, %s, %s:%s\n", peers, duration, type, host,
+		port);
+	struct timeval timeout = { .tv_usec = UDPGEN_ACK_TIMEOUT_MS * 1000 };
+	for (int i = 0; i < peers; i++) {
+		struct peer *p = &ps[i];
+		// The connected socket only receives from the server.
+		p->fd = socket(udpgen.addr->ai_family, SOCK_DGRAM, 0);
+		if (p->fd < 0 ||
+			setsockopt(p->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+				sizeof(timeout)) != 0 ||
+			connect(p->fd, udpgen.addr->ai_addr,
+				udpgen.addr->ai_addrlen) != 0) {
+			fprintf(stderr, "open peer %d failed: errno %d\n", i,
+				errno);
+			return EXIT_FAILURE;
+		}
+	}
+	uint64_t start = now_ns();
+	for (int i = 0; i < peers; i++) {
+		if (pthread_create(&ps[i].thread, NULL, peer_task,
+			&ps[i]) != 0) {
+			fprintf(stderr, "start peer %d failed\n", i);
+			return EXIT_FAILURE;
+		}
+	}
+	sleep(duration);
+	atomic_store(&udpgen.stop, true);
+	struct peer merged = { 0 };
+	for (int i = 0; i < peers; i++) {
+		pthread_join(ps[i].thread, NULL);
+		for (size_t j = 0; j < ps[i].count; j++) {
+			peer_add_latency(&merged, ps[i].latencies[j]);
+		}
+		merged.lost += ps[i].lost;
+		merged.rejected += ps[i].rejected;
+		free(ps[i].latencies);
+	}
+	double elapsed = (now_ns() - start) / 1e9;
+	if (merged.count > 0) {
+		qsort(merged.latencies, merged.count, sizeof(uint64_t),
+			compare_latency);
+	}
+
+	printf("%-10s %10s %9s %9s %9s %7s %9s\n", "packet", "pkt/s",
+		"p50 ms", "p99 ms", "max ms", "lost", "rejected");
+	printf("%-10s %10.1f %9.3f %9.3f %9.3f %7llu %9llu\n", type,
+		merged.count / elapsed,
+		percentile_ms(merged.latencies, merged.count, 0.50),
+		percentile_ms(merged.latencies, merged.count, 0.99),
+		merged.count > 0 ? merged.latencies[merged.count - 1] / 1e6 : 0,
+		(unsigned long long) merged.lost,
+		(unsigned long long) merged.rejected);
+	printf("total %.1f pkt/s, %llu lost, %llu rejected\n",
+		merged.count / elapsed, (unsigned long long) merged.lost,
+		(unsigned long long) merged.rejected);
+	free(merged.latencies);
+	free(ps);
+	freeaddrinfo(udpgen.addr);
+	return merged.count == 0 || merged.lost + merged.rejected > 0 ?
+		EXIT_FAILURE : EXIT_SUCCESS;
+}